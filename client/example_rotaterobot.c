@@ -0,0 +1,55 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+
+    Example client for libmecacomclient: rotate the robot for 2 seconds, sending a setpoint at 100Hz
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include "mecacomclient.h"
+
+
+void print_ack(void *userdata, int reqid, const char *command, const char *reply, double rtt) {
+    if (reply[0] == '!') {
+        printf("#%d %s: %s (%.2f ms)\n", reqid, command, reply, rtt * 1000.0);
+    }
+}
+
+
+int main() {
+
+    struct mecacom_client client;
+    struct mecacom_stats stats;
+    int n;
+
+    if (mecacom_connect(&client, MECACOM_PROTO_TCP, "127.0.0.1", MECACOM_DEFAULT_PORT, "PASSWORD") == -1) {
+        printf("Cannot connect to MecanumCommander!\n");
+        return 1;
+    }
+    mecacom_set_ack_callback(&client, print_ack, NULL);
+
+    for (n = 0; n < 200; n++) {
+        mecacom_set_setpoint(&client, 0, 0, 600);
+        usleep(10000);  // 10ms
+        if (mecacom_poll(&client) == -1) {
+            printf("Connection lost!\n");
+            return 1;
+        }
+    }
+
+    mecacom_stop(&client);
+    usleep(100000);
+    mecacom_poll(&client);
+
+    mecacom_get_stats(&client, &stats);
+    printf("sent: %lu acked: %lu errors: %lu lost: %lu busy: %lu rtt avg/max: %.2f/%.2f ms\n",
+        stats.sent, stats.acked, stats.errors, stats.lost, stats.busy, stats.rtt_avg * 1000.0, stats.rtt_max * 1000.0);
+
+    mecacom_close(&client);
+
+    return 0;
+}
@@ -12,7 +12,7 @@ import time
 from mecanumcommander_client import MecanumCommanderClient
 
 mecacomm_ip = "127.0.0.1";
-mecacomm_protocol = 1;  # 0 - TCP, 1 - UDP
+mecacomm_protocol = 1;  # 0 - TCP, 1 - UDP, 2 - UDP (binary setpoints)
 mecacomm_port = 3475;
 mecacomm_passwd = "PASSWORD";
 
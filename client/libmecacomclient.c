@@ -0,0 +1,464 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+
+    libmecacomclient - C client library for MecanumCommander
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "mecacomclient.h"
+#include "../crc16/crc16.h"
+
+
+static double mecacom_time_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+// handshake only: wait for one line from the commander (it waits for us, so nothing else arrives meanwhile)
+static int mecacom_read_line_blocking(struct mecacom_client *client, char *line, int maxlen, int timeout_ms) {
+    struct timeval tv;
+    fd_set readset;
+    int len = 0, ret;
+
+    while (len < (maxlen - 1)) {
+        FD_ZERO(&readset);
+        FD_SET(client->fd, &readset);
+        tv.tv_sec  = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        if (select(client->fd + 1, &readset, NULL, NULL, &tv) <= 0) {
+            return -1;
+        }
+        ret = read(client->fd, &line[len], 1);
+        if (ret <= 0) {
+            return -1;
+        }
+        if (line[len] == '\n') {
+            if ((len > 0) && (line[len - 1] == '\r')) {
+                len--;
+            }
+            line[len] = 0;
+            return len;
+        }
+        len++;
+    }
+
+    return -1;
+}
+
+
+static int mecacom_handshake(struct mecacom_client *client, const char *password) {
+    char line[256];
+    char request[64];
+    int len;
+
+    if ((mecacom_read_line_blocking(client, line, sizeof(line), MECACOM_CONNECT_TIMEOUT_MS) == -1) ||
+        (strcmp(line, "I'm NLAB-MecanumCommander. Please authenticate yourself.") != 0)) {
+        return -1;
+    }
+
+    len = snprintf(request, sizeof(request), "%s\r\n", password);
+    if (write(client->fd, request, len) != len) {
+        return -1;
+    }
+    len = mecacom_read_line_blocking(client, line, sizeof(line), MECACOM_CONNECT_TIMEOUT_MS);
+    if ((len < 6) || (strncmp(line, "NLAB-MecanumCommander", 21) != 0) || (strcmp(&line[len - 6], "Ready.") != 0)) {
+        return -1;  // !BADPWD!
+    }
+
+    // framed mode: the replies carry the request ids
+    if ((write(client->fd, "FRM00001\r\n", 10) != 10) ||
+        (mecacom_read_line_blocking(client, line, sizeof(line), MECACOM_CONNECT_TIMEOUT_MS) == -1) ||
+        (strcmp(line, "OKFRM") != 0)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int mecacom_connect(struct mecacom_client *client, int proto, const char *ip, int port, const char *password) {
+    int i;
+
+    memset(client, 0, sizeof(struct mecacom_client));
+    client->proto = proto;
+    client->keepalive_ms = MECACOM_KEEPALIVE_MS;
+    client->nextreqid = 1;
+    for (i = 0; i < MECACOM_PENDING_MAX; i++) {
+        client->pending[i].reqid = -1;
+    }
+
+    client->dest.sin_family = AF_INET;
+    client->dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &client->dest.sin_addr) != 1) {
+        return -1;
+    }
+
+    if (proto == MECACOM_PROTO_TCP) {
+        client->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (client->fd == -1) {
+            return -1;
+        }
+        if ((connect(client->fd, (struct sockaddr *)&client->dest, sizeof(client->dest)) == -1) ||
+            (mecacom_handshake(client, password) == -1)) {
+            close(client->fd);
+            return -1;
+        }
+        cmdring_init(&client->in);
+        remote_outbuf_init(&client->out, client->fd);
+    } else if ((proto == MECACOM_PROTO_UDP) || (proto == MECACOM_PROTO_UDPBIN)) {
+        client->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (client->fd == -1) {
+            return -1;
+        }
+        // connected UDP socket: plain send(), and the telemetry comes back here
+        if (connect(client->fd, (struct sockaddr *)&client->dest, sizeof(client->dest)) == -1) {
+            close(client->fd);
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+
+    return 0;
+}
+
+
+void mecacom_close(struct mecacom_client *client) {
+    if (client->proto == MECACOM_PROTO_TCP) {
+        remote_outbuf_flush(&client->out);
+    }
+    close(client->fd);
+    client->fd = -1;
+}
+
+
+int mecacom_fd(struct mecacom_client *client) {
+    return client->fd;
+}
+
+
+void mecacom_set_ack_callback(struct mecacom_client *client, mecacom_ack_callback callback, void *userdata) {
+    client->on_ack = callback;
+    client->on_ack_userdata = userdata;
+}
+
+
+void mecacom_set_keepalive(struct mecacom_client *client, unsigned int keepalive_ms) {
+    client->keepalive_ms = keepalive_ms;
+}
+
+
+int mecacom_want_write(struct mecacom_client *client) {
+    return (client->proto == MECACOM_PROTO_TCP) && (remote_outbuf_pending(&client->out) > 0);
+}
+
+
+// TCP: "#<id> <command>\r\n" into the output buffer, remembered until its reply arrives
+static int mecacom_queue_framed(struct mecacom_client *client, const char *command, double time_now) {
+    struct mecacom_pending *pending = NULL;
+    char frame[REMOTEFRAME_MAXLEN + 3];
+    int i, len;
+
+    if (client->pendingcount == MECACOM_PENDING_MAX) {
+        return -1;
+    }
+    for (i = 0; i < MECACOM_PENDING_MAX; i++) {
+        if (client->pending[i].reqid == -1) {
+            pending = &client->pending[i];
+            break;
+        }
+    }
+
+    len = sprintf(frame, "#%d %.8s\r\n", client->nextreqid, command);
+    if (remote_outbuf_append(&client->out, frame, len) == -1) {
+        return -1;
+    }
+
+    pending->reqid = client->nextreqid;
+    pending->time_sent = time_now;
+    snprintf(pending->command, sizeof(pending->command), "%.8s", command);
+    client->pendingcount++;
+    client->stats.sent++;
+
+    client->nextreqid++;
+    if (client->nextreqid > 99999999) {
+        client->nextreqid = 1;
+    }
+
+    return pending->reqid;
+}
+
+
+// UDP: packet number + command + CRC16
+static void mecacom_format_udp_command(struct mecacom_client *client, const char *command, unsigned char *packet) {
+    unsigned int crc;
+
+    client->udppacketno = (client->udppacketno + 1) & 0xFFFF;
+    packet[0] = client->udppacketno >> 8;
+    packet[1] = client->udppacketno & 0xFF;
+    memcpy(&packet[2], command, REMOTECMD_LEN);
+    crc = crc16_ccitt(packet, 2 + REMOTECMD_LEN);
+    packet[10] = crc >> 8;
+    packet[11] = crc & 0xFF;
+}
+
+
+static int mecacom_send_commands(struct mecacom_client *client, char commands[][REMOTECMD_LEN + 1], int count, double time_now) {
+    unsigned char packets[REMOTECMD_AXES][12];
+    struct mmsghdr msgs[REMOTECMD_AXES];
+    struct iovec iov[REMOTECMD_AXES];
+    unsigned int framelen = 0;
+    int i, reqid;
+
+    if (client->proto == MECACOM_PROTO_TCP) {
+        // the whole batch or nothing: a setpoint must not go out with only some of its axes
+        reqid = client->nextreqid;
+        for (i = 0; i < count; i++) {
+            framelen += snprintf(NULL, 0, "#%d ", reqid) + REMOTECMD_LEN + 2;
+            reqid = (reqid >= 99999999) ? 1 : (reqid + 1);
+        }
+        if (((MECACOM_PENDING_MAX - client->pendingcount) < count) ||
+            (framelen > (REMOTE_OUTBUF_SIZE - remote_outbuf_pending(&client->out)))) {
+            client->stats.busy++;
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if (mecacom_queue_framed(client, commands[i], time_now) == -1) {
+                client->stats.busy++;
+                return -1;
+            }
+        }
+        if (remote_outbuf_flush(&client->out) == -1) {
+            return -1;
+        }
+    } else {
+        // all of them with one syscall
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < count; i++) {
+            mecacom_format_udp_command(client, commands[i], packets[i]);
+            iov[i].iov_base = packets[i];
+            iov[i].iov_len  = 12;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        if (sendmmsg(client->fd, msgs, count, MSG_DONTWAIT) != count) {
+            client->stats.busy++;
+            return -1;
+        }
+        client->stats.sent += count;
+    }
+
+    client->time_last_sent = time_now;
+
+    return 0;
+}
+
+
+static int mecacom_send_setpoint_now(struct mecacom_client *client, double time_now) {
+    char commands[REMOTECMD_AXES][REMOTECMD_LEN + 1];
+    struct remote_setpoint sp;
+    unsigned char packet[REMOTEBIN_SETPOINT_LEN];
+    int i;
+
+    if (client->proto == MECACOM_PROTO_UDPBIN) {
+        memset(&sp, 0, sizeof(sp));
+        client->udppacketno = (client->udppacketno + 1) & 0xFFFF;
+        sp.packetno = client->udppacketno;
+        sp.flags = (client->stopped == 1) ? REMOTEBIN_FLAG_STOP : 0;
+        for (i = 0; i < REMOTECMD_AXES; i++) {
+            sp.speed[i] = client->setpoint[i];
+        }
+        remotebin_encode_setpoint(&sp, packet);
+        if (send(client->fd, packet, REMOTEBIN_SETPOINT_LEN, MSG_DONTWAIT) != REMOTEBIN_SETPOINT_LEN) {
+            client->stats.busy++;
+            return -1;
+        }
+        client->stats.sent++;
+        client->time_last_sent = time_now;
+        return 0;
+    }
+
+    if (client->stopped == 1) {
+        strcpy(commands[0], "STOPZERO");
+        return mecacom_send_commands(client, commands, 1, time_now);
+    }
+
+    sprintf(commands[REMOTECMD_AXIS_X],   "SPX%05d", client->setpoint[REMOTECMD_AXIS_X]);
+    sprintf(commands[REMOTECMD_AXIS_Y],   "SPY%05d", client->setpoint[REMOTECMD_AXIS_Y]);
+    sprintf(commands[REMOTECMD_AXIS_ROT], "ROT%05d", client->setpoint[REMOTECMD_AXIS_ROT]);
+
+    return mecacom_send_commands(client, commands, REMOTECMD_AXES, time_now);
+}
+
+
+int mecacom_set_setpoint(struct mecacom_client *client, int speedX, int speedY, int rotation) {
+    // the 8 char command holds 4 digits and the sign, the binary packet the full range of the commander
+    int limit = (client->proto == MECACOM_PROTO_UDPBIN) ? REMOTECMD_SETPOINT_LIMIT : 9999;
+
+    if ((abs(speedX) > limit) || (abs(speedY) > limit) || (abs(rotation) > limit)) {
+        return -1;
+    }
+
+    client->setpoint[REMOTECMD_AXIS_X]   = speedX;
+    client->setpoint[REMOTECMD_AXIS_Y]   = speedY;
+    client->setpoint[REMOTECMD_AXIS_ROT] = rotation;
+    client->stopped = 0;
+    client->have_setpoint = 1;
+
+    return mecacom_send_setpoint_now(client, mecacom_time_now());
+}
+
+
+int mecacom_stop(struct mecacom_client *client) {
+    int i;
+
+    for (i = 0; i < REMOTECMD_AXES; i++) {
+        client->setpoint[i] = 0;
+    }
+    client->stopped = 1;
+    client->have_setpoint = 0;  // no keepalive needed, the commander stops the robot anyway
+
+    return mecacom_send_setpoint_now(client, mecacom_time_now());
+}
+
+
+int mecacom_send_command(struct mecacom_client *client, const char *command) {
+    char commands[1][REMOTECMD_LEN + 1];
+    double time_now = mecacom_time_now();
+
+    if (strlen(command) != REMOTECMD_LEN) {
+        return -1;
+    }
+    strcpy(commands[0], command);
+
+    if (client->proto == MECACOM_PROTO_TCP) {
+        int reqid = client->nextreqid;
+        if (mecacom_send_commands(client, commands, 1, time_now) == -1) {
+            return -1;
+        }
+        return reqid;
+    }
+
+    return mecacom_send_commands(client, commands, 1, time_now);
+}
+
+
+static void mecacom_process_reply(struct mecacom_client *client, unsigned char *line, int len, double time_now) {
+    struct mecacom_pending *pending;
+    unsigned char *reply;
+    int i, reqid, replylen;
+    double rtt;
+
+    replylen = remoteframe_parse(line, len, &reqid, &reply);
+    if (replylen == -1) {
+        // not a reply to a request: watchdog, telemetry, ...
+        if (strcmp((char *)line, "!NOCMST!") == 0) {
+            client->stats.watchdog++;
+        }
+        return;
+    }
+
+    for (i = 0; i < MECACOM_PENDING_MAX; i++) {
+        pending = &client->pending[i];
+        if (pending->reqid != reqid) {
+            continue;
+        }
+
+        rtt = time_now - pending->time_sent;
+        client->stats.rtt_last = rtt;
+        client->stats.rtt_avg = (client->stats.acked + client->stats.errors == 0) ? rtt : (client->stats.rtt_avg * 0.9 + rtt * 0.1);
+        if (rtt > client->stats.rtt_max) {
+            client->stats.rtt_max = rtt;
+        }
+        if (reply[0] == '!') {
+            client->stats.errors++;
+        } else {
+            client->stats.acked++;
+        }
+        if (client->on_ack != NULL) {
+            client->on_ack(client->on_ack_userdata, reqid, pending->command, (char *)reply, rtt);
+        }
+
+        pending->reqid = -1;
+        client->pendingcount--;
+        return;
+    }
+}
+
+
+int mecacom_poll(struct mecacom_client *client) {
+    unsigned char *line;
+    double time_now = mecacom_time_now();
+    int i, len, ret, replies = 0;
+
+    if (client->proto == MECACOM_PROTO_TCP) {
+
+        if (remote_outbuf_flush(&client->out) == -1) {
+            return -1;
+        }
+
+        while (cmdring_free(&client->in) > 0) {
+            ret = cmdring_read(&client->in, client->fd);
+            if (ret == 0) {
+                return -1;  // the commander closed the connection
+            }
+            if (ret == -1) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    break;
+                }
+                return -1;
+            }
+            while ((len = cmdring_next_line(&client->in, &line)) != CMDRING_NOLINE) {
+                if (len > 0) {
+                    mecacom_process_reply(client, line, len, time_now);
+                    replies++;
+                }
+            }
+        }
+
+        // lost commands
+        for (i = 0; i < MECACOM_PENDING_MAX; i++) {
+            if ((client->pending[i].reqid != -1) && ((time_now - client->pending[i].time_sent) > (MECACOM_ACK_TIMEOUT_MS / 1000.0))) {
+                client->pending[i].reqid = -1;
+                client->pendingcount--;
+                client->stats.lost++;
+            }
+        }
+
+    }  // UDP: there are no replies, only telemetry (if subscribed) - that is left for the application to read
+
+    // keepalive: repeat the last setpoint well within the watchdog time of the commander
+    if ((client->have_setpoint == 1) && (client->keepalive_ms > 0) &&
+        ((time_now - client->time_last_sent) >= (client->keepalive_ms / 1000.0))) {
+        if (mecacom_send_setpoint_now(client, time_now) == 0) {
+            client->stats.keepalives++;
+        }
+    }
+
+    return replies;
+}
+
+
+void mecacom_get_stats(struct mecacom_client *client, struct mecacom_stats *stats) {
+    *stats = client->stats;
+}
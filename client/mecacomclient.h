@@ -0,0 +1,97 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+
+    libmecacomclient - C client library for MecanumCommander
+*/
+
+#ifndef __MECACOMCLIENT_H__
+
+#define __MECACOMCLIENT_H__
+
+#include <netinet/in.h>
+#include "../mecanumcommander_remote.h"
+
+#define MECACOM_PROTO_TCP          0  // framed mode, every command is acknowledged
+#define MECACOM_PROTO_UDP          1  // text commands (packet number + CRC16)
+#define MECACOM_PROTO_UDPBIN       2  // binary setpoints (X, Y and rotation in one packet)
+
+#define MECACOM_DEFAULT_PORT       3475
+#define MECACOM_CONNECT_TIMEOUT_MS 2000
+#define MECACOM_KEEPALIVE_MS       200   // the last setpoint is repeated this often (the commander stops the robot after 500ms)
+#define MECACOM_ACK_TIMEOUT_MS     1000  // a command without a reply after this long is counted as lost
+#define MECACOM_PENDING_MAX        64    // commands in flight (TCP)
+
+struct mecacom_pending {
+    int reqid;                              // -1: free
+    double time_sent;
+    char command[REMOTECMD_LEN + 1];
+};
+
+struct mecacom_stats {
+    unsigned long sent;                     // commands (a setpoint over TCP/UDP text is 3)
+    unsigned long acked;                    // OK replies
+    unsigned long errors;                   // error replies (!BADSPX!, !ERRROT!, ...)
+    unsigned long lost;                     // no reply within MECACOM_ACK_TIMEOUT_MS
+    unsigned long busy;                     // sending was not possible, too many commands in flight / output buffer full
+    unsigned long watchdog;                 // !NOCMST! - the robot was stopped by the commander
+    unsigned long keepalives;
+    double rtt_last;                        // sec
+    double rtt_avg;                         // moving average
+    double rtt_max;
+};
+
+// called for every reply to a command (TCP)
+typedef void (*mecacom_ack_callback)(void *userdata, int reqid, const char *command, const char *reply, double rtt);
+
+struct mecacom_client {
+    int proto;
+    int fd;
+    struct sockaddr_in dest;
+    unsigned int udppacketno;
+    int nextreqid;
+
+    struct remote_outbuf out;               // TCP: non-blocking send
+    struct cmdring in;                      // TCP: replies
+
+    unsigned char have_setpoint;            // keepalive: repeat the last setpoint
+    unsigned char stopped;
+    int setpoint[REMOTECMD_AXES];
+    unsigned int keepalive_ms;              // 0: no keepalive
+    double time_last_sent;
+
+    struct mecacom_pending pending[MECACOM_PENDING_MAX];
+    int pendingcount;
+
+    mecacom_ack_callback on_ack;
+    void *on_ack_userdata;
+
+    struct mecacom_stats stats;
+};
+
+// TCP: connects, authenticates and switches to framed mode (blocking), afterwards everything is non-blocking
+int  mecacom_connect(struct mecacom_client *client, int proto, const char *ip, int port, const char *password);
+void mecacom_close(struct mecacom_client *client);
+int  mecacom_fd(struct mecacom_client *client);
+void mecacom_set_ack_callback(struct mecacom_client *client, mecacom_ack_callback callback, void *userdata);
+void mecacom_set_keepalive(struct mecacom_client *client, unsigned int keepalive_ms);
+
+// X/Y/rotation in one batch (one send/sendmmsg), returns -1 on error or if the client is too far behind (nothing is queued then)
+// limits: +-9999 (TCP, UDP text), +-REMOTECMD_SETPOINT_LIMIT (UDPBIN)
+int  mecacom_set_setpoint(struct mecacom_client *client, int speedX, int speedY, int rotation);
+int  mecacom_stop(struct mecacom_client *client);
+// any 8 char command, e.g. "TLR00100" (TCP: returns the request id)
+int  mecacom_send_command(struct mecacom_client *client, const char *command);
+
+// call it regularly (or when mecacom_fd() is readable/writable): sends what is buffered, processes the replies,
+// expires the lost commands and sends the keepalive, returns the number of replies processed or -1 if the connection is lost
+int  mecacom_poll(struct mecacom_client *client);
+// 1 if there is buffered data to send (wait for mecacom_fd() to be writable)
+int  mecacom_want_write(struct mecacom_client *client);
+
+void mecacom_get_stats(struct mecacom_client *client, struct mecacom_stats *stats);
+
+#endif
@@ -14,10 +14,11 @@ from crc16pure import crc16xmodem as crc16_ccitt
 
 class MecanumCommanderClient:
 
-    def __init__(self, mecacom_protocol = 0, mecacom_ip = "127.0.0.1", mecacom_port = 3475, mecacom_pass = "PASSWORD"):
+    def __init__(self, mecacom_protocol = 0, mecacom_ip = "127.0.0.1", mecacom_port = 3475, mecacom_pass = "PASSWORD", mecacom_framed = False):
 
         self.param__commandsendmintime = 0.025;
         self.protocol = mecacom_protocol;
+        self.framed = False;
 
         if self.protocol == 0:  # TCP
             self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM);
@@ -43,7 +44,20 @@ class MecanumCommanderClient:
                 sys.exit(2);
             print("MECACOM: Connected to NLAB-MecanumCommander");
 
-        elif self.protocol == 1:  # UDP
+            # framed mode: every request has an id, the replies can be matched (no need to throttle)
+            if mecacom_framed:
+                self.sock.send(b"FRM00001\r\n");
+                reply = self.sock.recv(1024).decode('UTF-8').strip();
+                if reply != "OKFRM":
+                    print("MECACOM: Could not switch to framed mode: %s\n"%(reply));
+                    sys.exit(2);
+                self.framed = True;
+                self.requestid = 0;
+                self.pendingrequests = {};
+                self.tcprecvbuf = b'';
+                self.param__commandsendmintime = 0;
+
+        elif self.protocol == 1 or self.protocol == 2:  # UDP (text) / UDP (binary setpoint)
             self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM);
             self.udpdestination = (mecacom_ip, mecacom_port);
             self.udppacketno = 0;
@@ -61,24 +75,63 @@ class MecanumCommanderClient:
 
 
     def sendudpcommand(self, commandtosend):
+        packetdata = struct.pack(">H", self.nextudppacketno()) + bytes(commandtosend, 'ascii');
+        checksum = crc16_ccitt(packetdata);
+        packetdata += struct.pack(">H", checksum);
+        self.sock.sendto(packetdata, self.udpdestination);
+        print("MECACOM: UDP packet sent: packetno: %d cmd: %s cksum: %x"%(self.udppacketno, commandtosend, checksum));
+
+
+    def nextudppacketno(self):
         if self.udppacketno == 0xFFFF:
             self.udppacketno = 0;
         else:
             self.udppacketno += 1;
-        packetdata = struct.pack(">H", self.udppacketno) + bytes(commandtosend, 'ascii');
+        return self.udppacketno;
+
+
+    # X, Y, rotation (+ stop flag and deadline) in one packet
+    def sendudpsetpoint(self, speedX, speedY, rotation, stop = False, deadline_ms = 0):
+        flags = 0;
+        if stop:
+            flags |= 0x01;
+        if deadline_ms > 0:
+            flags |= 0x02;
+        packetdata = struct.pack(">HBBhhhHH", self.nextudppacketno(), 0xB1, flags, speedX, speedY, rotation, deadline_ms, 0);
         checksum = crc16_ccitt(packetdata);
         packetdata += struct.pack(">H", checksum);
         self.sock.sendto(packetdata, self.udpdestination);
-        print("MECACOM: UDP packet sent: packetno: %d cmd: %s cksum: %x"%(self.udppacketno, commandtosend, checksum));
+        print("MECACOM: UDP setpoint sent: packetno: %d X: %d Y: %d rot: %d flags: %x cksum: %x"%(self.udppacketno, speedX, speedY, rotation, flags, checksum));
 
 
-    def setXYrot(self, speedX, speedY, rotation):
+    # trajectory in one packet, segments: ('vel', duration_ms, speedX, speedY, rotation)
+    # or ('wp', timeout_ms, x_mm, y_mm, theta_mrad, speedlimit), limits: accel, jerk, angaccel, angjerk, angspeed
+    def sendudptrajectory(self, segments, accel = 500, jerk = 2000, angaccel = 2000, angjerk = 10000, angspeed = 1000, closedloop = False):
+        flags = 0x01 if closedloop else 0x00;
+        packetdata = struct.pack(">HBBHHHHHBB", self.nextudppacketno(), 0xB4, flags, accel, jerk // 10, angaccel, angjerk // 10, angspeed, len(segments), 0);
+        for segment in segments:
+            if segment[0] == 'vel':
+                packetdata += struct.pack(">BBHhhhH", 0, 0, segment[1], segment[2], segment[3], segment[4], 0);
+            else:
+                packetdata += struct.pack(">BBHhhhH", 1, 0, segment[1], segment[2], segment[3], segment[4], segment[5]);
+        checksum = crc16_ccitt(packetdata);
+        packetdata += struct.pack(">H", checksum);
+        self.sock.sendto(packetdata, self.udpdestination);
+        print("MECACOM: UDP trajectory sent: packetno: %d segments: %d flags: %x cksum: %x"%(self.udppacketno, len(segments), flags, checksum));
+
+
+    def setXYrot(self, speedX, speedY, rotation, deadline_ms = 0):
 
         timenow = time.time();
         timediff = timenow - self.lastcmdsent_time;
         if timediff >= self.param__commandsendmintime:
 
-            if self.protocol == 0:  # TCP
+            if self.protocol == 0 and self.framed:  # TCP framed
+                self.sendframed("SPX%05d"%(speedX));
+                self.sendframed("SPY%05d"%(speedY));
+                self.sendframed("ROT%05d"%(rotation));
+
+            elif self.protocol == 0:  # TCP
                 commandtosend = "SPX%05d\r\nSPY%05d\r\nROT%05d\r\n"%(speedX, speedY, rotation);
                 self.sock.send(bytes(commandtosend, 'ascii'));
                 print("MECACOM: TCP: cmd sent:", str(commandtosend).replace('\r', '\\r').replace('\n', '\\n'));
@@ -89,6 +142,10 @@ class MecanumCommanderClient:
                 self.sendudpcommand("SPY%05d"%(speedY));
                 self.sendudpcommand("ROT%05d"%(rotation));
 
+            elif self.protocol == 2:  # UDP binary
+
+                self.sendudpsetpoint(speedX, speedY, rotation, deadline_ms = deadline_ms);
+
             else:
                 print("MECACOM: Unknown protocol, this should not happen!");
                 sys.exit(2);
@@ -109,13 +166,19 @@ class MecanumCommanderClient:
         timediff = timenow - self.lastcmdsent_time;
         if timediff >= self.param__commandsendmintime:
 
-            if self.protocol == 0:  # TCP
+            if self.protocol == 0 and self.framed:  # TCP framed
+                self.sendframed("STOPZERO");
+
+            elif self.protocol == 0:  # TCP
                 self.sock.send(bytes("STOPZERO\r\n", "ascii"));
                 print("MECACOM: TCP: STOPZERO sent");
 
             elif self.protocol == 1:  # UDP
                 self.sendudpcommand("STOPZERO");
 
+            elif self.protocol == 2:  # UDP binary
+                self.sendudpsetpoint(0, 0, 0, stop = True);
+
             else:
                 print("MECACOM: Unknown protocol, this should not happen!");
                 sys.exit(2);
@@ -126,3 +189,99 @@ class MecanumCommanderClient:
         else:
             print("MECACOM: too fast - STOPZERO cmd was not sent");
 
+
+
+    # ask the commander to push telemetry every period_ms (0: unsubscribe), fields: TLM_FIELD_* mask (0xFFF: all)
+    def subscribetelemetry(self, period_ms, fields = 0xFFF):
+        if self.protocol == 0:  # TCP
+            self.sock.send(bytes("TLF%05d\r\nTLR%05d\r\n"%(fields, period_ms), 'ascii'));
+        else:  # UDP - sent back to our address, the subscription expires unless it is renewed (every 10s)
+            self.sendudpcommand("TLF%05d"%(fields));
+            self.sendudpcommand("TLR%05d"%(period_ms));
+            self.tlmperiod_ms = period_ms;
+            self.tlmrenewed_time = time.time();
+
+
+    # wait for the next telemetry sample, returns a dict (or None on timeout)
+    def recvtelemetry(self, timeout = 1.0):
+        self.sock.settimeout(timeout);
+        try:
+            if self.protocol == 0:  # TCP - text lines, the replies to the commands are skipped
+                if not hasattr(self, 'tcprecvbuf'):
+                    self.tcprecvbuf = b'';
+                while True:
+                    while b'\n' in self.tcprecvbuf:
+                        line, self.tcprecvbuf = self.tcprecvbuf.split(b'\n', 1);
+                        line = line.decode('ascii').strip();
+                        if line.startswith("TLM "):
+                            sample = {};
+                            for item in line[4:].split():
+                                key, value = item.split('=');
+                                values = [ int(v) for v in value.split(',') ];
+                                sample[key] = values if len(values) > 1 else values[0];
+                            return sample;
+                    data = self.sock.recv(1024);
+                    if not data:
+                        return None;
+                    self.tcprecvbuf += data;
+            else:  # UDP - binary packet
+                if (getattr(self, 'tlmperiod_ms', 0) > 0) and (time.time() - self.tlmrenewed_time > 5.0):
+                    self.sendudpcommand("TLR%05d"%(self.tlmperiod_ms));
+                    self.tlmrenewed_time = time.time();
+                packet = self.sock.recv(256);
+                return self.decodetelemetry(packet);
+        except socket.timeout:
+            return None;
+        finally:
+            self.sock.settimeout(None);
+
+
+    def decodetelemetry(self, packet):
+        if len(packet) < 12 or packet[2] != 0xB2:
+            return None;
+        if crc16_ccitt(packet[:-2]) != struct.unpack(">H", packet[-2:])[0]:
+            return None;
+        fields, seq = struct.unpack(">HI", packet[4:10]);
+        sample = { 'seq': seq };
+        offset = 10;
+        # the same order and names as in the TCP text format
+        layout = ( (0x001, 'up', ">I"), (0x002, 'bat', ">H"), (0x004, 'mot', ">BB"), (0x008, 'enc', ">iiii"),
+                   (0x010, 'pos', ">iiii"), (0x020, 'spd', ">iiii"), (0x040, 'cur', ">HHHH"), (0x080, 'sp', ">hhh"),
+                   (0x100, 'err', ">HH"), (0x200, 'odo', ">Iiiiiii"), (0x200, 'ocov', ">6i"), (0x200, 'vcov', ">6i"),
+                   (0x400, 'trj', ">HBBi"), (0x800, 'ts', ">QQI") );
+        for (bit, name, fmt) in layout:
+            if fields & bit:
+                values = struct.unpack_from(fmt, packet, offset);
+                offset += struct.calcsize(fmt);
+                sample[name] = list(values) if len(values) > 1 else values[0];
+        return sample;
+
+
+    # framed mode: send a request with a new id, returns the id
+    def sendframed(self, commandtosend):
+        self.requestid = (self.requestid + 1) % 100000000;
+        self.pendingrequests[self.requestid] = commandtosend;
+        self.sock.send(bytes("#%d %s\r\n"%(self.requestid, commandtosend), 'ascii'));
+        return self.requestid;
+
+
+    # framed mode: collect the replies which arrived so far, returns a list of (id, command, reply)
+    def recvframedreplies(self, timeout = 0):
+        replies = [];
+        self.sock.settimeout(timeout);
+        try:
+            data = self.sock.recv(4096);
+            self.tcprecvbuf += data;
+        except (socket.timeout, BlockingIOError):
+            pass;
+        finally:
+            self.sock.settimeout(None);
+        while b'\n' in self.tcprecvbuf:
+            line, self.tcprecvbuf = self.tcprecvbuf.split(b'\n', 1);
+            line = line.decode('ascii').strip();
+            if line.startswith('#'):
+                reqid, reply = line[1:].split(' ', 1);
+                replies.append((int(reqid), self.pendingrequests.pop(int(reqid), None), reply));
+            elif line != '':
+                replies.append((None, None, line));
+        return replies;
@@ -64,7 +64,25 @@ static const unsigned short crc16tab[256]= {
 	0x6e17,0x7e36,0x4e55,0x5e74,0x2e93,0x3eb2,0x0ed1,0x1ef0
 };
   
-unsigned short crc16_ccitt(const void *buf, int len)
+/*
+ * Slicing-by-8: crc16tab8[k][n] is the CRC of byte n followed by k zero
+ * bytes, so eight input bytes can be folded in with eight independent
+ * lookups. Filled from crc16tab at load time.
+ */
+static unsigned short crc16tab8[8][256];
+
+static void __attribute__((constructor)) crc16_init_tables(void)
+{
+	register int n, k;
+	for( n = 0; n < 256; n++) {
+		crc16tab8[0][n] = crc16tab[n];
+		for( k = 1; k < 8; k++)
+			crc16tab8[k][n] = (crc16tab8[k-1][n]<<8) ^ crc16tab[(crc16tab8[k-1][n]>>8)&0x00FF];
+	}
+}
+
+/* original byte-at-a-time loop, kept as the reference for crc16_bench */
+unsigned short crc16_ccitt_bytewise(const void *buf, int len)
 {
 	register int counter;
 	register unsigned short crc = 0;
@@ -72,3 +90,25 @@ unsigned short crc16_ccitt(const void *buf, int len)
 		crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *(char *)buf++)&0x00FF];
 	return crc;
 }
+
+unsigned short crc16_ccitt_update(unsigned short crc, const void *buf, int len)
+{
+	register const unsigned char *p = buf;
+	while (len >= 8) {
+		crc = crc16tab8[7][((crc>>8) ^ p[0])&0x00FF] ^
+		      crc16tab8[6][(crc ^ p[1])&0x00FF] ^
+		      crc16tab8[5][p[2]] ^ crc16tab8[4][p[3]] ^
+		      crc16tab8[3][p[4]] ^ crc16tab8[2][p[5]] ^
+		      crc16tab8[1][p[6]] ^ crc16tab8[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *p++)&0x00FF];
+	return crc;
+}
+
+unsigned short crc16_ccitt(const void *buf, int len)
+{
+	return crc16_ccitt_update(0, buf, len);
+}
@@ -29,5 +29,8 @@
 #define _CRC16_H_
 
 unsigned short crc16_ccitt(const void *buf, int len);
+/* continue a CRC over the next chunk of a stream, start with crc = 0 */
+unsigned short crc16_ccitt_update(unsigned short crc, const void *buf, int len);
+unsigned short crc16_ccitt_bytewise(const void *buf, int len);
 
 #endif /* _CRC16_H_ */
@@ -0,0 +1,102 @@
+/*
+    crc16_bench - checks the slicing-by-8 CRC16-CCITT (XMODEM) against the
+    byte-at-a-time reference and vectors from client/crc16pure.py,
+    then compares their speed
+    part of NLAB-MecanumCommander for Linux
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "crc16.h"
+
+// expected values from: python3 -c 'import crc16pure; print(hex(crc16pure.crc16xmodem(data)))'
+struct crc16_vector {
+    const char *name;
+    unsigned char data[256];
+    int len;
+    unsigned short crc;
+};
+
+static double bench(unsigned short (*crcfunc)(const void *, int), unsigned char *buf, int len, long rounds) {
+
+    struct timespec ts_start, ts_end;
+    volatile unsigned short sink = 0;
+    long i;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    for (i = 0; i < rounds; i++) {
+        buf[0] = i;
+        sink ^= crcfunc(buf, len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    (void)sink;
+
+    return ((ts_end.tv_sec - ts_start.tv_sec) * 1e9 + (ts_end.tv_nsec - ts_start.tv_nsec)) / rounds;
+}
+
+int main(void) {
+
+    struct crc16_vector vectors[] = {
+        { "check",     "123456789", 9,  0x31C3 },
+        { "textcmd",   "SPX00300",  8,  0x1B64 },
+        { "zeros16",   { 0 },       16, 0x0000 },
+        { "0..255",    { 0 },       256, 0x7E55 },
+        { "ff33",      { 0 },       33, 0x7BFC },
+    };
+    int nvectors = sizeof(vectors) / sizeof(vectors[0]);
+    int benchlens[] = { 8, 16, 64, 512, 4096 };
+    unsigned char buf[4096];
+    unsigned short crc_ref, crc_new, crc_inc;
+    int i, len, split, errors = 0;
+
+    for (i = 0; i < 256; i++)
+        vectors[3].data[i] = i;
+    memset(vectors[4].data, 0xFF, vectors[4].len);
+
+    for (i = 0; i < nvectors; i++) {
+        crc_ref = crc16_ccitt_bytewise(vectors[i].data, vectors[i].len);
+        crc_new = crc16_ccitt(vectors[i].data, vectors[i].len);
+        if ((crc_ref != vectors[i].crc) || (crc_new != vectors[i].crc)) {
+            printf("FAIL %-8s expected %04X bytewise %04X sliced %04X\n", vectors[i].name, vectors[i].crc, crc_ref, crc_new);
+            errors++;
+        }
+    }
+
+    // every length up to 1024 with random contents, and every split point for the incremental API
+    srand(1);
+    for (i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = rand();
+    for (len = 0; len <= 1024; len++) {
+        crc_ref = crc16_ccitt_bytewise(buf, len);
+        if (crc16_ccitt(buf, len) != crc_ref) {
+            printf("FAIL len %d\n", len);
+            errors++;
+        }
+        split = rand() % (len + 1);
+        crc_inc = crc16_ccitt_update(0, buf, split);
+        crc_inc = crc16_ccitt_update(crc_inc, buf + split, len - split);
+        if (crc_inc != crc_ref) {
+            printf("FAIL len %d split %d\n", len, split);
+            errors++;
+        }
+    }
+
+    if (errors > 0) {
+        printf("%d mismatches\n", errors);
+        return 1;
+    }
+    printf("all vectors OK\n\n");
+
+    printf("%6s %14s %14s %8s\n", "bytes", "bytewise ns", "sliced ns", "speedup");
+    for (i = 0; i < (int)(sizeof(benchlens) / sizeof(benchlens[0])); i++) {
+        long rounds = 200000000L / (benchlens[i] + 16);
+        double t_ref = bench(crc16_ccitt_bytewise, buf, benchlens[i], rounds);
+        double t_new = bench(crc16_ccitt, buf, benchlens[i], rounds);
+        printf("%6d %14.1f %14.1f %7.2fx\n", benchlens[i], t_ref, t_new, t_ref / t_new);
+    }
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <string.h>
+#include <math.h>
+#include "mecanumcommander_rt.h"
+#include "mecanumcommander_clocksync.h"
+
+
+void clocksync_init(struct clocksync *cs) {
+    memset(cs, 0, sizeof(struct clocksync));
+    cs->rate = 0.001;
+}
+
+
+// line fit of the kept samples, anchored at the newest one (the times mapped are mostly recent)
+static void clocksync_fit(struct clocksync *cs) {
+
+    struct clocksync_sample *smp;
+    double min_rtt, host_ref, x, y, xmin, xmax, n, sx, sy, sxx, sxy, intercept, rate, sq;
+    int i;
+
+    min_rtt = cs->bucket[cs->current].rtt;
+    for (i = 0; i < cs->buckets; i++) {
+        if (cs->bucket[i].rtt < min_rtt) {
+            min_rtt = cs->bucket[i].rtt;
+        }
+    }
+
+    cs->uptime_base = cs->bucket[cs->current].uptime_ms;
+    host_ref = cs->bucket[cs->current].host;
+
+    n = sx = sy = sxx = sxy = 0;
+    xmin = xmax = 0;
+    for (i = 0; i < cs->buckets; i++) {
+        smp = &cs->bucket[i];
+        if (smp->rtt > (min_rtt * CLOCKSYNC_RTT_OUTLIER + CLOCKSYNC_RTT_SLACK)) {
+            continue;
+        }
+        x = (int)(smp->uptime_ms - cs->uptime_base);
+        y = smp->host + smp->rtt / 2.0 - host_ref;
+        if (x < xmin) { xmin = x; }
+        if (x > xmax) { xmax = x; }
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    rate = 0.001;
+    if ((n >= 3) && ((xmax - xmin) >= CLOCKSYNC_DRIFT_SPAN_MS)) {
+        rate = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        if (fabs(rate * 1000.0 - 1.0) > CLOCKSYNC_DRIFT_MAX) {
+            rate = 0.001;
+        }
+    }
+    intercept = (sy - rate * sx) / n;
+
+    sq = 0;
+    for (i = 0; i < cs->buckets; i++) {
+        smp = &cs->bucket[i];
+        if (smp->rtt > (min_rtt * CLOCKSYNC_RTT_OUTLIER + CLOCKSYNC_RTT_SLACK)) {
+            continue;
+        }
+        x = (int)(smp->uptime_ms - cs->uptime_base);
+        y = smp->host + smp->rtt / 2.0 - host_ref;
+        sq += (y - intercept - rate * x) * (y - intercept - rate * x);
+    }
+
+    cs->host_base = host_ref + intercept;
+    cs->rate = rate;
+    cs->latency = min_rtt / 2.0;
+    cs->residual = sqrt(sq / n);
+    cs->valid = 1;
+}
+
+
+int clocksync_add(struct clocksync *cs, double host_start, double host_end, unsigned int uptime_ms) {
+
+    struct clocksync_sample smp;
+    int restarted = 0;
+
+    smp.uptime_ms = uptime_ms;
+    smp.host = host_start;
+    smp.rtt = host_end - host_start;
+    if (smp.rtt < 0) {
+        return 0;
+    }
+    cs->samples++;
+
+    // the rover was reset (or the estimate was wrong), the kept samples are useless
+    if ((cs->valid == 1) && (fabs(host_start + smp.rtt / 2.0 - clocksync_host_time(cs, uptime_ms)) > (CLOCKSYNC_RESYNC_SEC + smp.rtt / 2.0))) {
+        cs->buckets = 0;
+        cs->valid = 0;
+        cs->resyncs++;
+        restarted = 1;
+    }
+
+    if (cs->buckets == 0) {
+        cs->current = 0;
+        cs->buckets = 1;
+        cs->current_start = uptime_ms;
+        cs->bucket[0] = smp;
+    } else if ((int)(uptime_ms - cs->current_start) >= CLOCKSYNC_BUCKET_MS) {
+        cs->current = (cs->current + 1) % CLOCKSYNC_BUCKETS;
+        if (cs->buckets < CLOCKSYNC_BUCKETS) {
+            cs->buckets++;
+        }
+        cs->current_start = uptime_ms;
+        cs->bucket[cs->current] = smp;
+    } else if (smp.rtt < cs->bucket[cs->current].rtt) {
+        cs->bucket[cs->current] = smp;
+    }
+
+    clocksync_fit(cs);
+
+    return restarted;
+}
+
+
+int clocksync_read(struct clocksync *cs, struct roverstruct *rover) {
+
+    double host_start, host_end;
+    int ret;
+
+    host_start = rt_now();
+    ret = rover_read_register(rover->regs->controller_addr_main, rover->regs->uptime, 4, rover->memmap_main, rover);
+    host_end = rt_now();
+    if (ret != 0) {
+        return -1;
+    }
+
+    return clocksync_add(cs, host_start, host_end, read_register_from_memmap(rover->memmap_main, rover->regs->uptime, 4));
+}
+
+
+double clocksync_host_time(const struct clocksync *cs, unsigned int uptime_ms) {
+
+    if (cs->valid == 0) {
+        return 0;
+    }
+
+    return cs->host_base + cs->rate * (int)(uptime_ms - cs->uptime_base);
+}
+
+
+double clocksync_offset(const struct clocksync *cs) {
+    return cs->host_base - cs->rate * cs->uptime_base;
+}
+
+
+double clocksync_error(const struct clocksync *cs) {
+    return cs->latency + cs->residual + CLOCKSYNC_RESOLUTION / 2.0;
+}
+
+
+double clocksync_drift_ppm(const struct clocksync *cs) {
+    return (0.001 / cs->rate - 1.0) * 1000000.0;
+}
@@ -0,0 +1,80 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_CLOCKSYNC_H__
+
+#define __MECACOM_CLOCKSYNC_H__
+
+#include "mecanumrover_commlib.h"
+
+/*
+ Host/rover clock synchronization
+
+ The uptime register (ms) of the main controller is the only clock of the rover, the values read from the
+ memmaps (encoders, ...) can be stamped with it. To compare them with host events, the uptime is mapped to
+ the host's CLOCK_MONOTONIC:
+ - every read of the uptime register is timed on the host (start/end of the serial transaction), the rover
+   sampled its counter somewhere in between, assumed to be in the middle (symmetric one-way latency)
+ - min-filter: of the reads within CLOCKSYNC_BUCKET_MS only the one with the shortest round trip is kept,
+   the serial delays (USB frames, other traffic, scheduling) can only make a read longer
+ - the kept samples of the last CLOCKSYNC_BUCKETS buckets are fitted with a line (least squares):
+   offset and drift of the rover's clock, the drift only when the samples span at least CLOCKSYNC_DRIFT_SPAN_MS
+ - a sample too far off the estimate (rover reset, uptime jumped) restarts the synchronization
+ The uptime wraps around after 49.7 days, the differences are taken modulo 2^32.
+ The error of a mapped time is about half of the shortest round trip, plus the residual of the fit and half of
+ the resolution of the uptime register.
+*/
+
+#define CLOCKSYNC_BUCKETS           64
+#define CLOCKSYNC_BUCKET_MS         1000    // one kept sample per second, a 64 s window
+#define CLOCKSYNC_DRIFT_SPAN_MS     10000   // shorter spans: nominal rate (1 ms / ms)
+#define CLOCKSYNC_DRIFT_MAX         0.001   // rate error estimates above this (1000 ppm) are not trusted
+#define CLOCKSYNC_RESYNC_SEC        0.1     // a read this far off the estimate restarts the synchronization
+#define CLOCKSYNC_RTT_OUTLIER       2.0     // buckets with a round trip above min. round trip * this
+#define CLOCKSYNC_RTT_SLACK         0.0005  // ... + this (sec) are not fitted
+#define CLOCKSYNC_RESOLUTION        0.001   // sec, of the uptime register
+
+struct clocksync_sample {
+    unsigned int uptime_ms;
+    double host;                // sec, CLOCK_MONOTONIC at the start of the read
+    double rtt;                 // sec
+};
+
+struct clocksync {
+    struct clocksync_sample bucket[CLOCKSYNC_BUCKETS];    // ring, the best read of every bucket
+    int buckets;                // used
+    int current;                // the bucket being filled
+    unsigned int current_start; // uptime at the start of the current bucket
+    unsigned char valid;
+    // host time of an uptime: host_base + rate * (uptime - uptime_base)
+    unsigned int uptime_base;
+    double host_base;
+    double rate;                // sec per rover ms
+    double latency;             // sec, estimated one-way latency (half of the shortest round trip)
+    double residual;            // sec, rms residual of the fit
+    // statistics
+    unsigned long samples;
+    unsigned long resyncs;
+};
+
+void   clocksync_init(struct clocksync *cs);
+// a read of the uptime register, started and finished at host_start, host_end (CLOCK_MONOTONIC, sec)
+// returns 1 if it restarted the synchronization, 0 otherwise
+int    clocksync_add(struct clocksync *cs, double host_start, double host_end, unsigned int uptime_ms);
+// read the uptime register of the main controller and add it, returns -1 on a read error, otherwise as clocksync_add()
+int    clocksync_read(struct clocksync *cs, struct roverstruct *rover);
+// host CLOCK_MONOTONIC time (sec) when the rover's uptime was uptime_ms, 0 if not synchronized yet
+double clocksync_host_time(const struct clocksync *cs, unsigned int uptime_ms);
+// host CLOCK_MONOTONIC time (sec) of the rover's uptime 0, i.e. when it was switched on
+double clocksync_offset(const struct clocksync *cs);
+// error bound of clocksync_host_time() (sec)
+double clocksync_error(const struct clocksync *cs);
+// rover clock rate error (ppm, positive: the rover's clock is fast)
+double clocksync_drift_ppm(const struct clocksync *cs);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <getopt.h>
+#include "mecanumcommander_config.h"
+#include "mecanumcommander_remote.h"
+#include "mecanumcommander_local.h"
+#include "mecanumrover_commlib.h"
+
+#define CONFIG_UCHAR   0  // unsigned char, min..max
+#define CONFIG_UINT    1  // unsigned int, min..max
+#define CONFIG_DOUBLE  2  // double, min 1: > 0, min 0: >= 0 (0: the default)
+#define CONFIG_STRING  3  // char[max]
+#define CONFIG_PROTO   4  // unsigned char, tcp/udp or 0/1
+#define CONFIG_INT     5  // int, min..max
+
+struct config_option {
+    const char *name;
+    int type;
+    size_t offset;
+    long min, max;
+};
+
+static const struct config_option config_options[] = {
+    { "remotecontrol",                CONFIG_UCHAR,  offsetof(struct commander_config, remotecontrol),                0, 1 },
+    { "remotecontrolproto",           CONFIG_PROTO,  offsetof(struct commander_config, remotecontrolproto),           0, 1 },
+    { "dummymode",                    CONFIG_UCHAR,  offsetof(struct commander_config, dummymode),                    0, 1 },
+    { "keyboardmode",                 CONFIG_UCHAR,  offsetof(struct commander_config, keyboardmode),                 1, 2 },
+    { "repeatcommands",               CONFIG_UCHAR,  offsetof(struct commander_config, repeatcommands),               0, 1 },
+    { "usekcommands",                 CONFIG_UCHAR,  offsetof(struct commander_config, usekcommands),                 0, 1 },
+    { "readmemmapfromfile",           CONFIG_UCHAR,  offsetof(struct commander_config, readmemmapfromfile),           0, 1 },
+    { "memmapurl",                    CONFIG_STRING, offsetof(struct commander_config, memmapurl),                    0, CONFIG_PATH_MAXLEN },
+    { "localcontrol",                 CONFIG_UCHAR,  offsetof(struct commander_config, localcontrol),                 0, 1 },
+    { "localsocket",                  CONFIG_STRING, offsetof(struct commander_config, localsocket),                  1, CONFIG_PATH_MAXLEN },
+    { "refreshmemmap",                CONFIG_UCHAR,  offsetof(struct commander_config, refreshmemmap),                0, 1 },
+    { "nolamp_when_setcmd",           CONFIG_UCHAR,  offsetof(struct commander_config, nolamp_when_setcmd),           0, 1 },
+    { "telemetrymulticast",           CONFIG_UCHAR,  offsetof(struct commander_config, telemetrymulticast),           0, 1 },
+    { "telemetrymulticast_period_ms", CONFIG_UINT,   offsetof(struct commander_config, telemetrymulticast_period_ms), 1, 60000 },
+    { "telemetrymulticast_fields",    CONFIG_UINT,   offsetof(struct commander_config, telemetrymulticast_fields),    1, TLM_FIELD_ALL },
+    { "headless",                     CONFIG_UCHAR,  offsetof(struct commander_config, headless),                     0, 1 },
+    { "port",                         CONFIG_UINT,   offsetof(struct commander_config, port),                         1, 65535 },
+    { "password",                     CONFIG_STRING, offsetof(struct commander_config, password),                     1, CONFIG_PASSWORD_MAXLEN },
+    { "logfile",                      CONFIG_STRING, offsetof(struct commander_config, logfile),                      1, CONFIG_PATH_MAXLEN },
+    { "repeat_time_cmdsent",          CONFIG_DOUBLE, offsetof(struct commander_config, repeat_time_cmdsent),          1, 0 },
+    { "repeat_time_kcmdsent",         CONFIG_DOUBLE, offsetof(struct commander_config, repeat_time_kcmdsent),         1, 0 },
+    { "remotecmd_validity",           CONFIG_DOUBLE, offsetof(struct commander_config, remotecmd_validity),           1, 0 },
+    { "memmapread_period",            CONFIG_DOUBLE, offsetof(struct commander_config, memmapread_period),            1, 0 },
+    { "rt_priority",                  CONFIG_INT,    offsetof(struct commander_config, rt_priority),                  0, 99 },
+    { "rt_cpu",                       CONFIG_INT,    offsetof(struct commander_config, rt_cpu),                       -1, 1023 },
+    { "serialdev",                    CONFIG_STRING, offsetof(struct commander_config, serialdev),                    1, CONFIG_PATH_MAXLEN },
+    { "serialbaud",                   CONFIG_UINT,   offsetof(struct commander_config, serialbaud),                   1200, 4000000 },
+    { "faststart",                    CONFIG_UCHAR,  offsetof(struct commander_config, faststart),                    0, 1 },
+    { "probe_timeout_ms",             CONFIG_UINT,   offsetof(struct commander_config, probe_timeout_ms),             1, 600000 },
+    { "identitycache",                CONFIG_STRING, offsetof(struct commander_config, identitycache),                0, CONFIG_PATH_MAXLEN },
+    { "replywait_floor_us",           CONFIG_UINT,   offsetof(struct commander_config, replywait_floor_us),           100, 999999 },
+    { "replywait_ceiling_us",         CONFIG_UINT,   offsetof(struct commander_config, replywait_ceiling_us),         100, 999999 },
+    { "replywait_gap_floor_us",       CONFIG_UINT,   offsetof(struct commander_config, replywait_gap_floor_us),       100, 999999 },
+    { "safestop",                     CONFIG_UCHAR,  offsetof(struct commander_config, safestop),                     0, 1 },
+    { "safestop_deadline_ms",         CONFIG_UINT,   offsetof(struct commander_config, safestop_deadline_ms),         1, 1000 },
+    { "odometry",                     CONFIG_UCHAR,  offsetof(struct commander_config, odometry),                     0, 1 },
+    { "odometry_period_ms",           CONFIG_UINT,   offsetof(struct commander_config, odometry_period_ms),           0, 10000 },
+    { "odom_wheel_radius_mm",         CONFIG_DOUBLE, offsetof(struct commander_config, odom_wheel_radius_mm),         0, 0 },
+    { "odom_track_mm",                CONFIG_DOUBLE, offsetof(struct commander_config, odom_track_mm),                0, 0 },
+    { "odom_wheelbase_mm",            CONFIG_DOUBLE, offsetof(struct commander_config, odom_wheelbase_mm),            0, 0 },
+    { "odom_counts_per_rev",          CONFIG_DOUBLE, offsetof(struct commander_config, odom_counts_per_rev),          0, 0 },
+    { "odom_invert",                  CONFIG_INT,    offsetof(struct commander_config, odom_invert),                  -1, 15 },
+    { "odom_front_main",              CONFIG_UCHAR,  offsetof(struct commander_config, odom_front_main),              0, 1 },
+    { "odom_wheel_noise",             CONFIG_DOUBLE, offsetof(struct commander_config, odom_wheel_noise),             1, 0 },
+    { "clocksync_period_ms",          CONFIG_UINT,   offsetof(struct commander_config, clocksync_period_ms),          0, 60000 },
+    { "trajectory_rate_hz",           CONFIG_UINT,   offsetof(struct commander_config, trajectory_rate_hz),           1, 1000 },
+    { "trajectory_gain",              CONFIG_DOUBLE, offsetof(struct commander_config, trajectory_gain),              1, 0 },
+    { "trajectory_lease_ms",          CONFIG_UINT,   offsetof(struct commander_config, trajectory_lease_ms),          10, 60000 },
+    { "trajectory_max_sec",           CONFIG_UINT,   offsetof(struct commander_config, trajectory_max_sec),           1, 86400 },
+};
+
+#define CONFIG_OPTIONS (int)(sizeof(config_options) / sizeof(config_options[0]))
+
+
+void config_defaults(struct commander_config *cfg) {
+
+    memset(cfg, 0, sizeof(struct commander_config));
+
+    cfg->remotecontrol      = 0;
+    cfg->remotecontrolproto = 0;
+    cfg->dummymode          = 0;
+    cfg->keyboardmode       = 1;
+    cfg->repeatcommands     = 1;
+    cfg->usekcommands       = 0;
+    cfg->readmemmapfromfile = 0;
+    cfg->memmapurl[0]       = 0;
+    cfg->localcontrol       = 0;
+    strcpy(cfg->localsocket, LOCALCTL_SOCKET_PATH);
+    cfg->refreshmemmap      = 0;
+    cfg->nolamp_when_setcmd = 1;
+    cfg->telemetrymulticast = 0;
+    cfg->telemetrymulticast_period_ms = 100;
+    cfg->telemetrymulticast_fields    = TLM_FIELD_ALL;
+    cfg->headless           = 0;
+    cfg->port               = CONFIG_DEFAULT_PORT;
+    strcpy(cfg->password, CONFIG_DEFAULT_PASSWORD);
+    strcpy(cfg->logfile, CONFIG_DEFAULT_LOGFILE);
+    cfg->repeat_time_cmdsent  = 0.4;
+    cfg->repeat_time_kcmdsent = 0.4;
+    cfg->remotecmd_validity   = 0.5;
+    cfg->memmapread_period    = 0.4;
+    cfg->rt_priority          = 0;
+    cfg->rt_cpu               = -1;
+    strcpy(cfg->serialdev, DEVFILE);
+    cfg->serialbaud           = BAUDRATE;
+    cfg->faststart            = 1;
+    cfg->probe_timeout_ms     = 3000;
+    cfg->identitycache[0]     = 0;
+    cfg->replywait_floor_us   = SERIAL_WAIT_FLOOR_USEC;
+    cfg->replywait_ceiling_us = REPLYWAIT_TIMEOUT_USEC;
+    cfg->replywait_gap_floor_us = SERIAL_GAP_FLOOR_USEC;
+    cfg->safestop             = 1;
+    cfg->safestop_deadline_ms = CONFIG_DEFAULT_SAFESTOP_DEADLINE_MS;
+    cfg->odometry             = 0;
+    cfg->odometry_period_ms   = 20;
+    cfg->odom_invert          = -1;
+    cfg->odom_wheel_noise     = 0.02;
+    cfg->clocksync_period_ms  = 100;
+    cfg->trajectory_rate_hz   = 50;
+    cfg->trajectory_gain      = 2.0;
+    cfg->trajectory_lease_ms  = 1000;
+    cfg->trajectory_max_sec   = 300;
+}
+
+
+// set one option from its text form, returns -1 if the name or the value is invalid
+static int config_set(struct commander_config *cfg, const char *name, const char *value) {
+
+    const struct config_option *opt = NULL;
+    char *field, *end;
+    long lval;
+    double dval;
+    int i;
+
+    for (i = 0; i < CONFIG_OPTIONS; i++) {
+        if (strcmp(config_options[i].name, name) == 0) {
+            opt = &config_options[i];
+            break;
+        }
+    }
+    if (opt == NULL) {
+        fprintf(stderr, "Unknown option: %s\n", name);
+        return -1;
+    }
+    field = (char *)cfg + opt->offset;
+
+    switch (opt->type) {
+
+        case CONFIG_PROTO:
+            if ((strcmp(value, "tcp") == 0) || (strcmp(value, "0") == 0)) {
+                *(unsigned char *)field = 0;
+            } else if ((strcmp(value, "udp") == 0) || (strcmp(value, "1") == 0)) {
+                *(unsigned char *)field = 1;
+            } else {
+                fprintf(stderr, "Invalid value for %s (tcp/udp): %s\n", name, value);
+                return -1;
+            }
+            break;
+
+        case CONFIG_UCHAR:
+        case CONFIG_UINT:
+        case CONFIG_INT:
+            lval = strtol(value, &end, 10);
+            if ((*value == '\0') || (*end != '\0') || (lval < opt->min) || (lval > opt->max)) {
+                fprintf(stderr, "Invalid value for %s (%ld-%ld): %s\n", name, opt->min, opt->max, value);
+                return -1;
+            }
+            if (opt->type == CONFIG_UCHAR) {
+                *(unsigned char *)field = lval;
+            } else if (opt->type == CONFIG_UINT) {
+                *(unsigned int *)field = lval;
+            } else {
+                *(int *)field = lval;
+            }
+            break;
+
+        case CONFIG_DOUBLE:
+            dval = strtod(value, &end);
+            if ((*value == '\0') || (*end != '\0') || (dval < 0.0) || ((dval == 0.0) && (opt->min > 0))) {
+                fprintf(stderr, "Invalid value for %s (%s): %s\n", name, (opt->min > 0) ? "> 0" : ">= 0", value);
+                return -1;
+            }
+            *(double *)field = dval;
+            break;
+
+        case CONFIG_STRING:
+            if ((strlen(value) < (size_t)opt->min) || (strlen(value) >= (size_t)opt->max)) {
+                fprintf(stderr, "Invalid length for %s (%ld-%ld): %s\n", name, opt->min, opt->max - 1, value);
+                return -1;
+            }
+            strcpy(field, value);
+            break;
+    }
+
+    return 0;
+}
+
+
+// "name = value" or "name=value", returns -1 if there is no '='
+static int config_set_assignment(struct commander_config *cfg, char *line) {
+
+    char *name, *value, *eq, *end;
+
+    eq = strchr(line, '=');
+    if (eq == NULL) {
+        return -1;
+    }
+    *eq = '\0';
+
+    name = line;
+    while (isspace((unsigned char)*name)) { name++; }
+    end = eq - 1;
+    while ((end >= name) && isspace((unsigned char)*end)) { *end-- = '\0'; }
+
+    value = eq + 1;
+    while (isspace((unsigned char)*value)) { value++; }
+    end = value + strlen(value) - 1;
+    while ((end >= value) && isspace((unsigned char)*end)) { *end-- = '\0'; }
+
+    return config_set(cfg, name, value);
+}
+
+
+int config_load_file(struct commander_config *cfg, const char *path) {
+
+    FILE *fp;
+    char line[CONFIG_LINE_MAXLEN];
+    char *p;
+    int lineno = 0, ret = 0;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        p = strchr(line, '#');
+        if (p != NULL) {
+            *p = '\0';
+        }
+        p = line;
+        while (isspace((unsigned char)*p)) { p++; }
+        if (*p == '\0') {
+            continue;
+        }
+        if (config_set_assignment(cfg, p) == -1) {
+            fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+            ret = -1;
+        }
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+
+static void config_usage(const char *progname) {
+
+    printf("Usage: %s [options]\n"
+           "  -c, --config FILE        read the configuration from FILE (command line flags override it)\n"
+           "  -H, --headless           no ncurses UI, for running as a daemon (e.g. under systemd)\n"
+           "  -n, --dummy              do not send real commands to the robot (testing)\n"
+           "  -t, --tcp                remote control over TCP\n"
+           "  -u, --udp                remote control over UDP\n"
+           "  -p, --port PORT          port for remote control (default: %d)\n"
+           "  -l, --local              accept setpoints from local processes (unix socket, shared memory)\n"
+           "  -k, --kcommands          use the \"triple command set\" (needs custom firmware)\n"
+           "  -f, --memmap-from-file   read the memmap from memmap_0x10.dat/memmap_0x1F.dat (or memmapurl)\n"
+           "  -m, --refresh-memmap     re-read the memmap periodically\n"
+           "  -M, --multicast          push telemetry to the multicast group\n"
+           "  -L, --logfile FILE       log to FILE (default: %s)\n"
+           "  -R, --rt-priority PRIO   run the control loop with SCHED_FIFO priority PRIO (1-99), memory locked\n"
+           "  -C, --cpu CPU            pin the control loop to CPU\n"
+           "  -D, --device DEV         serial port of the robot controller (default: %s),\n"
+           "                           or pty:PATH, tcp:HOST:PORT (serial bridge), http://ROVERIP (Wi-Fi)\n"
+           "  -O, --odometry           wheel odometry from the encoders (pose and velocity in the telemetry)\n"
+           "  -o, --set NAME=VALUE     set any option of the config file\n"
+           "  -h, --help               this help\n",
+           progname, CONFIG_DEFAULT_PORT, CONFIG_DEFAULT_LOGFILE, DEVFILE);
+}
+
+
+int config_parse_args(struct commander_config *cfg, int argc, char **argv) {
+
+    static const struct option longopts[] = {
+        { "config",           required_argument, NULL, 'c' },
+        { "headless",         no_argument,       NULL, 'H' },
+        { "dummy",            no_argument,       NULL, 'n' },
+        { "tcp",              no_argument,       NULL, 't' },
+        { "udp",              no_argument,       NULL, 'u' },
+        { "port",             required_argument, NULL, 'p' },
+        { "local",            no_argument,       NULL, 'l' },
+        { "kcommands",        no_argument,       NULL, 'k' },
+        { "memmap-from-file", no_argument,       NULL, 'f' },
+        { "refresh-memmap",   no_argument,       NULL, 'm' },
+        { "multicast",        no_argument,       NULL, 'M' },
+        { "logfile",          required_argument, NULL, 'L' },
+        { "rt-priority",      required_argument, NULL, 'R' },
+        { "cpu",              required_argument, NULL, 'C' },
+        { "device",           required_argument, NULL, 'D' },
+        { "odometry",         no_argument,       NULL, 'O' },
+        { "set",              required_argument, NULL, 'o' },
+        { "help",             no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *shortopts = "c:Hntup:lkfmML:R:C:D:Oo:h";
+    char assignment[CONFIG_LINE_MAXLEN];
+    int opt, ret = 0;
+
+    // the config file first, so the flags can override it
+    opterr = 0;
+    while ((opt = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
+        if (opt == 'c') {
+            if (config_load_file(cfg, optarg) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    optind = 1;
+    opterr = 1;
+    while ((opt = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
+        switch (opt) {
+            case 'c': break;
+            case 'H': cfg->headless = 1; break;
+            case 'n': cfg->dummymode = 1; break;
+            case 't': cfg->remotecontrol = 1; cfg->remotecontrolproto = 0; break;
+            case 'u': cfg->remotecontrol = 1; cfg->remotecontrolproto = 1; break;
+            case 'p': ret = config_set(cfg, "port", optarg); break;
+            case 'l': cfg->localcontrol = 1; break;
+            case 'k': cfg->usekcommands = 1; break;
+            case 'f': cfg->readmemmapfromfile = 1; break;
+            case 'm': cfg->refreshmemmap = 1; break;
+            case 'M': cfg->telemetrymulticast = 1; break;
+            case 'L': ret = config_set(cfg, "logfile", optarg); break;
+            case 'R': ret = config_set(cfg, "rt_priority", optarg); break;
+            case 'C': ret = config_set(cfg, "rt_cpu", optarg); break;
+            case 'D': ret = config_set(cfg, "serialdev", optarg); break;
+            case 'O': cfg->odometry = 1; break;
+            case 'o':
+                if (strchr(optarg, '=') == NULL) {
+                    fprintf(stderr, "Invalid option: %s (expected: NAME=VALUE)\n", optarg);
+                    return -1;
+                }
+                snprintf(assignment, sizeof(assignment), "%s", optarg);
+                ret = config_set_assignment(cfg, assignment);
+                break;
+            case 'h':
+                config_usage(argv[0]);
+                return 1;
+            default:
+                config_usage(argv[0]);
+                return -1;
+        }
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    if (optind < argc) {
+        fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_CONFIG_H__
+
+#define __MECACOM_CONFIG_H__
+
+/*
+ Runtime configuration of the commander
+
+ Defaults first, then the config file (-c), then the command line flags.
+ Config file: one "name = value" per line, '#' starts a comment, the names are the same
+ as the fields below (see mecanumcommander.conf for an example).
+*/
+
+#define CONFIG_DEFAULT_PASSWORD   "PASSWORD"
+#define CONFIG_DEFAULT_PORT       3475
+#define CONFIG_DEFAULT_LOGFILE    "mecanumcommander.log"
+#define CONFIG_DEFAULT_SAFESTOP_DEADLINE_MS  20
+
+#define CONFIG_PASSWORD_MAXLEN    64
+#define CONFIG_PATH_MAXLEN        256
+#define CONFIG_LINE_MAXLEN        512
+
+struct commander_config {
+    unsigned char remotecontrol;        // set to 1 to listen on tcp/udp <port> for easy remote control
+    unsigned char remotecontrolproto;   // 0 - TCP, 1 - UDP
+    unsigned char dummymode;            // for testing, do not send real commands to the robot
+    unsigned char keyboardmode;         // for future use...
+    unsigned char repeatcommands;       // repeat commands every repeat_time_cmdsent, so "commandtimeout" on the robot's controller won't trigger
+    unsigned char usekcommands;         // use the "triple command set"
+    unsigned char readmemmapfromfile;   // do not get the memmap from the robot, instead read it from a file
+    char memmapurl[CONFIG_PATH_MAXLEN]; // ... or fetch it from the HTTP API of the rover's Wi-Fi module ("": files)
+    unsigned char localcontrol;         // set to 1 to accept binary setpoints from local processes (unix socket, shared memory)
+    char localsocket[CONFIG_PATH_MAXLEN];   // path of the unix socket (only the same user and root can connect)
+    unsigned char refreshmemmap;        // re-read memmap periodically (on/off - 1/0)
+    unsigned char nolamp_when_setcmd;   // do not blink the "lamps" on the UI when sending set speed commands
+    unsigned char telemetrymulticast;   // push telemetry to the multicast group (on/off - 1/0)
+    unsigned int  telemetrymulticast_period_ms;
+    unsigned int  telemetrymulticast_fields;
+    unsigned char headless;             // no ncurses UI, no terminal I/O (daemon mode)
+    unsigned int  port;
+    char password[CONFIG_PASSWORD_MAXLEN];
+    char logfile[CONFIG_PATH_MAXLEN];
+    double repeat_time_cmdsent;         // sec
+    double repeat_time_kcmdsent;        // sec
+    double remotecmd_validity;          // sec, remote commands have to be repeated within this time
+    double memmapread_period;           // sec
+    int rt_priority;                    // real-time mode: SCHED_FIFO priority of the control loop (0: off)
+    int rt_cpu;                         // real-time mode: pin the control loop to this CPU (-1: no pinning)
+    char serialdev[CONFIG_PATH_MAXLEN]; // serial port of the robot controller (or pty:, tcp:, http:// transport)
+    unsigned int  serialbaud;           // line speed of a serial port
+    unsigned char faststart;            // identify with a short probe of both controllers instead of a full memmap read
+    unsigned int  probe_timeout_ms;     // ... retried for this long (booting controller)
+    char identitycache[CONFIG_PATH_MAXLEN]; // identity + memmap snapshot, the startup reads are skipped if it matches ("": off)
+    unsigned int  replywait_floor_us;   // the reply waits follow the measured round trips within floor..ceiling
+    unsigned int  replywait_ceiling_us; // ... (floor == ceiling: fixed wait)
+    unsigned int  replywait_gap_floor_us; // ... the wait between the bytes of a reply not below this
+    unsigned char safestop;             // watchdog thread stops the robot when the remote commands time out
+    unsigned int  safestop_deadline_ms; // ... and the stop has to be on the wire within this time
+    unsigned char odometry;             // read the encoders every odometry_period_ms and integrate the pose
+    unsigned int  odometry_period_ms;   // 0: as fast as the serial bus allows
+    double odom_wheel_radius_mm;        // geometry of the robot, 0: the default of the rover type
+    double odom_track_mm;
+    double odom_wheelbase_mm;
+    double odom_counts_per_rev;
+    int           odom_invert;          // bit n: motor n counts backwards (-1: default, 0: none)
+    unsigned char odom_front_main;      // mecanum: 1: M1/M2 (main controller) drive the front wheels, 0: M3/M4
+    double odom_wheel_noise;            // wheel travel error, sqrt(m)
+    unsigned int  clocksync_period_ms;  // read the uptime this often for the clock sync (if the odometry does not), 0: odometry reads only
+    unsigned int  trajectory_rate_hz;   // trajectory follower: setpoints computed/sent this many times per sec
+    double trajectory_gain;             // 1/s, feedback gain of the waypoints and the closed loop
+    unsigned int  trajectory_lease_ms;  // a trajectory is aborted if its sender is silent for this long
+    unsigned int  trajectory_max_sec;   // ... or when it has been running for this long
+};
+
+void config_defaults(struct commander_config *cfg);
+// returns -1 if the file cannot be read or has an invalid line (reported on stderr)
+int  config_load_file(struct commander_config *cfg, const char *path);
+// loads the config file given with -c first, returns -1 on error, 1 if only the usage was printed
+int  config_parse_args(struct commander_config *cfg, int argc, char **argv);
+
+#endif
@@ -0,0 +1,415 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "mecanumcommander_local.h"
+
+
+int localctl_init(struct localctl *lc, const char *path) {
+
+    struct sockaddr_un addr;
+    int i;
+
+    memset(lc, 0, sizeof(struct localctl));
+    for (i = 0; i < LOCALCTL_CLIENTS_MAX; i++) {
+        lc->clientfds[i] = -1;
+    }
+    lc->trajectory_fd = -1;
+
+    lc->listenfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lc->listenfd == -1) {
+        perror("socket(AF_UNIX)");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);  // left there by a previous run
+    if (bind(lc->listenfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("bind(unix socket)");
+        return -1;
+    }
+    // not for everyone: setting the speed of the robot is as much as owning the commander
+    if (chmod(path, S_IRUSR | S_IWUSR) == -1) {
+        perror("chmod(unix socket)");
+        return -1;
+    }
+    if (listen(lc->listenfd, LOCALCTL_CLIENTS_MAX) == -1) {
+        perror("listen(unix socket)");
+        return -1;
+    }
+
+    // the shared memory mailbox and its doorbell
+    lc->shmfd = memfd_create("mecanumcommander-mailbox", MFD_CLOEXEC);
+    if (lc->shmfd == -1) {
+        perror("memfd_create()");
+        return -1;
+    }
+    if (ftruncate(lc->shmfd, sizeof(struct localctl_shm)) == -1) {
+        perror("ftruncate(memfd)");
+        return -1;
+    }
+    lc->shm = mmap(NULL, sizeof(struct localctl_shm), PROT_READ | PROT_WRITE, MAP_SHARED, lc->shmfd, 0);
+    if (lc->shm == MAP_FAILED) {
+        perror("mmap(memfd)");
+        return -1;
+    }
+    lc->shm->magic = LOCALCTL_SHM_MAGIC;
+
+    lc->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (lc->eventfd == -1) {
+        perror("eventfd()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void localctl_close(struct localctl *lc, const char *path) {
+
+    int i;
+
+    for (i = 0; i < LOCALCTL_CLIENTS_MAX; i++) {
+        if (lc->clientfds[i] != -1) {
+            close(lc->clientfds[i]);
+        }
+    }
+    close(lc->listenfd);
+    unlink(path);
+    munmap(lc->shm, sizeof(struct localctl_shm));
+    close(lc->shmfd);
+    close(lc->eventfd);
+}
+
+
+int localctl_fdset(struct localctl *lc, fd_set *set, int maxfd) {
+
+    int i;
+
+    FD_SET(lc->listenfd, set);
+    if (lc->listenfd > maxfd) { maxfd = lc->listenfd; }
+    FD_SET(lc->eventfd, set);
+    if (lc->eventfd > maxfd) { maxfd = lc->eventfd; }
+
+    for (i = 0; i < LOCALCTL_CLIENTS_MAX; i++) {
+        if (lc->clientfds[i] != -1) {
+            FD_SET(lc->clientfds[i], set);
+            if (lc->clientfds[i] > maxfd) { maxfd = lc->clientfds[i]; }
+        }
+    }
+
+    return maxfd;
+}
+
+
+// reply to LOCALCTL_TYPE_SHM_REQUEST: the memfd and the eventfd
+static int localctl_send_shm_fds(struct localctl *lc, int clientfd) {
+
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    unsigned char reply[4] = { 0, 0, LOCALCTL_TYPE_SHM_REQUEST, 0 };
+    int fds[2] = { lc->shmfd, lc->eventfd };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = reply;
+    iov.iov_len  = sizeof(reply);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(clientfd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+
+int localctl_process(struct localctl *lc, fd_set *set, struct remote_mailbox *mailbox) {
+
+    struct remote_setpoint sp;
+    struct remote_trajectory trj;
+    unsigned char msgbuf[LOCALCTL_MSG_MAXLEN];
+    uint64_t doorbell;
+    struct ucred cred;
+    socklen_t credlen;
+    int i, fd, msglen, count = 0;
+
+    if (FD_ISSET(lc->listenfd, set)) {
+        fd = accept4(lc->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        // the file mode is set after bind(), so the peer is checked as well
+        credlen = sizeof(cred);
+        if ((fd != -1) && ((getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == -1) ||
+                           ((cred.uid != geteuid()) && (cred.uid != 0)))) {
+            close(fd);
+            fd = -1;
+            lc->rejected++;
+        }
+        if (fd != -1) {
+            for (i = 0; i < LOCALCTL_CLIENTS_MAX; i++) {
+                if (lc->clientfds[i] == -1) {
+                    lc->clientfds[i] = fd;
+                    break;
+                }
+            }
+            if (i == LOCALCTL_CLIENTS_MAX) {
+                close(fd);  // too many clients
+            }
+        }
+    }
+
+    for (i = 0; i < LOCALCTL_CLIENTS_MAX; i++) {
+
+        fd = lc->clientfds[i];
+        if ((fd == -1) || (FD_ISSET(fd, set) == 0)) {
+            continue;
+        }
+
+        // every message is a whole setpoint, all of them are read (the latest wins in the mailbox)
+        while ((msglen = recv(fd, msgbuf, sizeof(msgbuf), MSG_DONTWAIT)) > 0) {
+            if (fd == lc->trajectory_fd) {
+                lc->trajectory_alive = 1;
+            }
+            if ((msglen >= 3) && (msgbuf[2] == LOCALCTL_TYPE_KEEPALIVE)) {
+                continue;
+            }
+            if ((msglen >= 3) && (msgbuf[2] == LOCALCTL_TYPE_SHM_REQUEST)) {
+                localctl_send_shm_fds(lc, fd);
+                continue;
+            }
+            if (remotebin_is_trajectory(msgbuf, msglen)) {
+                if (remotebin_unpack_trajectory(msgbuf, msglen, &trj) == REMOTEBIN_OK) {
+                    remote_mailbox_post_trajectory(mailbox, &trj);
+                    lc->trajectory_fd = fd;
+                    lc->trajectory_posted = 1;
+                    lc->received++;
+                    count++;
+                }
+                continue;
+            }
+            if (remotebin_unpack_setpoint(msgbuf, msglen, &sp) != REMOTEBIN_OK) {
+                continue;
+            }
+            remote_mailbox_post_setpoint(mailbox, &sp);
+            lc->received++;
+            count++;
+        }
+
+        if ((msglen == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+            close(fd);  // the client is gone
+            lc->clientfds[i] = -1;
+            if (fd == lc->trajectory_fd) {
+                lc->trajectory_fd = -1;     // its trajectory is not renewed any more
+            }
+        }
+    }
+
+    // doorbell - the shared memory is checked in every iteration anyway
+    if (FD_ISSET(lc->eventfd, set)) {
+        read(lc->eventfd, &doorbell, sizeof(doorbell));
+    }
+    if (localctl_shm_read(lc->shm, &sp, &lc->shm_seq_seen) == 1) {
+        remote_mailbox_post_setpoint(mailbox, &sp);
+        lc->received_shm++;
+        count++;
+    }
+
+    return count;
+}
+
+
+int localctl_connect(const char *path) {
+
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket(AF_UNIX)");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("connect(unix socket)");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int localctl_send_setpoint(int fd, const struct remote_setpoint *sp) {
+
+    unsigned char packet[REMOTEBIN_SETPOINT_LEN];
+
+    remotebin_encode_setpoint(sp, packet);
+
+    return send(fd, packet, REMOTEBIN_SETPOINT_LEN, MSG_NOSIGNAL);
+}
+
+
+int localctl_send_trajectory(int fd, const struct remote_trajectory *trj) {
+
+    unsigned char packet[REMOTEBIN_TRAJECTORY_MAXLEN];
+    int len;
+
+    len = remotebin_encode_trajectory(trj, packet);
+
+    return send(fd, packet, len, MSG_NOSIGNAL);
+}
+
+
+int localctl_send_keepalive(int fd) {
+
+    unsigned char packet[4] = { 0, 0, LOCALCTL_TYPE_KEEPALIVE, 0 };
+
+    return send(fd, packet, sizeof(packet), MSG_NOSIGNAL);
+}
+
+
+int localctl_request_shm(int fd, struct localctl_shm **shm, int *eventfd) {
+
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    unsigned char request[4] = { 0, 0, LOCALCTL_TYPE_SHM_REQUEST, 0 };
+    unsigned char reply[4];
+    int fds[2];
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+
+    if (send(fd, request, sizeof(request), MSG_NOSIGNAL) == -1) {
+        perror("send(shm request)");
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = reply;
+    iov.iov_len  = sizeof(reply);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) == -1) {
+        perror("recvmsg(shm fds)");
+        return -1;
+    }
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if ((cmsg == NULL) || (cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    *shm = mmap(NULL, sizeof(struct localctl_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (*shm == MAP_FAILED) {
+        perror("mmap(shm)");
+        close(fds[1]);
+        return -1;
+    }
+    if ((*shm)->magic != LOCALCTL_SHM_MAGIC) {
+        munmap(*shm, sizeof(struct localctl_shm));
+        close(fds[1]);
+        return -1;
+    }
+    *eventfd = fds[1];
+
+    return 0;
+}
+
+
+// single writer
+void localctl_shm_post(struct localctl_shm *shm, int eventfd, const struct remote_setpoint *sp) {
+
+    uint64_t doorbell = 1;
+    uint32_t seq;
+    int i;
+
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (i = 0; i < REMOTECMD_AXES; i++) {
+        __atomic_store_n(&shm->speed[i], sp->speed[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&shm->flags, sp->flags, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->deadline_ms, sp->deadline_ms, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+
+    if (eventfd != -1) {
+        write(eventfd, &doorbell, sizeof(doorbell));
+    }
+}
+
+
+int localctl_shm_read(struct localctl_shm *shm, struct remote_setpoint *sp, uint32_t *seq) {
+
+    uint32_t seq1, seq2;
+    int i, tries;
+
+    for (tries = 0; tries < LOCALCTL_SHM_RETRIES; tries++) {
+
+        seq1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq1 == *seq) {
+            return 0;
+        }
+        if (seq1 & 1) {
+            continue;  // the writer is updating it right now
+        }
+
+        for (i = 0; i < REMOTECMD_AXES; i++) {
+            sp->speed[i] = __atomic_load_n(&shm->speed[i], __ATOMIC_RELAXED);
+        }
+        sp->flags       = __atomic_load_n(&shm->flags, __ATOMIC_RELAXED);
+        sp->deadline_ms = __atomic_load_n(&shm->deadline_ms, __ATOMIC_RELAXED);
+        sp->packetno    = seq1 >> 1;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+        if (seq1 == seq2) {
+            *seq = seq1;
+            for (i = 0; i < REMOTECMD_AXES; i++) {
+                if ((sp->speed[i] < -REMOTECMD_SETPOINT_LIMIT) || (sp->speed[i] > REMOTECMD_SETPOINT_LIMIT)) {
+                    return -1;
+                }
+            }
+            return 1;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,86 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_LOCAL_H__
+
+#define __MECACOM_LOCAL_H__
+
+#include <stdint.h>
+#include <sys/select.h>
+#include "mecanumcommander_remote.h"
+
+/*
+ Local control endpoint for processes running on the same host
+
+ 1. SOCK_SEQPACKET unix socket (LOCALCTL_SOCKET_PATH): every message is one binary setpoint or trajectory
+    (see mecanumcommander_remote.h), the CRC is not checked, the packet number is not used.
+
+ 2. Shared memory mailbox: send a LOCALCTL_TYPE_SHM_REQUEST message on the socket, the reply
+    carries the memfd of struct localctl_shm and an eventfd (SCM_RIGHTS). The writer updates
+    the mailbox with localctl_shm_post() (seqlock), then writes the eventfd to wake up the commander.
+
+ Both have to be refreshed within the same time as the network commands, otherwise the robot is stopped.
+ The socket file is made 0600, and a client is only accepted if it runs as the same user as the
+ commander or as root (SO_PEERCRED), anyone else is disconnected right away.
+ A running trajectory needs any message (e.g. LOCALCTL_TYPE_KEEPALIVE) from the client which sent it
+ within trajectory_lease_ms, otherwise it is aborted.
+*/
+
+#define LOCALCTL_SOCKET_PATH      "/tmp/mecanumcommander.sock"
+#define LOCALCTL_CLIENTS_MAX      4
+#define LOCALCTL_MSG_MAXLEN       REMOTEBIN_TRAJECTORY_MAXLEN
+
+#define LOCALCTL_TYPE_SHM_REQUEST 0xB3  // message: 0-1 unused, 2 type, 3 unused
+#define LOCALCTL_TYPE_KEEPALIVE   0xB5  // message: 0-1 unused, 2 type, 3 unused - renews the lease of the running trajectory
+#define LOCALCTL_SHM_MAGIC        0x4D434D42  // "MCMB"
+#define LOCALCTL_SHM_RETRIES      100   // reader gives up if the writer is still updating after this many tries
+
+struct localctl_shm {
+    uint32_t magic;
+    uint32_t seq;                       // seqlock: odd while the writer is updating, +2 for every new setpoint
+    int16_t  speed[REMOTECMD_AXES];     // indexed by REMOTECMD_AXIS_*
+    uint8_t  flags;                     // REMOTEBIN_FLAG_*
+    uint8_t  reserved;
+    uint16_t deadline_ms;
+};
+
+struct localctl {
+    int listenfd;
+    int clientfds[LOCALCTL_CLIENTS_MAX];   // -1: free
+    int shmfd;
+    int eventfd;
+    struct localctl_shm *shm;
+    uint32_t shm_seq_seen;
+    unsigned long received;                // setpoints through the socket
+    unsigned long received_shm;            // setpoints through the shared memory
+    unsigned long rejected;                // connections of other users
+    int trajectory_fd;                     // the client which sent the last trajectory (-1: none)
+    unsigned char trajectory_posted;       // a trajectory was posted to the mailbox (cleared by the caller)
+    unsigned char trajectory_alive;        // a message arrived from trajectory_fd (cleared by the caller)
+};
+
+// commander side
+int  localctl_init(struct localctl *lc, const char *path);
+void localctl_close(struct localctl *lc, const char *path);
+// add the fds to wait for, returns the new max fd
+int  localctl_fdset(struct localctl *lc, fd_set *set, int maxfd);
+// accept/read the clients and check the shared memory, the setpoints (and trajectories) are posted to the mailbox
+// returns the number of messages received
+int  localctl_process(struct localctl *lc, fd_set *set, struct remote_mailbox *mailbox);
+
+// client side
+int  localctl_connect(const char *path);
+int  localctl_send_setpoint(int fd, const struct remote_setpoint *sp);
+int  localctl_send_trajectory(int fd, const struct remote_trajectory *trj);
+int  localctl_send_keepalive(int fd);
+int  localctl_request_shm(int fd, struct localctl_shm **shm, int *eventfd);
+void localctl_shm_post(struct localctl_shm *shm, int eventfd, const struct remote_setpoint *sp);
+// returns 1 if there is a new setpoint since *seq, 0 if not, -1 if it could not be read consistently
+int  localctl_shm_read(struct localctl_shm *shm, struct remote_setpoint *sp, uint32_t *seq);
+
+#endif
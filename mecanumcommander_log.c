@@ -0,0 +1,120 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "mecanumcommander_log.h"
+
+struct log_ring {
+    char lines[LOG_RING_SLOTS][LOG_LINE_MAXLEN];
+    unsigned int lens[LOG_RING_SLOTS];
+    unsigned long head;     // written by the producer
+    unsigned long tail;     // written by the logger thread
+    unsigned long dropped;
+    int logfd;
+    unsigned char running;
+    unsigned char stop;
+    pthread_t thread;
+};
+
+static struct log_ring logring;
+
+
+static void log_ring_drain() {
+    unsigned long head, tail;
+    int slot;
+
+    head = __atomic_load_n(&logring.head, __ATOMIC_ACQUIRE);
+    tail = logring.tail;
+    while (tail != head) {
+        slot = tail % LOG_RING_SLOTS;
+        write(logring.logfd, logring.lines[slot], logring.lens[slot]);
+        tail++;
+        __atomic_store_n(&logring.tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+
+static void *log_ring_thread(void *arg) {
+    (void)arg;
+
+    while (__atomic_load_n(&logring.stop, __ATOMIC_ACQUIRE) == 0) {
+        log_ring_drain();
+        usleep(LOG_RING_FLUSH_USEC);
+    }
+    log_ring_drain();
+
+    return NULL;
+}
+
+
+void logmsg(int logfd, double time_start, const char *msg) {
+    double time_curr;
+    char logmsg[1024];
+    struct timeval timestruct;
+    unsigned long head;
+    int slot, len;
+
+    gettimeofday(&timestruct, NULL);
+    time_curr = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+
+    if (logring.running == 1) {
+        head = logring.head;
+        if ((head - __atomic_load_n(&logring.tail, __ATOMIC_ACQUIRE)) >= LOG_RING_SLOTS) {
+            logring.dropped++;
+            return;
+        }
+        slot = head % LOG_RING_SLOTS;
+        len = snprintf(logring.lines[slot], LOG_LINE_MAXLEN, "%9.3f %s\n", time_curr - time_start, msg);
+        if (len >= LOG_LINE_MAXLEN) { // truncated, but still one line
+            len = LOG_LINE_MAXLEN - 1;
+            logring.lines[slot][len - 1] = '\n';
+        }
+        logring.lens[slot] = len;
+        __atomic_store_n(&logring.head, head + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    sprintf(logmsg, "%9.3f %s\n", time_curr - time_start, msg);
+    write(logfd, logmsg, strlen(logmsg));
+}
+
+
+int log_ring_start(int logfd) {
+
+    logring.logfd = logfd;
+    logring.head = 0;
+    logring.tail = 0;
+    logring.dropped = 0;
+    logring.stop = 0;
+
+    if (pthread_create(&logring.thread, NULL, log_ring_thread, NULL) != 0) {
+        perror("pthread_create(logger)");
+        return -1;
+    }
+    logring.running = 1;
+
+    return 0;
+}
+
+
+unsigned long log_ring_stop() {
+
+    if (logring.running == 0) {
+        return 0;
+    }
+
+    __atomic_store_n(&logring.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(logring.thread, NULL);
+    logring.running = 0;
+
+    return logring.dropped;
+}
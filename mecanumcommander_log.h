@@ -0,0 +1,33 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_LOG_H__
+
+#define __MECACOM_LOG_H__
+
+/*
+ Log file of the commander
+
+ By default logmsg() writes the line to the file right away. After log_ring_start() the lines are
+ formatted into a fixed ring buffer (no allocation, no syscall besides the clock) and a logger thread
+ writes them out, so the control loop never waits for the disk. The ring has a single producer:
+ only the control loop thread may call logmsg() then. When the ring is full, lines are dropped and
+ counted.
+*/
+
+#define LOG_RING_SLOTS       512
+#define LOG_LINE_MAXLEN      320
+#define LOG_RING_FLUSH_USEC  20000   // the logger thread wakes up this often
+
+void logmsg(int logfd, double time_start, const char *msg);
+
+int  log_ring_start(int logfd);
+// writes out the rest, returns the number of dropped lines
+unsigned long log_ring_stop();
+
+#endif
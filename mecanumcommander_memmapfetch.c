@@ -0,0 +1,141 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "mecanumcommander_rt.h"
+#include "mecanumcommander_memmapfetch.h"
+
+
+static void *memmapfetch_thread(void *arg) {
+
+    struct memmapfetch *mf = arg;
+    unsigned char memmap_main[512], memmap_second[512];
+    struct timespec ts;
+    double next;
+    int ret;
+
+    next = rt_now();
+
+    pthread_mutex_lock(&mf->lock);
+    while (mf->stop == 0) {
+        pthread_mutex_unlock(&mf->lock);
+
+        ret = rover_memmapfetch_read(&mf->http, mf->controller_main, mf->controller_second, memmap_main, memmap_second, MEMMAPFETCH_TIMEOUT_MS);
+
+        pthread_mutex_lock(&mf->lock);
+        if (ret == 0) {
+            memcpy(mf->memmap_main, memmap_main, 512);
+            memcpy(mf->memmap_second, memmap_second, 512);
+            mf->snapshots++;
+            mf->time_snapshot = rt_now();
+        }
+
+        // a fetch longer than the period is followed by the next one right away
+        next += mf->period;
+        if (next < rt_now()) {
+            next = rt_now();
+        }
+        ts.tv_sec  = (time_t)next;
+        ts.tv_nsec = (long)((next - ts.tv_sec) * 1000000000.0);
+        while ((mf->stop == 0) && (pthread_cond_timedwait(&mf->cond, &mf->lock, &ts) == 0)) {}
+    }
+    pthread_mutex_unlock(&mf->lock);
+
+    return NULL;
+}
+
+
+int memmapfetch_init(struct memmapfetch *mf, const char *url, double period) {
+
+    memset(mf, 0, sizeof(struct memmapfetch));
+    mf->period = period;
+
+    return rover_memmapfetch_open(&mf->http, url);
+}
+
+
+int memmapfetch_once(struct memmapfetch *mf, unsigned char controller_main, unsigned char controller_second,
+                     unsigned char *memmap_main, unsigned char *memmap_second) {
+
+    int tries;
+
+    for (tries = 0; tries < MEMMAPFETCH_TRIES; tries++) {
+        if (rover_memmapfetch_read(&mf->http, controller_main, controller_second, memmap_main, memmap_second, MEMMAPFETCH_TIMEOUT_MS) == 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+int memmapfetch_start(struct memmapfetch *mf, unsigned char controller_main, unsigned char controller_second) {
+
+    pthread_condattr_t condattr;
+    int ret;
+
+    mf->controller_main = controller_main;
+    mf->controller_second = controller_second;
+    mf->stop = 0;
+
+    pthread_mutex_init(&mf->lock, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mf->cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    ret = pthread_create(&mf->thread, NULL, memmapfetch_thread, mf);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_create(memmapfetch): %s\n", strerror(ret));
+        pthread_cond_destroy(&mf->cond);
+        pthread_mutex_destroy(&mf->lock);
+        return -1;
+    }
+    mf->running = 1;
+
+    return 0;
+}
+
+
+int memmapfetch_get(struct memmapfetch *mf, unsigned char *memmap_main, unsigned char *memmap_second) {
+
+    int ret = 0;
+
+    pthread_mutex_lock(&mf->lock);
+    if (mf->snapshots != mf->taken) {
+        memcpy(memmap_main, mf->memmap_main, 512);
+        if (mf->controller_second != 0) {
+            memcpy(memmap_second, mf->memmap_second, 512);
+        }
+        mf->taken = mf->snapshots;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&mf->lock);
+
+    return ret;
+}
+
+
+void memmapfetch_close(struct memmapfetch *mf) {
+
+    if (mf->running == 1) {
+        pthread_mutex_lock(&mf->lock);
+        mf->stop = 1;
+        pthread_cond_signal(&mf->cond);
+        pthread_mutex_unlock(&mf->lock);
+        pthread_join(mf->thread, NULL);
+        pthread_cond_destroy(&mf->cond);
+        pthread_mutex_destroy(&mf->lock);
+        mf->running = 0;
+    }
+
+    rover_memmapfetch_close(&mf->http);
+}
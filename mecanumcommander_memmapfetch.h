@@ -0,0 +1,55 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_MEMMAPFETCH_H__
+
+#define __MECACOM_MEMMAPFETCH_H__
+
+#include <pthread.h>
+#include "mecanumrover_memmapfetch.h"
+
+/*
+ Memmaps over Wi-Fi (-f with memmapurl), instead of memmapupdate_via_wifi.sh and the memmap files
+
+ A thread fetches the memmaps every period (rover_memmapfetch_read()), so a slow Wi-Fi link does not hold up
+ the control loop, which takes the latest intact snapshot when it would read the memmap files.
+*/
+
+#define MEMMAPFETCH_TIMEOUT_MS  1000
+#define MEMMAPFETCH_TRIES       3       // memmapfetch_once()
+
+struct memmapfetch {
+    pthread_t thread;
+    pthread_mutex_t lock;           // protects everything below
+    pthread_cond_t cond;
+    struct rover_memmapfetch http;  // used by the thread only (after memmapfetch_start())
+    unsigned char controller_main;
+    unsigned char controller_second;    // 0: none
+    double period;                  // sec
+    unsigned char running;
+    unsigned char stop;
+    unsigned char memmap_main[512];
+    unsigned char memmap_second[512];
+    unsigned long snapshots;        // the number of the latest snapshot
+    unsigned long taken;            // the snapshot last given by memmapfetch_get()
+    double time_snapshot;           // CLOCK_MONOTONIC sec
+};
+
+// resolve the url (http://HOST[:PORT]), returns -1 on error
+int  memmapfetch_init(struct memmapfetch *mf, const char *url, double period);
+// fetch on the calling thread (MEMMAPFETCH_TRIES tries), before starting (e.g. to identify the rover), returns 0 or -1
+int  memmapfetch_once(struct memmapfetch *mf, unsigned char controller_main, unsigned char controller_second,
+                      unsigned char *memmap_main, unsigned char *memmap_second);
+// start fetching every period on the thread, returns -1 on error
+int  memmapfetch_start(struct memmapfetch *mf, unsigned char controller_main, unsigned char controller_second);
+// copy the latest snapshot if there is a new one since the last call, returns 1 if copied, 0 if not
+int  memmapfetch_get(struct memmapfetch *mf, unsigned char *memmap_main, unsigned char *memmap_second);
+// stops the thread, can be called more than once
+void memmapfetch_close(struct memmapfetch *mf);
+
+#endif
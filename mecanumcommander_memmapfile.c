@@ -0,0 +1,140 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "mecanumcommander_memmapfile.h"
+
+
+int memmapfile_init(struct memmapfile *mf) {
+
+    memset(mf, 0, sizeof(struct memmapfile));
+
+    mf->inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mf->inotifyfd == -1) {
+        perror("inotify_init1()");
+        return -1;
+    }
+
+    // symlink swapped (ln -sf: new link renamed over the old one, or unlinked and created), file moved there or written in place
+    if (inotify_add_watch(mf->inotifyfd, ".", IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE) == -1) {
+        perror("inotify_add_watch()");
+        close(mf->inotifyfd);
+        mf->inotifyfd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int memmapfile_load(struct memmapfile *mf, const char *path, unsigned char *memmap) {
+
+    struct stat st;
+    unsigned char data[MEMMAPFILE_LEN + 1];
+    ssize_t len;
+    int fd, i;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        mf->rejected++;
+        return -1;
+    }
+    if ((fstat(fd, &st) == -1) || (st.st_size != MEMMAPFILE_LEN)) {
+        close(fd);
+        mf->rejected++;
+        return -1;
+    }
+    // a copy: a mapping of a file truncated in place by its producer would raise SIGBUS
+    // (one byte more is asked for, so a file which grew since the fstat() is not taken either)
+    len = pread(fd, data, sizeof(data), 0);
+    close(fd);
+    if (len != MEMMAPFILE_LEN) {
+        mf->rejected++;
+        return -1;
+    }
+
+    for (i = 0; i < 512; i++) {
+        if (!(((data[i] >= '0') && (data[i] <= '9')) || ((data[i] >= 'A') && (data[i] <= 'F')))) {
+            break;
+        }
+    }
+    if ((i < 512) || (data[512] != '\r') || (data[513] != '\n')) {
+        mf->rejected++;
+        return -1;
+    }
+
+    memcpy(memmap, data, 512);
+    mf->loads++;
+
+    return 0;
+}
+
+
+int memmapfile_load_all(struct memmapfile *mf, unsigned char *main, unsigned char *second) {
+
+    int updated = 0;
+
+    if (memmapfile_load(mf, MEMMAPFILE_MAIN, main) == 0) {
+        updated |= MEMMAPFILE_UPDATED_MAIN;
+    }
+    if ((second != NULL) && (memmapfile_load(mf, MEMMAPFILE_SECOND, second) == 0)) {
+        updated |= MEMMAPFILE_UPDATED_SECOND;
+    }
+
+    return updated;
+}
+
+
+int memmapfile_events(struct memmapfile *mf, unsigned char *main, unsigned char *second) {
+
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct stat st;
+    int len, pos, changed = 0, updated = 0;
+
+    // several swaps since the last call: only the current files are loaded, once
+    while ((len = read(mf->inotifyfd, buffer, sizeof(buffer))) > 0) {
+        for (pos = 0; pos < len; pos += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)&buffer[pos];
+            if (event->len == 0) {
+                continue;
+            }
+            // a regular file being created is still empty, it is loaded when closed after writing
+            if ((event->mask & IN_CREATE) && ((lstat(event->name, &st) == -1) || (!S_ISLNK(st.st_mode)))) {
+                continue;
+            }
+            if (strcmp(event->name, MEMMAPFILE_MAIN) == 0) {
+                changed |= MEMMAPFILE_UPDATED_MAIN;
+            } else if (strcmp(event->name, MEMMAPFILE_SECOND) == 0) {
+                changed |= MEMMAPFILE_UPDATED_SECOND;
+            }
+        }
+    }
+
+    if ((changed & MEMMAPFILE_UPDATED_MAIN) && (memmapfile_load(mf, MEMMAPFILE_MAIN, main) == 0)) {
+        updated |= MEMMAPFILE_UPDATED_MAIN;
+    }
+    if ((changed & MEMMAPFILE_UPDATED_SECOND) && (second != NULL) && (memmapfile_load(mf, MEMMAPFILE_SECOND, second) == 0)) {
+        updated |= MEMMAPFILE_UPDATED_SECOND;
+    }
+
+    return updated;
+}
+
+
+void memmapfile_close(struct memmapfile *mf) {
+    if (mf->inotifyfd != -1) {
+        close(mf->inotifyfd);
+        mf->inotifyfd = -1;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_MEMMAPFILE_H__
+
+#define __MECACOM_MEMMAPFILE_H__
+
+#include "mecanumrover_commlib.h"
+
+/*
+ Memmap files (-f): memmap_0x10.dat, memmap_0x1F.dat in the working directory, e.g. symlinks swapped by
+ memmapupdate_via_wifi.sh, or written by any other producer
+
+ The directory is watched with inotify, a file is only loaded when its name was (re)linked, moved there or
+ closed after writing, so nothing is read while nothing changes, and a new file is picked up right away.
+ The file is read with one pread() (a mapping would SIGBUS if the file was truncated in place) and checked
+ (512 hex digits + "\r\n", as the script checks it) before it is copied into the memmap, a partial or
+ broken file never replaces the last good one.
+ Without inotify the files are loaded every memmapread_period, with the same checks.
+*/
+
+#define MEMMAPFILE_MAIN     "memmap_0x10.dat"
+#define MEMMAPFILE_SECOND   "memmap_0x1F.dat"
+#define MEMMAPFILE_LEN      514
+
+#define MEMMAPFILE_UPDATED_MAIN     0x01
+#define MEMMAPFILE_UPDATED_SECOND   0x02
+
+struct memmapfile {
+    int inotifyfd;          // -1: not watched, polled
+    unsigned long loads;    // memmaps updated
+    unsigned long rejected; // missing, short or broken files
+};
+
+// start watching the working directory, returns 0, -1 if inotify is not available (the files have to be polled)
+int  memmapfile_init(struct memmapfile *mf);
+// load one file into memmap (512 bytes) if it is intact, returns 0 or -1
+int  memmapfile_load(struct memmapfile *mf, const char *path, unsigned char *memmap);
+// load both files (the second only if second is not NULL), returns MEMMAPFILE_UPDATED_* of the loaded ones
+int  memmapfile_load_all(struct memmapfile *mf, unsigned char *main, unsigned char *second);
+// inotifyfd is readable: load the files that changed, returns MEMMAPFILE_UPDATED_* of the loaded ones
+int  memmapfile_events(struct memmapfile *mf, unsigned char *main, unsigned char *second);
+void memmapfile_close(struct memmapfile *mf);
+
+#endif
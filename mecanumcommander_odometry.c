@@ -0,0 +1,213 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <string.h>
+#include <math.h>
+#include "mecanumrover_commlib.h"
+#include "mecanumcommander_rt.h"
+#include "mecanumcommander_odometry.h"
+
+// nominal values, see mecanumcommander_odometry.h
+//                                                        radius  track  wheelbase  counts/rev  invert  front_main
+static const struct odom_geometry odom_geometry_mecanumrover21 = { 0.050, 0.300, 0.300,     4096.0,     0x0A,   0 };
+static const struct odom_geometry odom_geometry_megarover3     = { 0.076, 0.280, 0.000,     4096.0,     0x02,   0 };
+
+
+int odometry_init(struct odometry *odom, struct roverstruct *rover, const struct odom_geometry *geometry, double noise) {
+
+    memset(odom, 0, sizeof(struct odometry));
+
+    switch (rover->sysname) {
+        case SYSNAME_MECANUMROVER21:
+            odom->kinematics = ODOM_MECANUM;
+            odom->wheels = 4;
+            odom->geo = odom_geometry_mecanumrover21;
+            break;
+        case SYSNAME_MEGAROVER3:
+            odom->kinematics = ODOM_DIFFERENTIAL;
+            odom->wheels = 2;
+            odom->geo = odom_geometry_megarover3;
+            break;
+        default:
+            return -1;
+    }
+
+    if (geometry != NULL) {
+        if (geometry->wheel_radius   > 0) { odom->geo.wheel_radius   = geometry->wheel_radius;   }
+        if (geometry->track          > 0) { odom->geo.track          = geometry->track;          }
+        if (geometry->wheelbase      > 0) { odom->geo.wheelbase      = geometry->wheelbase;      }
+        if (geometry->counts_per_rev > 0) { odom->geo.counts_per_rev = geometry->counts_per_rev; }
+        if (geometry->invert        >= 0) { odom->geo.invert         = geometry->invert;         }
+        if (geometry->front_main    != 0) { odom->geo.front_main     = geometry->front_main;     }
+    }
+    odom->noise = noise;
+
+    return 0;
+}
+
+
+int odometry_sample(struct odometry *odom, struct roverstruct *rover) {
+
+    unsigned int encoder[ODOM_WHEELS_MAX];
+    unsigned int uptime_ms;
+    unsigned char controller;
+    unsigned char *memmap;
+    int i, ret;
+
+    // uptime first, the encoders are read right after it
+    odom->uptime_read_start = rt_now();
+    ret = rover_read_register(rover->regs->controller_addr_main, rover->regs->uptime, 4, rover->memmap_main, rover);
+    odom->uptime_read_end = rt_now();
+    if (ret != 0) {
+        odom->readerrors++;
+        return -1;
+    }
+    uptime_ms = read_register_from_memmap(rover->memmap_main, rover->regs->uptime, 4);
+
+    // encoder 0 and 1 are neighbouring registers, one read per controller
+    for (i = 0; i < odom->wheels; i += 2) {
+        controller = (i == 0) ? rover->regs->controller_addr_main : rover->regs->controller_addr_second;
+        memmap     = (i == 0) ? rover->memmap_main : rover->memmap_second;
+        ret = rover_read_register(controller, rover->regs->encodervalue0, 8, memmap, rover);
+        if (ret != 0) {
+            odom->readerrors++;
+            return -1;
+        }
+        encoder[i]     = rover_get_encoder_value0(rover, memmap);
+        encoder[i + 1] = rover_get_encoder_value1(rover, memmap);
+    }
+
+    odometry_update(odom, uptime_ms, encoder);
+
+    return 0;
+}
+
+
+// out = a * b * a^T
+static void odom_sandwich(double a[3][3], double b[3][3], double out[3][3]) {
+    double ab[3][3];
+    int i, j, k;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            ab[i][j] = 0;
+            for (k = 0; k < 3; k++) {
+                ab[i][j] += a[i][k] * b[k][j];
+            }
+        }
+    }
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            out[i][j] = 0;
+            for (k = 0; k < 3; k++) {
+                out[i][j] += ab[i][k] * a[j][k];
+            }
+        }
+    }
+}
+
+
+void odometry_update(struct odometry *odom, unsigned int uptime_ms, const unsigned int *encoder) {
+
+    struct odom_state *st = &odom->state;
+    double travel[ODOM_WHEELS_MAX];
+    double kin[3][ODOM_WHEELS_MAX];     // wheel travel -> body frame motion (dx, dy, dtheta)
+    double du[3], ducov[3][3], f[3][3], g[3][3], fpf[3][3], gug[3][3];
+    double perrev, lever, c, s, dt, var;
+    unsigned int dt_ms;
+    int i, j, w, front, rear;
+
+    if (odom->primed == 0) {
+        memcpy(odom->last_encoder, encoder, sizeof(unsigned int) * odom->wheels);
+        odom->last_uptime_ms = uptime_ms;
+        st->uptime_ms = uptime_ms;
+        odom->primed = 1;
+        return;
+    }
+
+    // modulo 2^32, so the wrap around of the counters does not matter
+    perrev = 2.0 * M_PI * odom->geo.wheel_radius / odom->geo.counts_per_rev;
+    for (w = 0; w < odom->wheels; w++) {
+        travel[w] = (int)(encoder[w] - odom->last_encoder[w]) * perrev;
+        if (odom->geo.invert & (1 << w)) {
+            travel[w] = -travel[w];
+        }
+        odom->last_encoder[w] = encoder[w];
+    }
+    dt_ms = uptime_ms - odom->last_uptime_ms;
+    odom->last_uptime_ms = uptime_ms;
+
+    memset(kin, 0, sizeof(kin));
+    if (odom->kinematics == ODOM_MECANUM) {
+        // left, right wheel of the front and the rear controller
+        front = (odom->geo.front_main == 1) ? 0 : 2;
+        rear  = 2 - front;
+        lever = (odom->geo.track + odom->geo.wheelbase) / 2.0;
+        kin[0][front] =  0.25;          kin[0][front + 1] = 0.25;          kin[0][rear] =  0.25;          kin[0][rear + 1] =  0.25;
+        kin[1][front] = -0.25;          kin[1][front + 1] = 0.25;          kin[1][rear] =  0.25;          kin[1][rear + 1] = -0.25;
+        kin[2][front] = -0.25 / lever;  kin[2][front + 1] = 0.25 / lever;  kin[2][rear] = -0.25 / lever;  kin[2][rear + 1] =  0.25 / lever;
+    } else {
+        // left, right
+        kin[0][0] =  0.5;                    kin[0][1] = 0.5;
+        kin[2][0] = -1.0 / odom->geo.track;  kin[2][1] = 1.0 / odom->geo.track;
+    }
+
+    // body frame motion and its covariance (independent wheel errors)
+    for (i = 0; i < 3; i++) {
+        du[i] = 0;
+        for (w = 0; w < odom->wheels; w++) {
+            du[i] += kin[i][w] * travel[w];
+        }
+        for (j = 0; j < 3; j++) {
+            ducov[i][j] = 0;
+            for (w = 0; w < odom->wheels; w++) {
+                var = odom->noise * odom->noise * fabs(travel[w]);
+                ducov[i][j] += kin[i][w] * var * kin[j][w];
+            }
+        }
+    }
+
+    // integrate at the middle of the arc
+    c = cos(st->theta + du[2] / 2.0);
+    s = sin(st->theta + du[2] / 2.0);
+
+    f[0][0] = 1; f[0][1] = 0; f[0][2] = -s * du[0] - c * du[1];
+    f[1][0] = 0; f[1][1] = 1; f[1][2] =  c * du[0] - s * du[1];
+    f[2][0] = 0; f[2][1] = 0; f[2][2] = 1;
+    g[0][0] = c; g[0][1] = -s; g[0][2] = f[0][2] / 2.0;
+    g[1][0] = s; g[1][1] =  c; g[1][2] = f[1][2] / 2.0;
+    g[2][0] = 0; g[2][1] =  0; g[2][2] = 1;
+
+    st->x += c * du[0] - s * du[1];
+    st->y += s * du[0] + c * du[1];
+    st->theta = atan2(sin(st->theta + du[2]), cos(st->theta + du[2]));
+
+    odom_sandwich(f, st->pose_cov, fpf);
+    odom_sandwich(g, ducov, gug);
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            st->pose_cov[i][j] = fpf[i][j] + gug[i][j];
+        }
+    }
+
+    // two reads within the same ms: the pose is updated, the velocity is kept
+    if (dt_ms > 0) {
+        dt = dt_ms / 1000.0;
+        st->vx    = du[0] / dt;
+        st->vy    = du[1] / dt;
+        st->omega = du[2] / dt;
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                st->twist_cov[i][j] = ducov[i][j] / (dt * dt);
+            }
+        }
+    }
+
+    st->uptime_ms = uptime_ms;
+    st->samples++;
+}
@@ -0,0 +1,82 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_ODOMETRY_H__
+
+#define __MECACOM_ODOMETRY_H__
+
+#include "mecanumrover_commlib.h"
+
+/*
+ Wheel odometry from the encoder registers
+
+ odometry_sample() reads only the uptime and the encoder registers (one short read per register group
+ instead of the full memmaps), so it can run at a much higher rate than the memmap refresh.
+ The encoders are 32 bit counters, the differences are taken modulo 2^32, so they can wrap around.
+
+ Kinematics:
+ - MecanumRover 2.1: 4 mecanum wheels, second controller (0x1F, M3/M4): front left/right, main controller
+   (0x10, M1/M2): rear left/right, as drawn by the UI (odom_front_main = 1 swaps them, the sign of vy
+   depends on it)
+ - MegaRover 3: differential drive, main controller: left/right
+ Pose: x forward, y left, theta counter-clockwise, relative to the pose at start (m, rad).
+ Velocity: in the body frame (m/s, rad/s), from the last two samples.
+ Timestamps: the uptime register of the main controller (ms), the host time of its read is kept for the clock sync.
+
+ Covariance: every wheel's travel has an independent error with variance noise^2 * |travel|
+ (noise in sqrt(m)), it is propagated through the kinematics and the pose integration.
+ Stationary wheels do not add uncertainty.
+
+ The default geometry is nominal, measure your robot (config: odom_* options).
+*/
+
+#define ODOM_DIFFERENTIAL   0
+#define ODOM_MECANUM        1
+
+#define ODOM_WHEELS_MAX     4
+
+struct odom_geometry {
+    double wheel_radius;        // m
+    double track;               // m, distance of the left and right wheels
+    double wheelbase;           // m, distance of the front and rear axles (mecanum only)
+    double counts_per_rev;      // encoder counts per wheel revolution
+    int invert;                 // bit n: count of motor n is negated (mirrored motors on the right side), -1: default
+    unsigned char front_main;   // mecanum: 0: the second controller drives the front wheels, 1: the main controller
+};
+
+struct odom_state {
+    unsigned int uptime_ms;     // timestamp of the sample (rover uptime)
+    double x, y, theta;         // m, m, rad
+    double vx, vy, omega;       // m/s, m/s, rad/s (body frame)
+    double pose_cov[3][3];      // x, y, theta
+    double twist_cov[3][3];     // vx, vy, omega
+    unsigned long samples;
+};
+
+struct odometry {
+    unsigned char kinematics;
+    int wheels;
+    struct odom_geometry geo;
+    double noise;
+    unsigned char primed;                   // the first sample is only the reference
+    unsigned int last_encoder[ODOM_WHEELS_MAX];
+    unsigned int last_uptime_ms;
+    double uptime_read_start;               // host CLOCK_MONOTONIC around the uptime read of the last sample (sec)
+    double uptime_read_end;                 // (for the clock synchronization)
+    struct odom_state state;
+    unsigned long readerrors;
+};
+
+// geometry: NULL or fields set to 0 (invert: -1) use the defaults of the rover type, returns -1 for an unknown rover
+int  odometry_init(struct odometry *odom, struct roverstruct *rover, const struct odom_geometry *geometry, double noise);
+// read the uptime and the encoders, then update, returns 0 on success, -1 on a read error (counted)
+int  odometry_sample(struct odometry *odom, struct roverstruct *rover);
+// integrate the raw encoder counts (motor 0,1 main, 2,3 second controller) read at uptime_ms
+void odometry_update(struct odometry *odom, unsigned int uptime_ms, const unsigned int *encoder);
+
+#endif
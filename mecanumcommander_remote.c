@@ -0,0 +1,958 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "mecanumcommander_remote.h"
+#include "crc16/crc16.h"
+
+
+// adding a new command only needs a new line here (and handling its action in the commander, if it is a new one)
+static const struct remotecmd_def remotecmd_table[] = {
+//    name        action              axis                 min     max    reply_ok        reply_bad
+    { "STOPZERO", REMOTECMD_STOPZERO, 0,                     0,      0,   "OKZERO\r\n",  NULL           },
+    { "RESETALL", REMOTECMD_RESETALL, 0,                     0,      0,   "OKRESET\r\n", NULL           },
+    { "SPX",      REMOTECMD_SETPOINT, REMOTECMD_AXIS_X,   -REMOTECMD_SETPOINT_LIMIT, REMOTECMD_SETPOINT_LIMIT, NULL, "!BADSPX!\r\n" },
+    { "SPY",      REMOTECMD_SETPOINT, REMOTECMD_AXIS_Y,   -REMOTECMD_SETPOINT_LIMIT, REMOTECMD_SETPOINT_LIMIT, NULL, "!BADSPY!\r\n" },
+    { "ROT",      REMOTECMD_SETPOINT, REMOTECMD_AXIS_ROT, -REMOTECMD_SETPOINT_LIMIT, REMOTECMD_SETPOINT_LIMIT, NULL, "!BADROT!\r\n" },
+    { "TLR",      REMOTECMD_TLMPERIOD, 0,                    0,  60000,   "OKTLR\r\n",   "!BADTLR!\r\n" },
+    { "TLF",      REMOTECMD_TLMFIELDS, 0,                    1,  TLM_FIELD_ALL, "OKTLF\r\n", "!BADTLF!\r\n" },
+    { "FRM",      REMOTECMD_FRAMING,   0,                    0,      1,   "OKFRM\r\n",   "!BADFRM!\r\n" },
+    { "KAL",      REMOTECMD_KEEPALIVE, 0,                    0,      0,   "OKKAL\r\n",   "!BADKAL!\r\n" },
+};
+
+#define REMOTECMD_TABLE_LEN   (sizeof(remotecmd_table) / sizeof(remotecmd_table[0]))
+#define REMOTECMD_HASH_BITS   5
+#define REMOTECMD_HASH_SLOTS  (1 << REMOTECMD_HASH_BITS)
+
+// open addressing hash table on the first 3 chars of the command, built on first use
+static unsigned char remotecmd_hash_built = 0;
+static const struct remotecmd_def *remotecmd_hash_def[REMOTECMD_HASH_SLOTS];
+static uint32_t remotecmd_hash_key[REMOTECMD_HASH_SLOTS];
+static uint64_t remotecmd_hash_word[REMOTECMD_HASH_SLOTS];     // the 8 chars of full word commands
+static unsigned char remotecmd_hash_fullword[REMOTECMD_HASH_SLOTS];
+
+
+static inline uint32_t remotecmd_opcode_key(const unsigned char *command) {
+    return command[0] | (command[1] << 8) | (command[2] << 16);
+}
+
+
+static inline unsigned int remotecmd_hash(uint32_t key) {
+    return (key * 0x9E3779B1u) >> (32 - REMOTECMD_HASH_BITS);
+}
+
+
+static void remotecmd_build_hash() {
+    unsigned int i, slot;
+    uint32_t key;
+
+    for (i = 0; i < REMOTECMD_TABLE_LEN; i++) {
+        key = remotecmd_opcode_key((const unsigned char *)remotecmd_table[i].name);
+        for (slot = remotecmd_hash(key); remotecmd_hash_def[slot] != NULL; slot = (slot + 1) % REMOTECMD_HASH_SLOTS) {}
+        remotecmd_hash_def[slot] = &remotecmd_table[i];
+        remotecmd_hash_key[slot] = key;
+        if (strlen(remotecmd_table[i].name) == REMOTECMD_LEN) {
+            memcpy(&remotecmd_hash_word[slot], remotecmd_table[i].name, REMOTECMD_LEN);
+            remotecmd_hash_fullword[slot] = 1;
+        }
+    }
+
+    remotecmd_hash_built = 1;
+}
+
+
+void cmdring_init(struct cmdring *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->scanned = 0;
+    ring->skipping = 0;
+}
+
+
+unsigned int cmdring_used(struct cmdring *ring) {
+    return ring->head - ring->tail;
+}
+
+
+unsigned int cmdring_free(struct cmdring *ring) {
+    return CMDRING_SIZE - (ring->head - ring->tail);
+}
+
+
+int cmdring_read(struct cmdring *ring, int fd) {
+    struct iovec iov[2];
+    unsigned int freebytes, headpos, firstpart;
+    int iovcnt = 1, ret;
+
+    freebytes = cmdring_free(ring);
+    if (freebytes == 0) {
+        return -1;
+    }
+
+    headpos = ring->head & CMDRING_MASK;
+    firstpart = CMDRING_SIZE - headpos;
+    if (firstpart > freebytes) { firstpart = freebytes; }
+
+    iov[0].iov_base = &ring->buf[headpos];
+    iov[0].iov_len  = firstpart;
+    if (firstpart < freebytes) {
+        iov[1].iov_base = &ring->buf[0];
+        iov[1].iov_len  = freebytes - firstpart;
+        iovcnt = 2;
+    }
+
+    ret = readv(fd, iov, iovcnt);
+    if (ret > 0) {
+        ring->head += ret;
+    }
+
+    return ret;
+}
+
+
+int cmdring_put(struct cmdring *ring, const unsigned char *data, unsigned int len) {
+    unsigned int i;
+
+    if (len > cmdring_free(ring)) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        ring->buf[(ring->head + i) & CMDRING_MASK] = data[i];
+    }
+    ring->head += len;
+
+    return 0;
+}
+
+
+int cmdring_next_line(struct cmdring *ring, unsigned char **line) {
+    unsigned int pos, linelen, tailpos, i;
+    unsigned char c;
+
+    while ((ring->tail + ring->scanned) != ring->head) {
+
+        pos = ring->tail + ring->scanned;
+        c = ring->buf[pos & CMDRING_MASK];
+
+        if ((c == '\n') || (c == '\r')) {
+
+            if (ring->skipping == 1) { // end of the overlong line, which was already reported
+                ring->skipping = 0;
+                ring->tail = pos + 1;
+                ring->scanned = 0;
+                continue;
+            }
+
+            linelen = ring->scanned;
+            tailpos = ring->tail & CMDRING_MASK;
+
+            if ((tailpos + linelen) < CMDRING_SIZE) {
+                // the terminator is right after the line, so it can be parsed in place
+                ring->buf[tailpos + linelen] = 0;
+                *line = &ring->buf[tailpos];
+            } else {
+                for (i = 0; i < linelen; i++) {
+                    ring->line[i] = ring->buf[(ring->tail + i) & CMDRING_MASK];
+                }
+                ring->line[linelen] = 0;
+                *line = ring->line;
+            }
+
+            ring->tail = pos + 1;
+            ring->scanned = 0;
+            return linelen;
+        }
+
+        if (ring->skipping == 1) {
+            ring->tail++;
+            continue;
+        }
+
+        ring->scanned++;
+        if (ring->scanned > CMDRING_MAXLINE) {
+            ring->skipping = 1;
+            ring->tail += ring->scanned;
+            ring->scanned = 0;
+            return CMDRING_OVERLONG;
+        }
+
+    }
+
+    return CMDRING_NOLINE;
+}
+
+
+// fixed width signed decimal: optional leading spaces, optional sign, then only digits until the end
+int remotecmd_parse_decimal(const unsigned char *digits, int len, int *value) {
+    int i = 0, negative = 0, num = 0;
+
+    while ((i < len) && (digits[i] == ' ')) { i++; }
+    if (i < len) {
+        if (digits[i] == '-') { negative = 1; i++; }
+        else if (digits[i] == '+') { i++; }
+    }
+    if (i == len) {
+        return -1;
+    }
+
+    for (; i < len; i++) {
+        if ((unsigned char)(digits[i] - '0') > 9) {
+            return -1;
+        }
+        num = num * 10 + (digits[i] - '0');
+    }
+
+    *value = negative ? -num : num;
+
+    return 0;
+}
+
+
+int remotecmd_decode(const unsigned char *command, int commandlen, struct remotecmd *rcmd) {
+    const struct remotecmd_def *def;
+    unsigned int slot;
+    uint32_t key;
+    uint64_t word;
+
+    rcmd->def = NULL;
+    rcmd->value = 0;
+
+    if (commandlen != REMOTECMD_LEN) {
+        return REMOTECMD_UNKNOWN;
+    }
+
+    if (remotecmd_hash_built == 0) {
+        remotecmd_build_hash();
+    }
+
+    key = remotecmd_opcode_key(command);
+    for (slot = remotecmd_hash(key); remotecmd_hash_def[slot] != NULL; slot = (slot + 1) % REMOTECMD_HASH_SLOTS) {
+        if (remotecmd_hash_key[slot] == key) {
+            break;
+        }
+    }
+    def = remotecmd_hash_def[slot];
+    if (def == NULL) {
+        return REMOTECMD_UNKNOWN;
+    }
+
+    if (remotecmd_hash_fullword[slot] == 1) { // the whole word has to match
+        memcpy(&word, command, REMOTECMD_LEN);
+        if (word != remotecmd_hash_word[slot]) {
+            return REMOTECMD_UNKNOWN;
+        }
+        rcmd->def = def;
+        return REMOTECMD_OK;
+    }
+
+    rcmd->def = def;
+    if ((remotecmd_parse_decimal(&command[REMOTECMD_OPCODE_LEN], REMOTECMD_LEN - REMOTECMD_OPCODE_LEN, &rcmd->value) != 0) ||
+        (rcmd->value < def->minvalue) || (rcmd->value > def->maxvalue)) {
+        return REMOTECMD_BADARG;
+    }
+
+    return REMOTECMD_OK;
+}
+
+
+int remoteframe_parse(unsigned char *line, int len, int *reqid, unsigned char **command) {
+    int i, id = 0;
+
+    if ((len < 3) || (line[0] != '#')) {
+        return -1;
+    }
+
+    for (i = 1; (i < len) && (line[i] != ' '); i++) {
+        if (((unsigned char)(line[i] - '0') > 9) || (i > REMOTEFRAME_MAXIDLEN)) {
+            return -1;
+        }
+        id = id * 10 + (line[i] - '0');
+    }
+    if ((i == 1) || (i == len)) {  // no id, or no command
+        return -1;
+    }
+
+    *reqid = id;
+    *command = &line[i + 1];
+
+    return len - (i + 1);
+}
+
+
+int remoteframe_format_reply(char *buf, int reqid, const char *reply) {
+    if (reqid == REMOTEFRAME_NOID) {
+        return sprintf(buf, "%s", reply);
+    }
+    return sprintf(buf, "#%d %s", reqid, reply);
+}
+
+
+int remote_acks_add(struct remote_acks *acks, int reqid) {
+    if (acks->count == REMOTEACK_MAX) {
+        return -1;
+    }
+    acks->ids[acks->count++] = reqid;
+    return 0;
+}
+
+
+void remote_outbuf_init(struct remote_outbuf *out, int fd) {
+    out->fd = fd;
+    out->len = 0;
+}
+
+
+unsigned int remote_outbuf_pending(struct remote_outbuf *out) {
+    return out->len;
+}
+
+
+int remote_outbuf_append(struct remote_outbuf *out, const void *data, unsigned int len) {
+    if (len > (REMOTE_OUTBUF_SIZE - out->len)) {
+        return -1;
+    }
+    memcpy(&out->buf[out->len], data, len);
+    out->len += len;
+    return 0;
+}
+
+
+int remote_outbuf_flush(struct remote_outbuf *out) {
+    int sent;
+
+    if (out->len == 0) {
+        return 0;
+    }
+
+    // MSG_NOSIGNAL: a closed connection is an EPIPE error here instead of a SIGPIPE
+    sent = send(out->fd, out->buf, out->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent == -1) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+            return out->len;
+        }
+        return -1;
+    }
+
+    out->len -= sent;
+    if (out->len > 0) {
+        memmove(out->buf, &out->buf[sent], out->len);
+    }
+
+    return out->len;
+}
+
+
+int remotebin_is_setpoint(const unsigned char *packet, int len) {
+    return (len == REMOTEBIN_SETPOINT_LEN) && (packet[2] == REMOTEBIN_TYPE_SETPOINT_V1);
+}
+
+
+int remotebin_encode_setpoint(const struct remote_setpoint *sp, unsigned char *packet) {
+    unsigned int crc, i;
+
+    packet[0] = (sp->packetno >> 8) & 0xFF;
+    packet[1] =  sp->packetno & 0xFF;
+    packet[2] = REMOTEBIN_TYPE_SETPOINT_V1;
+    packet[3] = sp->flags;
+    for (i = 0; i < REMOTECMD_AXES; i++) {
+        packet[4 + 2*i] = (sp->speed[i] >> 8) & 0xFF;
+        packet[5 + 2*i] =  sp->speed[i] & 0xFF;
+    }
+    packet[10] = (sp->deadline_ms >> 8) & 0xFF;
+    packet[11] =  sp->deadline_ms & 0xFF;
+    packet[12] = 0;
+    packet[13] = 0;
+    crc = crc16_ccitt(packet, REMOTEBIN_SETPOINT_LEN - 2);
+    packet[14] = crc >> 8;
+    packet[15] = crc & 0xFF;
+
+    return REMOTEBIN_SETPOINT_LEN;
+}
+
+
+int remotebin_decode_setpoint(const unsigned char *packet, int len, struct remote_setpoint *sp) {
+    unsigned int recvcrc;
+
+    if (remotebin_is_setpoint(packet, len) == 0) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    recvcrc = (packet[14] << 8) | packet[15];
+    if (recvcrc != crc16_ccitt(packet, REMOTEBIN_SETPOINT_LEN - 2)) {
+        return REMOTEBIN_BADCRC;
+    }
+
+    return remotebin_unpack_setpoint(packet, len, sp);
+}
+
+
+int remotebin_unpack_setpoint(const unsigned char *packet, int len, struct remote_setpoint *sp) {
+    unsigned int i;
+
+    if (remotebin_is_setpoint(packet, len) == 0) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    sp->packetno = (packet[0] << 8) | packet[1];
+    sp->flags = packet[3];
+    for (i = 0; i < REMOTECMD_AXES; i++) {
+        sp->speed[i] = (int16_t)((packet[4 + 2*i] << 8) | packet[5 + 2*i]);
+        if ((sp->speed[i] < -REMOTECMD_SETPOINT_LIMIT) || (sp->speed[i] > REMOTECMD_SETPOINT_LIMIT)) {
+            return REMOTEBIN_BADVALUE;
+        }
+    }
+    sp->deadline_ms = (packet[10] << 8) | packet[11];
+
+    return REMOTEBIN_OK;
+}
+
+
+int remotebin_is_trajectory(const unsigned char *packet, int len) {
+    return (len >= (REMOTETRJ_HEADER_LEN + REMOTETRJ_SEGMENT_LEN + 2)) && (packet[2] == REMOTEBIN_TYPE_TRAJECTORY_V1) &&
+           (len == (REMOTETRJ_HEADER_LEN + packet[14] * REMOTETRJ_SEGMENT_LEN + 2));
+}
+
+
+int remotebin_encode_trajectory(const struct remote_trajectory *trj, unsigned char *packet) {
+    unsigned char *seg;
+    unsigned int crc, value;
+    int len, i, j;
+
+    packet[0]  = (trj->packetno >> 8) & 0xFF;
+    packet[1]  =  trj->packetno & 0xFF;
+    packet[2]  = REMOTEBIN_TYPE_TRAJECTORY_V1;
+    packet[3]  = trj->flags;
+    packet[4]  = (trj->accel_limit >> 8) & 0xFF;
+    packet[5]  =  trj->accel_limit & 0xFF;
+    packet[6]  = ((trj->jerk_limit / 10) >> 8) & 0xFF;
+    packet[7]  =  (trj->jerk_limit / 10) & 0xFF;
+    packet[8]  = (trj->angaccel_limit >> 8) & 0xFF;
+    packet[9]  =  trj->angaccel_limit & 0xFF;
+    packet[10] = ((trj->angjerk_limit / 10) >> 8) & 0xFF;
+    packet[11] =  (trj->angjerk_limit / 10) & 0xFF;
+    packet[12] = (trj->angspeed_limit >> 8) & 0xFF;
+    packet[13] =  trj->angspeed_limit & 0xFF;
+    packet[14] = trj->segments;
+    packet[15] = 0;
+
+    for (i = 0; i < trj->segments; i++) {
+        seg = &packet[REMOTETRJ_HEADER_LEN + i * REMOTETRJ_SEGMENT_LEN];
+        seg[0] = trj->segment[i].type;
+        seg[1] = 0;
+        seg[2] = (trj->segment[i].duration_ms >> 8) & 0xFF;
+        seg[3] =  trj->segment[i].duration_ms & 0xFF;
+        for (j = 0; j < REMOTECMD_AXES; j++) {
+            value = trj->segment[i].value[j];
+            seg[4 + 2*j] = (value >> 8) & 0xFF;
+            seg[5 + 2*j] =  value & 0xFF;
+        }
+        value = (trj->segment[i].type == REMOTETRJ_SEG_WAYPOINT) ? trj->segment[i].speed_limit : 0;
+        seg[10] = (value >> 8) & 0xFF;
+        seg[11] =  value & 0xFF;
+    }
+
+    len = REMOTETRJ_HEADER_LEN + trj->segments * REMOTETRJ_SEGMENT_LEN;
+    crc = crc16_ccitt(packet, len);
+    packet[len]     = crc >> 8;
+    packet[len + 1] = crc & 0xFF;
+
+    return len + 2;
+}
+
+
+int remotebin_decode_trajectory(const unsigned char *packet, int len, struct remote_trajectory *trj) {
+    unsigned int recvcrc;
+
+    if (remotebin_is_trajectory(packet, len) == 0) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    recvcrc = (packet[len - 2] << 8) | packet[len - 1];
+    if (recvcrc != crc16_ccitt(packet, len - 2)) {
+        return REMOTEBIN_BADCRC;
+    }
+
+    return remotebin_unpack_trajectory(packet, len, trj);
+}
+
+
+int remotebin_unpack_trajectory(const unsigned char *packet, int len, struct remote_trajectory *trj) {
+    const unsigned char *seg;
+    struct remote_trajectory_segment *s;
+    int i, j;
+
+    if (remotebin_is_trajectory(packet, len) == 0) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    trj->packetno       = (packet[0] << 8) | packet[1];
+    trj->flags          = packet[3];
+    trj->accel_limit    = (packet[4] << 8) | packet[5];
+    trj->jerk_limit     = ((packet[6] << 8) | packet[7]) * 10;
+    trj->angaccel_limit = (packet[8] << 8) | packet[9];
+    trj->angjerk_limit  = ((packet[10] << 8) | packet[11]) * 10;
+    trj->angspeed_limit = (packet[12] << 8) | packet[13];
+    trj->segments       = packet[14];
+    if (trj->segments > REMOTETRJ_SEGMENTS_MAX) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    for (i = 0; i < trj->segments; i++) {
+        seg = &packet[REMOTETRJ_HEADER_LEN + i * REMOTETRJ_SEGMENT_LEN];
+        s = &trj->segment[i];
+        s->type        = seg[0];
+        s->duration_ms = (seg[2] << 8) | seg[3];
+        for (j = 0; j < REMOTECMD_AXES; j++) {
+            s->value[j] = (int16_t)((seg[4 + 2*j] << 8) | seg[5 + 2*j]);
+        }
+        s->speed_limit = (seg[10] << 8) | seg[11];
+
+        if (s->duration_ms == 0) {
+            return REMOTEBIN_BADVALUE;
+        }
+        switch (s->type) {
+            case REMOTETRJ_SEG_VELOCITY:
+                for (j = 0; j < REMOTECMD_AXES; j++) {
+                    if ((s->value[j] < -REMOTECMD_SETPOINT_LIMIT) || (s->value[j] > REMOTECMD_SETPOINT_LIMIT)) {
+                        return REMOTEBIN_BADVALUE;
+                    }
+                }
+                break;
+            case REMOTETRJ_SEG_WAYPOINT:
+                if ((s->speed_limit == 0) || (s->speed_limit > REMOTECMD_SETPOINT_LIMIT) ||
+                    (trj->angspeed_limit == 0) || (trj->angspeed_limit > REMOTECMD_SETPOINT_LIMIT)) {
+                    return REMOTEBIN_BADVALUE;
+                }
+                break;
+            default:
+                return REMOTEBIN_BADVALUE;
+        }
+    }
+
+    return REMOTEBIN_OK;
+}
+
+
+void remote_mailbox_clear(struct remote_mailbox *mailbox) {
+    memset(mailbox, 0, sizeof(struct remote_mailbox));
+}
+
+
+static void remote_mailbox_post_stop(struct remote_mailbox *mailbox) {
+    int axis;
+
+    // setpoints received before the stop are obsolete
+    mailbox->stop = 1;
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        mailbox->pending[axis] = 0;
+        mailbox->value[axis] = 0;
+    }
+}
+
+
+void remote_mailbox_post_command(struct remote_mailbox *mailbox, const struct remotecmd *rcmd) {
+
+    mailbox->received = 1;
+    mailbox->deadline_ms = 0;
+    mailbox->trajectory = 0;    // superseded by the newer command
+
+    switch (rcmd->def->action) {
+        case REMOTECMD_STOPZERO:
+        case REMOTECMD_RESETALL:
+            remote_mailbox_post_stop(mailbox);
+            break;
+
+        case REMOTECMD_SETPOINT:
+            mailbox->pending[rcmd->def->axis] = 1;
+            mailbox->value[rcmd->def->axis] = rcmd->value;
+            break;
+    }
+}
+
+
+void remote_mailbox_post_setpoint(struct remote_mailbox *mailbox, const struct remote_setpoint *sp) {
+    int axis;
+
+    mailbox->received = 1;
+    mailbox->deadline_ms = ((sp->flags & REMOTEBIN_FLAG_DEADLINE) != 0) ? sp->deadline_ms : 0;
+    mailbox->trajectory = 0;
+
+    if ((sp->flags & REMOTEBIN_FLAG_STOP) != 0) {
+        remote_mailbox_post_stop(mailbox);
+        return;
+    }
+
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        mailbox->pending[axis] = 1;
+        mailbox->value[axis] = sp->speed[axis];
+    }
+}
+
+
+void remote_mailbox_post_trajectory(struct remote_mailbox *mailbox, const struct remote_trajectory *trj) {
+    int axis;
+
+    // the trajectory takes over from the setpoints received before it (a stop is still sent first)
+    mailbox->received = 1;
+    mailbox->deadline_ms = 0;
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        mailbox->pending[axis] = 0;
+    }
+    mailbox->trajectory = 1;
+    mailbox->trj = *trj;
+}
+
+
+int replay_window_check(struct replay_window *window, unsigned int packetno, unsigned int *skipped) {
+    int diff;
+    uint64_t bit;
+
+    *skipped = 0;
+
+    if (window->started == 0) {
+        window->started = 1;
+        window->highest = packetno;
+        window->bitmap = 1;
+        return REPLAY_NEW;
+    }
+
+    // serial number arithmetic, so the 0xFFFF -> 0x0000 wraparound is handled
+    diff = (int16_t)(packetno - window->highest);
+
+    if (diff > 0) {
+        if (diff < REPLAY_WINDOW_SIZE) {
+            window->bitmap = (window->bitmap << diff) | 1;
+        } else {
+            window->bitmap = 1;
+        }
+        window->highest = packetno & 0xFFFF;
+        *skipped = diff - 1;
+        return REPLAY_NEW;
+    }
+
+    if (diff == 0) {
+        return REPLAY_DUPLICATE;
+    }
+
+    if (-diff >= REPLAY_WINDOW_SIZE) {
+        return REPLAY_TOOOLD;
+    }
+
+    bit = (uint64_t)1 << (-diff);
+    if ((window->bitmap & bit) != 0) {
+        return REPLAY_DUPLICATE;
+    }
+    window->bitmap |= bit;
+
+    return REPLAY_REORDERED;
+}
+
+
+static void udpclient_reset(struct udpclient *client, const struct sockaddr_in *addr, double time_now) {
+    memset(client, 0, sizeof(struct udpclient));
+    client->used = 1;
+    client->addr = *addr;
+    client->time_first_recv = time_now;
+}
+
+
+// find the client (or make a new entry, replacing the least recently seen one if needed) and account the arrival
+struct udpclient *udpclient_lookup(struct udpclient *clients, const struct sockaddr_in *addr, double time_now) {
+    struct udpclient *client = NULL, *oldest = &clients[0];
+    double interval, deviation;
+    int i;
+
+    for (i = 0; i < UDPCLIENT_MAX; i++) {
+        if ((clients[i].used == 1) && (clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr) && (clients[i].addr.sin_port == addr->sin_port)) {
+            client = &clients[i];
+            break;
+        }
+        // prefer a free entry, otherwise the least recently seen client
+        if ((oldest->used == 1) && ((clients[i].used == 0) || (clients[i].time_last_recv < oldest->time_last_recv))) {
+            oldest = &clients[i];
+        }
+    }
+
+    if (client == NULL) {
+        client = oldest;
+        udpclient_reset(client, addr, time_now);
+    } else if ((time_now - client->time_last_recv) > UDPCLIENT_TIMEOUT_SEC) {
+        udpclient_reset(client, addr, time_now);
+    }
+
+    client->stats.received++;
+
+    if (client->time_last_recv > 0) {
+        interval = time_now - client->time_last_recv;
+        if (client->interarrival_avg == 0) {
+            client->interarrival_avg = interval;
+        } else {
+            deviation = interval - client->interarrival_avg;
+            if (deviation < 0) { deviation = -deviation; }
+            client->stats.jitter += (deviation - client->stats.jitter) / 16.0;
+            client->interarrival_avg += (interval - client->interarrival_avg) / 16.0;
+        }
+    }
+    client->time_last_recv = time_now;
+
+    return client;
+}
+
+
+// returns REPLAY_NEW/REPLAY_REORDERED if the packet should be processed, REPLAY_DUPLICATE/REPLAY_TOOOLD (<0) if not
+int udpclient_accept_packetno(struct udpclient *client, unsigned int packetno) {
+    unsigned int skipped;
+    int ret;
+
+    ret = replay_window_check(&client->window, packetno, &skipped);
+    switch (ret) {
+        case REPLAY_NEW:
+            client->stats.lost += skipped;
+            break;
+
+        case REPLAY_REORDERED:
+            client->stats.reordered++;
+            if (client->stats.lost > 0) { client->stats.lost--; }
+            break;
+
+        case REPLAY_DUPLICATE:
+            client->stats.duplicates++;
+            return ret;
+
+        case REPLAY_TOOOLD:
+            client->stats.tooold++;
+            return ret;
+    }
+
+    client->stats.accepted++;
+
+    return ret;
+}
+
+
+void udpclient_reset_window(struct udpclient *client) {
+    memset(&client->window, 0, sizeof(struct replay_window));
+}
+
+
+int udpclient_format_stats(struct udpclient *client, char *str) {
+    return sprintf(str, "%s:%d rx:%lu ok:%lu lost:%lu reord:%lu dup:%lu old:%lu crc:%lu bad:%lu jitter:%.1fms",
+        inet_ntoa(client->addr.sin_addr), ntohs(client->addr.sin_port),
+        client->stats.received, client->stats.accepted, client->stats.lost, client->stats.reordered,
+        client->stats.duplicates, client->stats.tooold, client->stats.crcerrors, client->stats.badformat,
+        client->stats.jitter * 1000.0);
+}
+
+
+static unsigned char *put_be16(unsigned char *p, unsigned int value) {
+    p[0] = (value >> 8) & 0xFF;
+    p[1] =  value & 0xFF;
+    return p + 2;
+}
+
+
+static unsigned char *put_be32(unsigned char *p, unsigned int value) {
+    p[0] = (value >> 24) & 0xFF;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >>  8) & 0xFF;
+    p[3] =  value & 0xFF;
+    return p + 4;
+}
+
+
+static unsigned int get_be16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+
+static unsigned int get_be32(const unsigned char *p) {
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+// appends to line[len], cut short at maxlen - 1 (the line stays terminated), returns the new length
+static int tlm_append(char *line, int len, int maxlen, const char *format, ...) {
+    va_list args;
+    int ret;
+
+    if (len >= maxlen - 1) {
+        return len;
+    }
+    va_start(args, format);
+    ret = vsnprintf(&line[len], maxlen - len, format, args);
+    va_end(args);
+    if (ret < 0) {
+        return len;
+    }
+
+    return ((len + ret) < maxlen) ? (len + ret) : (maxlen - 1);
+}
+
+
+int remotetext_format_telemetry(const struct telemetry_sample *sample, unsigned int fields, char *line, int maxlen) {
+    int len, room;
+
+    // the fields are cut short if they do not fit, the line end always does
+    room = maxlen - 2;
+    len = tlm_append(line, 0, room, "TLM seq=%u", sample->seq);
+    if (fields & TLM_FIELD_UPTIME)    { len = tlm_append(line, len, room, " up=%u", sample->uptime_ms); }
+    if (fields & TLM_FIELD_BATTERY)   { len = tlm_append(line, len, room, " bat=%u", sample->battery_mv); }
+    if (fields & TLM_FIELD_MOTORS)    { len = tlm_append(line, len, room, " mot=%u,%u", sample->motor_status[0], sample->motor_status[1]); }
+    if (fields & TLM_FIELD_ENCODERS)  { len = tlm_append(line, len, room, " enc=%d,%d,%d,%d", sample->encoder[0], sample->encoder[1], sample->encoder[2], sample->encoder[3]); }
+    if (fields & TLM_FIELD_POSITIONS) { len = tlm_append(line, len, room, " pos=%d,%d,%d,%d", sample->position[0], sample->position[1], sample->position[2], sample->position[3]); }
+    if (fields & TLM_FIELD_SPEEDS)    { len = tlm_append(line, len, room, " spd=%d,%d,%d,%d", sample->speed[0], sample->speed[1], sample->speed[2], sample->speed[3]); }
+    if (fields & TLM_FIELD_CURRENTS)  { len = tlm_append(line, len, room, " cur=%u,%u,%u,%u", sample->current_ma[0], sample->current_ma[1], sample->current_ma[2], sample->current_ma[3]); }
+    if (fields & TLM_FIELD_SETPOINT)  { len = tlm_append(line, len, room, " sp=%d,%d,%d", sample->setpoint[0], sample->setpoint[1], sample->setpoint[2]); }
+    if (fields & TLM_FIELD_RS485ERR)  { len = tlm_append(line, len, room, " err=%u,%u", sample->rs485_err[0], sample->rs485_err[1]); }
+    if (fields & TLM_FIELD_ODOMETRY)  {
+        len = tlm_append(line, len, room, " odo=%u,%d,%d,%d,%d,%d,%d", sample->odom_uptime_ms,
+                         sample->odom_pose[0], sample->odom_pose[1], sample->odom_pose[2], sample->odom_twist[0], sample->odom_twist[1], sample->odom_twist[2]);
+        len = tlm_append(line, len, room, " ocov=%d,%d,%d,%d,%d,%d", sample->odom_pose_cov[0], sample->odom_pose_cov[1], sample->odom_pose_cov[2],
+                         sample->odom_pose_cov[3], sample->odom_pose_cov[4], sample->odom_pose_cov[5]);
+        len = tlm_append(line, len, room, " vcov=%d,%d,%d,%d,%d,%d", sample->odom_twist_cov[0], sample->odom_twist_cov[1], sample->odom_twist_cov[2],
+                         sample->odom_twist_cov[3], sample->odom_twist_cov[4], sample->odom_twist_cov[5]);
+    }
+    if (fields & TLM_FIELD_TRAJECTORY) {
+        len = tlm_append(line, len, room, " trj=%u,%u,%u,%d", sample->trj_id, sample->trj_state, sample->trj_segment, sample->trj_error_mm);
+    }
+    if (fields & TLM_FIELD_TIMESTAMPS) {
+        len = tlm_append(line, len, room, " ts=%llu,%llu,%u", sample->host_us, sample->odom_host_us, sample->sync_error_us);
+    }
+    len = tlm_append(line, len, maxlen, "\r\n");
+
+    return len;
+}
+
+
+int remotebin_encode_telemetry(const struct telemetry_sample *sample, unsigned int fields, unsigned int packetno, unsigned char *packet) {
+    unsigned char *p;
+    unsigned int crc;
+    int i;
+
+    fields &= TLM_FIELD_ALL;
+
+    p = put_be16(packet, packetno);
+    *p++ = REMOTEBIN_TYPE_TELEMETRY_V1;
+    *p++ = 0;
+    p = put_be16(p, fields);
+    p = put_be32(p, sample->seq);
+
+    if (fields & TLM_FIELD_UPTIME)    { p = put_be32(p, sample->uptime_ms); }
+    if (fields & TLM_FIELD_BATTERY)   { p = put_be16(p, sample->battery_mv); }
+    if (fields & TLM_FIELD_MOTORS)    { *p++ = sample->motor_status[0]; *p++ = sample->motor_status[1]; }
+    if (fields & TLM_FIELD_ENCODERS)  { for (i = 0; i < TLM_MOTORS; i++) { p = put_be32(p, sample->encoder[i]); } }
+    if (fields & TLM_FIELD_POSITIONS) { for (i = 0; i < TLM_MOTORS; i++) { p = put_be32(p, sample->position[i]); } }
+    if (fields & TLM_FIELD_SPEEDS)    { for (i = 0; i < TLM_MOTORS; i++) { p = put_be32(p, sample->speed[i]); } }
+    if (fields & TLM_FIELD_CURRENTS)  { for (i = 0; i < TLM_MOTORS; i++) { p = put_be16(p, sample->current_ma[i]); } }
+    if (fields & TLM_FIELD_SETPOINT)  { for (i = 0; i < REMOTECMD_AXES; i++) { p = put_be16(p, sample->setpoint[i]); } }
+    if (fields & TLM_FIELD_RS485ERR)  { p = put_be16(p, sample->rs485_err[0]); p = put_be16(p, sample->rs485_err[1]); }
+    if (fields & TLM_FIELD_ODOMETRY)  {
+        p = put_be32(p, sample->odom_uptime_ms);
+        for (i = 0; i < 3; i++) { p = put_be32(p, sample->odom_pose[i]); }
+        for (i = 0; i < 3; i++) { p = put_be32(p, sample->odom_twist[i]); }
+        for (i = 0; i < 6; i++) { p = put_be32(p, sample->odom_pose_cov[i]); }
+        for (i = 0; i < 6; i++) { p = put_be32(p, sample->odom_twist_cov[i]); }
+    }
+    if (fields & TLM_FIELD_TRAJECTORY) {
+        p = put_be16(p, sample->trj_id);
+        *p++ = sample->trj_state;
+        *p++ = sample->trj_segment;
+        p = put_be32(p, sample->trj_error_mm);
+    }
+    if (fields & TLM_FIELD_TIMESTAMPS) {
+        p = put_be32(p, sample->host_us >> 32);      p = put_be32(p, sample->host_us & 0xFFFFFFFF);
+        p = put_be32(p, sample->odom_host_us >> 32); p = put_be32(p, sample->odom_host_us & 0xFFFFFFFF);
+        p = put_be32(p, sample->sync_error_us);
+    }
+
+    crc = crc16_ccitt(packet, p - packet);
+    p = put_be16(p, crc);
+
+    return p - packet;
+}
+
+
+// bytes of each TLM_FIELD_* in the binary telemetry, in the order of their bits
+static const unsigned char tlm_field_len[] = { 4, 2, 2, 16, 16, 16, 8, 6, 4, 76, 8, 20 };
+
+
+int remotebin_decode_telemetry(const unsigned char *packet, int len, struct telemetry_sample *sample, unsigned int *fields, unsigned int *packetno) {
+    const unsigned char *p;
+    unsigned int mask;
+    int i, expected;
+
+    if ((len < 12) || (packet[2] != REMOTEBIN_TYPE_TELEMETRY_V1)) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    // the length has to match the mask exactly before any field is read
+    mask = get_be16(&packet[4]);
+    if (mask & ~TLM_FIELD_ALL) {
+        return REMOTEBIN_BADFORMAT;
+    }
+    expected = 10 + 2;
+    for (i = 0; i < (int)sizeof(tlm_field_len); i++) {
+        if (mask & (1 << i)) {
+            expected += tlm_field_len[i];
+        }
+    }
+    if (len != expected) {
+        return REMOTEBIN_BADFORMAT;
+    }
+
+    if (get_be16(&packet[len - 2]) != crc16_ccitt(packet, len - 2)) {
+        return REMOTEBIN_BADCRC;
+    }
+
+    memset(sample, 0, sizeof(struct telemetry_sample));
+    *packetno = get_be16(packet);
+    *fields = mask;
+    sample->seq = get_be32(&packet[6]);
+    p = &packet[10];
+
+    if (*fields & TLM_FIELD_UPTIME)    { sample->uptime_ms = get_be32(p); p += 4; }
+    if (*fields & TLM_FIELD_BATTERY)   { sample->battery_mv = get_be16(p); p += 2; }
+    if (*fields & TLM_FIELD_MOTORS)    { sample->motor_status[0] = p[0]; sample->motor_status[1] = p[1]; p += 2; }
+    if (*fields & TLM_FIELD_ENCODERS)  { for (i = 0; i < TLM_MOTORS; i++) { sample->encoder[i]  = (int32_t)get_be32(p); p += 4; } }
+    if (*fields & TLM_FIELD_POSITIONS) { for (i = 0; i < TLM_MOTORS; i++) { sample->position[i] = (int32_t)get_be32(p); p += 4; } }
+    if (*fields & TLM_FIELD_SPEEDS)    { for (i = 0; i < TLM_MOTORS; i++) { sample->speed[i]    = (int32_t)get_be32(p); p += 4; } }
+    if (*fields & TLM_FIELD_CURRENTS)  { for (i = 0; i < TLM_MOTORS; i++) { sample->current_ma[i] = get_be16(p); p += 2; } }
+    if (*fields & TLM_FIELD_SETPOINT)  { for (i = 0; i < REMOTECMD_AXES; i++) { sample->setpoint[i] = (int16_t)get_be16(p); p += 2; } }
+    if (*fields & TLM_FIELD_RS485ERR)  { sample->rs485_err[0] = get_be16(p); sample->rs485_err[1] = get_be16(p + 2); p += 4; }
+    if (*fields & TLM_FIELD_ODOMETRY)  {
+        sample->odom_uptime_ms = get_be32(p); p += 4;
+        for (i = 0; i < 3; i++) { sample->odom_pose[i]      = (int32_t)get_be32(p); p += 4; }
+        for (i = 0; i < 3; i++) { sample->odom_twist[i]     = (int32_t)get_be32(p); p += 4; }
+        for (i = 0; i < 6; i++) { sample->odom_pose_cov[i]  = (int32_t)get_be32(p); p += 4; }
+        for (i = 0; i < 6; i++) { sample->odom_twist_cov[i] = (int32_t)get_be32(p); p += 4; }
+    }
+    if (*fields & TLM_FIELD_TRAJECTORY) {
+        sample->trj_id = get_be16(p);
+        sample->trj_state = p[2];
+        sample->trj_segment = p[3];
+        sample->trj_error_mm = (int32_t)get_be32(p + 4);
+        p += 8;
+    }
+    if (*fields & TLM_FIELD_TIMESTAMPS) {
+        sample->host_us      = ((unsigned long long)get_be32(p)     << 32) | get_be32(p + 4);
+        sample->odom_host_us = ((unsigned long long)get_be32(p + 8) << 32) | get_be32(p + 12);
+        sample->sync_error_us = get_be32(p + 16);
+        p += 20;
+    }
+
+    return REMOTEBIN_OK;
+}
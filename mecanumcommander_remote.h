@@ -0,0 +1,376 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_REMOTE_H__
+
+#define __MECACOM_REMOTE_H__
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+// ring buffer for the commands received through the network
+#define CMDRING_SIZE      1024  // has to be a power of 2
+#define CMDRING_MASK      (CMDRING_SIZE - 1)
+#define CMDRING_MAXLINE   32    // a line longer than this cannot be a valid command, it will be skipped
+
+// return values of cmdring_next_line() besides the length of the line
+#define CMDRING_NOLINE    -1    // no complete line in the buffer (yet)
+#define CMDRING_OVERLONG  -2    // a too long line was found, it is being dropped
+
+struct cmdring {
+    unsigned char buf[CMDRING_SIZE];
+    unsigned int head;      // next byte to write (free running counter)
+    unsigned int tail;      // first byte of the current line (free running counter)
+    unsigned int scanned;   // bytes after tail which are already known not to be a newline
+    unsigned char skipping; // dropping an overlong line until the next newline
+    unsigned char line[CMDRING_MAXLINE + 1]; // for lines which wrap around the end of buf
+};
+
+void         cmdring_init(struct cmdring *ring);
+unsigned int cmdring_used(struct cmdring *ring);
+unsigned int cmdring_free(struct cmdring *ring);
+// read() as much as fits into the free space, returns what read() returned
+int cmdring_read(struct cmdring *ring, int fd);
+// append data, returns -1 (and appends nothing) if it doesn't fit
+int cmdring_put(struct cmdring *ring, const unsigned char *data, unsigned int len);
+// get the next line without the line terminator (\r or \n), *line will be null-terminated
+int cmdring_next_line(struct cmdring *ring, unsigned char **line);
+
+
+// commands received through the network are always 8 chars long:
+// either a full word (e.g. "STOPZERO"), or a 3 char opcode + a 5 char signed decimal number (e.g. "SPX-0570")
+#define REMOTECMD_LEN        8
+#define REMOTECMD_OPCODE_LEN 3
+
+// actions
+#define REMOTECMD_STOPZERO   1
+#define REMOTECMD_RESETALL   2
+#define REMOTECMD_SETPOINT   3
+#define REMOTECMD_TLMPERIOD  4  // subscribe to telemetry with this period (ms), 0: unsubscribe
+#define REMOTECMD_TLMFIELDS  5  // select the telemetry fields (TLM_FIELD_* mask)
+#define REMOTECMD_FRAMING    6  // TCP: switch framed mode (request ids) on/off
+#define REMOTECMD_KEEPALIVE  7  // renews the lease of the running trajectory (nothing else)
+
+// setpoint axes
+#define REMOTECMD_AXIS_X     0
+#define REMOTECMD_AXIS_Y     1
+#define REMOTECMD_AXIS_ROT   2
+#define REMOTECMD_AXES       3
+
+#define REMOTECMD_SETPOINT_LIMIT 10000
+
+// decode status
+#define REMOTECMD_OK         0
+#define REMOTECMD_UNKNOWN   -1  // bad length or unknown command
+#define REMOTECMD_BADARG    -2  // known opcode, but the number is invalid or out of range
+
+struct remotecmd_def {
+    const char *name;           // full word (8 chars) or opcode (3 chars)
+    unsigned char action;
+    unsigned char axis;         // for REMOTECMD_SETPOINT
+    int minvalue;
+    int maxvalue;
+    const char *reply_ok;       // reply when accepted (NULL: no immediate reply, e.g. it is sent after the serial write)
+    const char *reply_bad;      // reply when the number is invalid
+};
+
+struct remotecmd {
+    const struct remotecmd_def *def; // NULL if unknown
+    int value;
+};
+
+int remotecmd_decode(const unsigned char *command, int commandlen, struct remotecmd *rcmd);
+int remotecmd_parse_decimal(const unsigned char *digits, int len, int *value);
+
+
+// framed TCP mode: every request is "#<id> <command>", the reply to it is "#<id> <reply>"
+// replies come in the order the requests complete (setpoints after their serial write), not in the order they were sent
+#define REMOTEFRAME_NOID       -1        // unframed request, or a message which is not a reply (e.g. !NOCMST!)
+#define REMOTEFRAME_MAXIDLEN    8        // id: 0..99999999
+#define REMOTEFRAME_MAXLEN     (1 + REMOTEFRAME_MAXIDLEN + 1 + REMOTECMD_LEN)
+#define REMOTEFRAME_REPLY_MAXLEN 32
+
+// setpoint requests waiting for their serial write, per axis
+#define REMOTEACK_MAX          64
+
+struct remote_acks {
+    int count;
+    int ids[REMOTEACK_MAX];
+};
+
+// split a framed line to id and command, returns the length of the command or -1 if the frame is invalid
+int  remoteframe_parse(unsigned char *line, int len, int *reqid, unsigned char **command);
+// "<reply>" or "#<id> <reply>", returns the length
+int  remoteframe_format_reply(char *buf, int reqid, const char *reply);
+// returns -1 if the queue is full
+int  remote_acks_add(struct remote_acks *acks, int reqid);
+
+
+// output buffer of a TCP client: the replies of one loop iteration are collected and sent with one send(),
+// what the (slow) client does not accept right away stays here for the next iteration
+#define REMOTE_OUTBUF_SIZE     4096
+
+struct remote_outbuf {
+    int fd;
+    unsigned int len;
+    unsigned char buf[REMOTE_OUTBUF_SIZE];
+};
+
+void         remote_outbuf_init(struct remote_outbuf *out, int fd);
+unsigned int remote_outbuf_pending(struct remote_outbuf *out);
+// returns -1 (and appends nothing) if it doesn't fit - the client is not reading
+int remote_outbuf_append(struct remote_outbuf *out, const void *data, unsigned int len);
+// non-blocking send, returns the bytes still pending, or -1 if the connection is lost
+int remote_outbuf_flush(struct remote_outbuf *out);
+
+
+/*
+ Binary setpoint message (UDP) - X, Y and rotation in one packet, all fields are big endian
+
+  0-1  packet number (same as in the text UDP packets)
+  2    message type + version (REMOTEBIN_TYPE_SETPOINT_V1), >= 0x80 so it can't be mistaken for a text command
+  3    flags (REMOTEBIN_FLAG_*)
+  4-5  X speed (int16, mm/s)
+  6-7  Y speed (int16, mm/s)
+  8-9  rotation speed (int16, mrad/s)
+ 10-11 deadline (uint16, ms) - the setpoint is only valid for this long, if REMOTEBIN_FLAG_DEADLINE is set
+ 12-13 reserved (0)
+ 14-15 CRC16-CCITT of bytes 0-13
+*/
+
+#define REMOTEBIN_SETPOINT_LEN       16
+#define REMOTEBIN_TYPE_SETPOINT_V1   0xB1
+
+#define REMOTEBIN_FLAG_STOP          0x01  // stop the robot (speeds are ignored)
+#define REMOTEBIN_FLAG_DEADLINE      0x02  // deadline field is valid
+
+// decode status
+#define REMOTEBIN_OK                 0
+#define REMOTEBIN_BADFORMAT         -1  // not a binary setpoint message (length/type)
+#define REMOTEBIN_BADCRC            -2
+#define REMOTEBIN_BADVALUE          -3  // speed out of range
+
+struct remote_setpoint {
+    unsigned int packetno;
+    unsigned char flags;
+    int speed[REMOTECMD_AXES];      // indexed by REMOTECMD_AXIS_*
+    unsigned int deadline_ms;
+};
+
+
+/*
+ Binary trajectory message (UDP, local control) - a whole motion in one message, the commander executes it
+ on its own fixed-rate timer (see mecanumcommander_trajectory.h), all fields are big endian
+
+  0-1  packet number (same sequence as the setpoints)
+  2    message type + version (REMOTEBIN_TYPE_TRAJECTORY_V1)
+  3    flags (REMOTETRJ_FLAG_*)
+  4-5  linear acceleration limit (uint16, mm/s^2, 0: no limit)
+  6-7  linear jerk limit (uint16, 10 mm/s^3, 0: no limit)
+  8-9  angular acceleration limit (uint16, mrad/s^2, 0: no limit)
+ 10-11 angular jerk limit (uint16, 10 mrad/s^3, 0: no limit)
+ 12-13 rotation speed limit of the waypoint segments (uint16, mrad/s)
+ 14    number of segments (1 - REMOTETRJ_SEGMENTS_MAX)
+ 15    reserved (0)
+ 16-   the segments, REMOTETRJ_SEGMENT_LEN bytes each:
+        0    type (REMOTETRJ_SEG_*)
+        1    reserved (0)
+        2-3  velocity: duration, waypoint: timeout (uint16, ms)
+        4-9  velocity: X, Y speed (int16, mm/s), rotation speed (int16, mrad/s)
+             waypoint: x, y (int16, mm), theta (int16, mrad), relative to the pose at the start of the trajectory
+       10-11 waypoint: speed limit (uint16, mm/s), velocity: reserved (0)
+ last 2 bytes: CRC16-CCITT of everything before
+*/
+
+#define REMOTEBIN_TYPE_TRAJECTORY_V1  0xB4
+#define REMOTETRJ_HEADER_LEN          16
+#define REMOTETRJ_SEGMENT_LEN         12
+#define REMOTETRJ_SEGMENTS_MAX        32
+#define REMOTEBIN_TRAJECTORY_MAXLEN   (REMOTETRJ_HEADER_LEN + REMOTETRJ_SEGMENTS_MAX * REMOTETRJ_SEGMENT_LEN + 2)
+
+#define REMOTETRJ_SEG_VELOCITY        0  // hold a velocity (reached within the accel/jerk limits) for duration_ms
+#define REMOTETRJ_SEG_WAYPOINT        1  // drive to a pose measured by the odometry
+
+#define REMOTETRJ_FLAG_CLOSEDLOOP     0x01  // velocity segments: steer back to the reference path using the odometry
+
+struct remote_trajectory_segment {
+    unsigned char type;
+    unsigned int duration_ms;
+    int value[REMOTECMD_AXES];      // indexed by REMOTECMD_AXIS_*, velocity: mm/s, mrad/s, waypoint: mm, mrad
+    unsigned int speed_limit;       // waypoint: mm/s
+};
+
+struct remote_trajectory {
+    unsigned int packetno;
+    unsigned char flags;
+    unsigned int accel_limit;       // mm/s^2
+    unsigned int jerk_limit;        // mm/s^3
+    unsigned int angaccel_limit;    // mrad/s^2
+    unsigned int angjerk_limit;     // mrad/s^3
+    unsigned int angspeed_limit;    // mrad/s
+    int segments;
+    struct remote_trajectory_segment segment[REMOTETRJ_SEGMENTS_MAX];
+};
+
+int remotebin_is_trajectory(const unsigned char *packet, int len);
+// returns the length of the packet
+int remotebin_encode_trajectory(const struct remote_trajectory *trj, unsigned char *packet);
+int remotebin_decode_trajectory(const unsigned char *packet, int len, struct remote_trajectory *trj);
+// same without the CRC check (for reliable local transports)
+int remotebin_unpack_trajectory(const unsigned char *packet, int len, struct remote_trajectory *trj);
+
+
+// latest-wins mailbox: the commands received in one loop iteration are merged here,
+// so only the newest setpoint per axis (and a stop, if there was one) is sent to the robot
+struct remote_mailbox {
+    unsigned char received;                 // at least one valid command arrived
+    unsigned char stop;                     // STOPZERO/RESETALL/stop flag arrived
+    unsigned char pending[REMOTECMD_AXES];  // a setpoint arrived for this axis (after the last stop)
+    int value[REMOTECMD_AXES];
+    unsigned int deadline_ms;               // deadline of the latest command, 0 if none
+    unsigned char trajectory;               // a trajectory arrived (after the last setpoint/stop)
+    struct remote_trajectory trj;
+};
+
+void remote_mailbox_clear(struct remote_mailbox *mailbox);
+void remote_mailbox_post_command(struct remote_mailbox *mailbox, const struct remotecmd *rcmd);
+void remote_mailbox_post_setpoint(struct remote_mailbox *mailbox, const struct remote_setpoint *sp);
+void remote_mailbox_post_trajectory(struct remote_mailbox *mailbox, const struct remote_trajectory *trj);
+
+
+// UDP clients are told apart by their source address/port (a restarted client gets a new entry)
+// The replay window is there for the duplicates and the reordering of the network, not against an attacker:
+// a packet replayed from another port, or after UDPCLIENT_TIMEOUT_SEC of silence (or a RESETALL) starts a new
+// window and is accepted (there is no authentication beyond the password and the CRC anyway).
+#define UDPCLIENT_MAX           8
+#define UDPCLIENT_TIMEOUT_SEC   10.0  // the state of a client which was silent for this long is reset
+#define REPLAY_WINDOW_SIZE      64    // packets, the size of the bitmap in struct replay_window
+
+// 64 packet sliding window on the 16 bit packet numbers
+struct replay_window {
+    unsigned char started;
+    unsigned int highest;   // highest accepted packet number
+    uint64_t bitmap;        // bit n is set if packet (highest - n) was accepted
+};
+
+struct udpclient_stats {
+    unsigned long received;
+    unsigned long accepted;
+    unsigned long lost;        // missing from the sequence (decreased if they arrive later)
+    unsigned long reordered;   // arrived later than a packet with a higher number
+    unsigned long duplicates;
+    unsigned long tooold;      // behind the window
+    unsigned long crcerrors;
+    unsigned long badformat;
+    double jitter;             // mean deviation of the inter-arrival time from its average (sec)
+};
+
+struct udpclient {
+    unsigned char used;
+    struct sockaddr_in addr;
+    double time_first_recv;
+    double time_last_recv;
+    double interarrival_avg;
+    struct replay_window window;
+    struct udpclient_stats stats;
+};
+
+#define REPLAY_NEW        0  // newer than anything received so far
+#define REPLAY_REORDERED  1  // inside the window, not seen yet
+#define REPLAY_DUPLICATE -1
+#define REPLAY_TOOOLD    -2
+
+int  replay_window_check(struct replay_window *window, unsigned int packetno, unsigned int *skipped);
+
+struct udpclient *udpclient_lookup(struct udpclient *clients, const struct sockaddr_in *addr, double time_now);
+int  udpclient_accept_packetno(struct udpclient *client, unsigned int packetno);
+void udpclient_reset_window(struct udpclient *client);
+int  udpclient_format_stats(struct udpclient *client, char *str);
+
+int remotebin_is_setpoint(const unsigned char *packet, int len);
+int remotebin_encode_setpoint(const struct remote_setpoint *sp, unsigned char *packet);
+int remotebin_decode_setpoint(const unsigned char *packet, int len, struct remote_setpoint *sp);
+// same without the CRC check (for reliable local transports)
+int remotebin_unpack_setpoint(const unsigned char *packet, int len, struct remote_setpoint *sp);
+
+
+/*
+ Telemetry pushed to the subscribed clients
+
+ TCP: one text line, only the selected fields, e.g.
+   TLM seq=12 up=123456 bat=24150 mot=3,3 enc=1,2,3,4 ... sp=100,0,0 err=0,0 odo=... ocov=... vcov=... trj=... ts=...\r\n
+
+ UDP: binary packet, all fields are big endian
+  0-1  packet number
+  2    message type + version (REMOTEBIN_TYPE_TELEMETRY_V1)
+  3    reserved (0)
+  4-5  field mask (TLM_FIELD_*)
+  6-9  sample sequence number
+  ...  the selected fields in the order of their bits (see below)
+  last 2 bytes: CRC16-CCITT of everything before
+*/
+
+#define REMOTEBIN_TYPE_TELEMETRY_V1  0xB2
+#define REMOTEBIN_TELEMETRY_MAXLEN   204
+// worst case of the text line with all fields (10/11 chars per unsigned/int, 20 per 64 bit, 3 per uchar):
+//   "TLM seq=" 18, up 14, bat 15, mot 12, enc/pos/spd 3x 52, cur 48, sp 39, err 26,
+//   odo 87, ocov 77, vcov 77, trj 35, ts 56, "\r\n" 2, NUL 1 = 663
+// (remotetext_format_telemetry() cuts the line short rather than overflow, if a new field is not added here)
+#define REMOTETEXT_TELEMETRY_MAXLEN  664
+
+#define TLM_FIELD_UPTIME     0x0001  // uint32  ms
+#define TLM_FIELD_BATTERY    0x0002  // uint16  mV
+#define TLM_FIELD_MOTORS     0x0004  // 2x uint8 motor status of the main/second controller
+#define TLM_FIELD_ENCODERS   0x0008  // 4x int32
+#define TLM_FIELD_POSITIONS  0x0010  // 4x int32 measured positions
+#define TLM_FIELD_SPEEDS     0x0020  // 4x int32 motor speeds
+#define TLM_FIELD_CURRENTS   0x0040  // 4x uint16 mA
+#define TLM_FIELD_SETPOINT   0x0080  // 3x int16 commanded X/Y/rotation speed
+#define TLM_FIELD_RS485ERR   0x0100  // 2x uint16 rs485 error counters (0x10/0x1F)
+#define TLM_FIELD_ODOMETRY   0x0200  // uint32 uptime ms of the odometry sample, 3x int32 pose (x, y mm, theta mrad),
+                                     // 3x int32 velocity (vx, vy mm/s, omega mrad/s), 6x int32 pose covariance,
+                                     // 6x int32 velocity covariance (upper triangles: xx xy xt yy yt tt, in the units above)
+#define TLM_FIELD_TRAJECTORY 0x0400  // uint16 id (packet number) of the trajectory, uint8 state (TRAJ_*), uint8 segment,
+                                     // int32 tracking error / distance to the waypoint (mm)
+#define TLM_FIELD_TIMESTAMPS 0x0800  // uint64 host CLOCK_MONOTONIC time (us) of the uptime above, uint64 of the odometry sample,
+                                     // uint32 error bound (us) of the clock sync (all 0 until the clocks are synchronized)
+#define TLM_FIELD_ALL        0x0FFF
+
+#define TLM_MOTORS           4       // motor 0,1: main controller, 2,3: second controller
+
+struct telemetry_sample {
+    unsigned int seq;
+    unsigned int uptime_ms;
+    unsigned int battery_mv;
+    unsigned char motor_status[2];
+    int encoder[TLM_MOTORS];
+    int position[TLM_MOTORS];
+    int speed[TLM_MOTORS];
+    unsigned int current_ma[TLM_MOTORS];
+    int setpoint[REMOTECMD_AXES];
+    unsigned int rs485_err[2];
+    unsigned int odom_uptime_ms;
+    int odom_pose[3];
+    int odom_twist[3];
+    int odom_pose_cov[6];
+    int odom_twist_cov[6];
+    unsigned int trj_id;
+    unsigned char trj_state;
+    unsigned char trj_segment;
+    int trj_error_mm;
+    unsigned long long host_us;
+    unsigned long long odom_host_us;
+    unsigned int sync_error_us;
+};
+
+// line: maxlen bytes (REMOTETEXT_TELEMETRY_MAXLEN for all fields), returns the length without the NUL
+int remotetext_format_telemetry(const struct telemetry_sample *sample, unsigned int fields, char *line, int maxlen);
+int remotebin_encode_telemetry(const struct telemetry_sample *sample, unsigned int fields, unsigned int packetno, unsigned char *packet);
+int remotebin_decode_telemetry(const unsigned char *packet, int len, struct telemetry_sample *sample, unsigned int *fields, unsigned int *packetno);
+
+#endif
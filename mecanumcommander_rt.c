@@ -0,0 +1,128 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "mecanumcommander_rt.h"
+
+static const unsigned int jitter_bucket_limits[JITTER_BUCKETS - 1] = JITTER_BUCKET_LIMITS;
+
+
+// touch the pages of the stack the loop may use later, so it never page faults
+static void rt_prefault_stack() {
+    volatile unsigned char stackbuf[RT_STACK_PREFAULT];
+    int i;
+
+    for (i = 0; i < RT_STACK_PREFAULT; i += 4096) {
+        stackbuf[i] = 0;
+    }
+}
+
+
+int rt_setup(int priority, int cpu) {
+
+    struct sched_param param;
+    cpu_set_t cpuset;
+    int ret;
+
+    // freed memory stays in the process (and locked)
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        perror("mlockall()");
+        return -1;
+    }
+    rt_prefault_stack();
+
+    if (cpu != -1) {
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_setaffinity_np(CPU %d): %s\n", cpu, strerror(ret));
+            return -1;
+        }
+    }
+
+    if (priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_setschedparam(SCHED_FIFO, %d): %s\n", priority, strerror(ret));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+double rt_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+void jitter_init(struct jitter_hist *hist) {
+    memset(hist, 0, sizeof(struct jitter_hist));
+}
+
+
+void jitter_add(struct jitter_hist *hist, double sec) {
+    unsigned int usec;
+    int bucket;
+
+    if (sec < 0) {
+        sec = 0;
+    }
+    usec = (sec > 3600.0) ? 3600000000U : (unsigned int)(sec * 1000000.0);
+
+    for (bucket = 0; bucket < (JITTER_BUCKETS - 1); bucket++) {
+        if (usec < jitter_bucket_limits[bucket]) {
+            break;
+        }
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum += sec;
+    if (sec > hist->max) {
+        hist->max = sec;
+    }
+}
+
+
+int jitter_format(struct jitter_hist *hist, char *str) {
+    int len, bucket;
+
+    len = sprintf(str, "n=%lu avg=%.3fms max=%.3fms", hist->count,
+                  (hist->count > 0) ? (hist->sum / hist->count) * 1000.0 : 0.0, hist->max * 1000.0);
+
+    for (bucket = 0; bucket < JITTER_BUCKETS; bucket++) {
+        if (hist->buckets[bucket] == 0) {
+            continue;
+        }
+        if (bucket == (JITTER_BUCKETS - 1)) {
+            len += sprintf(&str[len], " >=%uus:%lu", jitter_bucket_limits[bucket - 1], hist->buckets[bucket]);
+        } else {
+            len += sprintf(&str[len], " <%uus:%lu", jitter_bucket_limits[bucket], hist->buckets[bucket]);
+        }
+    }
+
+    return len;
+}
@@ -0,0 +1,50 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_RT_H__
+
+#define __MECACOM_RT_H__
+
+/*
+ Real-time mode of the control loop
+
+ rt_setup() is called by the thread running the control loop (the main thread), after the UI and
+ logger threads were started, so those keep the normal scheduling policy and CPU set:
+ - memory is locked (mlockall) and the stack is prefaulted, malloc does not give back memory
+ - CPU affinity (optional)
+ - SCHED_FIFO with the given priority (needs CAP_SYS_NICE / root, or an rtprio limit)
+
+ The jitter histograms are collected in every mode, so the normal and the real-time
+ scheduling can be compared.
+*/
+
+#define RT_STACK_PREFAULT   (256 * 1024)
+
+#define JITTER_BUCKETS      14
+
+// upper limits of the buckets in usec, the last one is everything above
+#define JITTER_BUCKET_LIMITS { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000 }
+
+struct jitter_hist {
+    unsigned long buckets[JITTER_BUCKETS];
+    unsigned long count;
+    double sum;     // sec
+    double max;     // sec
+};
+
+// priority: 1-99 (0: keep SCHED_OTHER), cpu: -1 for no pinning
+int  rt_setup(int priority, int cpu);
+// CLOCK_MONOTONIC in sec
+double rt_now();
+
+void jitter_init(struct jitter_hist *hist);
+void jitter_add(struct jitter_hist *hist, double sec);
+// e.g. "n=123 avg=0.052ms max=0.310ms <50us:100 <100us:20 ..." (only the non-empty buckets)
+int  jitter_format(struct jitter_hist *hist, char *str);
+
+#endif
@@ -0,0 +1,357 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "mecanumrover_commlib.h"
+#include "mecanumcommander_safestop.h"
+
+
+static int safestop_serial_lock(void *arg) {
+    struct safestop *ss = arg;
+    unsigned char latched;
+
+    pthread_mutex_lock(&ss->seriallock);
+
+    // the watchdog latches before it competes for the port: either this setpoint is on the wire before the stop, or it is not sent at all
+    if (ss->motion == 1) {
+        pthread_mutex_lock(&ss->lock);
+        latched = ss->latched;
+        pthread_mutex_unlock(&ss->lock);
+        if (latched == 1) {
+            pthread_mutex_unlock(&ss->seriallock);
+            ss->refused++;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void safestop_serial_unlock(void *arg) {
+    struct safestop *ss = arg;
+
+    pthread_mutex_unlock(&ss->seriallock);
+}
+
+
+// CLOCK_MONOTONIC sec -> absolute timespec on the given clock
+static void safestop_timespec(clockid_t clock, double monotonic, struct timespec *ts) {
+    double abstime;
+
+    if (clock == CLOCK_MONOTONIC) {
+        abstime = monotonic;
+    } else {
+        clock_gettime(clock, ts);
+        abstime = ts->tv_sec + ts->tv_nsec / 1000000000.0 + (monotonic - rt_now());
+    }
+    ts->tv_sec  = (time_t)abstime;
+    ts->tv_nsec = (long)((abstime - ts->tv_sec) * 1000000000.0);
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+
+// write the stop frame to the wire, returns 1 if the serial lock could not be taken in time, -1 on error
+static int safestop_send(struct safestop *ss, double due) {
+    struct timespec ts;
+    uint64_t counter = 1;
+    int locked, ret = 0;
+
+    // the transaction in progress gives up waiting for its reply
+    if (write(ss->abortfd, &counter, sizeof(counter)) != sizeof(counter)) {
+        ret = -1;
+    }
+
+    // shared connection: there is no other way to the controller than after the transaction in progress
+    if (ss->shared == 1) {
+        pthread_mutex_lock(&ss->seriallock);
+        if (rover_serial_write_locked(&ss->frame[1], ss->framelen) != ss->framelen) {
+            ret = -1;
+        }
+        read(ss->abortfd, &counter, sizeof(counter));
+        pthread_mutex_unlock(&ss->seriallock);
+        return ret;
+    }
+
+    // PI mutexes only support CLOCK_REALTIME timeouts
+    safestop_timespec(CLOCK_REALTIME, due + ss->deadline_ms / 2000.0, &ts);
+    locked = (pthread_mutex_timedlock(&ss->seriallock, &ts) == 0);
+
+    if (locked) {
+        if (rover_transport_write(&ss->transport, &ss->frame[1], ss->framelen) != ss->framelen) {
+            ret = -1;
+        }
+    } else {
+        if (rover_transport_write(&ss->transport, ss->frame, ss->framelen + 1) != (ss->framelen + 1)) {
+            ret = -1;
+        }
+    }
+    if (rover_transport_drain(&ss->transport) == -1) {
+        ret = -1;
+    }
+
+    // eventfd: reading resets the counter
+    read(ss->abortfd, &counter, sizeof(counter));
+
+    if (locked) {
+        pthread_mutex_unlock(&ss->seriallock);
+    } else if (ret == 0) {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
+static void *safestop_thread(void *arg) {
+
+    struct safestop *ss = arg;
+    struct timespec ts;
+    double due, latency;
+    int ret;
+
+    pthread_mutex_lock(&ss->lock);
+
+    while (ss->stop == 0) {
+
+        if (ss->armed == 0) {
+            pthread_cond_wait(&ss->cond, &ss->lock);
+            continue;
+        }
+        if (rt_now() < ss->expiry) {
+            safestop_timespec(CLOCK_MONOTONIC, ss->expiry, &ts);
+            pthread_cond_timedwait(&ss->cond, &ss->lock, &ts);
+            continue;
+        }
+
+        due = ss->expiry;
+        ss->armed = 0;
+        ss->latched = 1;
+        pthread_mutex_unlock(&ss->lock);
+
+        ret = safestop_send(ss, due);
+        latency = rt_now() - due;
+
+        pthread_mutex_lock(&ss->lock);
+        ss->fired++;
+        ss->last_latency = latency;
+        jitter_add(&ss->latency, latency);
+        if (latency * 1000.0 > ss->deadline_ms) {
+            ss->late++;
+        }
+        if (ret == 1) {
+            ss->forced++;
+        } else if (ret == -1) {
+            ss->errors++;
+        }
+    }
+
+    pthread_mutex_unlock(&ss->lock);
+
+    return NULL;
+}
+
+
+int safestop_init(struct safestop *ss, const unsigned char *frame, int framelen, unsigned int deadline_ms, int priority) {
+
+    struct rover_serial_hooks hooks;
+    pthread_mutexattr_t mutexattr;
+    pthread_condattr_t condattr;
+    pthread_attr_t threadattr;
+    struct sched_param param;
+    int ret;
+
+    memset(ss, 0, sizeof(struct safestop));
+    ss->transport.fd = -1;
+    ss->transport.pipefd = -1;
+    ss->abortfd = -1;
+
+    if ((framelen < 1) || (framelen > SAFESTOP_FRAME_MAXLEN)) {
+        fprintf(stderr, "safestop_init(): invalid frame length: %d\n", framelen);
+        return -1;
+    }
+    ss->frame[0] = '\n';
+    memcpy(&ss->frame[1], frame, framelen);
+    ss->framelen = framelen;
+    ss->deadline_ms = deadline_ms;
+    jitter_init(&ss->latency);
+
+    // same transport and settings as send_command_raw(), but a connection of its own
+    // (a serial bridge over TCP accepts only one connection, and an HTTP request cannot be cut short:
+    // there the stop goes through the main connection)
+    if (rover_transport_parse(&ss->transport, rover_devfile, rover_baudrate) == -1) {
+        return -1;
+    }
+    if ((ss->transport.type == TRANSPORT_TCP) || (ss->transport.type == TRANSPORT_HTTP)) {
+        ss->shared = 1;
+    } else if (rover_transport_open(&ss->transport, rover_devfile, rover_baudrate) == -1) {
+        return -1;
+    }
+
+    ss->abortfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ss->abortfd == -1) {
+        perror("eventfd()");
+        rover_transport_close(&ss->transport);
+        return -1;
+    }
+
+    // the control loop holding the port gets the priority of the watchdog
+    pthread_mutexattr_init(&mutexattr);
+    pthread_mutexattr_setprotocol(&mutexattr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&ss->seriallock, &mutexattr);
+    pthread_mutexattr_destroy(&mutexattr);
+    pthread_mutex_init(&ss->lock, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ss->cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    pthread_attr_init(&threadattr);
+    if (priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        pthread_attr_setinheritsched(&threadattr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&threadattr, SCHED_FIFO);
+        pthread_attr_setschedparam(&threadattr, &param);
+    }
+    ret = pthread_create(&ss->thread, &threadattr, safestop_thread, ss);
+    pthread_attr_destroy(&threadattr);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_create(safestop, priority %d): %s\n", priority, strerror(ret));
+        pthread_cond_destroy(&ss->cond);
+        pthread_mutex_destroy(&ss->lock);
+        pthread_mutex_destroy(&ss->seriallock);
+        close(ss->abortfd);
+        rover_transport_close(&ss->transport);
+        return -1;
+    }
+
+    hooks.lock    = safestop_serial_lock;
+    hooks.unlock  = safestop_serial_unlock;
+    hooks.arg     = ss;
+    hooks.abortfd = ss->abortfd;
+    rover_set_serial_hooks(&hooks);
+
+    ss->running = 1;
+
+    return 0;
+}
+
+
+void safestop_close(struct safestop *ss) {
+
+    if (ss->running == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&ss->lock);
+    ss->stop = 1;
+    pthread_cond_signal(&ss->cond);
+    pthread_mutex_unlock(&ss->lock);
+    pthread_join(ss->thread, NULL);
+
+    rover_set_serial_hooks(NULL);
+    close(ss->abortfd);
+    rover_transport_close(&ss->transport);
+    pthread_cond_destroy(&ss->cond);
+    pthread_mutex_destroy(&ss->lock);
+    pthread_mutex_destroy(&ss->seriallock);
+
+    ss->running = 0;
+}
+
+
+void safestop_feed(struct safestop *ss, double validity) {
+
+    if (ss->running == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&ss->lock);
+    ss->expiry = rt_now() + validity;
+    ss->armed = 1;
+    if (validity > 0) {
+        ss->latched = 0;
+    }
+    pthread_cond_signal(&ss->cond);
+    pthread_mutex_unlock(&ss->lock);
+}
+
+
+void safestop_disarm(struct safestop *ss) {
+
+    if (ss->running == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&ss->lock);
+    ss->armed = 0;
+    pthread_mutex_unlock(&ss->lock);
+}
+
+
+void safestop_trigger(struct safestop *ss) {
+    safestop_feed(ss, 0.0);
+}
+
+
+void safestop_motion(struct safestop *ss, int motion) {
+
+    if (ss->running == 0) {
+        return;
+    }
+
+    ss->motion = (motion != 0);
+}
+
+
+unsigned long safestop_poll(struct safestop *ss, double *last_latency) {
+    unsigned long newstops;
+
+    if (ss->running == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ss->lock);
+    newstops = ss->fired - ss->fired_polled;
+    ss->fired_polled = ss->fired;
+    *last_latency = ss->last_latency;
+    pthread_mutex_unlock(&ss->lock);
+
+    return newstops;
+}
+
+
+void safestop_stats(struct safestop *ss, struct jitter_hist *latency, unsigned long *late, unsigned long *forced, unsigned long *errors) {
+
+    // after safestop_close() the thread is joined and the mutex destroyed, the counters are final
+    if (ss->running == 1) {
+        pthread_mutex_lock(&ss->lock);
+    }
+    *latency = ss->latency;
+    *late    = ss->late;
+    *forced  = ss->forced;
+    *errors  = ss->errors;
+    if (ss->running == 1) {
+        pthread_mutex_unlock(&ss->lock);
+    }
+}
@@ -0,0 +1,91 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_SAFESTOP_H__
+
+#define __MECACOM_SAFESTOP_H__
+
+#include <pthread.h>
+#include "mecanumcommander_rt.h"
+
+/*
+ Safety stop watchdog
+
+ A thread of its own, which does not depend on the control loop getting past select(), the socket
+ parsing or a memmap read. The control loop feeds it with every remote command, if it is not fed again
+ within the validity of the command (or safestop_trigger() is called, e.g. the client disconnected),
+ the pre-formatted stop frame is written to the serial port within deadline_ms:
+ - the serial port is opened and configured once, the frame is formatted at init
+ - every send_command_raw() holds the serial lock (commlib hooks), the watchdog cuts its reply wait
+   short through an eventfd and takes the lock
+ - if the lock is not released within half of the deadline (e.g. a write() is stuck), the frame is
+   written anyway, starting with a newline to terminate the half sent line
+ - the latency (expiry -> frame transmitted, tcdrain()) is recorded in a histogram
+ - once it fired, the stop stands until the next feed: setpoints written by the control loop
+   (safestop_motion()) are refused in the serial lock, so a setpoint from before the expiry which
+   lost the race for the port cannot follow the stop frame and start the robot again
+
+ With a tcp: or http:// device there is no second connection: a serial bridge accepts only one, and
+ an HTTP request (up to TRANSPORT_HTTP_TIMEOUT_MS) cannot be interrupted. The stop is written through
+ the main connection (rover_serial_write_locked()) once the transaction in progress released the
+ serial lock, nothing is forced, and deadline_ms is not guaranteed (shared is set, the late stops
+ are still counted).
+
+ With a real-time control loop the watchdog runs with a higher SCHED_FIFO priority, and the serial
+ lock inherits priority.
+*/
+
+#define SAFESTOP_FRAME_MAXLEN   32
+
+struct safestop {
+    pthread_t thread;
+    pthread_mutex_t seriallock;     // held during every serial transaction and while sending the stop
+    pthread_mutex_t lock;           // protects everything below
+    pthread_cond_t cond;
+    struct rover_transport transport;   // its own connection to the controller (not opened if shared)
+    unsigned char shared;           // tcp:/http:// device: the stop goes through the main connection, no deadline
+    int abortfd;                    // eventfd
+    unsigned char frame[SAFESTOP_FRAME_MAXLEN + 1];  // [0] is '\n', used when the lock was not released
+    int framelen;
+    unsigned int deadline_ms;
+    unsigned char running;
+    unsigned char stop;
+    unsigned char armed;
+    unsigned char latched;          // fired, not fed since
+    unsigned char motion;           // the control loop is writing setpoints (its own thread only)
+    double expiry;                  // CLOCK_MONOTONIC sec
+    // statistics
+    unsigned long fired;
+    unsigned long fired_polled;
+    unsigned long late;             // the stop was on the wire later than deadline_ms
+    unsigned long forced;           // written without the serial lock
+    unsigned long errors;           // write() or tcdrain() failed
+    unsigned long refused;          // setpoint transactions refused after a stop (control loop only)
+    double last_latency;            // sec
+    struct jitter_hist latency;
+};
+
+// frame: the stop command as returned by rover_format_stop_frame()
+// priority: SCHED_FIFO priority of the watchdog thread (0: normal scheduling)
+// opens rover_devfile (rover_transport_open(), except if shared) and installs the serial hooks of commlib, returns -1 on error
+int  safestop_init(struct safestop *ss, const unsigned char *frame, int framelen, unsigned int deadline_ms, int priority);
+// stops the thread and removes the hooks, can be called more than once
+void safestop_close(struct safestop *ss);
+// (re)arm: stop the robot if not fed again within validity sec, a new command (validity > 0) releases a stop
+void safestop_feed(struct safestop *ss, double validity);
+void safestop_disarm(struct safestop *ss);
+// stop the robot right now
+void safestop_trigger(struct safestop *ss);
+// 1: the following serial transactions set the speed, they are refused (-1) while a stop stands, 0: back to normal
+void safestop_motion(struct safestop *ss, int motion);
+// number of stops sent since the last call, and the latency of the last one
+unsigned long safestop_poll(struct safestop *ss, double *last_latency);
+// copy of the statistics (also after safestop_close())
+void safestop_stats(struct safestop *ss, struct jitter_hist *latency, unsigned long *late, unsigned long *forced, unsigned long *errors);
+
+#endif
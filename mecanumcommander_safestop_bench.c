@@ -0,0 +1,248 @@
+/*
+    safestop_bench - worst-case latency of the safety stop watchdog
+    The robot controller is simulated on the master side of a pty, the watchdog opens the slave
+    side as its serial port. A load thread keeps the port busy like the control loop does
+    (set speed commands waiting for their reply), and the time between the expiry of the watchdog
+    and the arrival of the complete stop frame at the simulated controller is measured.
+    part of NLAB-MecanumCommander for Linux
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "mecanumrover_commlib.h"
+#include "mecanumcommander_rt.h"
+#include "mecanumcommander_safestop.h"
+
+// how the simulated controller answers the commands of the load thread
+#define SIM_IDLE    0   // no load at all
+#define SIM_PROMPT  1   // replies after 1 ms
+#define SIM_MUTE    2   // never replies, every command waits REPLYWAIT_TIMEOUT_USEC
+#define SIM_DRIBBLE 3   // replies one byte every 20 ms, so the reply wait never times out by itself
+#define SIM_STUCK   4   // the load thread keeps the serial lock for 200 ms (e.g. a write() stuck)
+#define SIM_MODES   5
+
+static const char *sim_mode_names[SIM_MODES] = { "idle", "prompt", "mute", "dribble", "stuck" };
+
+struct sim {
+    int masterfd;
+    int mode;
+    unsigned char stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char stopline[SAFESTOP_FRAME_MAXLEN];   // the stop frame as a line, without the newlines
+    unsigned long stops;                    // complete stop frames received
+    double time_laststop;
+};
+
+struct load {
+    struct sim *sim;
+    struct safestop *ss;
+    struct roverstruct *rover;
+    unsigned char stop;
+};
+
+
+static void *sim_thread(void *arg) {
+
+    struct sim *sim = arg;
+    struct pollfd pfd;
+    char line[BUFFER_SIZE];
+    int linelen = 0, replypos = 0, replylen = 0, timeout;
+    const char *reply = "w10 C0 0000\n";
+    double time_nextreply = 0;
+    unsigned char c;
+
+    pfd.fd = sim->masterfd;
+    pfd.events = POLLIN;
+
+    while (sim->stop == 0) {
+
+        timeout = 10;
+        if (replypos < replylen) {
+            timeout = (int)((time_nextreply - rt_now()) * 1000.0);
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        }
+
+        if ((poll(&pfd, 1, timeout) == 1) && (read(sim->masterfd, &c, 1) == 1)) {
+            if ((c == '\n') || (c == '\r')) {
+                if (linelen == 0) {
+                    continue;
+                }
+                line[linelen] = 0;
+                if (strstr(line, sim->stopline) != NULL) {
+                    pthread_mutex_lock(&sim->lock);
+                    sim->stops++;
+                    sim->time_laststop = rt_now();
+                    pthread_cond_signal(&sim->cond);
+                    pthread_mutex_unlock(&sim->lock);
+                } else if ((sim->mode == SIM_PROMPT) || (sim->mode == SIM_DRIBBLE)) {
+                    replypos = 0;
+                    replylen = strlen(reply);
+                    time_nextreply = rt_now() + ((sim->mode == SIM_PROMPT) ? 0.001 : 0.020);
+                }
+                linelen = 0;
+            } else if ((c != 0) && (linelen < (BUFFER_SIZE - 1))) {
+                line[linelen++] = c;
+            }
+        }
+
+        if ((replypos < replylen) && (rt_now() >= time_nextreply)) {
+            if (sim->mode == SIM_PROMPT) {
+                write(sim->masterfd, reply, replylen);
+                replypos = replylen;
+            } else {
+                write(sim->masterfd, &reply[replypos++], 1);
+                time_nextreply = rt_now() + 0.020;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// keeps the serial port busy like the control loop
+static void *load_thread(void *arg) {
+
+    struct load *load = arg;
+    unsigned char answer[BUFFER_SIZE];
+    struct timespec ts = { 0, 200000000L };
+    struct timespec idle = { 0, 1000000L };
+
+    while (load->stop == 0) {
+        if (load->sim->mode == SIM_IDLE) {
+            nanosleep(&idle, NULL);
+        } else if (load->sim->mode == SIM_STUCK) {
+            pthread_mutex_lock(&load->ss->seriallock);
+            nanosleep(&ts, NULL);
+            pthread_mutex_unlock(&load->ss->seriallock);
+        } else {
+            rover_set_X_speed(load->rover, 100, answer);
+        }
+    }
+
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+
+    struct sim sim;
+    struct load load;
+    struct safestop ss;
+    struct roverstruct rover;
+    struct jitter_hist wire[SIM_MODES];
+    pthread_t simthread, loadthread;
+    struct timespec ts;
+    unsigned char frame[SAFESTOP_FRAME_MAXLEN];
+    char histstr[512];
+    unsigned long stops, late, forced, errors;
+    double validity, time_feed, worst = 0;
+    int iterations = 100, deadline_ms = 20, priority = 0, usekcommands = 0;
+    int framelen, mode, i, missed = 0;
+
+    if (argc > 1) { iterations  = atoi(argv[1]); }
+    if (argc > 2) { deadline_ms = atoi(argv[2]); }
+    if (argc > 3) { priority    = atoi(argv[3]); }
+    if (argc > 4) { usekcommands = atoi(argv[4]); }
+    if ((iterations < 1) || (deadline_ms < 1)) {
+        printf("Usage: %s [iterations per mode] [deadline ms] [SCHED_FIFO priority] [kcommands 0/1]\n", argv[0]);
+        return 1;
+    }
+
+    // a MecanumRover 2.1, as far as the registers are concerned
+    memset(&rover, 0, sizeof(rover));
+    memset(rover.memmap_main, '0', sizeof(rover.memmap_main));
+    rover.memmap_main[0] = '2';
+    rover.memmap_main[1] = '1';
+    rover_identify_from_main_memmap(&rover);
+
+    memset(&sim, 0, sizeof(sim));
+    pthread_mutex_init(&sim.lock, NULL);
+    pthread_cond_init(&sim.cond, NULL);
+    sim.masterfd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((sim.masterfd == -1) || (grantpt(sim.masterfd) == -1) || (unlockpt(sim.masterfd) == -1)) {
+        perror("posix_openpt()");
+        return 1;
+    }
+    rover_devfile = ptsname(sim.masterfd);
+
+    framelen = rover_format_stop_frame(&rover, usekcommands, frame);
+    memcpy(sim.stopline, frame, framelen);
+    sim.stopline[strcspn(sim.stopline, "\n")] = 0;
+
+    if (safestop_init(&ss, frame, framelen, deadline_ms, priority) == -1) {
+        printf("Cannot start the watchdog!\n");
+        return 1;
+    }
+
+    pthread_create(&simthread, NULL, sim_thread, &sim);
+    memset(&load, 0, sizeof(load));
+    load.sim = &sim;
+    load.ss = &ss;
+    load.rover = &rover;
+    pthread_create(&loadthread, NULL, load_thread, &load);
+
+    printf("Serial port: %s (pty), stop frame: %s, deadline: %d ms, watchdog priority: %d\n",
+           rover_devfile, sim.stopline, deadline_ms, priority);
+
+    srand(time(NULL));
+    for (mode = 0; mode < SIM_MODES; mode++) {
+
+        jitter_init(&wire[mode]);
+        sim.mode = mode;
+
+        for (i = 0; i < iterations; i++) {
+
+            // expire at a random point of the serial transaction in progress
+            validity = (5 + rand() % 60) / 1000.0;
+            pthread_mutex_lock(&sim.lock);
+            stops = sim.stops;
+            time_feed = rt_now();
+            safestop_feed(&ss, validity);
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 2;
+            while ((sim.stops == stops) && (pthread_cond_timedwait(&sim.cond, &sim.lock, &ts) == 0));
+            if (sim.stops == stops) {
+                missed++;
+            } else {
+                jitter_add(&wire[mode], sim.time_laststop - (time_feed + validity));
+            }
+            pthread_mutex_unlock(&sim.lock);
+        }
+
+        jitter_format(&wire[mode], histstr);
+        printf("%-8s %s\n", sim_mode_names[mode], histstr);
+        if (wire[mode].max > worst) {
+            worst = wire[mode].max;
+        }
+    }
+
+    load.stop = 1;
+    sim.mode = SIM_PROMPT;
+    pthread_join(loadthread, NULL);
+    safestop_close(&ss);
+    sim.stop = 1;
+    pthread_join(simthread, NULL);
+
+    safestop_stats(&ss, &wire[0], &late, &forced, &errors);
+    jitter_format(&wire[0], histstr);
+    printf("watchdog %s\n", histstr);
+    printf("late: %lu, without the serial lock: %lu, failed: %lu, not received: %d\n", late, forced, errors, missed);
+    printf("Worst-case stop latency on the wire: %.3f ms (deadline: %d ms) - %s\n",
+           worst * 1000.0, deadline_ms, ((worst * 1000.0 <= deadline_ms) && (missed == 0)) ? "OK" : "FAILED");
+
+    return ((worst * 1000.0 <= deadline_ms) && (missed == 0)) ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "mecanumcommander_telemetry.h"
+
+
+void telemetry_init(struct telemetry *tlm) {
+    memset(tlm, 0, sizeof(struct telemetry));
+}
+
+
+// scale to the integer units of the telemetry (mm, mrad, mm^2, ...), saturated to int32
+static int telemetry_scaled(double value, double scale) {
+    value *= scale;
+    if (value >  2147483647.0) { return  2147483647; }
+    if (value < -2147483647.0) { return -2147483647; }
+    return (int)lrint(value);
+}
+
+
+void telemetry_update_sample(struct telemetry *tlm, struct roverstruct *rover, int speedX, int speedY, int rotate, const struct odom_state *odom,
+                             const struct trajectory_status *trj, const struct clocksync *cs) {
+
+    struct telemetry_sample sample;
+    int i, j, k;
+
+    memset(&sample, 0, sizeof(struct telemetry_sample));
+
+    sample.uptime_ms  = rover_get_uptime(rover) * 1000.0 + 0.5;
+    sample.battery_mv = rover_get_battery_voltage(rover) * 1000.0 + 0.5;
+    sample.motor_status[0] = rover_get_motor_status(rover, rover->memmap_main);
+
+    // motor 0,1: main controller, 2,3: second controller
+    sample.encoder[0] = rover_get_encoder_value0(rover, rover->memmap_main);
+    sample.encoder[1] = rover_get_encoder_value1(rover, rover->memmap_main);
+
+    switch (rover->sysname) {
+
+        case SYSNAME_MECANUMROVER21:
+            sample.motor_status[1] = rover_get_motor_status(rover, rover->memmap_second);
+            sample.encoder[2]  = rover_get_encoder_value0(rover, rover->memmap_second);
+            sample.encoder[3]  = rover_get_encoder_value1(rover, rover->memmap_second);
+            sample.position[0] = rover_get_measured_position0(rover, rover->memmap_main);
+            sample.position[1] = rover_get_measured_position1(rover, rover->memmap_main);
+            sample.position[2] = rover_get_measured_position0(rover, rover->memmap_second);
+            sample.position[3] = rover_get_measured_position1(rover, rover->memmap_second);
+            sample.speed[0]    = rover_get_speed0(rover, rover->memmap_main);
+            sample.speed[1]    = rover_get_speed1(rover, rover->memmap_main);
+            sample.speed[2]    = rover_get_speed0(rover, rover->memmap_second);
+            sample.speed[3]    = rover_get_speed1(rover, rover->memmap_second);
+            sample.current_ma[0] = rover_get_measured_current_value0(rover, rover->memmap_main)   * 1000.0 + 0.5;
+            sample.current_ma[1] = rover_get_measured_current_value1(rover, rover->memmap_main)   * 1000.0 + 0.5;
+            sample.current_ma[2] = rover_get_measured_current_value0(rover, rover->memmap_second) * 1000.0 + 0.5;
+            sample.current_ma[3] = rover_get_measured_current_value1(rover, rover->memmap_second) * 1000.0 + 0.5;
+            break;
+
+        case SYSNAME_MEGAROVER3:
+            sample.speed[0] = rover_get_motorspeed0(rover, rover->memmap_main);
+            sample.speed[1] = rover_get_motorspeed1(rover, rover->memmap_main);
+            break;
+    }
+
+    sample.setpoint[REMOTECMD_AXIS_X]   = speedX;
+    sample.setpoint[REMOTECMD_AXIS_Y]   = speedY;
+    sample.setpoint[REMOTECMD_AXIS_ROT] = rotate;
+    sample.rs485_err[0] = rover->rs485_err_0x10;
+    sample.rs485_err[1] = rover->rs485_err_0x1F;
+
+    if (odom != NULL) {
+        sample.odom_uptime_ms = odom->uptime_ms;
+        sample.odom_pose[0]  = telemetry_scaled(odom->x,     1000.0);
+        sample.odom_pose[1]  = telemetry_scaled(odom->y,     1000.0);
+        sample.odom_pose[2]  = telemetry_scaled(odom->theta, 1000.0);
+        sample.odom_twist[0] = telemetry_scaled(odom->vx,    1000.0);
+        sample.odom_twist[1] = telemetry_scaled(odom->vy,    1000.0);
+        sample.odom_twist[2] = telemetry_scaled(odom->omega, 1000.0);
+        // upper triangles: xx xy xt yy yt tt
+        k = 0;
+        for (i = 0; i < 3; i++) {
+            for (j = i; j < 3; j++) {
+                sample.odom_pose_cov[k]  = telemetry_scaled(odom->pose_cov[i][j],  1000000.0);
+                sample.odom_twist_cov[k] = telemetry_scaled(odom->twist_cov[i][j], 1000000.0);
+                k++;
+            }
+        }
+    }
+
+    if (trj != NULL) {
+        sample.trj_id       = trj->id;
+        sample.trj_state    = trj->state;
+        sample.trj_segment  = trj->segment;
+        sample.trj_error_mm = trj->error_mm;
+    }
+
+    if ((cs != NULL) && (cs->valid == 1)) {
+        sample.host_us = clocksync_host_time(cs, sample.uptime_ms) * 1000000.0 + 0.5;
+        if (odom != NULL) {
+            sample.odom_host_us = clocksync_host_time(cs, odom->uptime_ms) * 1000000.0 + 0.5;
+        }
+        sample.sync_error_us = clocksync_error(cs) * 1000000.0 + 0.5;
+    }
+
+    sample.seq = tlm->sample.seq;
+    if (memcmp(&sample, &tlm->sample, sizeof(struct telemetry_sample)) != 0) {
+        sample.seq++;
+        tlm->sample = sample;
+    }
+
+}
+
+
+int telemetry_active(struct telemetry *tlm) {
+
+    int i;
+
+    for (i = 0; i < TELEMETRY_SUBSCRIBERS_MAX; i++) {
+        if ((tlm->subscribers[i].used == 1) && (tlm->subscribers[i].period_ms > 0)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// anyone can subscribe any address over UDP, so a subscription does not last unless the subscriber keeps asking for it
+static void telemetry_expire(struct telemetry *tlm, double time_current) {
+
+    struct telemetry_subscriber *sub;
+    int i;
+
+    for (i = 0; i < TELEMETRY_SUBSCRIBERS_MAX; i++) {
+        sub = &tlm->subscribers[i];
+        if ((sub->used == 1) && (sub->proto == TELEMETRY_PROTO_UDP) && (sub->permanent == 0) &&
+            ((time_current - sub->time_renewed) > TELEMETRY_LEASE_SEC)) {
+            sub->used = 0;
+            tlm->expired++;
+        }
+    }
+}
+
+
+struct telemetry_subscriber *telemetry_find(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned char create) {
+
+    struct telemetry_subscriber *sub, *freesub = NULL;
+    int i;
+
+    for (i = 0; i < TELEMETRY_SUBSCRIBERS_MAX; i++) {
+        sub = &tlm->subscribers[i];
+        if (sub->used == 0) {
+            if (freesub == NULL) {
+                freesub = sub;
+            }
+            continue;
+        }
+        if ((sub->permanent == 1) || (sub->proto != proto)) {
+            continue;
+        }
+        if (proto == TELEMETRY_PROTO_TCP) {
+            if (sub->out == out) {
+                return sub;
+            }
+        } else if ((sub->addr.sin_addr.s_addr == addr->sin_addr.s_addr) && (sub->addr.sin_port == addr->sin_port)) {
+            return sub;
+        }
+    }
+
+    if ((create == 0) || (freesub == NULL)) {
+        return NULL;
+    }
+
+    memset(freesub, 0, sizeof(struct telemetry_subscriber));
+    freesub->used   = 1;
+    freesub->proto  = proto;
+    freesub->fd     = fd;
+    freesub->out    = out;
+    freesub->fields = TLM_FIELD_ALL;
+    if (addr != NULL) {
+        freesub->addr = *addr;
+    }
+
+    return freesub;
+}
+
+
+int telemetry_subscribe(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned int period_ms, double time_current) {
+
+    struct telemetry_subscriber *sub;
+
+    telemetry_expire(tlm, time_current);
+
+    if (period_ms == 0) {
+        sub = telemetry_find(tlm, proto, out, fd, addr, 0);
+        if (sub != NULL) {
+            sub->used = 0;
+        }
+        return 0;
+    }
+
+    sub = telemetry_find(tlm, proto, out, fd, addr, 1);
+    if (sub == NULL) {
+        return -1;
+    }
+    if (period_ms < TELEMETRY_PERIOD_MIN_MS) {
+        period_ms = TELEMETRY_PERIOD_MIN_MS;
+    }
+    sub->period_ms = period_ms;
+    sub->time_renewed = time_current;
+
+    return 0;
+}
+
+
+int telemetry_set_fields(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned int fields, double time_current) {
+
+    struct telemetry_subscriber *sub;
+
+    telemetry_expire(tlm, time_current);
+
+    sub = telemetry_find(tlm, proto, out, fd, addr, 1);
+    if (sub == NULL) {
+        return -1;
+    }
+    sub->fields = fields & TLM_FIELD_ALL;
+    sub->time_renewed = time_current;
+    // send the new set of fields with the next period even if the sample did not change
+    sub->seq_last_sent = tlm->sample.seq - 1;
+
+    return 0;
+}
+
+
+int telemetry_add_multicast(struct telemetry *tlm, int fd, const struct sockaddr_in *group, unsigned int period_ms, unsigned int fields) {
+
+    struct telemetry_subscriber *sub = NULL;
+    int i;
+
+    for (i = 0; i < TELEMETRY_SUBSCRIBERS_MAX; i++) {
+        if (tlm->subscribers[i].used == 0) {
+            sub = &tlm->subscribers[i];
+            break;
+        }
+    }
+    if (sub == NULL) {
+        return -1;
+    }
+
+    memset(sub, 0, sizeof(struct telemetry_subscriber));
+    sub->used      = 1;
+    sub->proto     = TELEMETRY_PROTO_UDP;
+    sub->permanent = 1;
+    sub->fd        = fd;
+    sub->addr      = *group;
+    sub->fields    = fields & TLM_FIELD_ALL;
+    sub->period_ms = (period_ms < TELEMETRY_PERIOD_MIN_MS) ? TELEMETRY_PERIOD_MIN_MS : period_ms;
+
+    return 0;
+}
+
+
+int telemetry_publish(struct telemetry *tlm, double time_current) {
+
+    struct telemetry_subscriber *sub;
+    unsigned char message[REMOTETEXT_TELEMETRY_MAXLEN];  // the text format is the longer one
+    int i, messagelen, sret, sentcount = 0;
+
+    tlm->udp_tokens += (time_current - tlm->time_udp_tokens) * TELEMETRY_UDP_RATE_MAX;
+    if ((tlm->udp_tokens > TELEMETRY_SUBSCRIBERS_MAX) || (tlm->udp_tokens < 0)) {
+        tlm->udp_tokens = TELEMETRY_SUBSCRIBERS_MAX;    // burst: one sample to every subscriber
+    }
+    tlm->time_udp_tokens = time_current;
+
+    telemetry_expire(tlm, time_current);
+
+    for (i = 0; i < TELEMETRY_SUBSCRIBERS_MAX; i++) {
+
+        sub = &tlm->subscribers[i];
+
+        if ((sub->used == 0) || (sub->period_ms == 0)) {
+            continue;
+        }
+        // only new samples are sent, but not more often than requested
+        if (sub->seq_last_sent == tlm->sample.seq) {
+            continue;
+        }
+        if ((time_current - sub->time_last_sent) < (sub->period_ms / 1000.0)) {
+            continue;
+        }
+
+        if (sub->proto == TELEMETRY_PROTO_TCP) {
+            messagelen = remotetext_format_telemetry(&tlm->sample, sub->fields, (char *)message, sizeof(message));
+            // goes out with the replies, if the client does not read, the sample is dropped
+            sret = (remote_outbuf_append(sub->out, message, messagelen) == 0) ? messagelen : 0;
+        } else {
+            // the total is capped, a subscriber which does not fit is served next time
+            if (sub->permanent == 0) {
+                if (tlm->udp_tokens < 1.0) {
+                    tlm->ratelimited++;
+                    continue;
+                }
+                tlm->udp_tokens -= 1.0;
+            }
+            messagelen = remotebin_encode_telemetry(&tlm->sample, sub->fields, sub->packetno, message);
+            sret = sendto(sub->fd, message, messagelen, MSG_DONTWAIT, (struct sockaddr *)&sub->addr, sizeof(struct sockaddr_in));
+            sub->packetno = (sub->packetno + 1) & 0xFFFF;
+        }
+
+        sub->time_last_sent = time_current;
+        sub->seq_last_sent  = tlm->sample.seq;
+
+        if (sret != messagelen) {
+            sub->senderrors++;
+            if ((sret == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (sub->permanent == 0)) {
+                sub->used = 0;  // connection lost, or the client is gone
+            }
+            continue;
+        }
+
+        sub->sent++;
+        sentcount++;
+    }
+
+    return sentcount;
+}
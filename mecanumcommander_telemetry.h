@@ -0,0 +1,75 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_TELEMETRY_H__
+
+#define __MECACOM_TELEMETRY_H__
+
+#include <netinet/in.h>
+#include "mecanumrover_commlib.h"
+#include "mecanumcommander_remote.h"
+#include "mecanumcommander_odometry.h"
+#include "mecanumcommander_trajectory.h"
+#include "mecanumcommander_clocksync.h"
+
+#define TELEMETRY_SUBSCRIBERS_MAX  8
+#define TELEMETRY_PERIOD_MIN_MS    10   // faster subscriptions are rounded up to this
+#define TELEMETRY_LEASE_SEC        10.0 // UDP subscriptions expire unless renewed (TLR/TLF) within this time
+#define TELEMETRY_UDP_RATE_MAX     200  // packets/s to all the UDP subscribers together (multicast not included)
+
+#define TELEMETRY_PROTO_TCP        0    // text lines on the command connection
+#define TELEMETRY_PROTO_UDP        1    // binary packets to the address of the subscriber (unicast or multicast)
+
+struct telemetry_subscriber {
+    unsigned char used;
+    unsigned char proto;
+    unsigned char permanent;        // e.g. multicast, not removed by unsubscribing
+    int fd;                         // UDP: the socket to send from
+    struct remote_outbuf *out;      // TCP: the output buffer of the connection
+    struct sockaddr_in addr;        // UDP only
+    unsigned int fields;            // TLM_FIELD_*
+    unsigned int period_ms;         // 0: subscription is paused
+    double time_last_sent;
+    double time_renewed;            // UDP: the last TLR/TLF of the subscriber (lease)
+    unsigned int seq_last_sent;
+    unsigned int packetno;          // UDP packet number
+    unsigned long sent;
+    unsigned long senderrors;
+};
+
+struct telemetry {
+    struct telemetry_subscriber subscribers[TELEMETRY_SUBSCRIBERS_MAX];
+    struct telemetry_sample sample;
+    double udp_tokens;              // token bucket of TELEMETRY_UDP_RATE_MAX
+    double time_udp_tokens;
+    unsigned long expired;          // UDP subscriptions not renewed in time
+    unsigned long ratelimited;      // UDP samples not sent because of TELEMETRY_UDP_RATE_MAX
+};
+
+void telemetry_init(struct telemetry *tlm);
+// decode the memmaps (and the odometry, the trajectory status, if not NULL) into a sample, the sequence number is increased only if something changed
+// cs: the uptimes are stamped with the host time (if not NULL and synchronized)
+void telemetry_update_sample(struct telemetry *tlm, struct roverstruct *rover, int speedX, int speedY, int rotate, const struct odom_state *odom,
+                             const struct trajectory_status *trj, const struct clocksync *cs);
+// 1 if there is at least one subscriber with a non-zero period
+int  telemetry_active(struct telemetry *tlm);
+
+// a client is identified by its output buffer (TCP) or by its address (UDP, the packets are sent through fd)
+// find the subscription of a client, optionally create it (fields: TLM_FIELD_ALL, paused)
+struct telemetry_subscriber *telemetry_find(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned char create);
+// period_ms == 0 removes the subscription, returns -1 if there is no free slot
+// the UDP source address can be spoofed: a UDP subscription is a lease which has to be renewed by the subscriber
+// (time_current: the same clock as for telemetry_publish()), and all of them share TELEMETRY_UDP_RATE_MAX
+int  telemetry_subscribe(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned int period_ms, double time_current);
+int  telemetry_set_fields(struct telemetry *tlm, unsigned char proto, struct remote_outbuf *out, int fd, const struct sockaddr_in *addr, unsigned int fields, double time_current);
+int  telemetry_add_multicast(struct telemetry *tlm, int fd, const struct sockaddr_in *group, unsigned int period_ms, unsigned int fields);
+
+// send the current sample to the subscribers which are due, returns the number of messages sent
+int  telemetry_publish(struct telemetry *tlm, double time_current);
+
+#endif
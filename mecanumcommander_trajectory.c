@@ -0,0 +1,397 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/timerfd.h>
+#include "mecanumcommander_trajectory.h"
+
+static const char *trajectory_state_names[] = { "idle", "running", "done", "aborted", "timeout", "rejected" };
+
+
+static double traj_wrap(double angle) {
+    return atan2(sin(angle), cos(angle));
+}
+
+
+static double traj_clamp(double value, double limit) {
+    if (value >  limit) { return  limit; }
+    if (value < -limit) { return -limit; }
+    return value;
+}
+
+
+// one axis of the profile: follow the target with limited acceleration and jerk (0: no limit)
+static void traj_profile_axis(double *vel, double *acc, double target, double amax, double jmax, double dt) {
+    double err, adesired, limit;
+
+    err = target - *vel;
+    adesired = 0;
+    if (err != 0) {
+        adesired = err / dt;
+        // the acceleration can still be ramped down to zero (in steps of dt) before the target is reached,
+        // the step landing on the target ends with at most 2 * jmax * dt of acceleration
+        if (jmax > 0) {
+            limit = sqrt(jmax * jmax * dt * dt / 4.0 + 2.0 * jmax * fabs(err)) - jmax * dt / 2.0;
+            adesired = traj_clamp(adesired, limit);
+        }
+        if (amax > 0) {
+            adesired = traj_clamp(adesired, amax);
+        }
+    }
+    if (jmax > 0) {
+        adesired = *acc + traj_clamp(adesired - *acc, jmax * dt);
+    }
+
+    *acc = adesired;
+    *vel += *acc * dt;
+    if (((err > 0) && (*vel > target)) || ((err < 0) && (*vel < target))) {
+        *vel = target;
+        *acc = 0;
+    }
+}
+
+
+// odometry pose in the frame of the start of the trajectory
+static void traj_relative_pose(struct trajectory *traj, const struct odom_state *odom, double *pose) {
+    double dx, dy, c, s;
+
+    dx = odom->x - traj->origin[0];
+    dy = odom->y - traj->origin[1];
+    c = cos(traj->origin[2]);
+    s = sin(traj->origin[2]);
+    pose[0] =  c * dx + s * dy;
+    pose[1] = -s * dx + c * dy;
+    pose[2] = traj_wrap(odom->theta - traj->origin[2]);
+}
+
+
+// target - pose, in the body frame of pose
+static void traj_body_error(const double *target, const double *pose, double *err) {
+    double dx, dy, c, s;
+
+    dx = target[0] - pose[0];
+    dy = target[1] - pose[1];
+    c = cos(pose[2]);
+    s = sin(pose[2]);
+    err[0] =  c * dx + s * dy;
+    err[1] = -s * dx + c * dy;
+    err[2] = traj_wrap(target[2] - pose[2]);
+}
+
+
+static void traj_disarm(struct trajectory *traj) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(traj->timerfd, 0, &its, NULL);
+}
+
+
+int trajectory_init(struct trajectory *traj, double period, double gain, unsigned char has_y) {
+
+    memset(traj, 0, sizeof(struct trajectory));
+    traj->period = period;
+    traj->gain = gain;
+    traj->has_y = has_y;
+    traj->state = TRAJ_IDLE;
+
+    traj->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (traj->timerfd == -1) {
+        perror("timerfd_create()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void trajectory_close(struct trajectory *traj) {
+
+    if (traj->timerfd != -1) {
+        close(traj->timerfd);
+        traj->timerfd = -1;
+    }
+}
+
+
+int trajectory_active(struct trajectory *traj) {
+    return (traj->state == TRAJ_RUNNING);
+}
+
+
+int trajectory_start(struct trajectory *traj, const struct remote_trajectory *trj, const int *speed, const struct odom_state *odom) {
+
+    struct itimerspec its;
+    int i, waypoints = 0, sideways = 0;
+
+    for (i = 0; i < trj->segments; i++) {
+        if (trj->segment[i].type == REMOTETRJ_SEG_WAYPOINT) {
+            waypoints++;
+        } else if (trj->segment[i].value[REMOTECMD_AXIS_Y] != 0) {
+            sideways++;
+        }
+    }
+
+    traj->trj = *trj;
+    traj->segment = 0;
+    traj->time_segment = 0;
+    traj->waypoint_inplace = 0;
+    traj->error = 0;
+    traj->max_error = 0;
+
+    if ((odom == NULL) && ((waypoints > 0) || ((trj->flags & REMOTETRJ_FLAG_CLOSEDLOOP) != 0))) {
+        traj->state = TRAJ_REJECTED;
+        return -1;
+    }
+    if ((traj->has_y == 0) && (sideways > 0)) {
+        traj->state = TRAJ_REJECTED;
+        return -1;
+    }
+
+    // continue from the current setpoints, the robot may be moving already
+    for (i = 0; i < REMOTECMD_AXES; i++) {
+        traj->vel[i] = speed[i] / 1000.0;
+        traj->acc[i] = 0;
+        traj->ref[i] = 0;
+        traj->origin[i] = 0;
+    }
+    if (odom != NULL) {
+        traj->origin[0] = odom->x;
+        traj->origin[1] = odom->y;
+        traj->origin[2] = odom->theta;
+    }
+
+    its.it_value.tv_sec  = (time_t)traj->period;
+    its.it_value.tv_nsec = (long)((traj->period - its.it_value.tv_sec) * 1000000000.0);
+    its.it_interval = its.it_value;
+    if (timerfd_settime(traj->timerfd, 0, &its, NULL) == -1) {
+        perror("timerfd_settime()");
+        traj->state = TRAJ_REJECTED;
+        return -1;
+    }
+
+    traj->state = TRAJ_RUNNING;
+
+    return 0;
+}
+
+
+void trajectory_abort(struct trajectory *traj) {
+
+    if (traj->state == TRAJ_RUNNING) {
+        traj_disarm(traj);
+        traj->state = TRAJ_ABORTED;
+    }
+}
+
+
+int trajectory_timer_read(struct trajectory *traj) {
+    uint64_t expirations;
+
+    if (read(traj->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return 0;
+    }
+
+    return (int)expirations;
+}
+
+
+int trajectory_step(struct trajectory *traj, int ticks, const struct odom_state *odom, int *speed) {
+
+    struct remote_trajectory_segment *seg;
+    double target[REMOTECMD_AXES], out[REMOTECMD_AXES], amax[REMOTECMD_AXES], jmax[REMOTECMD_AXES];
+    double pose[3], waypoint[3], err[3];
+    double dt, dist, heading, vmax, wmax, c, s;
+    int axis, reached;
+
+    if ((traj->state != TRAJ_RUNNING) || (ticks < 1)) {
+        return traj->state;
+    }
+
+    traj->ticks++;
+    traj->overruns += ticks - 1;
+    dt = ticks * traj->period;
+    traj->time_segment += dt;
+
+    amax[REMOTECMD_AXIS_X]   = amax[REMOTECMD_AXIS_Y] = traj->trj.accel_limit / 1000.0;
+    jmax[REMOTECMD_AXIS_X]   = jmax[REMOTECMD_AXIS_Y] = traj->trj.jerk_limit  / 1000.0;
+    amax[REMOTECMD_AXIS_ROT] = traj->trj.angaccel_limit / 1000.0;
+    jmax[REMOTECMD_AXIS_ROT] = traj->trj.angjerk_limit  / 1000.0;
+
+    memset(pose, 0, sizeof(pose));
+    if (odom != NULL) {
+        traj_relative_pose(traj, odom, pose);
+    }
+
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        target[axis] = 0;   // ramping down after the last segment
+    }
+
+    // find the segment for this tick, a reached waypoint goes on with the next one right away
+    while (traj->segment < traj->trj.segments) {
+
+        seg = &traj->trj.segment[traj->segment];
+
+        if (seg->type == REMOTETRJ_SEG_VELOCITY) {
+            if ((traj->time_segment * 1000.0) >= seg->duration_ms) {
+                traj->time_segment -= seg->duration_ms / 1000.0;
+                traj->segment++;
+                continue;
+            }
+            for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+                target[axis] = seg->value[axis] / 1000.0;
+            }
+            break;
+        }
+
+        // waypoint
+        if ((traj->time_segment * 1000.0) >= seg->duration_ms) {
+            traj_disarm(traj);
+            traj->state = TRAJ_TIMEOUT;
+            for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+                traj->vel[axis] = 0;
+                traj->acc[axis] = 0;
+                speed[axis] = 0;
+            }
+            return traj->state;
+        }
+
+        for (axis = 0; axis < 3; axis++) {
+            waypoint[axis] = seg->value[axis] / 1000.0;
+        }
+        traj_body_error(waypoint, pose, err);
+        dist = hypot(err[0], err[1]);
+        traj->error = dist;
+
+        // fast enough to get there, slow enough to stop there
+        vmax = seg->speed_limit / 1000.0;
+        if ((amax[REMOTECMD_AXIS_X] > 0) && (sqrt(2.0 * amax[REMOTECMD_AXIS_X] * dist) < vmax)) {
+            vmax = sqrt(2.0 * amax[REMOTECMD_AXIS_X] * dist);
+        }
+        wmax = traj->trj.angspeed_limit / 1000.0;
+        if ((amax[REMOTECMD_AXIS_ROT] > 0) && (sqrt(2.0 * amax[REMOTECMD_AXIS_ROT] * fabs(err[2])) < wmax)) {
+            wmax = sqrt(2.0 * amax[REMOTECMD_AXIS_ROT] * fabs(err[2]));
+        }
+
+        if (traj->has_y == 1) {
+            reached = (dist <= TRAJ_WAYPOINT_TOL_M) && (fabs(err[2]) <= TRAJ_WAYPOINT_TOL_RAD);
+            if (dist > 0) {
+                target[REMOTECMD_AXIS_X] = traj_clamp(traj->gain * dist, vmax) * err[0] / dist;
+                target[REMOTECMD_AXIS_Y] = traj_clamp(traj->gain * dist, vmax) * err[1] / dist;
+            }
+            target[REMOTECMD_AXIS_ROT] = traj_clamp(traj->gain * err[2], wmax);
+        } else {
+            // differential drive: turn towards the point, drive there, then turn to the heading in place
+            if (dist <= TRAJ_WAYPOINT_TOL_M) {
+                traj->waypoint_inplace = 1;
+            }
+            reached = (traj->waypoint_inplace == 1) && (fabs(err[2]) <= TRAJ_WAYPOINT_TOL_RAD);
+            if (traj->waypoint_inplace == 0) {
+                heading = atan2(err[1], err[0]);
+                if (fabs(heading) < 0.3) {
+                    target[REMOTECMD_AXIS_X] = traj_clamp(traj->gain * dist * cos(heading), vmax);
+                }
+                target[REMOTECMD_AXIS_ROT] = traj_clamp(2.0 * traj->gain * heading, traj->trj.angspeed_limit / 1000.0);
+            } else {
+                target[REMOTECMD_AXIS_ROT] = traj_clamp(traj->gain * err[2], wmax);
+            }
+        }
+
+        if (reached) {
+            traj->segment++;
+            traj->time_segment = 0;
+            traj->waypoint_inplace = 0;
+            // the closed loop of the next velocity segments starts from here
+            for (axis = 0; axis < 3; axis++) {
+                traj->ref[axis] = pose[axis];
+                target[axis] = 0;
+            }
+            traj->error = 0;
+            continue;
+        }
+        break;
+    }
+
+    if (traj->has_y == 0) {
+        target[REMOTECMD_AXIS_Y] = 0;
+    }
+
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        traj_profile_axis(&traj->vel[axis], &traj->acc[axis], target[axis], amax[axis], jmax[axis], dt);
+        out[axis] = traj->vel[axis];
+    }
+
+    // closed loop: the deviation from the reference pose (where the profile would have taken the robot so far)
+    seg = (traj->segment < traj->trj.segments) ? &traj->trj.segment[traj->segment] : NULL;
+    if ((odom != NULL) && ((traj->trj.flags & REMOTETRJ_FLAG_CLOSEDLOOP) != 0) && ((seg == NULL) || (seg->type == REMOTETRJ_SEG_VELOCITY))) {
+
+        traj_body_error(traj->ref, pose, err);
+        traj->error = hypot(err[0], err[1]);
+        if (traj->error > traj->max_error) {
+            traj->max_error = traj->error;
+        }
+
+        if (traj->has_y == 1) {
+            out[REMOTECMD_AXIS_X]   += traj->gain * err[0];
+            out[REMOTECMD_AXIS_Y]   += traj->gain * err[1];
+            out[REMOTECMD_AXIS_ROT] += traj->gain * err[2];
+        } else {
+            // Kanayama: kx = ktheta = gain, ky = gain^2
+            out[REMOTECMD_AXIS_X]    = traj->vel[REMOTECMD_AXIS_X] * cos(err[2]) + traj->gain * err[0];
+            out[REMOTECMD_AXIS_ROT] += traj->vel[REMOTECMD_AXIS_X] * traj->gain * traj->gain * err[1] + traj->gain * sin(err[2]);
+        }
+
+        // midpoint integration, like the odometry
+        c = cos(traj->ref[2] + traj->vel[REMOTECMD_AXIS_ROT] * dt / 2.0);
+        s = sin(traj->ref[2] + traj->vel[REMOTECMD_AXIS_ROT] * dt / 2.0);
+        traj->ref[0] += (c * traj->vel[REMOTECMD_AXIS_X] - s * traj->vel[REMOTECMD_AXIS_Y]) * dt;
+        traj->ref[1] += (s * traj->vel[REMOTECMD_AXIS_X] + c * traj->vel[REMOTECMD_AXIS_Y]) * dt;
+        traj->ref[2]  = traj_wrap(traj->ref[2] + traj->vel[REMOTECMD_AXIS_ROT] * dt);
+    }
+
+    // ramped down after the last segment
+    if ((traj->segment == traj->trj.segments) && (fabs(traj->vel[REMOTECMD_AXIS_X]) < TRAJ_STOPPED_SPEED) &&
+        (fabs(traj->vel[REMOTECMD_AXIS_Y]) < TRAJ_STOPPED_SPEED) && (fabs(traj->vel[REMOTECMD_AXIS_ROT]) < TRAJ_STOPPED_SPEED)) {
+        traj_disarm(traj);
+        traj->state = TRAJ_DONE;
+        for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+            traj->vel[axis] = 0;
+            traj->acc[axis] = 0;
+            out[axis] = 0;
+        }
+    }
+
+    for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+        speed[axis] = (int)lrint(traj_clamp(out[axis], REMOTECMD_SETPOINT_LIMIT / 1000.0) * 1000.0);
+    }
+
+    return traj->state;
+}
+
+
+void trajectory_get_status(struct trajectory *traj, struct trajectory_status *status) {
+
+    status->id = traj->trj.packetno;
+    status->state = traj->state;
+    status->segment = traj->segment;
+    status->error_mm = (int)lrint(traj->error * 1000.0);
+}
+
+
+const char *trajectory_state_name(unsigned char state) {
+
+    if (state > TRAJ_REJECTED) {
+        return "unknown";
+    }
+
+    return trajectory_state_names[state];
+}
@@ -0,0 +1,87 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_TRAJECTORY_H__
+
+#define __MECACOM_TRAJECTORY_H__
+
+#include "mecanumcommander_remote.h"
+#include "mecanumcommander_odometry.h"
+
+/*
+ Trajectory follower
+
+ A whole trajectory arrives in one message (see REMOTEBIN_TYPE_TRAJECTORY_V1 in mecanumcommander_remote.h),
+ and the commander computes the setpoints itself on a fixed-rate timer (timerfd, waited for in the select()
+ of the control loop), so the client does not have to stream setpoints over the network.
+ - velocity segments: every axis follows the target velocity with limited acceleration and jerk
+   (the acceleration is ramped, and reduced in time to arrive at the target without overshooting it)
+ - waypoint segments: drive to a pose relative to the start of the trajectory, measured by the odometry,
+   the speed is proportional to the remaining distance (gain), limited by the speed limits and by the
+   distance the robot can still stop within
+ - REMOTETRJ_FLAG_CLOSEDLOOP: the velocity segments also integrate a reference pose, and the deviation of
+   the odometry from it is fed back (holonomic: on every axis, differential drive: Kanayama's tracking law)
+ After the last segment the robot is ramped down to zero, the same way.
+ If the control loop falls behind, the missed ticks are made up with a longer step (and counted).
+*/
+
+#define TRAJ_IDLE           0
+#define TRAJ_RUNNING        1
+#define TRAJ_DONE           2
+#define TRAJ_ABORTED        3   // replaced by another command
+#define TRAJ_TIMEOUT        4   // a waypoint was not reached within its timeout
+#define TRAJ_REJECTED       5   // cannot be executed on this robot (no odometry, Y speed on a differential drive)
+
+#define TRAJ_WAYPOINT_TOL_M     0.010   // a waypoint is reached within this distance
+#define TRAJ_WAYPOINT_TOL_RAD   0.020   // ... and this heading error
+#define TRAJ_STOPPED_SPEED      0.001   // m/s, rad/s - the final ramp down is complete below this
+
+struct trajectory_status {
+    unsigned int id;                // packet number of the trajectory message
+    unsigned char state;            // TRAJ_*
+    unsigned char segment;          // index of the segment being executed
+    int error_mm;                   // tracking error (closed loop) or remaining distance (waypoint)
+};
+
+struct trajectory {
+    int timerfd;
+    double period;                  // sec
+    double gain;                    // 1/s, feedback gain
+    unsigned char has_y;            // the robot can move sideways
+    struct remote_trajectory trj;
+    unsigned char state;
+    int segment;                    // == trj.segments: ramping down after the last one
+    double time_segment;            // time spent in the current segment (sec)
+    double vel[REMOTECMD_AXES];     // profile: m/s, m/s, rad/s
+    double acc[REMOTECMD_AXES];     // profile: m/s^2, m/s^2, rad/s^2
+    double ref[3];                  // reference pose of the closed loop, in the start frame
+    double origin[3];               // odometry pose at the start
+    unsigned char waypoint_inplace; // differential drive: the position of the waypoint is reached, turning in place
+    double error;                   // m
+    // statistics
+    unsigned long ticks;
+    unsigned long overruns;         // ticks missed by the control loop
+    double max_error;               // m, closed loop tracking error
+};
+
+// period: of the timer (sec), gain: feedback gain of the waypoints and the closed loop (1/s)
+int  trajectory_init(struct trajectory *traj, double period, double gain, unsigned char has_y);
+void trajectory_close(struct trajectory *traj);
+int  trajectory_active(struct trajectory *traj);
+// speed: the current setpoints (mm/s, mrad/s) to start the profile from, odom: NULL without odometry
+// returns -1 (state: TRAJ_REJECTED) if the trajectory cannot be executed on this robot
+int  trajectory_start(struct trajectory *traj, const struct remote_trajectory *trj, const int *speed, const struct odom_state *odom);
+void trajectory_abort(struct trajectory *traj);
+// number of timer periods elapsed since the last call (0 if none, e.g. a spurious wake-up)
+int  trajectory_timer_read(struct trajectory *traj);
+// advance by ticks periods and compute the new setpoints (mm/s, mrad/s), returns the state
+int  trajectory_step(struct trajectory *traj, int ticks, const struct odom_state *odom, int *speed);
+void trajectory_get_status(struct trajectory *traj, struct trajectory_status *status);
+const char *trajectory_state_name(unsigned char state);
+
+#endif
@@ -0,0 +1,585 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <locale.h>
+#include <ncurses.h>
+#include "mecanumcommander_ui.h"
+
+#define COMMANDER_VERSION  "0.60"
+
+static int roverdrawx=5, roverdrawy=10;
+static int commanddrawx=2, commanddrawy=2;
+static int statusdrawx=30, statusdrawy=2;
+static int aboutdrawx=2, aboutdrawy=16;
+
+
+static double ui_time_ms() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+// draw the text only if it differs from what is already on the screen at this position
+static void ui_print(struct ui *ui, int y, int x, int attr, const char *fmt, ...) {
+
+    struct ui_cell *cell = NULL;
+    char text[UI_CELL_MAXLEN];
+    va_list args;
+    int i;
+
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    for (i = 0; i < ui->cellcount; i++) {
+        if ((ui->cells[i].y == y) && (ui->cells[i].x == x)) {
+            cell = &ui->cells[i];
+            break;
+        }
+    }
+    if ((cell == NULL) && (ui->cellcount < UI_CELLS_MAX)) {
+        cell = &ui->cells[ui->cellcount++];
+        cell->y = y;
+        cell->x = x;
+        cell->attr = -1;
+    }
+
+    if (cell != NULL) {
+        if ((cell->attr == attr) && (strcmp(cell->text, text) == 0)) {
+            return;
+        }
+        cell->attr = attr;
+        strcpy(cell->text, text);
+    }
+
+    attron(attr);
+    mvprintw(y, x, "%s", text);
+    attroff(attr);
+}
+
+
+static void ui_draw_layout(struct roverstruct *rover) {
+
+    attron(COLOR_PAIR(1));
+    mvprintw(0, 1, "Rover type 0x%x (%s) Firmware revision: 0x%x", rover->sysname, rover->fullname, rover->firmrev);
+    attroff(COLOR_PAIR(1));
+
+    switch (rover->sysname) {
+        case SYSNAME_MECANUMROVER21:
+            attron(COLOR_PAIR(9));
+            mvprintw(roverdrawy    , roverdrawx + 5, "☵▇█▇☵");
+            mvprintw(roverdrawy + 1, roverdrawx + 5, "▐███▌");
+            mvprintw(roverdrawy + 2, roverdrawx + 5, "☵");
+            attroff(COLOR_PAIR(9));
+            attron(COLOR_PAIR(10));
+            mvprintw(roverdrawy + 2, roverdrawx + 6, "▁▁▁");
+            attroff(COLOR_PAIR(10));
+            attron(COLOR_PAIR(2));
+            mvprintw(roverdrawy + 2, roverdrawx + 7, "⬤");
+            attroff(COLOR_PAIR(2));
+            attron(COLOR_PAIR(9));
+            mvprintw(roverdrawy + 2, roverdrawx + 9, "☵");
+            attroff(COLOR_PAIR(9));
+            break;
+
+        case SYSNAME_MEGAROVER3:
+            attron(COLOR_PAIR(5));
+            mvprintw(roverdrawy - 1, roverdrawx + 6, "▂");
+            attroff(COLOR_PAIR(5));
+            attron(COLOR_PAIR(9));
+            mvprintw(roverdrawy    , roverdrawx + 5, "≣███≣");
+            mvprintw(roverdrawy + 1, roverdrawx + 7, "█▊");
+//            mvprintw(roverdrawy + 1, roverdrawx + 7, "█▉");
+            attroff(COLOR_PAIR(9));
+            attron(COLOR_PAIR(10));
+            mvprintw(roverdrawy + 1, roverdrawx + 6, "▎");
+            mvprintw(roverdrawy + 2, roverdrawx + 7, "▇");
+            attroff(COLOR_PAIR(10));
+            break;
+
+        default:
+            attron(COLOR_PAIR(9));
+            mvprintw(roverdrawy    , roverdrawx + 5, "☵███☵");
+            mvprintw(roverdrawy + 2, roverdrawx + 6, "███");
+            attroff(COLOR_PAIR(9));
+            attron(COLOR_PAIR(2));
+            mvprintw(roverdrawy + 1, roverdrawx + 7, "⬤");
+            attroff(COLOR_PAIR(2));
+    }
+
+    attron(A_UNDERLINE | A_BOLD);
+    mvprintw(commanddrawy, commanddrawx, "Command               ");
+    mvprintw(statusdrawy,  statusdrawx , "Rover status                         ");
+    mvprintw(aboutdrawy,   aboutdrawx  , "About                 ");
+    attroff(A_UNDERLINE | A_BOLD);
+
+    attron(COLOR_PAIR(1));
+    mvprintw(aboutdrawy + 1, aboutdrawx, "NLAB-MecanumCommander");
+    mvprintw(aboutdrawy + 2, aboutdrawx + 7, "for Linux v" COMMANDER_VERSION);
+    mvprintw(aboutdrawy + 4, aboutdrawx, "See source for more info.");
+
+    mvprintw(commanddrawy + 1, commanddrawx, "X Speed:      0 mm/s");
+    if (rover->config->has_Y_speed == 1) {
+        mvprintw(commanddrawy + 2, commanddrawx, "Y Speed:      0 mm/s");
+    }
+    mvprintw(commanddrawy + 3, commanddrawx, "Rotation:     0 mrad/s");
+
+    mvprintw(statusdrawy + 1,  statusdrawx, "Uptime              :");
+    mvprintw(statusdrawy + 2,  statusdrawx, "Battery             :");
+    mvprintw(statusdrawy + 3,  statusdrawx, "Motors          🏍️   :");
+
+    switch (rover->sysname) {
+
+        case SYSNAME_MECANUMROVER21:
+            mvprintw(statusdrawy +  4, statusdrawx + 1, "Speed        M3,M4 : ");
+            mvprintw(statusdrawy +  5, statusdrawx + 1, "Speed        M1,M2 : ");
+            mvprintw(statusdrawy +  6, statusdrawx + 1, "Position     M3,M4 : ");
+            mvprintw(statusdrawy +  7, statusdrawx + 1, "Position     M1,M2 : ");
+            mvprintw(statusdrawy +  8, statusdrawx + 1, "Encoder      M3,M4 : ");
+            mvprintw(statusdrawy +  9, statusdrawx + 1, "Encoder      M1,M2 : ");
+            mvprintw(statusdrawy + 10, statusdrawx + 1, "OutputOffset M3,M4 : ");
+            mvprintw(statusdrawy + 11, statusdrawx + 1, "OutputOffset M1,M2 : ");
+            mvprintw(statusdrawy + 12, statusdrawx + 1, "MotOutCalc   M3,M4 :               %%");
+            mvprintw(statusdrawy + 13, statusdrawx + 1, "MotOutCalc   M1,M2 :               %%");
+            mvprintw(statusdrawy + 14, statusdrawx + 1, "MeasuredCurr M3,M4 :               A");
+            mvprintw(statusdrawy + 15, statusdrawx + 1, "MeasuredCurr M1,M2 :               A");
+            mvprintw(statusdrawy + 16, statusdrawx + 1, "MaxCurrent   M3,M4 :               A");
+            mvprintw(statusdrawy + 17, statusdrawx + 1, "MaxCurrent   M1,M2 :               A");
+            mvprintw(statusdrawy + 18, statusdrawx + 1, "CurrentLimit M3,M4 :               A");
+            mvprintw(statusdrawy + 19, statusdrawx + 1, "CurrentLimit M1,M2 :               A");
+            break;
+
+        case SYSNAME_MEGAROVER3:
+            mvprintw(statusdrawy +  5, statusdrawx + 1, "MotorSpeed M1,M2 : ");
+            mvprintw(statusdrawy +  9, statusdrawx + 1, "Encoder    M1,M2 : ");
+//            mvprintw(statusdrawy + 15, statusdrawx + 1, "MeasuredCurr M1,M2 :               A");
+            break;
+    }
+    attroff(COLOR_PAIR(1));
+
+    attron(COLOR_PAIR(7));
+    mvprintw(statusdrawy + 2, statusdrawx + 16, "⚡");
+    attroff(COLOR_PAIR(7));
+
+}
+
+
+static void ui_render(struct ui *ui, struct ui_snapshot *snap, unsigned char *indicator, const char *errmsg, int errmsg_xpos) {
+
+    struct roverstruct *rover = &snap->rover;
+    unsigned char main_motor_status, second_motor_status;
+    int motorcolor;
+
+    if (indicator[UI_IND_HEART] == 1) {
+        ui_print(ui, statusdrawy + 1, statusdrawx + 16, COLOR_PAIR(5) | A_BOLD, "♥");
+    } else {
+        ui_print(ui, statusdrawy + 1, statusdrawx + 16, COLOR_PAIR(1), " ");
+    }
+
+    if (indicator[UI_IND_LAMP] == 1) {
+        ui_print(ui, 2, 2 + 23, COLOR_PAIR(7), "⚟");
+    } else {
+        ui_print(ui, 2, 2 + 23, COLOR_PAIR(1), "  ");
+    }
+
+    // the error message is on the same line
+    if ((errmsg[0] == '\0') && ((rover->rs485_err_0x10 > 0) || (rover->rs485_err_0x1F > 0))) {
+        int alertcolor = 7;
+        if ((rover->rs485_err_0x10 >= 5) || (rover->rs485_err_0x1F >= 5)) {
+            alertcolor = 5;
+        }
+        ui_print(ui, 1, 30, COLOR_PAIR(alertcolor), "⚠ RS485 CommErr! Main:%03d Front:%03d ⚠", rover->rs485_err_0x10, rover->rs485_err_0x1F);
+    }
+
+    if (snap->udpstats_valid == 1) {
+        ui_print(ui, statusdrawy + 21, 1, COLOR_PAIR(1), "UDP rx:%-7lu lost:%-5lu reord:%-5lu dup:%-5lu crc:%-5lu jitter:%6.1fms",
+            snap->udpstats.received, snap->udpstats.lost, snap->udpstats.reordered,
+            snap->udpstats.duplicates, snap->udpstats.crcerrors, snap->udpstats.jitter * 1000.0);
+    }
+
+    ui_print(ui, statusdrawy + 1, statusdrawx + 22, COLOR_PAIR(1), " % 6.2lf sec", rover_get_uptime(rover));
+    ui_print(ui, statusdrawy + 2, statusdrawx + 22, COLOR_PAIR(1), "    %2.2lf V", rover_get_battery_voltage(rover));
+
+    main_motor_status = rover_get_motor_status(rover, rover->memmap_main);
+    motorcolor = ((main_motor_status & 1) == 1) ? COLOR_PAIR(3) : COLOR_PAIR(5);
+    ui_print(ui, statusdrawy + 3, statusdrawx + 22, motorcolor, ((main_motor_status & 1) == 1) ? "On " : "Off");
+    if (rover->sysname == SYSNAME_MECANUMROVER21) {
+        ui_print(ui, roverdrawy + 3, roverdrawx + 2, motorcolor, "M1");
+    } else {
+        ui_print(ui, roverdrawy - 1, roverdrawx + 2, motorcolor, "M1");
+    }
+    motorcolor = ((main_motor_status >> 1) == 1) ? COLOR_PAIR(3) : COLOR_PAIR(5);
+    ui_print(ui, statusdrawy + 3, statusdrawx + 26, motorcolor, ((main_motor_status >> 1) == 1) ? "On " : "Off");
+    if (rover->sysname == SYSNAME_MECANUMROVER21) {
+        ui_print(ui, roverdrawy + 3, roverdrawx + 11, motorcolor, "M2");
+    } else {
+        ui_print(ui, roverdrawy - 1, roverdrawx + 11, motorcolor, "M2");
+    }
+    if (rover->config->motor_count == 4) {
+        second_motor_status = rover_get_motor_status(rover, rover->memmap_second);
+
+        motorcolor = ((second_motor_status & 1) == 1) ? COLOR_PAIR(3) : COLOR_PAIR(5);
+        ui_print(ui, statusdrawy + 3, statusdrawx + 30, motorcolor, ((second_motor_status & 1) == 1) ? "On " : "Off");
+        ui_print(ui, roverdrawy - 1, roverdrawx + 2, motorcolor, "M3");
+        motorcolor = ((second_motor_status >> 1) == 1) ? COLOR_PAIR(3) : COLOR_PAIR(5);
+        ui_print(ui, statusdrawy + 3, statusdrawx + 34, motorcolor, ((second_motor_status >> 1) == 1) ? "On " : "Off");
+        ui_print(ui, roverdrawy - 1, roverdrawx + 11, motorcolor, "M4");
+    }
+
+    switch (rover->sysname) {
+
+        case SYSNAME_MECANUMROVER21:
+            ui_print(ui, statusdrawy +  4, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_speed0(rover, rover->memmap_second), rover_get_speed1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy +  5, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_speed0(rover, rover->memmap_main),   rover_get_speed1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy +  6, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_measured_position0(rover, rover->memmap_second), rover_get_measured_position1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy +  7, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_measured_position0(rover, rover->memmap_main),   rover_get_measured_position1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy +  8, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_encoder_value0(rover, rover->memmap_second), rover_get_encoder_value1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy +  9, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_encoder_value0(rover, rover->memmap_main),   rover_get_encoder_value1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy + 10, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_outputoffset0(rover, rover->memmap_second), rover_get_outputoffset1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy + 11, statusdrawx + 22, COLOR_PAIR(1), "% 6d,% 6d", rover_get_outputoffset0(rover, rover->memmap_main),   rover_get_outputoffset1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy + 12, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_motoroutput_calc0(rover, rover->memmap_second), rover_get_motoroutput_calc1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy + 13, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_motoroutput_calc0(rover, rover->memmap_main),   rover_get_motoroutput_calc1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy + 14, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_measured_current_value0(rover, rover->memmap_second), rover_get_measured_current_value1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy + 15, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_measured_current_value0(rover, rover->memmap_main),   rover_get_measured_current_value1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy + 16, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_max_current0(rover, rover->memmap_second), rover_get_max_current1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy + 17, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_max_current0(rover, rover->memmap_main),   rover_get_max_current1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy + 18, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_current_limit0(rover, rover->memmap_second), rover_get_current_limit1(rover, rover->memmap_second));
+            ui_print(ui, statusdrawy + 19, statusdrawx + 22, COLOR_PAIR(1), "% 6.2lf,% 6.2lf", rover_get_current_limit0(rover, rover->memmap_main),   rover_get_current_limit1(rover, rover->memmap_main));
+            break;
+
+        case SYSNAME_MEGAROVER3:
+            ui_print(ui, statusdrawy +  5, statusdrawx + 22, COLOR_PAIR(1), "% 8d,% 8d", rover_get_motorspeed0(rover, rover->memmap_main), rover_get_motorspeed1(rover, rover->memmap_main));
+            ui_print(ui, statusdrawy +  9, statusdrawx + 22, COLOR_PAIR(1), "% 8d,% 8d", rover_get_encoder_value0(rover, rover->memmap_main), rover_get_encoder_value1(rover, rover->memmap_main));
+            break;
+    }
+
+    ui_print(ui, commanddrawy + 1, commanddrawx + 10, COLOR_PAIR(1), "% 5d", snap->speedX);
+    if (rover->config->has_Y_speed == 1) {
+        ui_print(ui, commanddrawy + 2, commanddrawx + 10, COLOR_PAIR(1), "% 5d", snap->speedY);
+    }
+    ui_print(ui, commanddrawy + 3, commanddrawx + 10, COLOR_PAIR(1), "% 5d", snap->rotate);
+
+    if (snap->speedX > 0) {
+        ui_print(ui, commanddrawy + 1, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "↑");
+        ui_print(ui, roverdrawy - 2, roverdrawx + 6, COLOR_PAIR(6) | A_BOLD, "↑↑↑");
+        ui_print(ui, roverdrawy + 4, roverdrawx + 6, 0, "   ");
+    } else if (snap->speedX < 0) {
+        ui_print(ui, commanddrawy + 1, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "↓");
+        ui_print(ui, roverdrawy + 4, roverdrawx + 6, COLOR_PAIR(6) | A_BOLD, "↓↓↓");
+        ui_print(ui, roverdrawy - 2, roverdrawx + 6, 0, "   ");
+    } else {
+        ui_print(ui, commanddrawy + 1, commanddrawx + 23, 0, " ");
+        ui_print(ui, roverdrawy - 2, roverdrawx + 6, 0, "   ");
+        ui_print(ui, roverdrawy + 4, roverdrawx + 6, 0, "   ");
+    }
+
+    if (rover->config->has_Y_speed == 1) {
+        if (snap->speedY < 0) {
+            ui_print(ui, commanddrawy + 2, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "→");
+            ui_print(ui, roverdrawy + 1, roverdrawx + 12, COLOR_PAIR(6) | A_BOLD, "→→→");
+            ui_print(ui, roverdrawy + 1, roverdrawx, 0, "   ");
+        } else if (snap->speedY > 0) {
+            ui_print(ui, commanddrawy + 2, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "←");
+            ui_print(ui, roverdrawy + 1, roverdrawx, COLOR_PAIR(6) | A_BOLD, "←←←");
+            ui_print(ui, roverdrawy + 1, roverdrawx + 12, 0, "   ");
+        } else {
+            ui_print(ui, commanddrawy + 2, commanddrawx + 23, 0, " ");
+            ui_print(ui, roverdrawy + 1, roverdrawx, 0, "   ");
+            ui_print(ui, roverdrawy + 1, roverdrawx + 12, 0, "   ");
+        }
+    }
+
+    if (snap->rotate < 0) {
+        ui_print(ui, commanddrawy + 3, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "↻");
+        ui_print(ui, roverdrawy + 1, roverdrawx + 7, COLOR_PAIR(8) | A_BOLD, "↻");
+    } else if (snap->rotate > 0) {
+        ui_print(ui, commanddrawy + 3, commanddrawx + 23, COLOR_PAIR(6) | A_BOLD, "↺");
+        ui_print(ui, roverdrawy + 1, roverdrawx + 7, COLOR_PAIR(8) | A_BOLD, "↺");
+    } else {
+        ui_print(ui, commanddrawy + 3, commanddrawx + 23, 0, " ");
+        ui_print(ui, roverdrawy + 1, roverdrawx + 7, COLOR_PAIR(9), "█");
+    }
+
+    if (errmsg[0] != '\0') {
+        ui_print(ui, 1, errmsg_xpos, COLOR_PAIR(5), "%s", errmsg);
+    }
+
+}
+
+
+// ESC [ ... sequences of the cursor keys to the key codes used by the control loop
+static int ui_read_escape() {
+
+    int c = -1, c2, c3, c4, c5, c6;
+
+    timeout(0);
+    c2 = getch();
+    if (c2 == -1) {
+        return UI_KEY_QUIT;
+    }
+    if (c2 == 91) {
+        c3 = getch();
+        switch (c3) {
+            case 49:
+                c4 = getch();
+                c5 = getch();
+                c6 = getch();
+                if ((c4 == 59) && (c5 == 50)) {
+                    switch(c6) {
+                        case 65: c = 87; break;
+                        case 66: c = 83; break;
+                        case 67: c = 68; break;
+                        case 68: c = 65; break;
+                        case 72: c = 81; break;
+                    }
+                }
+                break;
+
+            case 53:
+                c4 = getch();
+                if (c4 == 59) {
+                    c5 = getch();
+                    c6 = getch();
+                    if ((c5 == 50) && (c6 == 126)) { c = 69; }
+                } else {
+                    if (c4 == 126) { c = 101; }
+                }
+                break;
+
+            case 65: c = 119; break;
+            case 66: c = 115; break;
+            case 67: c = 100; break;
+            case 68: c =  97; break;
+            case 69: c =  32; break;
+            case 72: c = 113; break;
+        }
+    }
+
+    return c;
+}
+
+
+static void *ui_thread(void *arg) {
+
+    struct ui *ui = arg;
+    struct ui_snapshot snap;
+    unsigned int seq_drawn = 0;
+    unsigned char indicator[UI_INDICATORS];
+    char errmsg[UI_ERRMSG_MAXLEN];
+    int errmsg_xpos = 0, errmsg_shown = 0;
+    double time_next_frame, time_now;
+    int c, i, wait_ms;
+    unsigned char key;
+
+    memset(&snap, 0, sizeof(snap));
+    errmsg[0] = '\0';
+    time_next_frame = ui_time_ms();
+
+    while (__atomic_load_n(&ui->stop, __ATOMIC_ACQUIRE) == 0) {
+
+        wait_ms = time_next_frame - ui_time_ms();
+        timeout((wait_ms > 0) ? wait_ms : 0);
+        c = getch();
+        if (c == 27) {
+            c = ui_read_escape();
+        }
+        if (c != -1) {
+            key = c;
+            write(ui->keyfd_write, &key, 1);  // if the control loop is behind, the key is dropped
+        }
+
+        time_now = ui_time_ms();
+        if (time_now < time_next_frame) {
+            continue;
+        }
+        time_next_frame += 1000.0 / UI_FRAME_RATE;
+        if (time_next_frame < time_now) {
+            time_next_frame = time_now + 1000.0 / UI_FRAME_RATE;
+        }
+
+        for (i = 0; i < UI_INDICATORS; i++) {
+            indicator[i] = __atomic_load_n(&ui->indicator[i], __ATOMIC_RELAXED) | __atomic_exchange_n(&ui->indicator_latch[i], 0, __ATOMIC_RELAXED);
+        }
+
+        pthread_mutex_lock(&ui->lock);
+        if (ui->seq != seq_drawn) {
+            memcpy(&snap, &ui->snapshot, sizeof(snap));
+            seq_drawn = ui->seq;
+        }
+        if (ui->errmsg[0] != '\0') {
+            strcpy(errmsg, ui->errmsg);
+            errmsg_xpos = ui->errmsg_xpos;
+        }
+        pthread_mutex_unlock(&ui->lock);
+
+        // nothing was published yet
+        if (seq_drawn == 0) {
+            continue;
+        }
+
+        ui_render(ui, &snap, indicator, errmsg, errmsg_xpos);
+        if ((errmsg[0] != '\0') && (errmsg_shown == 0)) {
+            beep();
+            errmsg_shown = 1;
+        }
+        refresh();  // only the changed cells are sent to the terminal
+        ui->frames++;
+    }
+
+    // the latest state, and the error message is kept on the screen until a key is pressed
+    pthread_mutex_lock(&ui->lock);
+    if (ui->seq != seq_drawn) {
+        memcpy(&snap, &ui->snapshot, sizeof(snap));
+        seq_drawn = ui->seq;
+    }
+    strcpy(errmsg, ui->errmsg);
+    errmsg_xpos = ui->errmsg_xpos;
+    pthread_mutex_unlock(&ui->lock);
+
+    if (errmsg[0] != '\0') {
+        memset(indicator, 0, sizeof(indicator));
+        if (seq_drawn != 0) {
+            ui_render(ui, &snap, indicator, errmsg, errmsg_xpos);
+        } else {
+            ui_print(ui, 1, errmsg_xpos, COLOR_PAIR(5), "%s", errmsg);
+        }
+        if (errmsg_shown == 0) {
+            beep();
+        }
+        refresh();
+        timeout(-1);
+        getch();
+    }
+
+    return NULL;
+}
+
+
+int ui_init(struct ui *ui, struct roverstruct *rover, unsigned char headless) {
+
+    int pipefds[2];
+
+    memset(ui, 0, sizeof(struct ui));
+    ui->keyfd = -1;
+    ui->keyfd_write = -1;
+    if (headless == 1) {
+        ui->headless = 1;
+        return 0;
+    }
+
+    if (pipe2(pipefds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        perror("pipe2()");
+        return -1;
+    }
+    ui->keyfd = pipefds[0];
+    ui->keyfd_write = pipefds[1];
+    pthread_mutex_init(&ui->lock, NULL);
+
+    // ncurses init
+    setlocale(LC_CTYPE, "");
+    initscr();
+    noecho();
+    cbreak();
+    start_color();
+    init_pair(1, 15,  0); // feher + fekete
+    init_pair(2 , 9,  7); // piros + szurke
+    init_pair(3, 10,  0); // zold + fekete
+    init_pair(4, 10, 15); // zold + feher
+    init_pair(5,  9,  0); // piros + fekete
+    init_pair(6, 12,  0); // kek + fekete
+    init_pair(7, 11,  0); // sarga + fekete
+    init_pair(8, 12,  7); // kek + szurke
+    init_pair(9,  7,  0); // szurke + fekete
+    init_pair(10, 0,  7); // fekete + szurke
+    curs_set(0);
+
+    ui_draw_layout(rover);
+    refresh();
+
+    if (pthread_create(&ui->thread, NULL, ui_thread, ui) != 0) {
+        endwin();
+        perror("pthread_create(UI)");
+        return -1;
+    }
+    ui->running = 1;
+
+    return 0;
+}
+
+
+void ui_close(struct ui *ui) {
+
+    if (ui->running == 0) {
+        return;
+    }
+
+    __atomic_store_n(&ui->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(ui->thread, NULL);
+    ui->running = 0;
+
+    // ncurses close
+    endwin();
+
+    close(ui->keyfd);
+    close(ui->keyfd_write);
+    pthread_mutex_destroy(&ui->lock);
+}
+
+
+void ui_publish(struct ui *ui, const struct ui_snapshot *snapshot) {
+
+    if (ui->headless == 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&ui->lock);
+    memcpy(&ui->snapshot, snapshot, sizeof(struct ui_snapshot));
+    ui->seq++;
+    if (ui->seq == 0) {  // 0: nothing published yet
+        ui->seq = 1;
+    }
+    pthread_mutex_unlock(&ui->lock);
+}
+
+
+void ui_indicator(struct ui *ui, int indicator, unsigned char on) {
+
+    if (ui->headless == 1) {
+        return;
+    }
+
+    __atomic_store_n(&ui->indicator[indicator], on, __ATOMIC_RELAXED);
+    // a short blink is shown for at least one frame
+    if (on == 1) {
+        __atomic_store_n(&ui->indicator_latch[indicator], 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+void ui_errormsg(struct ui *ui, const char *errmsg, int xpos) {
+
+    if (ui->headless == 1) {
+        fprintf(stderr, "%s\n", errmsg);
+        return;
+    }
+
+    pthread_mutex_lock(&ui->lock);
+    snprintf(ui->errmsg, sizeof(ui->errmsg), "%s", errmsg);
+    ui->errmsg_xpos = xpos;
+    pthread_mutex_unlock(&ui->lock);
+}
@@ -0,0 +1,85 @@
+/*
+    NLAB-MecanumCommander for Linux, a simple bridge to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOM_UI_H__
+
+#define __MECACOM_UI_H__
+
+#include <pthread.h>
+#include "mecanumrover_commlib.h"
+#include "mecanumcommander_remote.h"
+
+/*
+ ncurses UI on its own thread
+
+ The control loop publishes a snapshot of its state once per iteration (ui_publish()), the UI thread
+ renders the latest one at most UI_FRAME_RATE times per second, and only the cells whose text changed
+ are redrawn. All curses calls are made by the UI thread. Keys are read by the UI thread too, the
+ escape sequences are decoded there, and the resulting key codes are forwarded through a pipe
+ (ui->keyfd, select()-able) to the control loop.
+
+ Headless mode (daemon): there is no UI thread and no terminal I/O at all, ui->keyfd is -1,
+ publishing is a no-op and the error messages go to stderr.
+*/
+
+#define UI_FRAME_RATE       20     // frames per second at most
+#define UI_CELLS_MAX        96     // screen positions tracked for changes
+#define UI_CELL_MAXLEN      96
+#define UI_ERRMSG_MAXLEN    128
+
+// indicators, switched from the control loop without waiting for the UI thread
+#define UI_IND_LAMP         0      // command is being sent to the robot
+#define UI_IND_HEART        1      // memmap is being read
+#define UI_INDICATORS       2
+
+#define UI_KEY_QUIT         27     // ESC alone
+
+struct ui_snapshot {
+    int speedX, speedY, rotate;
+    struct roverstruct rover;       // memmaps, RS485 error counters
+    unsigned char udpstats_valid;   // statistics of the most recently seen UDP client
+    struct udpclient_stats udpstats;
+};
+
+struct ui_cell {
+    short y, x;
+    int attr;
+    char text[UI_CELL_MAXLEN];
+};
+
+struct ui {
+    pthread_t thread;
+    pthread_mutex_t lock;           // protects snapshot, seq, errmsg
+    struct ui_snapshot snapshot;
+    unsigned int seq;               // bumped by every ui_publish()
+    char errmsg[UI_ERRMSG_MAXLEN];
+    int errmsg_xpos;
+    unsigned char indicator[UI_INDICATORS];         // current state
+    unsigned char indicator_latch[UI_INDICATORS];   // was on since the last frame
+    int keyfd;                      // control loop reads the key codes from here
+    int keyfd_write;
+    unsigned char headless;
+    unsigned char running;
+    unsigned char stop;
+    // UI thread only
+    struct ui_cell cells[UI_CELLS_MAX];
+    int cellcount;
+    unsigned long frames;
+};
+
+// ncurses init, static screen layout, starts the UI thread (nothing in headless mode)
+int  ui_init(struct ui *ui, struct roverstruct *rover, unsigned char headless);
+// stops the UI thread and restores the terminal, waits for a key first if an error message is shown
+// can be called more than once
+void ui_close(struct ui *ui);
+void ui_publish(struct ui *ui, const struct ui_snapshot *snapshot);
+void ui_indicator(struct ui *ui, int indicator, unsigned char on);
+// shown until ui_close()
+void ui_errormsg(struct ui *ui, const char *errmsg, int xpos);
+
+#endif
@@ -6,12 +6,13 @@
     https://github.com/szaguldo-kamaz/
 */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <ncurses.h>
-#include <locale.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -22,34 +23,32 @@
 #include <arpa/inet.h>
 #include <signal.h>
 #include "mecanumrover_commlib.h"
+#include "mecanumcommander_remote.h"
+#include "mecanumcommander_telemetry.h"
+#include "mecanumcommander_local.h"
+#include "mecanumcommander_ui.h"
+#include "mecanumcommander_config.h"
+#include "mecanumcommander_log.h"
+#include "mecanumcommander_rt.h"
+#include "mecanumcommander_safestop.h"
+#include "mecanumcommander_odometry.h"
+#include "mecanumcommander_trajectory.h"
+#include "mecanumcommander_clocksync.h"
+#include "mecanumcommander_memmapfetch.h"
+#include "mecanumcommander_memmapfile.h"
 #include "crc16/crc16.h"
 
 #define COMMANDER_VERSION  "0.60"
-#define COMMANDER_PASSWORD "PASSWORD"
-
-#define REPEAT_TIME_SEC_CMDSENT 0.4
-#define REPEAT_TIME_SEC_KCMDSENT 0.4
-#define REPEAT_TIME_SEC_REMOTECMDRECV 0.5
-//#define REPEAT_TIME_SEC_MEMMAPREAD 0.5
-#define REPEAT_TIME_SEC_MEMMAPREAD 0.4
-
-int got_sigpipe = 0;
-
-
-void errormsg(unsigned char *errmsg, unsigned char xpos) {
-    attron(COLOR_PAIR(5));
-    mvprintw(1, xpos, errmsg);
-    attroff(COLOR_PAIR(5));
-    beep();
-    timeout(-1);
-    getch();
-}
 
+#define UDP_BATCH_SIZE     16   // datagrams received with one recvmmsg() call
+#define UDP_PAYLOAD_MAXLEN REMOTEBIN_TRAJECTORY_MAXLEN
+#define UDP_STATS_LOG_SEC  5.0  // log the statistics of the UDP clients this often
+#define JITTER_LOG_SEC    10.0  // log the loop timing histograms this often
 
-void sigpipe_handler(int signum) {
-    got_sigpipe = 1;
-}
+#define TELEMETRY_MULTICAST_GROUP "239.255.34.75"
+#define TELEMETRY_MULTICAST_PORT  3476
 
+#define IDENTITYCACHE_MAGIC "MECACOM-IDCACHE"   // first word of the identity cache file
 
 void stoprobot(struct roverstruct *rover, char usekcommands, char *answer) {
     if (usekcommands == 1) {
@@ -60,64 +59,143 @@ void stoprobot(struct roverstruct *rover, char usekcommands, char *answer) {
 }
 
 
-void commandsend_lamp_on() {
-    attron(COLOR_PAIR(7));
-//    mvprintw(2 + 5, 2 + 9, "⚞ ⚟");
-    mvprintw(2, 2 + 23, "⚟");
-    attroff(COLOR_PAIR(7));
-    refresh();
+// the UI thread shows it in the next frame, this does not wait for the terminal
+void commandsend_lamp_on(struct ui *ui) {
+    ui_indicator(ui, UI_IND_LAMP, 1);
 }
 
 
-void commandsend_lamp_off() {
-    attron(COLOR_PAIR(1));
-//    mvprintw(2 + 5, 2 + 9, "     ");
-    mvprintw(2, 2 + 23, "  ");
-    attroff(COLOR_PAIR(1));
-    refresh();
+void commandsend_lamp_off(struct ui *ui) {
+    ui_indicator(ui, UI_IND_LAMP, 0);
 }
 
 
-void read_memmap_files(struct roverstruct *rover) {
+// identity cache: a header line with the identity, then the main and the second memmap
+int read_identity_cache(const char *path, struct roverstruct *rover, unsigned char second_found) {
 
-    int fd;
+    FILE *cache;
+    char magic[32];
+    unsigned int sysname, firmrev, second;
+    unsigned char memmaps[2][384];
+    int ret;
 
-    fd = open("memmap_0x10.dat", O_RDONLY);
-    if (fd != -1) {
-        read(fd, rover->memmap_main, 512);
+    cache = fopen(path, "r");
+    if (cache == NULL) {
+        return -1;
     }
-    close(fd);
-    fd = open("memmap_0x1F.dat", O_RDONLY);
-    if (fd != -1) {
-        read(fd, rover->memmap_second, 512);
+    ret = fscanf(cache, "%31s %x %x %u\n", magic, &sysname, &firmrev, &second);
+    if ((ret != 4) || (strcmp(magic, IDENTITYCACHE_MAGIC) != 0) || (fread(memmaps, 384, 2, cache) != 2)) {
+        fclose(cache);
+        return -1;
     }
-    close(fd);
+    fclose(cache);
 
+    // only if it is the same rover (the probe has just read these)
+    if ((sysname != rover->sysname) || (firmrev != rover->firmrev) || (second != second_found)) {
+        return -1;
+    }
+    memcpy(rover->memmap_main,   memmaps[0], 384);
+    memcpy(rover->memmap_second, memmaps[1], 384);
+
+    return 0;
 }
 
 
-void logmsg(int logfd, double time_start, const char *msg) {
-    double time_curr;
-    char logmsg[1024];
-    struct timeval timestruct;
+int write_identity_cache(const char *path, struct roverstruct *rover, unsigned char second_found) {
 
-    gettimeofday(&timestruct, NULL);
-    time_curr = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
-    sprintf(logmsg, "%9.3f %s\n", time_curr - time_start, msg);
-    write(logfd, logmsg, strlen(logmsg));
+    FILE *cache;
+    char tmppath[CONFIG_PATH_MAXLEN + 8];
+
+    sprintf(tmppath, "%s.tmp", path);
+    cache = fopen(tmppath, "w");
+    if (cache == NULL) {
+        return -1;
+    }
+    fprintf(cache, "%s %x %x %u\n", IDENTITYCACHE_MAGIC, rover->sysname, rover->firmrev, second_found);
+    fwrite(rover->memmap_main, 384, 1, cache);
+    fwrite(rover->memmap_second, 384, 1, cache);
+    if (fclose(cache) != 0) {
+        unlink(tmppath);
+        return -1;
+    }
+
+    // a reader never sees a half written file
+    return rename(tmppath, path);
 }
 
 
-int main() {
+// queue a "XXX\r\n" reply to the TCP client (prefixed with "#<id> " in framed mode), it is sent at the end of the loop iteration
+int send_reply(struct remote_outbuf *out, int reqid, const char *reply, int logfd, double time_start) {
+    char replybuf[REMOTEFRAME_REPLY_MAXLEN];
+    char logstring[48];
+    int replylen;
 
-    int ret;
+    replylen = remoteframe_format_reply(replybuf, reqid, reply);
+    if (remote_outbuf_append(out, replybuf, replylen) == -1) {
+        logmsg(logfd, time_start, "Output buffer of the client is full!");
+        return -1;
+    }
+    sprintf(logstring, "Sent: %.*s", replylen - 2, replybuf);
+    logmsg(logfd, time_start, logstring);
+
+    return replylen;
+}
+
+
+// framed mode: reply to every request which was waiting for the serial write of this axis
+int send_axis_acks(struct remote_outbuf *out, struct remote_acks *acks, const char *reply, int logfd, double time_start) {
+    int i;
+
+    for (i = 0; i < acks->count; i++) {
+        if (send_reply(out, acks->ids[i], reply, logfd, time_start) == -1) {
+            return -1;
+        }
+    }
+    acks->count = 0;
+
+    return 0;
+}
+
+
+// SIGTERM (systemd stop), SIGINT: leave the main loop, stop the robot and clean up
+volatile sig_atomic_t got_termsignal = 0;
+
+void termsignal_handler(int sig) {
+    got_termsignal = sig;
+}
+
+
+// "<password>", "<password>\n" or "<password>\r\n"
+int check_password(const unsigned char *authbuff, int len, const char *password) {
+    int pwlen = strlen(password);
+
+    if ((len >= pwlen + 1) && (authbuff[len - 1] == '\n')) {
+        len--;
+        if ((len >= pwlen + 1) && (authbuff[len - 1] == '\r')) {
+            len--;
+        }
+    }
+    if ((len != pwlen) || (memcmp(authbuff, password, pwlen) != 0)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+
+    int ret, ret_second, i;
     unsigned char answer[BUFFER_SIZE];
 
     struct roverstruct rover;
+    struct rover_probe probe = { 0 };
+    unsigned char memmap_revalidate=0;  // started with the memmaps of the identity cache, not read yet
 
     struct timeval timestruct;
     double time_start, time_current, time_last_memmapread, time_last_cmdsent, time_last_kcmdsent, time_last_remotecmd_recv;
     unsigned char remotecmd_timed_out=1;
+    double remotecmd_validity;  // remote commands have to be repeated within this time (cfg.remotecmd_validity, or less)
     unsigned char repeatcommand_timeisup=0;
 
     int logfd;
@@ -126,41 +204,130 @@ int main() {
     int speedX=0, speedY=0, rotate=0;
     int prevspeedX=0, prevspeedY=0, prevrotate=0;
 
-    char quit=0, c, c2, c3, c4, c5, c6;
-    int roverdrawx=5, roverdrawy=10;
-    int commanddrawx=2, commanddrawy=2;
-    int statusdrawx=30, statusdrawy=2;
-    int aboutdrawx=2, aboutdrawy=16;
+    char quit=0, c;
+    unsigned char key;
 
-    fd_set commfdset;
+    fd_set commfdset, writefdset;
     struct timeval tv;
 
-    int listenfd=0, clientfd=0, sockread=0, socketcommbuff_offset=0;
+    int listenfd=0, clientfd=0, sockread=0;
     struct sockaddr_in serv_addr;
-    unsigned int udp_lastpacketno=0;
-    unsigned char socketcommbuff[BUFFER_SIZE+1];
-    unsigned char receivedcommand[16];
+    struct udpclient udpclients[UDPCLIENT_MAX];
+    struct sockaddr_in udp_srcaddr[UDP_BATCH_SIZE];
+    double time_last_udpstats=0;
+    struct cmdring remotering;
+    struct remote_outbuf remoteout;
+    struct mmsghdr udp_msgs[UDP_BATCH_SIZE];
+    struct iovec udp_iov[UDP_BATCH_SIZE];
+    unsigned char udp_payload[UDP_BATCH_SIZE][UDP_PAYLOAD_MAXLEN];
     unsigned char set_new_spx_value_from_remote=0;
     unsigned char set_new_spy_value_from_remote=0;
     unsigned char set_new_rot_value_from_remote=0;
+    // REMOTECMD_AXIS_X, REMOTECMD_AXIS_Y, REMOTECMD_AXIS_ROT
+    int *remote_axis_value[REMOTECMD_AXES] = { &speedX, &speedY, &rotate };
+    unsigned char *remote_axis_new[REMOTECMD_AXES] = { &set_new_spx_value_from_remote, &set_new_spy_value_from_remote, &set_new_rot_value_from_remote };
+    const char *remote_axis_reply_ok[REMOTECMD_AXES]  = { "OKSPX\r\n", "OKSPY\r\n", "OKROT\r\n" };
+    const char *remote_axis_reply_err[REMOTECMD_AXES] = { "!ERRSPX!\r\n", "!ERRSPY!\r\n", "!ERRROT!\r\n" };
+    int remote_axis_setret[REMOTECMD_AXES] = { 0, 0, 0 };      // result of the last serial write of the axis
+    struct remote_acks remote_axis_acks[REMOTECMD_AXES];      // framed mode: requests waiting for the serial write
+    unsigned char remoteframed=0;                             // TCP framed mode, switched by the client (FRM00001)
+
+    struct ui ui;
+    struct ui_snapshot uisnapshot;
+
+    // loop timing: interval between the iterations (= between the watchdog checks), select() wake-up lateness
+    struct jitter_hist loop_jitter, wakeup_jitter;
+    double time_looptop, time_looptop_prev=0, time_selectstart, time_selecttimeout, time_last_jitterlog=0;
+
+    struct telemetry telemetry;
+    int telemetryfd=-1;
+
+    struct safestop safestop;        // watchdog, stops the robot without the control loop
+    unsigned char stopframe[SAFESTOP_FRAME_MAXLEN];
+    double safestop_latency;
+
+    struct odometry odom;
+    struct odom_geometry odomgeometry;
+    unsigned char odometry=0;
+    double time_last_odomsample=0, odom_wait;
+
+    struct clocksync clocksync;      // rover uptime -> host CLOCK_MONOTONIC, for the telemetry timestamps
+    unsigned char clocksyncing=0;
+    double time_last_clocksync=0;
+    struct serial_rtt serialrtt;
+    struct rover_transport_stats txstats;
+    struct rover_cmd_stats *cmdstats;
+    unsigned long txbusy, txbytes;
+    int ctrl;
+    static const char *txctrl_names[ROVER_STATS_CTRLS] = { "0x10", "0x1F", "both/k" };
+    struct rover_transport transport;
+    struct memmapfetch memmapfetch;     // -f with memmapurl: memmaps over Wi-Fi
+    unsigned char memmapfetching=0;
+    struct memmapfile memmapfile;       // -f without memmapurl: the memmap files (memmapupdate_via_wifi.sh)
+    unsigned char memmapfiles=0;
+    unsigned char *memmapfile_second=NULL;
+    static const char *serialrtt_names[SERIAL_RTT_TYPES] = { "register reads", "memmap reads", "writes", "other commands", "paired memmap reads" };
+
+    struct trajectory trajectory;    // executed on its own timer, the setpoints are computed here
+    struct trajectory_status trjstatus;
+    unsigned char trajectories=0;
+    int trjspeed[REMOTECMD_AXES], trjticks;
+    struct sockaddr_in trjsender, trjsender_next;   // the UDP client which sent the running/the received trajectory
+    unsigned char trjsender_local=0, trjsender_next_local=0;   // ... or a local client
+    double time_trjstart=0, time_trjlease=0;        // the trajectory is aborted if its sender is silent (trajectory_lease_ms)
+
+    struct localctl localctl;
+    struct remote_mailbox mailbox;   // setpoints received in this loop iteration (UDP, local)
+
+    struct commander_config cfg;
+    struct sigaction termaction;
+
+    // see mecanumcommander_config.h
+    unsigned char remotecontrol, dummymode, keyboardmode, repeatcommands, usekcommands, readmemmapfromfile;
+    unsigned char remotecontrolproto, localcontrol, refreshmemmap, nolamp_when_setcmd, telemetrymulticast;
+    unsigned int telemetrymulticast_period_ms, telemetrymulticast_fields;
+
+
+    config_defaults(&cfg);
+    ret = config_parse_args(&cfg, argc, argv);
+    if (ret != 0) {
+        exit((ret == 1) ? 0 : 1);
+    }
+    remotecontrol      = cfg.remotecontrol;
+    dummymode          = cfg.dummymode;
+    keyboardmode       = cfg.keyboardmode;
+    repeatcommands     = cfg.repeatcommands;
+    usekcommands       = cfg.usekcommands;
+    readmemmapfromfile = cfg.readmemmapfromfile;
+    remotecontrolproto = cfg.remotecontrolproto;
+    localcontrol       = cfg.localcontrol;
+    refreshmemmap      = cfg.refreshmemmap;
+    nolamp_when_setcmd = cfg.nolamp_when_setcmd;
+    telemetrymulticast = cfg.telemetrymulticast;
+    telemetrymulticast_period_ms = cfg.telemetrymulticast_period_ms;
+    telemetrymulticast_fields    = cfg.telemetrymulticast_fields;
+    remotecmd_validity = cfg.remotecmd_validity;
+    rover_devfile      = cfg.serialdev;
+    rover_baudrate     = cfg.serialbaud;
+    rover_set_serial_timeouts(cfg.replywait_floor_us, cfg.replywait_ceiling_us, cfg.replywait_gap_floor_us);
+    safestop.running   = 0;
+
+    // under systemd stdout is a pipe to the journal
+    if (cfg.headless == 1) {
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    }
 
-    unsigned char main_motor_status, second_motor_status;
-
-    unsigned char remotecontrol=0;      // set to 1 to listen on tcp/3475 for easy remote control
-    unsigned char dummymode=0;          // for testing, do not send real commands to the robot
-    unsigned char keyboardmode=1;       // for future use...
-    unsigned char repeatcommands=1;     // repeat commands every REPEAT_TIME_SEC_CMDSENT, so "commandtimeout" on the robot's controller won't trigger
-    unsigned char usekcommands=0;       // use the "triple command set"
-    unsigned char readmemmapfromfile=0; // do not get the memmap from the robot, instead read it from a file
-    unsigned char remotecontrolproto=0; // 0 - TCP, 1 - UDP
-    unsigned char refreshmemmap=0;      // re-read memmap periodically (on/off - 1/0)
-    unsigned char nolamp_when_setcmd=1; // do not blink the "lamps" on the UI when sending set speed commands
-
+    // no SA_RESTART: a blocking accept()/select() returns with EINTR
+    memset(&termaction, 0, sizeof(termaction));
+    termaction.sa_handler = termsignal_handler;
+    sigemptyset(&termaction.sa_mask);
+    sigaction(SIGTERM, &termaction, NULL);
+    sigaction(SIGINT, &termaction, NULL);
 
 // create logfile
-    logfd = open("mecanumcommander.log", O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    logfd = open(cfg.logfile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
     if (logfd == -1) {
-        printf("Cannot create logfile: mecanumcommander.log\n");
+        printf("Cannot create logfile: %s\n", cfg.logfile);
         exit(1);
     }
 
@@ -195,34 +362,85 @@ int main() {
     } else {
 
         if (check_serial_dev() == -1) {
-            printf("Cannot open serial port: %s!\n", DEVFILE);
+            printf("Cannot open serial port: %s!\n", rover_devfile);
+            exit(1);
+        }
+
+        // the HTTP API only has register reads/writes
+        if ((usekcommands == 1) && (rover_transport_parse(&transport, rover_devfile, rover_baudrate) == 0) && (transport.type == TRANSPORT_HTTP)) {
+            printf("The k commands cannot be used over HTTP: %s!\n", rover_devfile);
             exit(1);
         }
 
         if (readmemmapfromfile == 1) {
 
-            if (access("memmap_0x10.dat", R_OK) != 0) {
-                printf("Cannot access memmap_0x10.dat!\n");
-                exit(1);
+            if (cfg.memmapurl[0] != 0) {
+                // the identity from the main memmap, then both memmaps on the fetcher thread
+                if ((memmapfetch_init(&memmapfetch, cfg.memmapurl, cfg.memmapread_period) == -1) ||
+                    (memmapfetch_once(&memmapfetch, CONTROLLER_ADDR_MAIN, 0, rover.memmap_main, NULL) == -1)) {
+                    printf("Cannot fetch the memmap from %s!\n", cfg.memmapurl);
+                    exit(1);
+                }
+            } else {
+                // watched before the first load, so a file swapped in between is not missed
+                if (memmapfile_init(&memmapfile) == -1) {
+                    printf("Cannot watch the memmap files, polling them every %.3f sec\n", cfg.memmapread_period);
+                }
+                if (memmapfile_load(&memmapfile, MEMMAPFILE_MAIN, rover.memmap_main) == -1) {
+                    printf("Cannot load %s (missing or not a valid memmap)!\n", MEMMAPFILE_MAIN);
+                    exit(1);
+                }
             }
-            read_memmap_files(&rover);  // when using memmapupdate_via_wifi.sh
 
             if (rover_identify_from_main_memmap(&rover) == 1 ) {
                 printf("Unknown rover type: 0x%X!\n", rover.sysname);
                 exit(1);
             }
 
+            if (cfg.memmapurl[0] != 0) {
+                if (memmapfetch_start(&memmapfetch, rover.regs->controller_addr_main,
+                                      (rover.config->has_second_controller == 1) ? rover.regs->controller_addr_second : 0) == -1) {
+                    exit(1);
+                }
+                memmapfetching = 1;
+            } else {
+                if (rover.config->has_second_controller == 1) {
+                    memmapfile_second = rover.memmap_second;
+                    memmapfile_load(&memmapfile, MEMMAPFILE_SECOND, memmapfile_second);
+                }
+                memmapfiles = 1;
+            }
+
         } else {
 
-            if (rover_identify(&rover) == 0) {
+            // fast start: only the identity, the memmaps too if there is no matching snapshot of them
+            if (cfg.faststart == 1) {
+                ret = rover_probe(&rover, cfg.probe_timeout_ms, &probe);
+                if (ret == -1) {
+                    printf("No answer from the rover's controller within %u ms!\n", cfg.probe_timeout_ms);
+                    exit(1);
+                }
+                if (ret != 0) {
+                    printf("Unknown rover type: 0x%X!\n", rover.sysname);
+                    exit(1);
+                }
                 printf("Rover found: 0x%x:%s FWRev: 0x%x\n", rover.sysname, rover.fullname, rover.firmrev);
-            } else {
-                printf("Unknown rover type: 0x%X!\n", rover.sysname);
-                exit(1);
+                sprintf(logstring, "Probe: %u attempt(s), last reply wait: %ld us, second controller: %s", probe.attempts, probe.timeout_usec,
+                        (probe.second_found == 1) ? "found" : "no answer");
+                logmsg(logfd, time_start, logstring);
+                if ((cfg.identitycache[0] != 0) && (read_identity_cache(cfg.identitycache, &rover, probe.second_found) == 0)) {
+                    logmsg(logfd, time_start, "Memmaps from the identity cache, they are read again in the control loop");
+                    memmap_revalidate = 1;
+                }
             }
 
+        }
+
+        if ((readmemmapfromfile == 0) && (memmap_revalidate == 0)) {
+
+            // the first memmap read identifies the rover too
             logmsg(logfd, time_start, "Reading main memmap from robot - initial");
-            ret = rover_read_full_memmap(rover.memmap_main, rover.regs->controller_addr_main, &rover);
+            ret = rover_read_full_memmap(rover.memmap_main, (cfg.faststart == 1) ? rover.regs->controller_addr_main : CONTROLLER_ADDR_DEFAULT, &rover);
             if (ret == -2) {
                 logmsg(logfd, time_start, "Err: Fatal error, while reading main memmap! (initial)");
                 printf("Fatal error, while reading main memmap - initial!");
@@ -233,6 +451,14 @@ int main() {
                 printf("Failed to read main memmap correctly (invalid length: %d) - initial.", ret);
                 exit(1);
             }
+            if (cfg.faststart == 0) {
+                if (rover_identify_from_main_memmap(&rover) == 0) {
+                    printf("Rover found: 0x%x:%s FWRev: 0x%x\n", rover.sysname, rover.fullname, rover.firmrev);
+                } else {
+                    printf("Unknown rover type: 0x%X!\n", rover.sysname);
+                    exit(1);
+                }
+            }
             if (rover.config->has_second_controller == 1) {
                 logmsg(logfd, time_start, "Reading second memmap from robot - initial");
                 ret = rover_read_full_memmap(rover.memmap_second, rover.regs->controller_addr_second, &rover);
@@ -247,6 +473,9 @@ int main() {
                     exit(1);
                 }
             }
+            if ((cfg.faststart == 1) && (cfg.identitycache[0] != 0) && (write_identity_cache(cfg.identitycache, &rover, probe.second_found) == -1)) {
+                logmsg(logfd, time_start, "Cannot write the identity cache");
+            }
 
         }
 
@@ -255,18 +484,17 @@ int main() {
     sprintf(logstring, "Rover type: 0x%x:%s FWRev: 0x%x", rover.sysname, rover.fullname, rover.firmrev);
     logmsg(logfd, time_start, logstring);
 
-    // bind to tcp/3475 or udp/3475
+    // bind to tcp/<port> or udp/<port> (3475 by default)
     if (remotecontrol == 1) {
-        typedef void (*sighandler_t)(int);
-        sighandler_t sigret;
         unsigned char replymsg[128];
+        unsigned char authbuff[BUFFER_SIZE+1];
         int replylen, wret;
         int enable=1;
 
         bzero(&serv_addr, sizeof(serv_addr));
         serv_addr.sin_family = AF_INET;
         serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        serv_addr.sin_port = htons(3475);
+        serv_addr.sin_port = htons(cfg.port);
 
         if (remotecontrolproto == 0 ) { // TCP
             listenfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -274,8 +502,8 @@ int main() {
                 perror("socket(TCP)");
                 exit(3);
             }
-            sigret = signal(SIGPIPE, sigpipe_handler);
-            if (sigret == SIG_ERR) {
+            // a lost connection is reported by write()/send() as EPIPE (the main loop uses MSG_NOSIGNAL anyway)
+            if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
                 perror("signal(SIGPIPE)");
                 exit(3);
             }
@@ -287,7 +515,7 @@ int main() {
 
             ret = bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr));
             if (ret == -1) {
-                perror("bind(INADDR_ANY/tcp/3475)");
+                perror("bind(INADDR_ANY/tcp)");
                 exit(3);
             }
             listen(listenfd, 1);
@@ -295,8 +523,9 @@ int main() {
                 perror("listen()");
                 exit(3);
             }
-            printf("Waiting for connection on tcp/3475...\n");
-            logmsg(logfd, time_start, "Waiting for connection on tcp/3475");
+            printf("Waiting for connection on tcp/%d...\n", cfg.port);
+            sprintf(logstring, "Waiting for connection on tcp/%d", cfg.port);
+            logmsg(logfd, time_start, logstring);
             clientfd = accept(listenfd, (struct sockaddr*)NULL, NULL);
             if (clientfd == -1) {
                 perror("accept()");
@@ -320,16 +549,9 @@ int main() {
                 perror("select()");
                 exit(7);
             }
-            if (got_sigpipe == 1) {
-                printf("Broken pipe.\n");
-                exit(8);
-            }
             if (ret) {
-                sockread = read(clientfd, &socketcommbuff[socketcommbuff_offset], BUFFER_SIZE);
-                if ((sockread > 10) ||
-                    ((strncmp(socketcommbuff, COMMANDER_PASSWORD, 8) != 0) &&
-                     (strncmp(socketcommbuff, COMMANDER_PASSWORD"\n", 9) != 0) &&
-                     (strncmp(socketcommbuff, COMMANDER_PASSWORD"\r\n", 10) != 0) ) ) {
+                sockread = read(clientfd, authbuff, BUFFER_SIZE);
+                if (check_password(authbuff, sockread, cfg.password) == -1) {
                         replylen = sprintf(replymsg, "!BADPWD!\r\n");
                         wret = write(clientfd, replymsg, replylen);
                         logmsg(logfd, time_start, "Bad password!");
@@ -370,7 +592,6 @@ int main() {
                 perror("write()");
                 exit(6);
             }
-            sockread = 0;
 
         } else { // UDP
 
@@ -382,11 +603,52 @@ int main() {
 
             ret = bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr));
             if (ret == -1) {
-                perror("bind(INADDR_ANY/udp/3475)");
+                perror("bind(INADDR_ANY/udp)");
                 exit(3);
             }
 
+            memset(udpclients, 0, sizeof(udpclients));
+
         }
+
+        cmdring_init(&remotering);
+        remote_outbuf_init(&remoteout, clientfd);
+        memset(remote_axis_acks, 0, sizeof(remote_axis_acks));
+    }
+
+    if (localcontrol == 1) {
+        if (localctl_init(&localctl, cfg.localsocket) == -1) {
+            printf("Cannot create the local control endpoint: %s\n", cfg.localsocket);
+            exit(3);
+        }
+        sprintf(logstring, "Local control on %s (+ shared memory mailbox)", cfg.localsocket);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    // telemetry: network clients can subscribe with TLR/TLF, or it is sent to a multicast group
+    telemetry_init(&telemetry);
+    if (telemetrymulticast == 1) {
+        struct sockaddr_in group_addr;
+        unsigned char ttl=1;
+
+        telemetryfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (telemetryfd == -1) {
+            perror("socket(UDP multicast)");
+            exit(3);
+        }
+        if (setsockopt(telemetryfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+            perror("setsockopt(IP_MULTICAST_TTL)");
+            exit(3);
+        }
+
+        bzero(&group_addr, sizeof(group_addr));
+        group_addr.sin_family = AF_INET;
+        group_addr.sin_addr.s_addr = inet_addr(TELEMETRY_MULTICAST_GROUP);
+        group_addr.sin_port = htons(TELEMETRY_MULTICAST_PORT);
+        telemetry_add_multicast(&telemetry, telemetryfd, &group_addr, telemetrymulticast_period_ms, telemetrymulticast_fields);
+
+        sprintf(logstring, "Telemetry multicast to %s:%d every %d ms", TELEMETRY_MULTICAST_GROUP, TELEMETRY_MULTICAST_PORT, telemetrymulticast_period_ms);
+        logmsg(logfd, time_start, logstring);
     }
 
     // it seems like this doesn't really do anything on this robot... but anyway
@@ -401,125 +663,87 @@ int main() {
         }
     }
 
-    // ncurses init
-    setlocale(LC_CTYPE, "");
-    initscr();
-    noecho();
-    cbreak();
-    timeout(500);
-    start_color();
-    init_pair(1, 15,  0); // feher + fekete
-    init_pair(2 , 9,  7); // piros + szurke
-    init_pair(3, 10,  0); // zold + fekete
-    init_pair(4, 10, 15); // zold + feher
-    init_pair(5,  9,  0); // piros + fekete
-    init_pair(6, 12,  0); // kek + fekete
-    init_pair(7, 11,  0); // sarga + fekete
-    init_pair(8, 12,  7); // kek + szurke
-    init_pair(9,  7,  0); // szurke + fekete
-    init_pair(10, 0,  7); // fekete + szurke
-    curs_set(0);
-
-    attron(COLOR_PAIR(1));
-    mvprintw(0, 1, "Rover type 0x%x (%s) Firmware revision: 0x%x", rover.sysname, rover.fullname, rover.firmrev);
-    attroff(COLOR_PAIR(1));
-
-    switch (rover.sysname) {
-        case SYSNAME_MECANUMROVER21:
-            attron(COLOR_PAIR(9));
-            mvprintw(roverdrawy    , roverdrawx + 5, "☵▇█▇☵");
-            mvprintw(roverdrawy + 1, roverdrawx + 5, "▐███▌");
-            mvprintw(roverdrawy + 2, roverdrawx + 5, "☵");
-            attroff(COLOR_PAIR(9));
-            attron(COLOR_PAIR(10));
-            mvprintw(roverdrawy + 2, roverdrawx + 6, "▁▁▁");
-            attroff(COLOR_PAIR(10));
-            attron(COLOR_PAIR(2));
-            mvprintw(roverdrawy + 2, roverdrawx + 7, "⬤");
-            attroff(COLOR_PAIR(2));
-            attron(COLOR_PAIR(9));
-            mvprintw(roverdrawy + 2, roverdrawx + 9, "☵");
-            attroff(COLOR_PAIR(9));
-            break;
-
-        case SYSNAME_MEGAROVER3:
-            attron(COLOR_PAIR(5));
-            mvprintw(roverdrawy - 1, roverdrawx + 6, "▂");
-            attroff(COLOR_PAIR(5));
-            attron(COLOR_PAIR(9));
-            mvprintw(roverdrawy    , roverdrawx + 5, "≣███≣");
-            mvprintw(roverdrawy + 1, roverdrawx + 7, "█▊");
-//            mvprintw(roverdrawy + 1, roverdrawx + 7, "█▉");
-            attroff(COLOR_PAIR(9));
-            attron(COLOR_PAIR(10));
-            mvprintw(roverdrawy + 1, roverdrawx + 6, "▎");
-            mvprintw(roverdrawy + 2, roverdrawx + 7, "▇");
-            attroff(COLOR_PAIR(10));
-            break;
+    // the screen is drawn by the UI thread from now on (headless: no screen at all)
+    if (ui_init(&ui, &rover, cfg.headless) == -1) {
+        printf("Cannot start the UI!\n");
+        exit(1);
+    }
+    // unexpected replies are counted in the transport statistics, not printed over the screen
+    if (cfg.headless == 0) {
+        rover_set_verbose(0);
+    }
 
-        default:
-            attron(COLOR_PAIR(9));
-            mvprintw(roverdrawy    , roverdrawx + 5, "☵███☵");
-            mvprintw(roverdrawy + 2, roverdrawx + 6, "███");
-            attroff(COLOR_PAIR(9));
-            attron(COLOR_PAIR(2));
-            mvprintw(roverdrawy + 1, roverdrawx + 7, "⬤");
-            attroff(COLOR_PAIR(2));
+    // the UI and the logger threads are started before, so they are not real-time
+    if ((cfg.rt_priority > 0) || (cfg.rt_cpu != -1)) {
+        if ((log_ring_start(logfd) == -1) || (rt_setup(cfg.rt_priority, cfg.rt_cpu) == -1)) {
+            logmsg(logfd, time_start, "Err: Cannot switch to real-time mode (9)");
+            ui_errormsg(&ui, "Cannot switch to real-time mode (no permission?)! Press a key to quit!", 1);
+            quit = 9;
+        } else {
+            sprintf(logstring, "Real-time mode: SCHED_FIFO priority %d, CPU %d, memory locked", cfg.rt_priority, cfg.rt_cpu);
+            logmsg(logfd, time_start, logstring);
+        }
     }
 
-    attron(A_UNDERLINE | A_BOLD);
-    mvprintw(commanddrawy, commanddrawx, "Command               ");
-    mvprintw(statusdrawy,  statusdrawx , "Rover status                         ");
-    mvprintw(aboutdrawy,   aboutdrawx  , "About                 ");
-    attroff(A_UNDERLINE | A_BOLD);
+    // one priority above the control loop, so the stop gets through even when the loop is busy
+    if ((quit == 0) && (dummymode == 0) && (cfg.safestop == 1) && ((remotecontrol == 1) || (localcontrol == 1))) {
+        ret = rover_format_stop_frame(&rover, usekcommands, stopframe);
+        if (safestop_init(&safestop, stopframe, ret, cfg.safestop_deadline_ms, (cfg.rt_priority > 0) ? ((cfg.rt_priority < 99) ? cfg.rt_priority + 1 : 99) : 0) == -1) {
+            logmsg(logfd, time_start, "Err: Cannot start the safety stop watchdog (10)");
+            ui_errormsg(&ui, "Cannot start the safety stop watchdog! Press a key to quit!", 1);
+            quit = 10;
+        } else if (safestop.shared == 1) {
+            // tcp:/http:// device: no second connection, the stop waits for the transaction in progress
+            sprintf(logstring, "Safety stop watchdog started on the main connection of %s, the %u ms deadline is not guaranteed", rover_devfile, cfg.safestop_deadline_ms);
+            logmsg(logfd, time_start, logstring);
+        } else {
+            sprintf(logstring, "Safety stop watchdog started, deadline: %u ms", cfg.safestop_deadline_ms);
+            logmsg(logfd, time_start, logstring);
+        }
+    }
 
-    attron(COLOR_PAIR(1));
-    mvprintw(aboutdrawy + 1, aboutdrawx, "NLAB-MecanumCommander");
-    mvprintw(aboutdrawy + 2, aboutdrawx + 7, "for Linux v" COMMANDER_VERSION);
-    mvprintw(aboutdrawy + 4, aboutdrawx, "See source for more info.");
+    // the encoders are read directly, not from the memmap files
+    if ((quit == 0) && (cfg.odometry == 1)) {
+        if ((dummymode == 1) || (readmemmapfromfile == 1)) {
+            logmsg(logfd, time_start, "Odometry needs the serial port, disabled");
+        } else {
+            odomgeometry.wheel_radius   = cfg.odom_wheel_radius_mm / 1000.0;
+            odomgeometry.track          = cfg.odom_track_mm / 1000.0;
+            odomgeometry.wheelbase      = cfg.odom_wheelbase_mm / 1000.0;
+            odomgeometry.counts_per_rev = cfg.odom_counts_per_rev;
+            odomgeometry.invert         = cfg.odom_invert;
+            odomgeometry.front_main     = cfg.odom_front_main;
+            if (odometry_init(&odom, &rover, &odomgeometry, cfg.odom_wheel_noise) == -1) {
+                logmsg(logfd, time_start, "Odometry: unknown rover type, disabled");
+            } else {
+                odometry = 1;
+                sprintf(logstring, "Odometry every %u ms: wheel radius %.1f mm, track %.1f mm, wheelbase %.1f mm, %.0f counts/rev, inverted: 0x%X",
+                        cfg.odometry_period_ms, odom.geo.wheel_radius * 1000.0, odom.geo.track * 1000.0, odom.geo.wheelbase * 1000.0,
+                        odom.geo.counts_per_rev, odom.geo.invert);
+                logmsg(logfd, time_start, logstring);
+            }
+        }
+    }
 
-    mvprintw(commanddrawy + 1, commanddrawx, "X Speed:      0 mm/s");
-    if (rover.config->has_Y_speed == 1) {
-        mvprintw(commanddrawy + 2, commanddrawx, "Y Speed:      0 mm/s");
+    // every uptime read is timed, the odometry reads too
+    clocksync_init(&clocksync);
+    if ((quit == 0) && (dummymode == 0) && (readmemmapfromfile == 0)) {
+        clocksyncing = 1;
     }
-    mvprintw(commanddrawy + 3, commanddrawx, "Rotation:     0 mrad/s");
-
-    mvprintw(statusdrawy + 1,  statusdrawx, "Uptime              :");
-    mvprintw(statusdrawy + 2,  statusdrawx, "Battery             :");
-    mvprintw(statusdrawy + 3,  statusdrawx, "Motors          🏍️   :");
-
-    switch (rover.sysname) {
-
-        case SYSNAME_MECANUMROVER21:
-            mvprintw(statusdrawy +  4, statusdrawx + 1, "Speed        M3,M4 : ");
-            mvprintw(statusdrawy +  5, statusdrawx + 1, "Speed        M1,M2 : ");
-            mvprintw(statusdrawy +  6, statusdrawx + 1, "Position     M3,M4 : ");
-            mvprintw(statusdrawy +  7, statusdrawx + 1, "Position     M1,M2 : ");
-            mvprintw(statusdrawy +  8, statusdrawx + 1, "Encoder      M3,M4 : ");
-            mvprintw(statusdrawy +  9, statusdrawx + 1, "Encoder      M1,M2 : ");
-            mvprintw(statusdrawy + 10, statusdrawx + 1, "OutputOffset M3,M4 : ");
-            mvprintw(statusdrawy + 11, statusdrawx + 1, "OutputOffset M1,M2 : ");
-            mvprintw(statusdrawy + 12, statusdrawx + 1, "MotOutCalc   M3,M4 :               %%");
-            mvprintw(statusdrawy + 13, statusdrawx + 1, "MotOutCalc   M1,M2 :               %%");
-            mvprintw(statusdrawy + 14, statusdrawx + 1, "MeasuredCurr M3,M4 :               A");
-            mvprintw(statusdrawy + 15, statusdrawx + 1, "MeasuredCurr M1,M2 :               A");
-            mvprintw(statusdrawy + 16, statusdrawx + 1, "MaxCurrent   M3,M4 :               A");
-            mvprintw(statusdrawy + 17, statusdrawx + 1, "MaxCurrent   M1,M2 :               A");
-            mvprintw(statusdrawy + 18, statusdrawx + 1, "CurrentLimit M3,M4 :               A");
-            mvprintw(statusdrawy + 19, statusdrawx + 1, "CurrentLimit M1,M2 :               A");
-            break;
 
-        case SYSNAME_MEGAROVER3:
-            mvprintw(statusdrawy +  5, statusdrawx + 1, "MotorSpeed M1,M2 : ");
-            mvprintw(statusdrawy +  9, statusdrawx + 1, "Encoder    M1,M2 : ");
-//            mvprintw(statusdrawy + 15, statusdrawx + 1, "MeasuredCurr M1,M2 :               A");
-            break;
+    if ((quit == 0) && ((remotecontrol == 1) || (localcontrol == 1))) {
+        if (trajectory_init(&trajectory, 1.0 / cfg.trajectory_rate_hz, cfg.trajectory_gain, rover.config->has_Y_speed) == 0) {
+            trajectories = 1;
+            memset(&trjsender, 0, sizeof(trjsender));
+            trjsender_next = trjsender;
+        } else {
+            logmsg(logfd, time_start, "Cannot create the timer of the trajectory follower, trajectories are disabled");
+        }
     }
-    attroff(COLOR_PAIR(1));
 
-    attron(COLOR_PAIR(7));
-    mvprintw(statusdrawy + 2, statusdrawx + 16, "⚡");
-    attroff(COLOR_PAIR(7));
+    jitter_init(&loop_jitter);
+    jitter_init(&wakeup_jitter);
+    time_last_jitterlog = time_start;
 
 
 // the fun begins here
@@ -531,684 +755,739 @@ int main() {
 
     logmsg(logfd, time_start, "Start");
 
-    while ((quit == 0) && (got_sigpipe == 0)) {
+    while (quit == 0) {
 
         int setret = 0;
+        int maxfd;
+
+        if (got_termsignal != 0) {
+            sprintf(logstring, "Got signal %d, exiting (8)", (int)got_termsignal);
+            logmsg(logfd, time_start, logstring);
+            quit = 8;
+            break;
+        }
+
+        time_looptop = rt_now();
+        if (time_looptop_prev > 0) {
+            jitter_add(&loop_jitter, time_looptop - time_looptop_prev);
+        }
+        time_looptop_prev = time_looptop;
 
         gettimeofday(&timestruct, NULL);
         time_current = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
 
-        if ( (refreshmemmap == 1) && (dummymode == 0) ) {
+        if ( ((refreshmemmap == 1) || (telemetry_active(&telemetry) == 1) || (memmap_revalidate == 1)) && (dummymode == 0) ) {
 
-            if ((time_current - time_last_memmapread) > REPEAT_TIME_SEC_MEMMAPREAD) {
+            if ((time_current - time_last_memmapread) > cfg.memmapread_period) {
 
-                // heart on
-                attron(COLOR_PAIR(5) | A_BOLD);
-                mvprintw(statusdrawy + 1, statusdrawx + 16, "♥");
-                attroff(COLOR_PAIR(5) | A_BOLD);
-                refresh();
+                ui_indicator(&ui, UI_IND_HEART, 1);
 
-                if (readmemmapfromfile == 1) {
-                    logmsg(logfd, time_start, "Reading memmap from files");
-                    read_memmap_files(&rover);  // when using memmapupdate_via_wifi.sh
+                if (memmapfetching == 1) {
+                    if (memmapfetch_get(&memmapfetch, rover.memmap_main, rover.memmap_second) == 1) {
+                        logmsg(logfd, time_start, "Memmap snapshot from Wi-Fi");
+                    }
+                } else if (memmapfiles == 1) {
+                    // watched: loaded as soon as they change (after select())
+                    if (memmapfile.inotifyfd == -1) {
+                        logmsg(logfd, time_start, "Reading memmap from files");
+                        memmapfile_load_all(&memmapfile, rover.memmap_main, memmapfile_second);
+                    }
                 } else { // read memmap from rover
-                    logmsg(logfd, time_start, "Reading main memmap from robot");
-                    ret = rover_read_full_memmap(rover.memmap_main, rover.regs->controller_addr_main, &rover);
+                    // both controllers at once: one sample of all 4 wheels, in half the round trips
+                    if (rover.config->has_second_controller == 1) {
+                        logmsg(logfd, time_start, "Reading main and second memmap from robot");
+                        ret = rover_read_full_memmaps(rover.memmap_main, rover.memmap_second, &rover, &ret_second);
+                    } else {
+                        logmsg(logfd, time_start, "Reading main memmap from robot");
+                        ret = rover_read_full_memmap(rover.memmap_main, rover.regs->controller_addr_main, &rover);
+                        ret_second = 384;
+                    }
                     if (ret == -2) {
                         if (dummymode == 0) {
-                            commandsend_lamp_on();
+                            commandsend_lamp_on(&ui);
                             logmsg(logfd, time_start, "Stoprobot");
                             stoprobot(&rover, usekcommands, answer);
-                            commandsend_lamp_off();
+                            commandsend_lamp_off(&ui);
                         }
-                        logmsg(logfd, time_start, "Err: Fatal error, while reading main memmap! (2)");
-                        errormsg("Fatal error, while reading main memmap! Press a key to quit!", 5);
+                        logmsg(logfd, time_start, "Err: Fatal error, while reading memmap! (2)");
+                        ui_errormsg(&ui, "Fatal error, while reading memmap! Press a key to quit!", 5);
                         quit = 2;
                         break;
                     }
                     if (ret != 384) {
                         unsigned char errmsg[256];
                         if (dummymode == 0) {
-                            commandsend_lamp_on();
+                            commandsend_lamp_on(&ui);
                             logmsg(logfd, time_start, "Stoprobot");
                             stoprobot(&rover, usekcommands, answer);
-                            commandsend_lamp_off();
+                            commandsend_lamp_off(&ui);
                         }
                         logmsg(logfd, time_start, "Err: Failed to read main memmap correctly (invalid length) (3)");
                         sprintf(errmsg, "Failed to read main memmap correctly (invalid length: %d). Press a key to quit!", ret);
-                        errormsg(errmsg, 1);
+                        ui_errormsg(&ui, errmsg, 1);
                         quit = 3;
                         break;
                     }
-                    if (rover.config->has_second_controller == 1) {
-                        logmsg(logfd, time_start, "Reading second memmap from robot");
-                        ret = rover_read_full_memmap(rover.memmap_second, rover.regs->controller_addr_second, &rover);
-                        if (ret == -2) {
-                            if (dummymode == 0) {
-                                commandsend_lamp_on();
-                                logmsg(logfd, time_start, "Stoprobot");
-                                stoprobot(&rover, usekcommands, answer);
-                                commandsend_lamp_off();
-                            }
-                            logmsg(logfd, time_start, "Err: Fatal error, while reading second memmap! (2)");
-                            errormsg("Fatal error, while reading second memmap! Press a key to quit!", 5);
-                            quit = 2;
-                            break;
-                        }
-                        if (ret != 384) {
-                            unsigned char errmsg[256];
-                            if (dummymode == 0) {
-                                commandsend_lamp_on();
-                                logmsg(logfd, time_start, "Stoprobot");
-                                stoprobot(&rover, usekcommands, answer);
-                                commandsend_lamp_off();
-                            }
-                            logmsg(logfd, time_start, "Err: Failed to read second memmap correctly (invalid length) (3)");
-                            sprintf(errmsg, "Failed to read second memmap correctly (invalid length: %d). Press a key to quit!", ret);
-                            errormsg(errmsg, 1);
-                            quit = 3;
-                            break;
+                    if (ret_second != 384) {
+                        unsigned char errmsg[256];
+                        if (dummymode == 0) {
+                            commandsend_lamp_on(&ui);
+                            logmsg(logfd, time_start, "Stoprobot");
+                            stoprobot(&rover, usekcommands, answer);
+                            commandsend_lamp_off(&ui);
                         }
+                        logmsg(logfd, time_start, "Err: Failed to read second memmap correctly (invalid length) (3)");
+                        sprintf(errmsg, "Failed to read second memmap correctly (invalid length: %d). Press a key to quit!", ret_second);
+                        ui_errormsg(&ui, errmsg, 1);
+                        quit = 3;
+                        break;
                     }
                 }
 
+                ui_indicator(&ui, UI_IND_HEART, 0);
+
                 gettimeofday(&timestruct, NULL);
                 time_last_memmapread = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
 
+                if (memmap_revalidate == 1) {
+                    memmap_revalidate = 0;
+                    logmsg(logfd, time_start, "Memmaps read, the identity cache is updated");
+                    if (write_identity_cache(cfg.identitycache, &rover, probe.second_found) == -1) {
+                        logmsg(logfd, time_start, "Cannot write the identity cache");
+                    }
+                }
+
             }
 
         }
 
-        if ((rover.rs485_err_0x10 > 0) || (rover.rs485_err_0x1F > 0)) {
-            int alertcolor = 7;
-            if ((rover.rs485_err_0x10 >= 5) || (rover.rs485_err_0x1F >= 5)) {
-                alertcolor = 5;
+        // only the uptime and the encoder registers, much faster than the memmap refresh
+        if ((odometry == 1) && ((rt_now() - time_last_odomsample) >= (cfg.odometry_period_ms / 1000.0))) {
+            time_last_odomsample = rt_now();
+            if (odometry_sample(&odom, &rover) == 0) {
+                time_last_clocksync = time_last_odomsample;
+                if (clocksync_add(&clocksync, odom.uptime_read_start, odom.uptime_read_end, odom.state.uptime_ms) == 1) {
+                    logmsg(logfd, time_start, "Clock sync restarted, the rover's uptime jumped");
+                }
             }
-            attron(COLOR_PAIR(alertcolor));
-            mvprintw(1, 30, "⚠ RS485 CommErr! Main:%03d Front:%03d ⚠", rover.rs485_err_0x10, rover.rs485_err_0x1F);
-            attroff(COLOR_PAIR(alertcolor));
         }
 
-        attron(COLOR_PAIR(1));
-        mvprintw(statusdrawy + 1, statusdrawx + 22, " % 6.2lf sec", rover_get_uptime(&rover));
-        mvprintw(statusdrawy + 2, statusdrawx + 22, "    %2.2lf V", rover_get_battery_voltage(&rover));
-        attroff(COLOR_PAIR(1));
-
-        main_motor_status = rover_get_motor_status(&rover, rover.memmap_main);
-        if ((main_motor_status & 1) == 1) {
-            attron(COLOR_PAIR(3));
-            mvprintw(statusdrawy + 3, statusdrawx + 22, "On ");
-            if (rover.sysname == SYSNAME_MECANUMROVER21) {
-                mvprintw(roverdrawy + 3, roverdrawx + 2, "M1");
-            } else {
-                mvprintw(roverdrawy - 1, roverdrawx + 2, "M1");
-            }
-            attroff(COLOR_PAIR(3));
-        } else {
-            attron(COLOR_PAIR(5));
-            mvprintw(statusdrawy + 3, statusdrawx + 22, "Off");
-            if (rover.sysname == SYSNAME_MECANUMROVER21) {
-                mvprintw(roverdrawy + 3, roverdrawx + 2, "M1");
-            } else {
-                mvprintw(roverdrawy - 1, roverdrawx + 2, "M1");
+        // the uptime alone, if the odometry does not read it often enough
+        if ((clocksyncing == 1) && (cfg.clocksync_period_ms > 0) && ((rt_now() - time_last_clocksync) >= (cfg.clocksync_period_ms / 1000.0))) {
+            time_last_clocksync = rt_now();
+            if (clocksync_read(&clocksync, &rover) == 1) {
+                logmsg(logfd, time_start, "Clock sync restarted, the rover's uptime jumped");
             }
-            attroff(COLOR_PAIR(5));
         }
-        if ((main_motor_status >> 1) == 1) {
-            attron(COLOR_PAIR(3));
-            mvprintw(statusdrawy + 3, statusdrawx + 26, "On ");
-            if (rover.sysname == SYSNAME_MECANUMROVER21) {
-                mvprintw(roverdrawy + 3, roverdrawx + 11, "M2");
-            } else {
-                mvprintw(roverdrawy - 1, roverdrawx + 11, "M2");
-            }
-            attroff(COLOR_PAIR(3));
-        } else {
-            attron(COLOR_PAIR(5));
-            mvprintw(statusdrawy + 3, statusdrawx + 26, "Off");
-            if (rover.sysname == SYSNAME_MECANUMROVER21) {
-                mvprintw(roverdrawy + 3, roverdrawx + 11, "M2");
-            } else {
-                mvprintw(roverdrawy - 1, roverdrawx + 11, "M2");
-            }
-            attroff(COLOR_PAIR(5));
-        }
-        if (rover.config->motor_count == 4) {
-            second_motor_status = rover_get_motor_status(&rover, rover.memmap_second);
-
-            if ((second_motor_status & 1) == 1) {
-                attron(COLOR_PAIR(3));
-                mvprintw(statusdrawy + 3, statusdrawx + 30, "On ");
-                mvprintw(roverdrawy - 1, roverdrawx + 2, "M3");
-                attroff(COLOR_PAIR(3));
-            } else {
-                attron(COLOR_PAIR(5));
-                mvprintw(statusdrawy + 3, statusdrawx + 30, "Off");
-                mvprintw(roverdrawy - 1, roverdrawx + 2, "M3");
-                attroff(COLOR_PAIR(5));
-            }
-            if ((second_motor_status >> 1) == 1) {
-                attron(COLOR_PAIR(3));
-                mvprintw(statusdrawy + 3, statusdrawx + 34, "On ");
-                mvprintw(roverdrawy - 1, roverdrawx + 11, "M4");
-                attroff(COLOR_PAIR(3));
-            } else {
-                attron(COLOR_PAIR(5));
-                mvprintw(statusdrawy + 3, statusdrawx + 34, "Off");
-                mvprintw(roverdrawy - 1, roverdrawx + 11, "M4");
-                attroff(COLOR_PAIR(5));
-            }
-        }
-
-        attron(COLOR_PAIR(1));
-        switch (rover.sysname) {
-
-            case SYSNAME_MECANUMROVER21:
-                mvprintw(statusdrawy +  4, statusdrawx + 22, "% 6d,% 6d", rover_get_speed0(&rover, rover.memmap_second), rover_get_speed1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy +  5, statusdrawx + 22, "% 6d,% 6d", rover_get_speed0(&rover, rover.memmap_main),   rover_get_speed1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy +  6, statusdrawx + 22, "% 6d,% 6d", rover_get_measured_position0(&rover, rover.memmap_second), rover_get_measured_position1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy +  7, statusdrawx + 22, "% 6d,% 6d", rover_get_measured_position0(&rover, rover.memmap_main),   rover_get_measured_position1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy +  8, statusdrawx + 22, "% 6d,% 6d", rover_get_encoder_value0(&rover, rover.memmap_second), rover_get_encoder_value1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy +  9, statusdrawx + 22, "% 6d,% 6d", rover_get_encoder_value0(&rover, rover.memmap_main),   rover_get_encoder_value1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy + 10, statusdrawx + 22, "% 6d,% 6d", rover_get_outputoffset0(&rover, rover.memmap_second), rover_get_outputoffset1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy + 11, statusdrawx + 22, "% 6d,% 6d", rover_get_outputoffset0(&rover, rover.memmap_main),   rover_get_outputoffset1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy + 12, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_motoroutput_calc0(&rover, rover.memmap_second), rover_get_motoroutput_calc1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy + 13, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_motoroutput_calc0(&rover, rover.memmap_main),   rover_get_motoroutput_calc1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy + 14, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_measured_current_value0(&rover, rover.memmap_second), rover_get_measured_current_value1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy + 15, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_measured_current_value0(&rover, rover.memmap_main),   rover_get_measured_current_value1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy + 16, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_max_current0(&rover, rover.memmap_second), rover_get_max_current1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy + 17, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_max_current0(&rover, rover.memmap_main),   rover_get_max_current1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy + 18, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_current_limit0(&rover, rover.memmap_second), rover_get_current_limit1(&rover, rover.memmap_second));
-                mvprintw(statusdrawy + 19, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_current_limit0(&rover, rover.memmap_main),   rover_get_current_limit1(&rover, rover.memmap_main));
-                break;
-
-            case SYSNAME_MEGAROVER3:
-                mvprintw(statusdrawy +  5, statusdrawx + 22, "% 8d,% 8d", rover_get_motorspeed0(&rover, rover.memmap_main), rover_get_motorspeed1(&rover, rover.memmap_main));
-                mvprintw(statusdrawy +  9, statusdrawx + 22, "% 8d,% 8d", rover_get_encoder_value0(&rover, rover.memmap_main), rover_get_encoder_value1(&rover, rover.memmap_main));
-//                mvprintw(statusdrawy + 15, statusdrawx + 22, "% 6.2lf,% 6.2lf", rover_get_measured_current_value0(&rover, rover.memmap_main), rover_get_measured_current_value1(&rover, rover.memmap_main));
-                break;
-        }
-        attroff(COLOR_PAIR(1));
 
-        // heart off
-        if ( (refreshmemmap == 1) && (dummymode == 0) ) {
-            attron(COLOR_PAIR(1));
-            mvprintw(statusdrawy + 1, statusdrawx + 16, " ");
-            attroff(COLOR_PAIR(1));
+        // push the freshly read values right away
+        if (telemetry_active(&telemetry) == 1) {
+            gettimeofday(&timestruct, NULL);
+            time_current = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+            if (trajectories == 1) {
+                trajectory_get_status(&trajectory, &trjstatus);
+            }
+            telemetry_update_sample(&telemetry, &rover, speedX, speedY, rotate, (odometry == 1) ? &odom.state : NULL,
+                                    (trajectories == 1) ? &trjstatus : NULL, (clocksyncing == 1) ? &clocksync : NULL);
+            telemetry_publish(&telemetry, time_current);
         }
 
-        refresh();
-
         c = -1;
 
         FD_ZERO(&commfdset);
-        FD_SET(0, &commfdset);
+        FD_ZERO(&writefdset);
+        maxfd = 0;
+        if (ui.keyfd != -1) {
+            FD_SET(ui.keyfd, &commfdset);
+            maxfd = ui.keyfd;
+        }
+        // TCP: when the command buffer is full, or the client does not read the replies, leave the data in the socket (backpressure)
         if (remotecontrol == 1) {
             if (remotecontrolproto == 0) { // TCP
-                FD_SET(clientfd, &commfdset);
+                if ((cmdring_free(&remotering) > 0) && (remote_outbuf_pending(&remoteout) < (REMOTE_OUTBUF_SIZE / 2))) {
+                    FD_SET(clientfd, &commfdset);
+                }
+                // wake up as soon as the rest of the replies can be sent
+                if (remote_outbuf_pending(&remoteout) > 0) {
+                    FD_SET(clientfd, &writefdset);
+                }
+                if (clientfd > maxfd) { maxfd = clientfd; }
             } else { // UDP
                 FD_SET(listenfd, &commfdset);
+                if (listenfd > maxfd) { maxfd = listenfd; }
             }
         }
+        if (localcontrol == 1) {
+            maxfd = localctl_fdset(&localctl, &commfdset, maxfd);
+        }
+        if ((trajectories == 1) && (trajectory_active(&trajectory) == 1)) {
+            FD_SET(trajectory.timerfd, &commfdset);
+            if (trajectory.timerfd > maxfd) { maxfd = trajectory.timerfd; }
+        }
+        if ((memmapfiles == 1) && (memmapfile.inotifyfd != -1)) {
+            FD_SET(memmapfile.inotifyfd, &commfdset);
+            if (memmapfile.inotifyfd > maxfd) { maxfd = memmapfile.inotifyfd; }
+        }
+
+        remote_mailbox_clear(&mailbox);
 
         tv.tv_sec  = 0;
         tv.tv_usec = REPLYWAIT_TIMEOUT_USEC;
-
-        if (remotecontrol == 1) {
-            if (remotecontrolproto == 0) { // TCP
-                ret = select(clientfd + 1, &commfdset, NULL, NULL, &tv);
-            } else { // UDP
-                ret = select(listenfd + 1, &commfdset, NULL, NULL, &tv);
+        // wake up in time for the next odometry sample
+        if (odometry == 1) {
+            odom_wait = time_last_odomsample + (cfg.odometry_period_ms / 1000.0) - rt_now();
+            if (odom_wait < 0) {
+                odom_wait = 0;
             }
-        } else {
-            ret = select(1, &commfdset, NULL, NULL, &tv);
+            if (odom_wait < (REPLYWAIT_TIMEOUT_USEC / 1000000.0)) {
+                tv.tv_usec = odom_wait * 1000000.0;
+            }
+        }
+        time_selecttimeout = tv.tv_usec / 1000000.0;
+
+        time_selectstart = rt_now();
+        ret = select(maxfd + 1, &commfdset, &writefdset, NULL, &tv);
+        if (ret == 0) {
+            jitter_add(&wakeup_jitter, rt_now() - time_selectstart - time_selecttimeout);
+        }
+        if ((ret == -1) && (errno == EINTR)) {
+            ret = 0;  // signal, checked at the top of the loop
         }
         if (ret == -1) {
-            endwin();
+            ui_close(&ui);
             perror("select()");
             quit = 1;
             break;
         } else {
-            if (got_sigpipe == 1) { break; }
             if (ret) {
-                if (FD_ISSET(0, &commfdset)) {
-                    c = getch();
+                if ((ui.keyfd != -1) && (FD_ISSET(ui.keyfd, &commfdset)) && (read(ui.keyfd, &key, 1) == 1)) {
+                    c = key;
                     sprintf(logstring, "Keypress: %c", c);
                     logmsg(logfd, time_start, logstring);
                 }
-                // don't read any new data, while the previous buffer has not been emptied yet
-                if ( (remotecontrol == 1) && (sockread == 0) ) {
+                if ((memmapfiles == 1) && (memmapfile.inotifyfd != -1) && (FD_ISSET(memmapfile.inotifyfd, &commfdset))) {
+                    if (memmapfile_events(&memmapfile, rover.memmap_main, memmapfile_second) != 0) {
+                        logmsg(logfd, time_start, "Memmap files changed, loaded");
+                    }
+                }
+                if (remotecontrol == 1) {
                     if (remotecontrolproto == 0) { // TCP
                         if (FD_ISSET(clientfd, &commfdset)) {
-                            sockread = read(clientfd, &socketcommbuff[socketcommbuff_offset], BUFFER_SIZE);
-                            socketcommbuff[sockread] = 0;
+                            sockread = cmdring_read(&remotering, clientfd);
                             if (sockread == 0) {
+                                safestop_trigger(&safestop);
                                 logmsg(logfd, time_start, "Client disconnected. (7)");
-                                errormsg("Client disconnected! Press a key to quit!", 1);
+                                ui_errormsg(&ui, "Client disconnected! Press a key to quit!", 1);
                                 quit = 7;
                                 break;
                             }
-                            sprintf(logstring, "Read from socket %d:-%s-", sockread, socketcommbuff);
+                            sprintf(logstring, "Read from socket %d bytes (%d buffered)", sockread, cmdring_used(&remotering));
                             logmsg(logfd, time_start, logstring);
                             if (sockread == -1) {
                                 if (dummymode == 0) {
-                                    commandsend_lamp_on();
+                                    commandsend_lamp_on(&ui);
                                     logmsg(logfd, time_start, "Stoprobot");
                                     stoprobot(&rover, usekcommands, answer);
-                                    commandsend_lamp_off();
+                                    commandsend_lamp_off(&ui);
                                 }
                                 logmsg(logfd, time_start, "Socket read error! (4)");
-                                errormsg("Socket read error! Press a key to quit!", 1);
+                                ui_errormsg(&ui, "Socket read error! Press a key to quit!", 1);
                                 quit = 4;
                                 break;
                             }
                         }
 
-                    } else { // UDP
-
-                        unsigned int udprecvpacketno = 0;
-                        unsigned char udp_payload[32];
-                        int udp_sockread;
-                        sockread = 0;
-
-                        while (1) {
+                    } else if (FD_ISSET(listenfd, &commfdset)) { // UDP
+
+                        int udp_batchlen, udp_recvd = 0, udpi;
+
+                        // drain the socket in batches, only the latest setpoint per axis is kept
+                        do {
+                            // no source address, no control data: everything else of the headers is zero
+                            memset(udp_msgs, 0, sizeof(udp_msgs));
+                            for (udpi = 0; udpi < UDP_BATCH_SIZE; udpi++) {
+                                udp_iov[udpi].iov_base = udp_payload[udpi];
+                                udp_iov[udpi].iov_len  = UDP_PAYLOAD_MAXLEN;
+                                udp_msgs[udpi].msg_hdr.msg_iov     = &udp_iov[udpi];
+                                udp_msgs[udpi].msg_hdr.msg_iovlen  = 1;
+                                udp_msgs[udpi].msg_hdr.msg_name    = &udp_srcaddr[udpi];
+                                udp_msgs[udpi].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                                udp_msgs[udpi].msg_hdr.msg_control    = NULL;
+                                udp_msgs[udpi].msg_hdr.msg_controllen = 0;
+                            }
 
-                            FD_ZERO(&commfdset);
-                            FD_SET(listenfd, &commfdset);
-                            tv.tv_sec  = 0;
-                            tv.tv_usec = 0;
-                            ret = select(listenfd + 1, &commfdset, NULL, NULL, &tv);
-                            if (ret == -1) {
-                                endwin();
-                                perror("select()");
+                            udp_batchlen = recvmmsg(listenfd, udp_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+                            if (udp_batchlen == -1) {
+                                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                                    break;
+                                }
+                                ui_close(&ui);
+                                perror("recvmmsg()");
                                 quit = 1;
                                 break;
                             }
 
-                            if (sockread >= (BUFFER_SIZE - 32)) {
-                                sprintf(logstring, "UDP buffer full: %d/%d", sockread, BUFFER_SIZE - 32);
-                                logmsg(logfd, time_start, logstring);
-                                break;
-                            }
+                            gettimeofday(&timestruct, NULL);
+                            time_current = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+
+                            for (udpi = 0; udpi < udp_batchlen; udpi++) {
 
-                            if (FD_ISSET(listenfd, &commfdset)) {
-                                udp_sockread = recvfrom(listenfd, udp_payload, 32, 0, (struct sockaddr *)NULL, NULL);
+                                unsigned char *udp_packet = udp_payload[udpi];
+                                int udp_packetlen = udp_msgs[udpi].msg_len;
+                                unsigned int udp_packetno;
+                                struct udpclient *udpclient;
 
-                                udprecvpacketno++;
+                                udp_recvd++;
+                                udpclient = udpclient_lookup(udpclients, &udp_srcaddr[udpi], time_current);
 
-                                sprintf(logstring, "Read UDP packet %d. (%d):%x %x %x %x %x %x %x %x %x %x %x %x", udprecvpacketno, udp_sockread,
-                                  udp_payload[0], udp_payload[1], udp_payload[2], udp_payload[3], udp_payload[4], udp_payload[5], udp_payload[6], udp_payload[7], udp_payload[8], udp_payload[9], udp_payload[10], udp_payload[11] );
-                                logmsg(logfd, time_start, logstring);
+                                if (remotebin_is_setpoint(udp_packet, udp_packetlen)) {
 
-                                if (udp_sockread == 12) {
+                                    struct remote_setpoint setpoint;
 
-                                    unsigned int udp_packetno = (udp_payload[0] << 8) + udp_payload[1];
+                                    ret = remotebin_decode_setpoint(udp_packet, udp_packetlen, &setpoint);
+                                    if (ret != REMOTEBIN_OK) {
+                                        if (ret == REMOTEBIN_BADCRC) {
+                                            udpclient->stats.crcerrors++;
+                                        } else {
+                                            udpclient->stats.badformat++;
+                                        }
+                                        sprintf(logstring, "Dropped binary UDP packet (%s)", (ret == REMOTEBIN_BADCRC) ? "checksum error" : "invalid value");
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
 
-                                    if ( (udp_packetno > udp_lastpacketno) ||
-                                       ( (udp_lastpacketno > 0xFF00) && (udp_packetno < 0x00FF) ) ) {  // allow a little tolerance for possible packet loss
+                                    ret = udpclient_accept_packetno(udpclient, setpoint.packetno);
+                                    if (ret < 0) {
+                                        sprintf(logstring, "Dropped old/duplicate UDP packet: %d vs. %d", setpoint.packetno, udpclient->window.highest);
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
+                                    // a late setpoint is already superseded by a newer one (but a late stop is still a stop)
+                                    if ((ret == REPLAY_REORDERED) && ((setpoint.flags & REMOTEBIN_FLAG_STOP) == 0)) {
+                                        continue;
+                                    }
+
+                                    remote_mailbox_post_setpoint(&mailbox, &setpoint);
 
-                                        unsigned int recvcksum = (udp_payload[10] << 8) + udp_payload[11];
-                                        unsigned int calccksum = crc16_ccitt(udp_payload, 10);
+                                } else if (remotebin_is_trajectory(udp_packet, udp_packetlen)) {
 
-                                        if (recvcksum != calccksum) {
-                                            sprintf(logstring, "Checksum error! Dropped UDP packet %d:%s:recv/calccrc:%x/%x", udp_packetno, &udp_payload[2], recvcksum, calccksum);
-                                            logmsg(logfd, time_start, logstring);
-                                            continue;
+                                    struct remote_trajectory udptrj;
+
+                                    ret = remotebin_decode_trajectory(udp_packet, udp_packetlen, &udptrj);
+                                    if (ret != REMOTEBIN_OK) {
+                                        if (ret == REMOTEBIN_BADCRC) {
+                                            udpclient->stats.crcerrors++;
+                                        } else {
+                                            udpclient->stats.badformat++;
                                         }
+                                        sprintf(logstring, "Dropped UDP trajectory (%s)", (ret == REMOTEBIN_BADCRC) ? "checksum error" : "invalid value");
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
+
+                                    // a late trajectory is superseded by the newer commands
+                                    if (udpclient_accept_packetno(udpclient, udptrj.packetno) != REPLAY_NEW) {
+                                        sprintf(logstring, "Dropped old/duplicate UDP trajectory: %d vs. %d", udptrj.packetno, udpclient->window.highest);
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
+
+                                    remote_mailbox_post_trajectory(&mailbox, &udptrj);
+                                    trjsender_next = udp_srcaddr[udpi];
+                                    trjsender_next_local = 0;
 
-                                        udp_payload[10] = 0;
-                                        sprintf(logstring, "Command in UDP packet:-%s-", &udp_payload[2]);
+                                } else if (udp_packetlen == 12) {
+
+                                    struct remotecmd rcmd;
+                                    unsigned int recvcksum, calccksum;
+
+                                    udp_packetno = (udp_packet[0] << 8) + udp_packet[1];
+
+                                    recvcksum = (udp_packet[10] << 8) + udp_packet[11];
+                                    calccksum = crc16_ccitt(udp_packet, 10);
+                                    if (recvcksum != calccksum) {
+                                        udpclient->stats.crcerrors++;
+                                        sprintf(logstring, "Checksum error! Dropped UDP packet %d:%.8s:recv/calccrc:%x/%x", udp_packetno, &udp_packet[2], recvcksum, calccksum);
                                         logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
+
+                                    ret = udpclient_accept_packetno(udpclient, udp_packetno);
+                                    if (ret < 0) {
+                                        sprintf(logstring, "Dropped old/duplicate UDP packet: %d vs. %d", udp_packetno, udpclient->window.highest);
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
+
+                                    // any packet of the sender of the running trajectory renews its lease
+                                    if ((trjsender_local == 0) && (udp_srcaddr[udpi].sin_addr.s_addr == trjsender.sin_addr.s_addr) &&
+                                        (udp_srcaddr[udpi].sin_port == trjsender.sin_port)) {
+                                        time_trjlease = time_current;
+                                    }
 
-                                        strncpy(&socketcommbuff[sockread], &udp_payload[2], 8);
-                                        sockread += 9;
-                                        socketcommbuff[sockread-1] = '\n';
-                                        socketcommbuff[sockread] = 0;
+                                    if (remotecmd_decode(&udp_packet[2], REMOTECMD_LEN, &rcmd) != REMOTECMD_OK) {
+                                        udpclient->stats.badformat++;
+                                        sprintf(logstring, "Bad command in UDP packet:-%.8s-", &udp_packet[2]);
+                                        logmsg(logfd, time_start, logstring);
+                                        continue;
+                                    }
 
-                                        //sprintf(logstring, "Full socketcommbuff(%d):-%s-", sockread, socketcommbuff);
-                                        //logmsg(logfd, time_start, logstring);
+                                    // as the binary setpoints: a late SPX/SPY/ROT is superseded by a newer one (but STOPZERO is still a stop)
+                                    if ((ret == REPLAY_REORDERED) && (rcmd.def->action == REMOTECMD_SETPOINT)) {
+                                        continue;
+                                    }
 
-                                        udp_lastpacketno = udp_packetno;
+                                    if (rcmd.def->action == REMOTECMD_RESETALL) {
+                                        udpclient_reset_window(udpclient);
+                                        logmsg(logfd, time_start, "UDP packet number window of the client was reset");
+                                    }
 
-                                    } else {
-                                        sprintf(logstring, "Dropped old UDP packet: %d vs. %d", udp_packetno, udp_lastpacketno);
+                                    // telemetry is sent back to the address of the sender, it does not touch the setpoints
+                                    if (rcmd.def->action == REMOTECMD_TLMPERIOD) {
+                                        ret = telemetry_subscribe(&telemetry, TELEMETRY_PROTO_UDP, NULL, listenfd, &udp_srcaddr[udpi], rcmd.value, time_current);
+                                        sprintf(logstring, "Telemetry period of %s:%d: %d ms%s", inet_ntoa(udp_srcaddr[udpi].sin_addr), ntohs(udp_srcaddr[udpi].sin_port), rcmd.value, (ret == -1) ? " - no free slot!" : "");
                                         logmsg(logfd, time_start, logstring);
                                         continue;
                                     }
+                                    if (rcmd.def->action == REMOTECMD_TLMFIELDS) {
+                                        telemetry_set_fields(&telemetry, TELEMETRY_PROTO_UDP, NULL, listenfd, &udp_srcaddr[udpi], rcmd.value, time_current);
+                                        continue;
+                                    }
+                                    if (rcmd.def->action == REMOTECMD_FRAMING) {
+                                        logmsg(logfd, time_start, "Framed mode is only available over TCP");
+                                        continue;
+                                    }
+                                    if (rcmd.def->action == REMOTECMD_KEEPALIVE) {
+                                        continue;
+                                    }
+
+                                    remote_mailbox_post_command(&mailbox, &rcmd);
 
                                 } else {
-                                    logmsg(logfd, time_start, "UDP payload is not 12 bytes!");
+                                    udpclient->stats.badformat++;
+                                    logmsg(logfd, time_start, "UDP payload is not 12 bytes (or a binary setpoint/trajectory)!");
                                 }
 
-                            } else {  // nothing can be read (select)
-                                break;  // while(1)
                             }
 
-                        }  // while(1)
+                        } while (udp_batchlen == UDP_BATCH_SIZE);
 
                         if (quit == 1) {
                             break;
                         }
 
+                        sprintf(logstring, "Read %d UDP packets, stop:%d X:%d/%d Y:%d/%d rot:%d/%d", udp_recvd, mailbox.stop,
+                          mailbox.pending[REMOTECMD_AXIS_X], mailbox.value[REMOTECMD_AXIS_X],
+                          mailbox.pending[REMOTECMD_AXIS_Y], mailbox.value[REMOTECMD_AXIS_Y],
+                          mailbox.pending[REMOTECMD_AXIS_ROT], mailbox.value[REMOTECMD_AXIS_ROT]);
+                        logmsg(logfd, time_start, logstring);
+
                     }  // UDP
 
-                }  // remotecontrol true + sockbuff is empty
+                }  // remotecontrol true
 
-            } else {
-                sockread = 0;
             }
 
         }
 
-        while (sockread > 0) {
-            unsigned char replymsg[16];
-            unsigned int wret;
+        if (localcontrol == 1) {
+            ret = localctl_process(&localctl, &commfdset, &mailbox);
+            if (localctl.trajectory_posted == 1) {
+                trjsender_next_local = 1;
+                localctl.trajectory_posted = 0;
+            }
+            if (localctl.trajectory_alive == 1) {
+                if (trjsender_local == 1) {
+                    gettimeofday(&timestruct, NULL);
+                    time_trjlease = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+                }
+                localctl.trajectory_alive = 0;
+            }
+            if (ret > 0) {
+                sprintf(logstring, "Read %d local setpoints, stop:%d X:%d/%d Y:%d/%d rot:%d/%d", ret, mailbox.stop,
+                  mailbox.pending[REMOTECMD_AXIS_X], mailbox.value[REMOTECMD_AXIS_X],
+                  mailbox.pending[REMOTECMD_AXIS_Y], mailbox.value[REMOTECMD_AXIS_Y],
+                  mailbox.pending[REMOTECMD_AXIS_ROT], mailbox.value[REMOTECMD_AXIS_ROT]);
+                logmsg(logfd, time_start, logstring);
+            }
+        }
 
-                unsigned int sockcommi, copyi, commlen, difflen;
+        // the latest setpoints of this iteration (UDP, local control)
+        if (mailbox.received == 1) {
 
-                for (sockcommi = 0; ((socketcommbuff[sockcommi] != '\n') && (socketcommbuff[sockcommi] != '\r') && (sockcommi < BUFFER_SIZE) && (sockcommi < sockread)); sockcommi++) {}
+            int axis;
 
-                if (sockcommi == BUFFER_SIZE) {
-                    if (dummymode == 0) {
-                        commandsend_lamp_on();
-                        logmsg(logfd, time_start, "Stoprobot");
-                        stoprobot(&rover, usekcommands, answer);
-                        commandsend_lamp_on();
-                    }
-                    logmsg(logfd, time_start, "Bad message through socket - Too long (no newline found) (5)!");
-                    errormsg("Bad message through socket - Too long (no newline found)! Press a key to quit!", 1);
-                    quit = 5;
-                    break;
-                }
+            if ((trajectories == 1) && (trajectory_active(&trajectory) == 1)) {
+                trajectory_abort(&trajectory);
+                sprintf(logstring, "Trajectory %u aborted by a new command", trajectory.trj.packetno);
+                logmsg(logfd, time_start, logstring);
+            }
 
-                // first char was a newline
-                if (sockcommi == 1) {
-                    for (sockcommi = 0; sockcommi < (sockread-1); sockcommi++) {
-                        socketcommbuff[sockcommi] = socketcommbuff[sockcommi+1];
-                    }
+            if (mailbox.stop == 1) {
+                if (dummymode == 0) {
+                    commandsend_lamp_on(&ui);
+                    logmsg(logfd, time_start, "Stoprobot");
+                    stoprobot(&rover, usekcommands, answer);
+                    commandsend_lamp_off(&ui);
+                }
+                for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+                    *remote_axis_value[axis] = 0;
+                    *remote_axis_new[axis] = 0;
                 }
-                commlen = sockcommi;
+            }
 
-                // if not just an empty line (only /r/n) - commlen/sockcommi == 0
-                if ((commlen > 0) && (socketcommbuff[sockcommi-1] == '\r')) {
-                    commlen--;
+            for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+                if (mailbox.pending[axis] == 1) {
+                    *remote_axis_value[axis] = mailbox.value[axis];
+                    *remote_axis_new[axis] = 1;
                 }
-                strncpy(receivedcommand, socketcommbuff, commlen);
-                receivedcommand[commlen] = 0;
-                difflen = sockread - sockcommi - 1;
-                if (difflen != 0) {
-                    for (copyi = 0; copyi < difflen; copyi++) {
-                        socketcommbuff[copyi] = socketcommbuff[copyi+sockcommi+1];
-                    }
-                    socketcommbuff[copyi] = 0;
+            }
+
+            // from now on the setpoints are computed on the timer of the trajectory
+            if ((mailbox.trajectory == 1) && (trajectories == 1)) {
+                for (axis = 0; axis < REMOTECMD_AXES; axis++) {
+                    trjspeed[axis] = *remote_axis_value[axis];
                 }
-                sockread -= sockcommi + 1;
-                socketcommbuff[sockread] = 0;
+                ret = trajectory_start(&trajectory, &mailbox.trj, trjspeed, (odometry == 1) ? &odom.state : NULL);
+                trjsender = trjsender_next;
+                trjsender_local = trjsender_next_local;
+                gettimeofday(&timestruct, NULL);
+                time_trjstart = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+                time_trjlease = time_trjstart;
+                sprintf(logstring, "Trajectory %u: %d segments, flags: 0x%02X%s", mailbox.trj.packetno, mailbox.trj.segments, mailbox.trj.flags,
+                        (ret == -1) ? " - rejected (needs odometry, or Y speed on a robot without it)" : "");
+                logmsg(logfd, time_start, logstring);
+            } else if (mailbox.trajectory == 1) {
+                logmsg(logfd, time_start, "Trajectory dropped, the trajectory follower is disabled");
+            }
 
-                if (commlen == 0) { continue; }
+            // a deadline can only shorten the validity of a remote command
+            remotecmd_validity = cfg.remotecmd_validity;
+            if ((mailbox.deadline_ms > 0) && ((mailbox.deadline_ms / 1000.0) < remotecmd_validity)) {
+                remotecmd_validity = mailbox.deadline_ms / 1000.0;
+            }
+            gettimeofday(&timestruct, NULL);
+            time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+            safestop_feed(&safestop, remotecmd_validity);
+        }
 
-                if (commlen != 8) {
-                    logmsg(logfd, time_start, "Bad command length (!=8)");
+        while (remotecontrol == 1) {
+            unsigned char *receivedcommand;
+            int commlen, decoderet;
+            int reqid = REMOTEFRAME_NOID;
+            int axis, wret = 0;
+            struct remotecmd rcmd;
+            const char *reply = NULL;
 
-                    if (remotecontrolproto == 0) {  // TCP
-                        logmsg(logfd, time_start, "Sent: !BADCMD!");
-                        strncpy(replymsg, "!BADCMD!\r\n", 10);
-                        wret = write(clientfd, replymsg, 10);
-                        if (wret == -1) {
-                            if (dummymode == 0) {
-                                commandsend_lamp_on();
-                                logmsg(logfd, time_start, "Stoprobot");
-                                stoprobot(&rover, usekcommands, answer);
-                                commandsend_lamp_off();
-                            }
-                            logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                            errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                            quit = 6;
-                            break;
-                        }
-                    }
+            commlen = cmdring_next_line(&remotering, &receivedcommand);
 
-                    continue;
-                }
+            if (commlen == CMDRING_NOLINE) { break; }
 
+            if (commlen == 0) { continue; }
 
-            {
-                    int badcommand = 1;
-                    int cmd_stopzero = 0;
-                    int cmd_resetall = 0;
+            if (commlen == CMDRING_OVERLONG) {
+                // too long to be a command, the rest of it is dropped until the next newline
+                logmsg(logfd, time_start, "Bad message through socket - Too long (no newline found)!");
+                decoderet = REMOTECMD_UNKNOWN;
+            } else {
+                logmsg(logfd, time_start, "Processing command: ");
+                logmsg(logfd, time_start, receivedcommand);
+                if (remoteframed == 1) {
+                    commlen = remoteframe_parse(receivedcommand, commlen, &reqid, &receivedcommand);
+                }
+                if (commlen == -1) {
+                    logmsg(logfd, time_start, "Bad frame (expected: #<id> <command>)");
+                    decoderet = REMOTECMD_UNKNOWN;
+                } else {
+                    decoderet = remotecmd_decode(receivedcommand, commlen, &rcmd);
+                }
+            }
 
-                    logmsg(logfd, time_start, "Processing command: ");
-                    logmsg(logfd, time_start, receivedcommand);
+            switch (decoderet) {
 
-                    if (strncmp(receivedcommand, "STOPZERO", 8) == 0) {
-                        cmd_stopzero = 1;
-                    } else if (strncmp(receivedcommand, "RESETALL", 8) == 0) {
-                        cmd_resetall = 1;
+                case REMOTECMD_UNKNOWN:
+                    if (commlen != REMOTECMD_LEN) {
+                        logmsg(logfd, time_start, "Bad command length (!=8)");
                     }
+                    reply = "!BADCMD!\r\n";
+                    break;
 
-                    if ((cmd_stopzero == 1) || (cmd_resetall == 1)) {
-                        if (dummymode == 0) {
-                            commandsend_lamp_on();
-                            logmsg(logfd, time_start, "Stoprobot");
-                            stoprobot(&rover, usekcommands, answer);
-                            commandsend_lamp_off();
-                        }
-                        rotate = 0;
-                        speedX = 0;
-                        speedY = 0;
-                        badcommand = 0;
-                        if (cmd_resetall == 1) {
-                            udp_lastpacketno = 0;
-                            logmsg(logfd, time_start, "UDP lastpacketno reset to 0");
-                        }
-                        gettimeofday(&timestruct, NULL);
-                        time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
-                        if (remotecontrolproto == 0) {
-                            if (cmd_stopzero == 1) {
-                                strncpy(replymsg, "OKZERO\r\n", 8);
-                                wret = write(clientfd, replymsg, 8);
-                                logmsg(logfd, time_start, "Sent: OKZERO");
-                            } else if (cmd_resetall == 1) {
-                                strncpy(replymsg, "OKRESET\r\n", 9);
-                                wret = write(clientfd, replymsg, 9);
-                                logmsg(logfd, time_start, "Sent: OKRESET");
-                            }
-                            if (wret == -1) {
-                                if (dummymode == 0) {
-                                    commandsend_lamp_on();
-                                    logmsg(logfd, time_start, "Stoprobot");
-                                    stoprobot(&rover, usekcommands, answer);
-                                    commandsend_lamp_off();
-                                }
-                                logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                                errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                                quit = 6;
-                                break;
-                            }
-                        }
+                case REMOTECMD_BADARG:
+                    // unframed: there is only one reply per axis, so the bad value cancels the OK of the previous one
+                    if ((rcmd.def->action == REMOTECMD_SETPOINT) && (remoteframed == 0)) {
+                        *remote_axis_new[rcmd.def->axis] = 0;
                     }
+                    reply = rcmd.def->reply_bad;
+                    break;
 
-                    if (strncmp(receivedcommand, "ROT", 3) == 0) {
-                        int newrot = 0, newrotret;
-                        badcommand = 0;
-                        newrotret = sscanf(&receivedcommand[3], "%d", &newrot);
-                        set_new_rot_value_from_remote = 0;
-                        if ((newrotret != 1) || (newrot < -10000) || (newrot > 10000)) {
-                            if (remotecontrolproto == 0) {
-                                strncpy(replymsg, "!BADROT!\r\n", 10);
-                                wret = write(clientfd, replymsg, 10);
-                                logmsg(logfd, time_start, "Sent: !BADROT!");
-                                if (wret == -1) {
-                                    if (dummymode == 0) {
-                                        commandsend_lamp_on();
-                                        logmsg(logfd, time_start, "Stoprobot");
-                                        stoprobot(&rover, usekcommands, answer);
-                                        commandsend_lamp_off();
-                                    }
-                                    logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                                    errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                                    quit = 6;
-                                    break;
-                                }
+                case REMOTECMD_OK:
+                    switch (rcmd.def->action) {
+                        case REMOTECMD_STOPZERO:
+                        case REMOTECMD_RESETALL:
+                            if (dummymode == 0) {
+                                commandsend_lamp_on(&ui);
+                                logmsg(logfd, time_start, "Stoprobot");
+                                stoprobot(&rover, usekcommands, answer);
+                                commandsend_lamp_off(&ui);
                             }
-                        } else {
-                            rotate = newrot;
-                            set_new_rot_value_from_remote = 1;
-                            logmsg(logfd, time_start, "Will set newrot");
-                            gettimeofday(&timestruct, NULL);
-                            time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
-                        }
-                    }
+                            rotate = 0;
+                            speedX = 0;
+                            speedY = 0;
+                            // the setpoints still waiting for the serial write would start the robot again, their requests fail
+                            for (axis = 0; (axis < REMOTECMD_AXES) && (wret != -1); axis++) {
+                                *remote_axis_new[axis] = 0;
+                                wret = send_axis_acks(&remoteout, &remote_axis_acks[axis], remote_axis_reply_err[axis], logfd, time_start);
+                            }
+                            break;
 
-                    if (strncmp(receivedcommand, "SPX", 3) == 0) {
-                        int newspx = 0, newspxret;
-                        badcommand = 0;
-                        newspxret = sscanf(&receivedcommand[3], "%d", &newspx);
-                        set_new_spx_value_from_remote = 0;
-                        if ((newspxret != 1) || (newspx < -10000) || (newspx > 10000)) {
-                            if (remotecontrolproto == 0) {
-                                strncpy(replymsg, "!BADSPX!\r\n", 10);
-                                wret = write(clientfd, replymsg, 10);
-                                logmsg(logfd, time_start, "Sent: !BADSPX!");
-                                if (wret == -1) {
-                                    if (dummymode == 0) {
-                                        commandsend_lamp_on();
-                                        logmsg(logfd, time_start, "Stoprobot");
-                                        stoprobot(&rover, usekcommands, answer);
-                                        commandsend_lamp_off();
-                                    }
-                                    logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                                    errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                                    quit = 6;
+                        case REMOTECMD_SETPOINT:
+                            // framed: acknowledged after the serial write (kkk commands are sent periodically, so those right away)
+                            if ((reqid != REMOTEFRAME_NOID) && (usekcommands == 0)) {
+                                if (remote_acks_add(&remote_axis_acks[rcmd.def->axis], reqid) == -1) {
+                                    reply = "!BUSY!\r\n";
                                     break;
                                 }
+                            } else if (reqid != REMOTEFRAME_NOID) {
+                                reply = remote_axis_reply_ok[rcmd.def->axis];
                             }
-                        } else {
-                            speedX = newspx;
-                            set_new_spx_value_from_remote = 1;
-                            logmsg(logfd, time_start, "Will set newspx");
-                            gettimeofday(&timestruct, NULL);
-                            time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
-                        }
-                    }
+                            *remote_axis_value[rcmd.def->axis] = rcmd.value;
+                            *remote_axis_new[rcmd.def->axis] = 1;
+                            sprintf(logstring, "Will set %s: %d", rcmd.def->name, rcmd.value);
+                            logmsg(logfd, time_start, logstring);
+                            break;
 
-                    if (strncmp(receivedcommand, "SPY", 3) == 0) {
-                        int newspy=0, newspyret;
-
-                        badcommand = 0;
-                        newspyret = sscanf(&receivedcommand[3], "%d", &newspy);
-                        set_new_spy_value_from_remote = 0;
-                        if ((newspyret != 1) || (newspy < -10000) || (newspy > 10000)) {
-                            if (remotecontrolproto == 0) {
-                                strncpy(replymsg, "!BADSPY!\r\n", 10);
-                                wret = write(clientfd, replymsg, 10);
-                                logmsg(logfd, time_start, "Sent: !BADSPY!");
-                                if (wret == -1) {
-                                    if (dummymode == 0) {
-                                        commandsend_lamp_on();
-                                        logmsg(logfd, time_start, "Stoprobot");
-                                        stoprobot(&rover, usekcommands, answer);
-                                        commandsend_lamp_off();
-                                    }
-                                    logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                                    errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                                    quit = 6;
-                                    break;
-                                }
+                        case REMOTECMD_TLMPERIOD:
+                            if (telemetry_subscribe(&telemetry, TELEMETRY_PROTO_TCP, &remoteout, -1, NULL, rcmd.value, time_current) == -1) {
+                                reply = "!TLMFULL!\r\n";
                             }
-                        } else {
-                            speedY = newspy;
-                            set_new_spy_value_from_remote = 1;
-                            logmsg(logfd, time_start, "Will set newspy");
-                            gettimeofday(&timestruct, NULL);
-                            time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
-                        }
-                    }
+                            break;
 
+                        case REMOTECMD_TLMFIELDS:
+                            if (telemetry_set_fields(&telemetry, TELEMETRY_PROTO_TCP, &remoteout, -1, NULL, rcmd.value, time_current) == -1) {
+                                reply = "!TLMFULL!\r\n";
+                            }
+                            break;
 
-                if ((badcommand == 1) && (remotecontrolproto == 0)) {
-                    strncpy(replymsg, "!BADCMD!\r\n", 10);
-                    wret = write(clientfd, replymsg, 10);
-                    logmsg(logfd, time_start, "Sent: !BADCMD!");
-                    if (wret == -1) {
-                        if (dummymode == 0) {
-                            commandsend_lamp_on();
-                            logmsg(logfd, time_start, "Stoprobot");
-                            stoprobot(&rover, usekcommands, answer);
-                            commandsend_lamp_off();
-                        }
-                        logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                        errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                        quit = 6;
+                        case REMOTECMD_FRAMING:
+                            remoteframed = rcmd.value;
+                            sprintf(logstring, "Framed mode: %s", (remoteframed == 1) ? "on" : "off");
+                            logmsg(logfd, time_start, logstring);
+                            break;
+                    }
+                    if (reply == NULL) {
+                        reply = rcmd.def->reply_ok;
+                    }
+                    // telemetry subscriptions are not motion commands, they do not keep the robot moving
+                    if ((rcmd.def->action == REMOTECMD_TLMPERIOD) || (rcmd.def->action == REMOTECMD_TLMFIELDS) ||
+                        (rcmd.def->action == REMOTECMD_FRAMING) || (rcmd.def->action == REMOTECMD_KEEPALIVE)) {
                         break;
                     }
-                }
-
+                    if ((trajectories == 1) && (trajectory_active(&trajectory) == 1)) {
+                        trajectory_abort(&trajectory);
+                        sprintf(logstring, "Trajectory %u aborted by a new command", trajectory.trj.packetno);
+                        logmsg(logfd, time_start, logstring);
+                    }
+                    remotecmd_validity = cfg.remotecmd_validity;
+                    gettimeofday(&timestruct, NULL);
+                    time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+                    safestop_feed(&safestop, remotecmd_validity);
+                    break;
             }
 
-        }  //  while (sockread > 0)
+            if ((wret != -1) && (reply != NULL) && (remotecontrolproto == 0)) { // TCP
+                wret = send_reply(&remoteout, reqid, reply, logfd, time_start);
+            }
+            if (wret == -1) {
+                if (dummymode == 0) {
+                    commandsend_lamp_on(&ui);
+                    logmsg(logfd, time_start, "Stoprobot");
+                    stoprobot(&rover, usekcommands, answer);
+                    commandsend_lamp_off(&ui);
+                }
+                logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
+                ui_errormsg(&ui, "Cannot send reply to client! Connection lost? Press a key to quit!", 1);
+                quit = 6;
+                break;
+            }
 
+        }  //  while (remotecontrol == 1)
+
+        // next step of the trajectory: the fresh odometry closes the loop, the new setpoints keep the watchdog fed
+        if ((trajectories == 1) && (trajectory_active(&trajectory) == 1) && FD_ISSET(trajectory.timerfd, &commfdset)) {
+            trjticks = trajectory_timer_read(&trajectory);
+            // one message must not keep the robot moving: the sender has to renew the lease, and there is an upper limit
+            gettimeofday(&timestruct, NULL);
+            time_current = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+            if ((trjticks > 0) && (((time_current - time_trjlease) * 1000.0 > cfg.trajectory_lease_ms) ||
+                                   ((time_current - time_trjstart) > cfg.trajectory_max_sec))) {
+                trajectory_abort(&trajectory);
+                if ((time_current - time_trjstart) > cfg.trajectory_max_sec) {
+                    sprintf(logstring, "Trajectory %u aborted: running for more than %u s", trajectory.trj.packetno, cfg.trajectory_max_sec);
+                } else {
+                    sprintf(logstring, "Trajectory %u aborted: nothing from its sender for %u ms", trajectory.trj.packetno, cfg.trajectory_lease_ms);
+                }
+                logmsg(logfd, time_start, logstring);
+                speedX = 0;
+                speedY = 0;
+                rotate = 0;
+                if (dummymode == 0) {
+                    commandsend_lamp_on(&ui);
+                    logmsg(logfd, time_start, "Stoprobot");
+                    stoprobot(&rover, usekcommands, answer);
+                    commandsend_lamp_off(&ui);
+                }
+            } else if (trjticks > 0) {
+                if (odometry == 1) {
+                    time_last_odomsample = rt_now();
+                    if (odometry_sample(&odom, &rover) == 0) {
+                        time_last_clocksync = time_last_odomsample;
+                        clocksync_add(&clocksync, odom.uptime_read_start, odom.uptime_read_end, odom.state.uptime_ms);
+                    }
+                }
+                ret = trajectory_step(&trajectory, trjticks, (odometry == 1) ? &odom.state : NULL, trjspeed);
+                speedX = trjspeed[REMOTECMD_AXIS_X];
+                speedY = trjspeed[REMOTECMD_AXIS_Y];
+                rotate = trjspeed[REMOTECMD_AXIS_ROT];
+                time_last_kcmdsent = 0;     // kkk commands: right away, not only every repeat_time_kcmdsent
+                remotecmd_validity = cfg.remotecmd_validity;
+                gettimeofday(&timestruct, NULL);
+                time_last_remotecmd_recv = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
+                safestop_feed(&safestop, remotecmd_validity);
+                if (ret != TRAJ_RUNNING) {
+                    sprintf(logstring, "Trajectory %u %s, %lu ticks, %lu missed, max. tracking error: %.1f mm", trajectory.trj.packetno,
+                            trajectory_state_name(ret), trajectory.ticks, trajectory.overruns, trajectory.max_error * 1000.0);
+                    logmsg(logfd, time_start, logstring);
+                }
+                if ((ret == TRAJ_TIMEOUT) && (dummymode == 0)) {
+                    commandsend_lamp_on(&ui);
+                    logmsg(logfd, time_start, "Stoprobot");
+                    stoprobot(&rover, usekcommands, answer);
+                    commandsend_lamp_off(&ui);
+                }
+            }
+        }
 
         if (c != -1) {
+            if ((trajectories == 1) && (trajectory_active(&trajectory) == 1)) {
+                trajectory_abort(&trajectory);
+                logmsg(logfd, time_start, "Trajectory aborted by a keypress");
+            }
             // stop
             if ((c == 32) || (c == 53) || (c == 48) || (c == 120) || (c == 10) || (c == 13) || (c == 46) || (c == 126)) {
                 speedX = 0;
                 speedY = 0;
                 rotate = 0;
                 if (dummymode == 0) {
-                    commandsend_lamp_on();
+                    commandsend_lamp_on(&ui);
                     logmsg(logfd, time_start, "Stoprobot");
                     stoprobot(&rover, usekcommands, answer);
-                    commandsend_lamp_off();
+                    commandsend_lamp_off(&ui);
                 }
             }
 
-            if (c == 27) {
-                timeout(0);
-                c2 = getch();
-                if (c2 == -1) {
-                    quit = 1;
-                    break;
-                }
-                if (c2 == 91) {
-                    c3 = getch();
-                    switch (c3) {
-                        case 49:
-                            c4 = getch();
-                            c5 = getch();
-                            c6 = getch();
-                            if ((c4 == 59) && (c5 == 50)) {
-                                switch(c6) {
-                                    case 65: c = 87; break;
-                                    case 66: c = 83; break;
-                                    case 67: c = 68; break;
-                                    case 68: c = 65; break;
-                                    case 72: c = 81; break;
-                                }
-                            }
-                            break;
-
-                        case 53:
-                            c4 = getch();
-                            if (c4 == 59) {
-                                c5 = getch();
-                                c6 = getch();
-                                if ((c5 == 50) && (c6 == 126)) { c = 69; }
-                            } else {
-                                if (c4 == 126) { c = 101; }
-                            }
-                            break;
-
-                        case 65: c = 119; break;
-                        case 66: c = 115; break;
-                        case 67: c = 100; break;
-                        case 68: c =  97; break;
-                        case 69: c =  32; break;
-                        case 72: c = 113; break;
-                    }
-                }
-
-                timeout(500);
+            if (c == UI_KEY_QUIT) {
+                quit = 1;
+                break;
             }
 
             switch (c) {
@@ -1248,93 +1527,54 @@ int main() {
         if (rotate >  LIMIT_SPEED_ROT) { rotate =  LIMIT_SPEED_ROT; }
         if (rotate < -LIMIT_SPEED_ROT) { rotate = -LIMIT_SPEED_ROT; }
 
-        attron(COLOR_PAIR(1));
-        mvprintw(commanddrawy + 1, commanddrawx + 10, "% 5d", speedX);
-        if (rover.config->has_Y_speed == 1) {
-            mvprintw(commanddrawy + 2, commanddrawx + 10, "% 5d", speedY);
-        }
-        mvprintw(commanddrawy + 3, commanddrawx + 10, "% 5d", rotate);
-        attroff(COLOR_PAIR(1));
-        if (speedX > 0) {
-            attron(COLOR_PAIR(6) | A_BOLD);
-            mvprintw(commanddrawy + 1, commanddrawx + 23, "↑");
-            mvprintw(roverdrawy - 2, roverdrawx + 6, "↑↑↑");
-            attroff(COLOR_PAIR(6) | A_BOLD);
-            mvprintw(roverdrawy + 4, roverdrawx + 6, "   ");
-        } else {
-            if (speedX < 0) {
-                attron(COLOR_PAIR(6) | A_BOLD);
-                mvprintw(commanddrawy + 1, commanddrawx + 23, "↓");
-                mvprintw(roverdrawy + 4, roverdrawx + 6, "↓↓↓");
-                attroff(COLOR_PAIR(6) | A_BOLD);
-                mvprintw(roverdrawy - 2, roverdrawx + 6, "   ");
-            } else {
-                mvprintw(commanddrawy + 1, commanddrawx + 23, " ");
-                mvprintw(roverdrawy - 2, roverdrawx + 6, "   ");
-                mvprintw(roverdrawy + 4, roverdrawx + 6, "   ");
-            }
-        }
-
-        if (rover.config->has_Y_speed == 1) {
-            if (speedY < 0) {
-                attron(COLOR_PAIR(6) | A_BOLD);
-                mvprintw(commanddrawy + 2, commanddrawx + 23, "→");
-                mvprintw(roverdrawy + 1, roverdrawx + 12, "→→→");
-                attroff(COLOR_PAIR(6) | A_BOLD);
-                mvprintw(roverdrawy + 1, roverdrawx, "   ");
-            } else {
-                if (speedY > 0) {
-                    attron(COLOR_PAIR(6) | A_BOLD);
-                    mvprintw(commanddrawy + 2, commanddrawx + 23, "←");
-                    mvprintw(roverdrawy + 1, roverdrawx, "←←←");
-                    attroff(COLOR_PAIR(6) | A_BOLD);
-                    mvprintw(roverdrawy + 1, roverdrawx + 12, "   ");
-                } else {
-                    mvprintw(commanddrawy + 2, commanddrawx + 23, " ");
-                    mvprintw(roverdrawy + 1, roverdrawx, "   ");
-                    mvprintw(roverdrawy + 1, roverdrawx + 12, "   ");
+        // the UI thread renders it at its own pace (nothing to do in headless mode)
+        if (ui.headless == 0) {
+            uisnapshot.speedX = speedX;
+            uisnapshot.speedY = speedY;
+            uisnapshot.rotate = rotate;
+            memcpy(&uisnapshot.rover, &rover, sizeof(struct roverstruct));
+            uisnapshot.udpstats_valid = 0;
+            // statistics of the most recently seen UDP client
+            if ((remotecontrol == 1) && (remotecontrolproto == 1)) {
+                struct udpclient *lastudpclient = NULL;
+                int udpi;
+
+                for (udpi = 0; udpi < UDPCLIENT_MAX; udpi++) {
+                    if ((udpclients[udpi].used == 1) && ((lastudpclient == NULL) || (udpclients[udpi].time_last_recv > lastudpclient->time_last_recv))) {
+                        lastudpclient = &udpclients[udpi];
+                    }
+                }
+                if (lastudpclient != NULL) {
+                    memcpy(&uisnapshot.udpstats, &lastudpclient->stats, sizeof(struct udpclient_stats));
+                    uisnapshot.udpstats_valid = 1;
                 }
             }
-        }
-
-        if (rotate < 0) {
-            attron(COLOR_PAIR(6) | A_BOLD);
-            mvprintw(commanddrawy + 3, commanddrawx + 23, "↻");
-            attroff(COLOR_PAIR(6) | A_BOLD);
-            attron(COLOR_PAIR(8) | A_BOLD);
-            mvprintw(roverdrawy + 1, roverdrawx + 7, "↻");
-            attroff(COLOR_PAIR(8) | A_BOLD);
-        } else {
-            if (rotate > 0) {
-                attron(COLOR_PAIR(6) | A_BOLD);
-                mvprintw(commanddrawy + 3, commanddrawx + 23, "↺");
-                attroff(COLOR_PAIR(6) | A_BOLD);
-                attron(COLOR_PAIR(8) | A_BOLD);
-                mvprintw(roverdrawy + 1, roverdrawx + 7, "↺");
-                attroff(COLOR_PAIR(8) | A_BOLD);
-            } else {
-                mvprintw(commanddrawy + 3, commanddrawx + 23, " ");
-                attron(COLOR_PAIR(9));
-                mvprintw(roverdrawy + 1, roverdrawx + 7, "█");
-                attroff(COLOR_PAIR(9));
-            }
+            ui_publish(&ui, &uisnapshot);
         }
 
         gettimeofday(&timestruct, NULL);
         time_current = timestruct.tv_sec + timestruct.tv_usec / 1000000.0;
 
-        if (remotecontrol == 1) {
-            if ((time_current - time_last_remotecmd_recv) > REPEAT_TIME_SEC_REMOTECMDRECV) {
+        if ((remotecontrol == 1) || (localcontrol == 1)) {
+            if ((time_current - time_last_remotecmd_recv) > remotecmd_validity) {
                 if (remotecmd_timed_out == 0) {
-                    unsigned char replymsg[16];
                     int wret;
 
                     logmsg(logfd, time_start, "Remotecommand timeout");
-                    if (dummymode == 0) {
-                        commandsend_lamp_on();
+                    // the loop was stuck for too long, the trajectory must not go on from where it was
+                    if ((trajectories == 1) && (trajectory_active(&trajectory) == 1)) {
+                        trajectory_abort(&trajectory);
+                    }
+                    // the watchdog has sent a stop already, or is just about to, one is enough
+                    safestop_disarm(&safestop);
+                    if (safestop_poll(&safestop, &safestop_latency) > 0) {
+                        sprintf(logstring, "Stopped by the watchdog (latency: %.3f ms)", safestop_latency * 1000.0);
+                        logmsg(logfd, time_start, logstring);
+                    } else if (dummymode == 0) {
+                        commandsend_lamp_on(&ui);
                         logmsg(logfd, time_start, "Stoprobot");
                         stoprobot(&rover, usekcommands, answer);
-                        commandsend_lamp_off();
+                        commandsend_lamp_off(&ui);
                     }
                     speedX = 0;
                     speedY = 0;
@@ -1343,14 +1583,17 @@ int main() {
                     set_new_spy_value_from_remote = 0;
                     set_new_rot_value_from_remote = 0;
                     remotecmd_timed_out = 1;
-                    if (remotecontrolproto == 0) { // TCP
-                        strncpy(replymsg, "!NOCMST!\r\n", 10);
-                        wret = write(clientfd, replymsg, 10);
-                        logmsg(logfd, time_start, "Sent: !NOCMST!");
+                    if ((remotecontrol == 1) && (remotecontrolproto == 0)) { // TCP
+                        int axis;
+
+                        wret = send_reply(&remoteout, REMOTEFRAME_NOID, "!NOCMST!\r\n", logfd, time_start);
+                        // the robot was stopped, the setpoints still waiting for the serial write failed
+                        for (axis = 0; (axis < REMOTECMD_AXES) && (wret != -1); axis++) {
+                            wret = send_axis_acks(&remoteout, &remote_axis_acks[axis], remote_axis_reply_err[axis], logfd, time_start);
+                        }
                         if (wret == -1) {
                             logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
-                            errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
-                            perror("write()");
+                            ui_errormsg(&ui, "Cannot send reply to client! Connection lost? Press a key to quit!", 1);
                             quit = 6;
                             break;
                         }
@@ -1361,19 +1604,51 @@ int main() {
             }
         }
 
-        if ((usekcommands == 1) && ((time_current - time_last_kcmdsent) > REPEAT_TIME_SEC_KCMDSENT)) {
+        if ((remotecontrol == 1) && (remotecontrolproto == 1) && ((time_current - time_last_udpstats) > UDP_STATS_LOG_SEC)) {
+            int udpi;
+
+            for (udpi = 0; udpi < UDPCLIENT_MAX; udpi++) {
+                if (udpclients[udpi].used == 1) {
+                    strcpy(logstring, "UDP client stats: ");
+                    udpclient_format_stats(&udpclients[udpi], &logstring[strlen(logstring)]);
+                    logmsg(logfd, time_start, logstring);
+                }
+            }
+            time_last_udpstats = time_current;
+        }
+
+        if ((time_current - time_last_jitterlog) > JITTER_LOG_SEC) {
+            strcpy(logstring, "Loop interval: ");
+            jitter_format(&loop_jitter, &logstring[strlen(logstring)]);
+            logmsg(logfd, time_start, logstring);
+            strcpy(logstring, "Wake-up lateness: ");
+            jitter_format(&wakeup_jitter, &logstring[strlen(logstring)]);
+            logmsg(logfd, time_start, logstring);
+            if (clocksync.valid == 1) {
+                sprintf(logstring, "Clock sync: rover started at %.3f s (host monotonic), drift: %.1f ppm, latency: %.3f ms, error: %.3f ms, resyncs: %lu",
+                        clocksync_offset(&clocksync), clocksync_drift_ppm(&clocksync), clocksync.latency * 1000.0,
+                        clocksync_error(&clocksync) * 1000.0, clocksync.resyncs);
+                logmsg(logfd, time_start, logstring);
+            }
+            time_last_jitterlog = time_current;
+        }
+
+        if ((usekcommands == 1) && ((time_current - time_last_kcmdsent) > cfg.repeat_time_kcmdsent)) {
             if (dummymode == 0) {
-                commandsend_lamp_on();
+                commandsend_lamp_on(&ui);
                 sprintf(logstring, "ksetXYrot: X:%d Y:%d rot:%d", speedX, speedY, rotate);
                 logmsg(logfd, time_start, logstring);
+                // not sent if the watchdog has stopped the robot since these values were checked
+                safestop_motion(&safestop, 1);
                 setret = rover_kset_XYrotation_speed(speedX, speedY, rotate, answer);
-                commandsend_lamp_off();
+                safestop_motion(&safestop, 0);
+                commandsend_lamp_off(&ui);
                 usleep(100);
                 time_last_kcmdsent = time_current;
             }
         }
 
-        if ((repeatcommands == 1) && ((time_current - time_last_cmdsent) > REPEAT_TIME_SEC_CMDSENT)) {
+        if ((repeatcommands == 1) && ((time_current - time_last_cmdsent) > cfg.repeat_time_cmdsent)) {
             repeatcommand_timeisup = 1;
         } else {
             repeatcommand_timeisup = 0;
@@ -1381,19 +1656,23 @@ int main() {
 
         if (usekcommands == 0) {
 
+            // the setpoints are refused if the watchdog has stopped the robot since the timeout was checked
+            safestop_motion(&safestop, 1);
+
             if ( ((set_new_spx_value_from_remote == 1) || (prevspeedX != speedX)) ||
                  (repeatcommand_timeisup == 1) ) {
 
 // pozitiv elore -- negativ hatra
                 if (dummymode == 0) {
                     if (nolamp_when_setcmd == 0) {
-                        commandsend_lamp_on();
+                        commandsend_lamp_on(&ui);
                     }
                     sprintf(logstring, "Set robot X speed: %d", speedX);
                     logmsg(logfd, time_start, logstring);
                     setret = rover_set_X_speed(&rover, speedX, NULL);
+                    remote_axis_setret[REMOTECMD_AXIS_X] = setret;
                     if (nolamp_when_setcmd == 0) {
-                        commandsend_lamp_off();
+                        commandsend_lamp_off(&ui);
                     }
 //                    usleep(10);
                     time_last_cmdsent = time_current;
@@ -1409,13 +1688,14 @@ int main() {
 // pozitiv balra - negativ jobbra
                     if (dummymode == 0) {
                         if (nolamp_when_setcmd == 0) {
-                            commandsend_lamp_on();
+                            commandsend_lamp_on(&ui);
                         }
                         sprintf(logstring, "Set robot Y speed: %d", speedY);
                         logmsg(logfd, time_start, logstring);
                         setret = rover_set_Y_speed(&rover, speedY, NULL);
+                        remote_axis_setret[REMOTECMD_AXIS_Y] = setret;
                         if (nolamp_when_setcmd == 0) {
-                            commandsend_lamp_off();
+                            commandsend_lamp_off(&ui);
                         }
 //                        usleep(10);
                         time_last_cmdsent = time_current;
@@ -1430,13 +1710,14 @@ int main() {
 // pozitiv balra forgas (100 is meg eleg lassu)
                 if (dummymode == 0) {
                     if (nolamp_when_setcmd == 0) {
-                        commandsend_lamp_on();
+                        commandsend_lamp_on(&ui);
                     }
                     sprintf(logstring, "Set robot rotation: %d", rotate);
                     logmsg(logfd, time_start, logstring);
                     setret = rover_set_rotation_speed(&rover, rotate, NULL);
+                    remote_axis_setret[REMOTECMD_AXIS_ROT] = setret;
                     if (nolamp_when_setcmd == 0) {
-                        commandsend_lamp_off();
+                        commandsend_lamp_off(&ui);
                     }
 //                    usleep(10);
                     time_last_cmdsent = time_current;
@@ -1444,66 +1725,37 @@ int main() {
                 prevrotate = rotate;
             }
 
-            if ( (set_new_spx_value_from_remote == 1) || (set_new_spy_value_from_remote == 1) || (set_new_rot_value_from_remote == 1) ) {
-
-                unsigned char replymsg[16];
-                int wret;
+            safestop_motion(&safestop, 0);
 
-                if (set_new_spx_value_from_remote == 1) {
-                    set_new_spx_value_from_remote = 0;
-                    if (remotecontrolproto == 0) { // TCP
-                        if (setret == 0) {
-                            strncpy(replymsg, "OKSPX\r\n", 7);
-                            wret = write(clientfd, replymsg, 7);
-                            logmsg(logfd, time_start, "Sent: OKSPX");
-                        } else {
-                            strncpy(replymsg, "!ERRSPX!\r\n", 10);
-                            wret = write(clientfd, replymsg, 10);
-                            logmsg(logfd, time_start, "Sent: !ERRSPX!");
-                        }
-                    }
-                }
+            if ( (set_new_spx_value_from_remote == 1) || (set_new_spy_value_from_remote == 1) || (set_new_rot_value_from_remote == 1) ) {
 
-                if (set_new_spy_value_from_remote == 1) {
-                    set_new_spy_value_from_remote = 0;
-                    if (remotecontrolproto == 0) { // TCP
-                        if (setret == 0) {
-                            strncpy(replymsg, "OKSPY\r\n", 7);
-                            wret = write(clientfd, replymsg, 7);
-                            logmsg(logfd, time_start, "Sent: OKSPY");
-                        } else {
-                            strncpy(replymsg, "!ERRSPY!\r\n", 10);
-                            wret = write(clientfd, replymsg, 10);
-                            logmsg(logfd, time_start, "Sent: !ERRSPY!");
-                        }
-                    }
-                }
+                const char *reply;
+                int axis, wret = 0;
 
-                if (set_new_rot_value_from_remote == 1) {
-                    set_new_rot_value_from_remote = 0;
-                    if (remotecontrolproto == 0) { // TCP
-                        if (setret == 0) {
-                            strncpy(replymsg, "OKROT\r\n", 7);
-                            wret = write(clientfd, replymsg, 7);
-                            logmsg(logfd, time_start, "Sent: OKROT");
-                        } else {
-                            strncpy(replymsg, "!ERRROT!\r\n", 10);
-                            wret = write(clientfd, replymsg, 10);
-                            logmsg(logfd, time_start, "Sent: !ERRROT!");
+                for (axis = 0; (axis < REMOTECMD_AXES) && (wret != -1); axis++) {
+                    if (*remote_axis_new[axis] == 1) {
+                        *remote_axis_new[axis] = 0;
+                        if ((remotecontrol == 1) && (remotecontrolproto == 0)) { // TCP
+                            reply = (remote_axis_setret[axis] == 0) ? remote_axis_reply_ok[axis] : remote_axis_reply_err[axis];
+                            if (remote_axis_acks[axis].count > 0) { // framed
+                                wret = send_axis_acks(&remoteout, &remote_axis_acks[axis], reply, logfd, time_start);
+                            } else {
+                                wret = send_reply(&remoteout, REMOTEFRAME_NOID, reply, logfd, time_start);
+                            }
                         }
                     }
                 }
 
-                if (remotecontrolproto == 0) { // TCP
+                if ((remotecontrol == 1) && (remotecontrolproto == 0)) { // TCP
                     if (wret == -1) {
                         if (dummymode == 0) {
-                            commandsend_lamp_on();
+                            commandsend_lamp_on(&ui);
                             logmsg(logfd, time_start, "Stoprobot");
                             stoprobot(&rover, usekcommands, answer);
-                            commandsend_lamp_off();
+                            commandsend_lamp_off(&ui);
                         }
                         logmsg(logfd, time_start, "Err: Cannot sent reply to client (6).");
-                        errormsg("Cannot send reply to client! Connection lost? Press a key to quit!", 1);
+                        ui_errormsg(&ui, "Cannot send reply to client! Connection lost? Press a key to quit!", 1);
                         quit = 6;
                         break;
                     }
@@ -1513,10 +1765,32 @@ int main() {
 
         }
 
+        // all the replies (and telemetry) of this iteration go out with one send(), it never blocks
+        if ((remotecontrol == 1) && (remotecontrolproto == 0) && (remote_outbuf_pending(&remoteout) > 0)) {
+            ret = remote_outbuf_flush(&remoteout);
+            if (ret == -1) {
+                if (dummymode == 0) {
+                    commandsend_lamp_on(&ui);
+                    logmsg(logfd, time_start, "Stoprobot");
+                    stoprobot(&rover, usekcommands, answer);
+                    commandsend_lamp_off(&ui);
+                }
+                logmsg(logfd, time_start, "Err: Cannot send reply to client (6).");
+                ui_errormsg(&ui, "Cannot send reply to client! Connection lost? Press a key to quit!", 1);
+                quit = 6;
+                break;
+            }
+            if (ret > 0) {
+                sprintf(logstring, "Client is slow, %d bytes are still waiting to be sent", ret);
+                logmsg(logfd, time_start, logstring);
+            }
+        }
+
     }
 
-    // ncurses close
-    endwin();
+    // waits for a key if an error message is shown
+    ui_close(&ui);
+    rover_set_verbose(1);
 
     if (remotecontrol == 1) {
         unsigned char replymsg[24];
@@ -1524,7 +1798,10 @@ int main() {
 
         if (remotecontrolproto == 0) { // TCP
             strncpy(replymsg, "Closing. Byebye!\r\n", 18);
-            wret = write(clientfd, replymsg, 17);
+            wret = remote_outbuf_append(&remoteout, replymsg, 17);
+            if (wret == 0) {
+                wret = remote_outbuf_flush(&remoteout);
+            }
             if (wret == -1) {
                 if (dummymode == 0) {
                     logmsg(logfd, time_start, "Stoprobot");
@@ -1540,17 +1817,28 @@ int main() {
         close(listenfd);
     }
 
+    if (telemetryfd != -1) {
+        close(telemetryfd);
+    }
+
+    if (localcontrol == 1) {
+        localctl_close(&localctl, cfg.localsocket);
+        if (localctl.rejected > 0) {
+            printf("Local control: %lu connections of other users rejected\n", localctl.rejected);
+        }
+    }
+
     switch (quit) {
         case 2: printf("Fatal error happened while reading memmap!\n"); break;
         case 3: printf("Failed to read memmap correctly (invalid length)!\n"); break;
         case 4: printf("Error while reading from socket()!\n"); break;
-        case 5: printf("Bad message received through socket - Too long (no newline found)!\n"); break;
         case 6: printf("Could not reply to client! Connection was lost maybe?\n"); break;
         case 7: printf("Client disconnected!\n"); break;
+        case 8: printf("Terminated by signal.\n"); break;
+        case 9: printf("Cannot switch to real-time mode!\n"); break;
+        case 10: printf("Cannot start the safety stop watchdog!\n"); break;
     }
 
-    if (got_sigpipe == 1) { printf("Got SIGPIPE! Connection to client was lost maybe?\n"); }
-
     if (dummymode == 0) {
         printf("Setting X+Y+Rot speed to zero.\n");
         stoprobot(&rover, usekcommands, answer);
@@ -1562,7 +1850,131 @@ int main() {
         }
     }
 
+    if (safestop.running == 1) {
+        unsigned long late, forced, errors;
+        struct jitter_hist latency;
+
+        safestop_stats(&safestop, &latency, &late, &forced, &errors);
+        safestop_close(&safestop);
+        jitter_format(&latency, logstring);
+        printf("Safety stop latency: %s\n", logstring);
+        printf("Safety stops later than %u ms: %lu, without the serial lock: %lu, failed: %lu, setpoints refused after a stop: %lu\n",
+               cfg.safestop_deadline_ms, late, forced, errors, safestop.refused);
+        sprintf(logstring, "Safety stops: %lu, late: %lu, forced: %lu, failed: %lu, max latency: %.3f ms", latency.count, late, forced, errors, latency.max * 1000.0);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    if (memmapfetching == 1) {
+        memmapfetch_close(&memmapfetch);
+        printf("Memmap fetcher: %lu fetches, %lu errors, %lu connections\n", memmapfetch.http.fetches, memmapfetch.http.errors, memmapfetch.http.connects);
+        sprintf(logstring, "Memmap fetcher: %lu fetches, %lu errors, %lu connections", memmapfetch.http.fetches, memmapfetch.http.errors, memmapfetch.http.connects);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    if (memmapfiles == 1) {
+        memmapfile_close(&memmapfile);
+        printf("Memmap files: %lu loaded, %lu rejected\n", memmapfile.loads, memmapfile.rejected);
+        sprintf(logstring, "Memmap files: %lu loaded, %lu rejected", memmapfile.loads, memmapfile.rejected);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    if (odometry == 1) {
+        printf("Odometry: %lu samples, %lu read errors, pose: x=%.3f m y=%.3f m theta=%.3f rad\n",
+               odom.state.samples, odom.readerrors, odom.state.x, odom.state.y, odom.state.theta);
+        sprintf(logstring, "Odometry: %lu samples, %lu read errors, pose: %.3f %.3f %.3f", odom.state.samples, odom.readerrors, odom.state.x, odom.state.y, odom.state.theta);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    if (clocksync.valid == 1) {
+        printf("Clock sync: %lu uptime reads, drift: %.1f ppm, one-way latency: %.3f ms, error: %.3f ms, resyncs: %lu\n",
+               clocksync.samples, clocksync_drift_ppm(&clocksync), clocksync.latency * 1000.0, clocksync_error(&clocksync) * 1000.0, clocksync.resyncs);
+        sprintf(logstring, "Clock sync: %lu uptime reads, drift: %.1f ppm, latency: %.3f ms, error: %.3f ms, resyncs: %lu",
+                clocksync.samples, clocksync_drift_ppm(&clocksync), clocksync.latency * 1000.0, clocksync_error(&clocksync) * 1000.0, clocksync.resyncs);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    // the reply waits the round trips settled at, and how often they were too short
+    for (i = 0; i < SERIAL_RTT_TYPES; i++) {
+        rover_get_serial_rtt(i, &serialrtt);
+        if ((serialrtt.samples == 0) && (serialrtt.timeouts == 0)) {
+            continue;
+        }
+        printf("Serial %s: %lu replies, %lu timeouts, round trip: %.3f +- %.3f ms, reply wait: %.3f ms, gap wait: %.3f ms\n",
+               serialrtt_names[i], serialrtt.samples, serialrtt.timeouts, serialrtt.srtt / 1000.0, serialrtt.rttvar / 1000.0,
+               rover_serial_first_wait(i) / 1000.0, rover_serial_gap_wait(i) / 1000.0);
+        sprintf(logstring, "Serial %s: %lu replies, %lu timeouts, round trip: %.3f +- %.3f ms, reply wait: %.3f ms",
+                serialrtt_names[i], serialrtt.samples, serialrtt.timeouts, serialrtt.srtt / 1000.0, serialrtt.rttvar / 1000.0,
+                rover_serial_first_wait(i) / 1000.0);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    // per command type and controller, to compare robots: where the time goes on the serial line
+    rover_get_transport_stats(&txstats);
+    txbusy = txbytes = 0;
+    for (i = 0; i < SERIAL_RTT_TYPES; i++) {
+        for (ctrl = 0; ctrl < ROVER_STATS_CTRLS; ctrl++) {
+            cmdstats = &txstats.cmd[i][ctrl];
+            if (cmdstats->commands == 0) {
+                continue;
+            }
+            txbusy  += cmdstats->busy_usec;
+            txbytes += cmdstats->bytes_out + cmdstats->bytes_in;
+            sprintf(logstring, "Transport %s %s: %lu commands, %lu replies, %lu timeouts, %lu retries, %lu/%lu bytes out/in, round trip p50/p99/max: %.3f/%.3f/%.3f ms",
+                    serialrtt_names[i], txctrl_names[ctrl], cmdstats->commands, cmdstats->replies, cmdstats->timeouts, cmdstats->retries,
+                    cmdstats->bytes_out, cmdstats->bytes_in, rover_hist_percentile(cmdstats->rtt_hist, 0.5) / 1000.0,
+                    rover_hist_percentile(cmdstats->rtt_hist, 0.99) / 1000.0, rover_hist_percentile(cmdstats->rtt_hist, 1.0) / 1000.0);
+            printf("%s\n", logstring);
+            logmsg(logfd, time_start, logstring);
+        }
+    }
+    for (ctrl = 0; ctrl < ROVER_STATS_CTRLS; ctrl++) {
+        if ((txstats.events[ctrl].rs485_errors == 0) && (txstats.events[ctrl].readey == 0) && (txstats.events[ctrl].invalid_chars == 0)) {
+            continue;
+        }
+        sprintf(logstring, "Transport events %s: %lu RS485 errors, %lu readey, %lu replies with invalid characters",
+                txctrl_names[ctrl], txstats.events[ctrl].rs485_errors, txstats.events[ctrl].readey, txstats.events[ctrl].invalid_chars);
+        printf("%s\n", logstring);
+        logmsg(logfd, time_start, logstring);
+    }
+    // busy: the port was held (waiting for the replies too), line: the bytes at the baud rate (10 bits per byte)
+    if (txstats.elapsed_usec > 0) {
+        sprintf(logstring, "Transport utilization: busy %.1f%%, line %.1f%% (%u baud), in %.1f sec",
+                100.0 * txbusy / txstats.elapsed_usec, 100.0 * txbytes * 10.0 / rover_baudrate * 1000000.0 / txstats.elapsed_usec,
+                rover_baudrate, txstats.elapsed_usec / 1000000.0);
+        printf("%s\n", logstring);
+        logmsg(logfd, time_start, logstring);
+    }
+    rover_serial_close();
+
+    if (trajectories == 1) {
+        trajectory_close(&trajectory);
+        if (trajectory.ticks > 0) {
+            printf("Trajectory follower: %lu ticks, %lu missed\n", trajectory.ticks, trajectory.overruns);
+            sprintf(logstring, "Trajectory follower: %lu ticks, %lu missed", trajectory.ticks, trajectory.overruns);
+            logmsg(logfd, time_start, logstring);
+        }
+    }
+
+    if ((telemetry.expired > 0) || (telemetry.ratelimited > 0)) {
+        sprintf(logstring, "UDP telemetry: %lu subscriptions expired, %lu samples over the rate limit", telemetry.expired, telemetry.ratelimited);
+        printf("%s\n", logstring);
+        logmsg(logfd, time_start, logstring);
+    }
+
+    // the longest iteration has to stay well below the validity of the remote commands (watchdog)
+    jitter_format(&loop_jitter, logstring);
+    printf("Loop interval: %s\n", logstring);
+    jitter_format(&wakeup_jitter, logstring);
+    printf("Wake-up lateness: %s\n", logstring);
+    printf("Longest loop interval: %.3f ms (remote command validity: %.0f ms)\n", loop_jitter.max * 1000.0, cfg.remotecmd_validity * 1000.0);
+    sprintf(logstring, "Longest loop interval: %.3f ms", loop_jitter.max * 1000.0);
+    logmsg(logfd, time_start, logstring);
+
     logmsg(logfd, time_start, "Exit");
+    ret = log_ring_stop();
+    if (ret > 0) {
+        printf("%d log lines were dropped (log ring was full).\n", ret);
+    }
 
     close(logfd);
 
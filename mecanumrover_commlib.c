@@ -7,6 +7,7 @@
 */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <strings.h>
@@ -14,9 +15,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
+#include <time.h>
 #include "mecanumrover_commlib.h"
 
 
+const char *rover_devfile = DEVFILE;
+unsigned int rover_baudrate = BAUDRATE;
+
+static struct rover_serial_hooks serial_hooks = { NULL, NULL, NULL, -1 };
+static int serial_verbose = 1;
+
+
 // { has_second_controller, has_Y_speed, motor_count, enablemotors_on, enablemotors_off }
 const struct rover_config rover_config_unknown        = { 0, 0, 2, 3, 0 };
 const struct rover_config rover_config_mecanumrover21 = { 1, 1, 4, 3, 0 };
@@ -119,6 +128,23 @@ int check_and_remove_readey(unsigned char *message) {
 }
 
 
+void rover_set_verbose(int verbose) {
+    serial_verbose = verbose;
+    rover_transport_set_verbose(verbose);
+}
+
+
+static void serial_message(const char *format, ...) {
+    va_list args;
+
+    if (serial_verbose == 1) {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+    }
+}
+
+
 int check_invalidchars(unsigned char *message) {
     int i, j;
 
@@ -132,100 +158,337 @@ int check_invalidchars(unsigned char *message) {
 
 
 int check_serial_dev() {
-    int chkfd;
+    struct rover_transport chk;
 
-    chkfd = open(DEVFILE, O_RDWR);
-    if (chkfd == -1) {
+    if (rover_transport_open(&chk, rover_devfile, rover_baudrate) == -1) {
         return -1;
     }
 
-    close(chkfd);
+    rover_transport_close(&chk);
 
     return 0;
 }
 
 
-int send_command_raw(unsigned char *message, unsigned char messagelen, unsigned char *reply) {
+// the port is opened on the first command and kept open (reopened after an I/O error)
+static struct rover_transport serial_transport = { .fd = -1, .pipefd = -1 };
+
+// reply wait estimates per command type, and their limits
+static struct serial_rtt serial_rtts[SERIAL_RTT_TYPES];
+static long serial_wait_floor_usec   = SERIAL_WAIT_FLOOR_USEC;
+static long serial_wait_ceiling_usec = REPLYWAIT_TIMEOUT_USEC;
+static long serial_gap_floor_usec    = SERIAL_GAP_FLOOR_USEC;
+// the reply of the previous command (not waited for, or timed out) may still be arriving until this time
+static double serial_drain_until = 0;
+
 
-    int serial, ret;
-    unsigned char incoming, datareceived;
-    struct termios tio;
+static double serial_now_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+// read the rest of a reply still on its way, the flush before the next command could miss it
+// and it would be taken for the reply of that command
+static void serial_drain(int serial) {
+
+    unsigned char incoming;
     fd_set serfdset;
     struct timeval tv;
+    double wait;
+
+    while ((wait = serial_drain_until - serial_now_usec()) > 0) {
+        FD_ZERO(&serfdset);
+        FD_SET(serial, &serfdset);
+        tv.tv_sec  = 0;
+        tv.tv_usec = wait;
+        if ((select(serial + 1, &serfdset, NULL, NULL, &tv) != 1) || (read(serial, &incoming, 1) != 1) || (incoming == '\n')) {
+            break;
+        }
+    }
+    serial_drain_until = 0;
+}
 
 
-    serial = open(DEVFILE, O_RDWR | O_NOCTTY);
-    if (serial == -1) {
-        perror("open(" DEVFILE "): ");
+static int serial_open() {
+
+    if ((serial_transport.fd != -1) && (serial_transport.spec == rover_devfile) && (serial_transport.baudrate == rover_baudrate)) {
+        return serial_transport.fd;
+    }
+    rover_serial_close();
+
+    return rover_transport_open(&serial_transport, rover_devfile, rover_baudrate);
+}
+
+
+void rover_serial_close() {
+    rover_transport_close(&serial_transport);
+}
+
+
+// "r10 00 40": read of 64 bytes, "w10 ...": write, anything else (k commands, several commands at once): other
+// "r10 00 40" + "r1F 00 40" at once: paired read
+static int serial_rtt_type(const unsigned char *message, int lines) {
+    if (lines > 1) {
+        return ((lines == 2) && (message[0] == 'r') && (message[9] == '\n') && (message[11] == 'r') &&
+                (strncmp((const char *)&message[7], "40", 2) == 0)) ? SERIAL_RTT_READ_PAIR : SERIAL_RTT_OTHER;
+    }
+    if (message[0] == 'w') {
+        return SERIAL_RTT_WRITE;
+    }
+    if ((message[0] == 'r') && (message[9] == '\n')) {
+        return (strncmp((const char *)&message[7], "40", 2) == 0) ? SERIAL_RTT_READ_LONG : SERIAL_RTT_READ_SHORT;
+    }
+    return SERIAL_RTT_OTHER;
+}
+
+
+// a message on the main connection, without the hooks and without waiting for the reply (it is drained before the next command)
+int rover_serial_write_locked(const unsigned char *message, int messagelen) {
+
+    int ret;
+
+    if (serial_open() == -1) {
         return -1;
     }
 
-    bzero(&tio, sizeof(tio));
+    ret = rover_transport_write(&serial_transport, message, messagelen);
+    if (ret == -1) {
+        perror("write(serial): ");
+        rover_serial_close();
+        return -1;
+    }
+    serial_drain_until = serial_now_usec() + rover_serial_first_wait(serial_rtt_type(message, 1));
 
-    tio.c_cflag = BAUDRATE | CS8 | CLOCAL | CREAD;
-    tio.c_oflag = 0;
-    tio.c_lflag = 0;
+    return ret;
+}
 
-    tio.c_cc[VTIME] = 0;     /* inter-character timer unused */
-    tio.c_cc[VMIN]  = 1;     /* blocking read until 1 character arrives */
 
-    ret = tcflush(serial, TCIFLUSH);
-    if (ret != 0) {
-        perror("tcflush(): ");
+static long serial_clamp(double usec, long floor_usec) {
+    if (usec < floor_usec) { return floor_usec; }
+    if (usec > serial_wait_ceiling_usec) { return serial_wait_ceiling_usec; }
+    return usec;
+}
+
+
+// RTO of RFC 6298: mean + 4 * deviation, doubled after every timeout until the next reply (the gaps: twice the longest)
+long rover_serial_first_wait(int type) {
+    struct serial_rtt *rtt = &serial_rtts[type];
+
+    if (rtt->samples == 0) {
+        return serial_wait_ceiling_usec;
+    }
+    return serial_clamp((rtt->srtt + 4.0 * rtt->rttvar) * (1 << rtt->backoff), serial_wait_floor_usec);
+}
+
+
+long rover_serial_gap_wait(int type) {
+    struct serial_rtt *rtt = &serial_rtts[type];
+
+    if (rtt->samples == 0) {
+        return serial_wait_ceiling_usec;
     }
-    ret = tcsetattr(serial, TCSANOW, &tio);
+    return serial_clamp(2.0 * rtt->gap * (1 << rtt->backoff), serial_gap_floor_usec);
+}
+
+
+static double serial_absdiff(double a, double b) {
+    return (a > b) ? (a - b) : (b - a);
+}
+
+
+static void serial_rtt_update(struct serial_rtt *rtt, double first, double gap) {
+
+    if (rtt->samples == 0) {
+        rtt->srtt   = first;
+        rtt->rttvar = first / 2.0;
+    } else {
+        rtt->rttvar = 0.75 * rtt->rttvar + 0.25 * serial_absdiff(rtt->srtt, first);
+        rtt->srtt   = 0.875 * rtt->srtt + 0.125 * first;
+    }
+    // the pauses within the replies are mostly none, sometimes a USB frame or the latency timer of the adapter:
+    // the longest one is kept, forgotten slowly
+    if (gap > rtt->gap) {
+        rtt->gap = gap;
+    } else {
+        rtt->gap -= (rtt->gap - gap) / SERIAL_GAP_DECAY;
+    }
+    rtt->samples++;
+    rtt->backoff = 0;
+}
+
+
+void rover_set_serial_timeouts(long floor_usec, long ceiling_usec, long gap_floor_usec) {
+    if (floor_usec > ceiling_usec) { floor_usec = ceiling_usec; }
+    if (gap_floor_usec > ceiling_usec) { gap_floor_usec = ceiling_usec; }
+    serial_wait_floor_usec   = floor_usec;
+    serial_wait_ceiling_usec = ceiling_usec;
+    serial_gap_floor_usec    = gap_floor_usec;
+}
+
+
+void rover_get_serial_rtt(int type, struct serial_rtt *rtt) {
+    *rtt = serial_rtts[type];
+}
+
+
+// the controller of "r10 ..."/"w1F ...", k commands and several commands at once: other
+static int serial_stats_ctrl(const unsigned char *message, int type) {
+
+    unsigned int controller_addr;
+
+    if ((type == SERIAL_RTT_OTHER) || (type == SERIAL_RTT_READ_PAIR) || (sscanf((const char *)&message[1], "%2x", &controller_addr) != 1)) {
+        return ROVER_STATS_CTRL_OTHER;
+    }
+    return rover_stats_ctrl(controller_addr);
+}
+
+
+static void serial_stats(const unsigned char *message, int type, int messagelen, const unsigned char *reply, int datareceived,
+                         double time_start, double firstbyte) {
+
+    int replied = 0, timedout = 0;
+
+    if (reply != NULL) {
+        replied  = (datareceived > 0) && (reply[datareceived - 1] == '\n');
+        timedout = !replied;
+    }
+    rover_stats_command(type, serial_stats_ctrl(message, type), messagelen, datareceived, serial_now_usec() - time_start,
+                        replied, timedout, firstbyte);
+}
+
+
+int send_command_raw(unsigned char *message, unsigned char messagelen, unsigned char *reply) {
+    return send_command_timeout(message, messagelen, reply, 0, 0);
+}
+
+
+int send_command_timeout(unsigned char *message, unsigned char messagelen, unsigned char *reply, long timeout_usec, int lines) {
+
+    int serial, ret, maxfd, linesreceived, type, datareceived;  // replies of several commands can be longer than 255 bytes
+    unsigned char incoming;
+    long firstwait, gapwait;
+    double time_last, time_start, gap, firstbyte, maxgap;
+    struct serial_rtt *rtt;
+    fd_set serfdset;
+    struct timeval tv;
+
+
+    if ((serial_hooks.lock != NULL) && (serial_hooks.lock(serial_hooks.arg) == -1)) {
+        return -1;
+    }
+
+    serial = serial_open();
+    if (serial == -1) {
+        if (serial_hooks.unlock != NULL) {
+            serial_hooks.unlock(serial_hooks.arg);
+        }
+        return -1;
+    }
+
+    // a late reply to an earlier command must not be taken for this one
+    if (serial_drain_until > 0) {
+        serial_drain(serial);
+    }
+    ret = rover_transport_flush(&serial_transport);
     if (ret != 0) {
-        perror("tcsetattr(): ");
+        perror("flush(serial): ");
+    }
+
+    type = serial_rtt_type(message, lines);
+    rtt = &serial_rtts[type];
+    if (timeout_usec > 0) {
+        firstwait = gapwait = timeout_usec;
+    } else {
+        firstwait = rover_serial_first_wait(type);
+        gapwait   = rover_serial_gap_wait(type);
     }
 
     ret = -1;
-    FD_ZERO(&serfdset);
-    FD_SET(serial, &serfdset);
+    maxfd = (serial_hooks.abortfd > serial) ? serial_hooks.abortfd : serial;
     tv.tv_sec  = 0;
-    tv.tv_usec = REPLYWAIT_TIMEOUT_USEC;
+    tv.tv_usec = firstwait;
 
-    ret = write(serial, message, ++messagelen);
+    time_start = serial_now_usec();
+    ret = rover_transport_write(&serial_transport, message, ++messagelen);
     if (ret != messagelen) {
-        printf("write() returned fewer bytes than expected!\n");
+        serial_message("write() returned fewer bytes than expected!\n");
         if (ret == -1) {
             perror("write(serial): ");
+            rover_serial_close();   // e.g. the USB serial adapter was unplugged
         }
     }
+    time_last = serial_now_usec();
+    firstbyte = maxgap = 0;
+    if (reply == NULL) {
+        // not waited for, but the controller answers anyway
+        serial_drain_until = time_last + rover_serial_first_wait(type);
+    }
 
     datareceived = 0;
+    linesreceived = 0;
 
     // if reply is NULL, then we do not care about reply
-    if (reply != NULL) {
+    if ((reply != NULL) && (serial_transport.fd != -1)) {
 
         reply[0] = 0;
 
         while(1) {
-            ret = select(serial + 1, &serfdset, NULL, NULL, &tv);
+            FD_ZERO(&serfdset);
+            FD_SET(serial, &serfdset);
+            if (serial_hooks.abortfd != -1) {
+                FD_SET(serial_hooks.abortfd, &serfdset);
+            }
+            ret = select(maxfd + 1, &serfdset, NULL, NULL, &tv);
             if (ret == -1) {
                 perror("select(): ");
                 break;
             }
+            else if ((serial_hooks.abortfd != -1) && (FD_ISSET(serial_hooks.abortfd, &serfdset))) {
+                // another thread needs the port right now, do not wait for the rest of the reply
+                break;
+            }
             else if (ret) {
                 ret = read(serial, &incoming, 1);
+                if (ret != 1) {
+                    perror("read(serial): ");
+                    rover_serial_close();
+                    break;
+                }
 #ifdef DEBUG
                 printf("Reply: 0x%x\n", incoming);
 #endif
+                // the first byte measures the round trip, the rest the gaps within the reply
+                gap = serial_now_usec() - time_last;
+                time_last += gap;
+                if (datareceived == 0) {
+                    firstbyte = gap;
+                } else if ((gap > maxgap) && (reply[datareceived - 1] != '\n')) {
+                    maxgap = gap;
+                }
                 // ha esetleg van meg valami egyeb a kovetkezo sorban, amugy ne varjunk ha nincs a rendes valasz utan semmi
+                // (several commands in one message: wait for all the replies, the next one may come from another controller)
                 if (incoming == '\n') {
-                    tv.tv_usec = 0;
+                    linesreceived++;
+                    tv.tv_usec = (linesreceived < lines) ? firstwait : 0;
                 } else {
-                    tv.tv_usec = REPLYWAIT_TIMEOUT_USEC;
+                    tv.tv_usec = gapwait;
                 }
                 reply[datareceived++] = incoming;
                 if (datareceived == BUFFER_SIZE) {
-                    printf("Buffer full (%d bytes)!\n", BUFFER_SIZE);
-                    close(serial);
+                    serial_message("Buffer full (%d bytes)!\n", BUFFER_SIZE);
+                    serial_stats(message, type, messagelen, reply, datareceived, time_start, firstbyte);
+                    if (serial_hooks.unlock != NULL) {
+                        serial_hooks.unlock(serial_hooks.arg);
+                    }
                     return datareceived;
                 }
             } else {
 #ifdef DEBUG
                 if (datareceived == 0) {
-                    printf("No reply within " REPLYWAIT_TIMEOUT_USEC " usec.\n");
+                    printf("No reply within %ld usec.\n", firstwait);
                 }
 #endif
                 break;
@@ -240,15 +503,47 @@ int send_command_raw(unsigned char *message, unsigned char messagelen, unsigned
 
         reply[datareceived] = 0;
 
+        // complete replies only, a cut off one would underestimate the gaps
+        if ((datareceived > 0) && (reply[datareceived - 1] == '\n')) {
+            serial_rtt_update(rtt, firstbyte, maxgap);
+        } else {
+            if (ret == 0) {
+                rtt->timeouts++;
+                if (rtt->backoff < SERIAL_BACKOFF_MAX) {
+                    rtt->backoff++;
+                }
+            }
+            // maybe just late: give it as long again (the backed off wait) before the next command
+            if (serial_transport.fd != -1) {
+                serial_drain_until = serial_now_usec() + ((datareceived == 0) ? rover_serial_first_wait(type) : gapwait);
+            }
+        }
+
     }
 
-    close(serial);
+    serial_stats(message, type, messagelen, reply, datareceived, time_start, firstbyte);
+
+    if (serial_hooks.unlock != NULL) {
+        serial_hooks.unlock(serial_hooks.arg);
+    }
 
     return datareceived;
 
 }
 
 
+void rover_set_serial_hooks(const struct rover_serial_hooks *hooks) {
+    if (hooks == NULL) {
+        serial_hooks.lock    = NULL;
+        serial_hooks.unlock  = NULL;
+        serial_hooks.arg     = NULL;
+        serial_hooks.abortfd = -1;
+    } else {
+        serial_hooks = *hooks;
+    }
+}
+
+
 // hexstring->endianness->num
 int read_register_from_memmap(unsigned char *memmap, unsigned char register_addr, unsigned char register_length) {
 
@@ -302,27 +597,44 @@ int read_register_from_memmap(unsigned char *memmap, unsigned char register_addr
 // read just a short part from the rover's memmap, and update it in the local memmap copy
 int rover_read_register(unsigned char controller_addr, unsigned char register_addr, unsigned char length, unsigned char *memmap, struct roverstruct *rover) {
     unsigned char datatosend[64];
-    unsigned char reply[256];
-    int datalen, recvbytes, rs485err=0xFF, readeyerr=1;
+    unsigned char reply[BUFFER_SIZE + 1];
+    int datalen, recvbytes, rs485err=0xFF, readeyerr=1, ctrl;
 
-    if ( (length != 1) && (length != 2) && (length != 4) && (length != 64) ) {
-        printf("rover_read_register(controller_addr:0x%x, register_addr:0x%x): Invalid length value (%d)! Valid length values are: 1, 2, 4, 64.\n", controller_addr, register_addr, length);
+    // 8: two neighbouring 4 byte registers at once (e.g. the encoders)
+    if ( (length != 1) && (length != 2) && (length != 4) && (length != 8) && (length != 64) ) {
+        printf("rover_read_register(controller_addr:0x%x, register_addr:0x%x): Invalid length value (%d)! Valid length values are: 1, 2, 4, 8, 64.\n", controller_addr, register_addr, length);
         return -1;
     }
 
-    bzero(reply, 256);
+    ctrl = rover_stats_ctrl(controller_addr);
+    bzero(reply, sizeof(reply));
     datalen = sprintf(datatosend, "r%02X %02X %02X\n", controller_addr, register_addr, length);
     recvbytes = send_command_raw(datatosend, datalen, reply);
     if (recvbytes == 0) {
         return -1;
     }
 
+    // "readey" first, the RS485 error check would take its 'e' for the start of an error message
+    while (readeyerr != 0) {
+        readeyerr = check_and_remove_readey(reply);
+        if (readeyerr < 0) {
+            serial_message("Unknown message when looking for 'readey' ?: %s\n", reply);
+            return -2;
+        }
+        if (readeyerr > 0) {
+            rover_stats_readey(ctrl);
+        }
+    }
+
     while (rs485err != 0) {
         rs485err = check_and_remove_rs485_error(reply);
         if (rs485err < 0) {
-            printf("Unknown error message ?: %s\n", reply);
+            serial_message("Unknown error message ?: %s\n", reply);
             return -2;
         }
+        if (rs485err > 0) {
+            rover_stats_rs485_error(rover_stats_ctrl(rs485err));
+        }
         if (rs485err == 0x10) {
             rover->rs485_err_0x10 += 1;
         } else {
@@ -334,16 +646,9 @@ int rover_read_register(unsigned char controller_addr, unsigned char register_ad
 
     recvbytes = strlen(reply);
 
-    while (readeyerr != 0) {
-        readeyerr = check_and_remove_readey(reply);
-        if (readeyerr < 0) {
-            printf("Unknown message when looking for 'readey' ?: %s\n", reply);
-            return -2;
-        }
-    }
-
     if (check_invalidchars(reply) != 0) {
-        printf("Unknown character in reply: %s\n", reply);
+        serial_message("Unknown character in reply: %s\n", reply);
+        rover_stats_invalid_chars(ctrl);
         return -2;
     }
 
@@ -353,7 +658,7 @@ int rover_read_register(unsigned char controller_addr, unsigned char register_ad
     }
 
     if ( (recvbytes != (2 * length + 2)) && (reply[2*length] != '\r') && (reply[2*length+1] != '\n') ) {
-        printf("Invalid response to command(len:%d)/register_addr 0x%X recvbytes: %d msg: %s\n", length, register_addr, recvbytes, reply);
+        serial_message("Invalid response to command(len:%d)/register_addr 0x%X recvbytes: %d msg: %s\n", length, register_addr, recvbytes, reply);
         return -1;
     }
     memcpy(&memmap[register_addr*2], reply, 2 * length);
@@ -464,6 +769,9 @@ int rover_read_full_memmap(unsigned char *memmap, unsigned int controller_addr,
     for (offset = 0x00; offset <= 0x80; offset += 0x40) {
         // try 3 times
         for (i = 0; i < 3; i++) {
+            if (i > 0) {
+                rover_stats_retry(SERIAL_RTT_READ_LONG, rover_stats_ctrl(controller_addr));
+            }
             ret = rover_read_register(controller_addr, offset, 64, replyfull, rover);
             if (ret ==  0) { break; }
             if (ret == -2) { return -2; }
@@ -477,6 +785,187 @@ int rover_read_full_memmap(unsigned char *memmap, unsigned int controller_addr,
 }
 
 
+// one 64 byte chunk from both controllers: the two reads in one write (with the terminator in between, as send_command_raw()
+// sends it), the replies come in the same order, an RS485 error message instead of the reply of a missing controller
+// got[i] is set for the chunks copied to memmaps[i]
+static int rover_read_chunk_pair(const unsigned char *controller_addrs, unsigned char offset, unsigned char memmaps[2][512],
+                                 unsigned char *got, struct roverstruct *rover) {
+
+    unsigned char datatosend[32];
+    unsigned char reply[BUFFER_SIZE + 1];
+    unsigned char failed[2] = { 0, 0 };
+    unsigned char *line;
+    int datalen, recvbytes, err, i;
+
+    bzero(reply, sizeof(reply));
+    datalen  = sprintf(datatosend, "r%02X %02X 40\n", controller_addrs[0], offset) + 1;
+    datalen += sprintf(&datatosend[datalen], "r%02X %02X 40\n", controller_addrs[1], offset);
+    recvbytes = send_command_timeout(datatosend, datalen, reply, 0, 2);
+    if (recvbytes <= 0) {
+        return -1;
+    }
+
+    while ((err = check_and_remove_readey(reply)) > 0) {
+        rover_stats_readey(ROVER_STATS_CTRL_OTHER);     // either of them
+    }
+    if (err < 0) {
+        serial_message("Unknown message when looking for 'readey' ?: %s\n", reply);
+        return -2;
+    }
+    while ((err = check_and_remove_rs485_error(reply)) > 0) {
+        rover_stats_rs485_error(rover_stats_ctrl(err));
+        if (err == 0x10) {
+            rover->rs485_err_0x10 += 1;
+        } else if (err == 0x1F) {
+            rover->rs485_err_0x1F += 1;
+        }
+        for (i = 0; i < 2; i++) {
+            if (controller_addrs[i] == err) {
+                failed[i] = 1;
+            }
+        }
+    }
+    if (err < 0) {
+        serial_message("Unknown error message ?: %s\n", reply);
+        return -2;
+    }
+    if (check_invalidchars(reply) != 0) {
+        serial_message("Unknown character in reply: %s\n", reply);
+        rover_stats_invalid_chars(ROVER_STATS_CTRL_OTHER);
+        return -2;
+    }
+
+    line = reply;
+    for (i = 0; i < 2; i++) {
+        if (failed[i] == 1) {
+            continue;
+        }
+        if ((strlen(line) < 130) || (line[128] != '\r') || (line[129] != '\n')) {
+            break;  // cut off, the rest is read again
+        }
+        memcpy(&memmaps[i][offset * 2], line, 128);
+        got[i] = 1;
+        line += 130;
+    }
+
+    return 0;
+}
+
+
+int rover_read_full_memmaps(unsigned char *memmap_main, unsigned char *memmap_second, struct roverstruct *rover, int *len_second) {
+
+    unsigned char memmaps[2][512];
+    unsigned char controller_addrs[2];
+    unsigned char got[2];
+    unsigned char offset;
+    int len[2], ret, i, c;
+
+    controller_addrs[0] = rover->regs->controller_addr_main;
+    controller_addrs[1] = rover->regs->controller_addr_second;
+    memset(memmaps, 'X', sizeof(memmaps));
+
+    for (offset = 0x00; offset <= 0x80; offset += 0x40) {
+        got[0] = got[1] = 0;
+        // try 3 times, a chunk missing from only one of them is read from that one alone
+        for (i = 0; (i < 3) && ((got[0] == 0) || (got[1] == 0)); i++) {
+            if ((got[0] == 0) && (got[1] == 0)) {
+                if (i > 0) {
+                    rover_stats_retry(SERIAL_RTT_READ_PAIR, ROVER_STATS_CTRL_OTHER);
+                }
+                ret = rover_read_chunk_pair(controller_addrs, offset, memmaps, got, rover);
+            } else {
+                c = (got[0] == 0) ? 0 : 1;
+                rover_stats_retry(SERIAL_RTT_READ_LONG, rover_stats_ctrl(controller_addrs[c]));
+                ret = rover_read_register(controller_addrs[c], offset, 64, memmaps[c], rover);
+                if (ret == 0) {
+                    got[c] = 1;
+                }
+            }
+            if (ret == -2) { return -2; }
+        }
+    }
+
+    for (c = 0; c < 2; c++) {
+        for (len[c] = 0; (len[c] < 512) && (memmaps[c][len[c]] != 'X'); len[c]++) {}
+    }
+    if ((len[0] == 384) && (len[1] == 384)) {
+        memcpy(memmap_main, memmaps[0], 384);
+        memcpy(memmap_second, memmaps[1], 384);
+    }
+    *len_second = len[1];
+
+    return len[0];
+}
+
+
+static double probe_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+int rover_probe(struct roverstruct *rover, unsigned int timeout_ms, struct rover_probe *probe) {
+
+    unsigned char datatosend[64];
+    unsigned char reply[BUFFER_SIZE + 1];
+    int datalen, recvbytes, err;
+    long timeout_usec = PROBE_TIMEOUT_MIN_USEC;
+    double deadline;
+
+    memset(probe, 0, sizeof(struct rover_probe));
+    deadline = probe_now() + timeout_ms / 1000.0;
+
+    // system name + firmware revision of both controllers, back to back, the replies come in the same order
+    // (the command terminators are sent too, as by send_command_raw())
+    datalen  = sprintf(datatosend, "r%02X %02X 04\n", CONTROLLER_ADDR_MAIN, ROVER_REG_SYSTEMNAME) + 1;
+    datalen += sprintf(&datatosend[datalen], "r%02X %02X 04\n", CONTROLLER_ADDR_SECOND, ROVER_REG_SYSTEMNAME);
+
+    while (1) {
+
+        probe->attempts++;
+        if (probe->attempts > 1) {
+            rover_stats_retry(SERIAL_RTT_OTHER, ROVER_STATS_CTRL_OTHER);
+        }
+        probe->timeout_usec = timeout_usec;
+        bzero(reply, sizeof(reply));
+        recvbytes = send_command_timeout(datatosend, datalen, reply, timeout_usec, 2);
+
+        if (recvbytes > 0) {
+            // a booting controller says "readey", a missing second controller gives an RS485 error
+            while ((err = check_and_remove_readey(reply)) > 0) {
+                rover_stats_readey(ROVER_STATS_CTRL_OTHER);
+            }
+            if (err == 0) {
+                while ((err = check_and_remove_rs485_error(reply)) > 0) {
+                    rover_stats_rs485_error(rover_stats_ctrl(err));
+                }
+            }
+            recvbytes = strlen(reply);
+            if ((err == 0) && (check_invalidchars(reply) == 0) && (recvbytes >= 10) && (reply[8] == '\r') && (reply[9] == '\n')) {
+                memcpy(rover->memmap_main, reply, 8);
+                if ((recvbytes >= 20) && (reply[18] == '\r') && (reply[19] == '\n')) {
+                    memcpy(rover->memmap_second, &reply[10], 8);
+                    probe->second_found = 1;
+                }
+                return rover_identify_from_main_memmap(rover);
+            }
+        } else if (recvbytes == -1) {
+            usleep(timeout_usec);   // the port cannot be opened (yet)
+        }
+
+        if (probe_now() >= deadline) {
+            return -1;
+        }
+        timeout_usec *= 2;
+        if (timeout_usec > REPLYWAIT_TIMEOUT_USEC) {
+            timeout_usec = REPLYWAIT_TIMEOUT_USEC;
+        }
+    }
+}
+
+
 unsigned char rover_identify(struct roverstruct *rover) {
 
     int ret;
@@ -569,6 +1058,17 @@ int rover_set_XYrotation_speed_to_zero(struct roverstruct *rover, unsigned char
  Also, to increase safety, kkk set speed command always has a timeout, so it should be periodically repeated, otherwise the robot will stop.
 */
 
+// the bytes of a stop command exactly as send_command_raw() puts them on the wire (with the closing 0x00)
+// for sending it later without any formatting, e.g. from a watchdog
+int rover_format_stop_frame(struct roverstruct *rover, char usekcommands, unsigned char *frame) {
+    if (usekcommands == 1) {
+        memcpy(frame, "STPSTPSTP\n\n\n", 13);
+        return 13;
+    }
+    return sprintf(frame, "w%02X %02X 000000000000\n", rover->regs->controller_addr_main, rover->regs->speed_x) + 1;
+}
+
+
 // kkk STOP command - "STPSTPSTP"
 int rover_kset_STOP(unsigned char *reply) {
     unsigned char datatosend[16] = "STPSTPSTP\n\n\n\0";
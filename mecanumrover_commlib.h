@@ -12,12 +12,14 @@
 
 #define __MECACOMLIB_H__
 
+#include "mecanumrover_transport.h"
+#include "mecanumrover_stats.h"
+
 // to use the FTDI USB-UART on the robot controller
+// (Raspberry Pi4's UART directly connected to the robot controller's UART, bypassing the FTDI chip - needs HW mod:
+//  rover_devfile = "/dev/ttyAMA1", rover_baudrate = 19200; Wi-Fi: "http://ROVERIP", serial bridge: "tcp:HOST:PORT")
 #define DEVFILE          "/dev/ttyUSB0"
-#define BAUDRATE         B115200
-// to use Raspberry Pi4's UART directly connected to the robot controller's UART (bypassing the FTDI chip - needs HW mod)
-//#define DEVFILE          "/dev/ttyAMA1"
-//#define BAUDRATE         B19200
+#define BAUDRATE         115200
 
 #define BUFFER_SIZE      1024
 
@@ -29,6 +31,15 @@
 // max time in usec to wait for reply when sending a command to the rover's controller
 //#define REPLYWAIT_TIMEOUT_USEC 100000
 #define REPLYWAIT_TIMEOUT_USEC 50000
+// first reply wait of the identity probe, doubled on every retry up to REPLYWAIT_TIMEOUT_USEC
+#define PROBE_TIMEOUT_MIN_USEC 5000
+// the reply waits are adapted to the measured round trips, but not below these
+#define SERIAL_WAIT_FLOOR_USEC 10000
+#define SERIAL_GAP_FLOOR_USEC  1000
+// after a timeout the waits are doubled, at most this many times, until the next complete reply
+#define SERIAL_BACKOFF_MAX     3
+// the longest pause within a reply is forgotten by 1/this per reply
+#define SERIAL_GAP_DECAY       64
 
 #define SYSNAME_MECANUMROVER21      0x21
 #define SYSNAME_MEGAROVER3          0x30
@@ -132,14 +143,76 @@ struct roverstruct {
     unsigned char fullname[32];
 };
 
+struct rover_probe {
+    unsigned char second_found;     // the second controller (0x1F) answered too
+    unsigned int attempts;
+    long timeout_usec;              // reply wait of the last attempt
+};
+
 int conv_int16_to_int32(int int16);
 int check_and_remove_rs485_error(unsigned char *message);
 int check_invalidchars(unsigned char *message);
 int check_and_remove_readey(unsigned char *message); // readey (sic!)
 int check_serial_dev();
 
+// serial device in use, DEVFILE by default, or any other transport (see mecanumrover_transport.h)
+extern const char *rover_devfile;
+// line speed of a serial port, BAUDRATE by default
+extern unsigned int rover_baudrate;
+
+// optional hooks around every serial transaction, so another thread can have the port in between
+// (the commander's safety stop watchdog)
+struct rover_serial_hooks {
+    int  (*lock)(void *arg);     // -1: the transaction is refused (the lock is not held), nothing is written
+    void (*unlock)(void *arg);
+    void *arg;
+    int abortfd;    // the reply wait is cut short when this fd becomes readable (-1: unused)
+};
+
+// NULL: no hooks
+void rover_set_serial_hooks(const struct rover_serial_hooks *hooks);
+// 0: no messages about unexpected replies on stdout (e.g. under a curses screen), they are counted anyway (mecanumrover_stats.h),
+// and no transport/memmap fetcher errors on stderr (rover_transport_set_verbose())
+void rover_set_verbose(int verbose);
+
+// reply wait statistics, per command type
+#define SERIAL_RTT_READ_SHORT   0   // register reads (up to 8 bytes)
+#define SERIAL_RTT_READ_LONG    1   // memmap chunk reads (64 bytes)
+#define SERIAL_RTT_WRITE        2
+#define SERIAL_RTT_OTHER        3
+#define SERIAL_RTT_READ_PAIR    4   // memmap chunk reads from both controllers in one write
+#define SERIAL_RTT_TYPES        5
+
+#if SERIAL_RTT_TYPES != ROVER_STATS_TYPES
+#error "ROVER_STATS_TYPES (mecanumrover_stats.h) has to be SERIAL_RTT_TYPES"
+#endif
+
+struct serial_rtt {
+    double srtt;            // usec, smoothed time until the first byte of the reply
+    double rttvar;          // usec, its mean deviation
+    double gap;             // usec, longest pause between two bytes of the recent replies
+    unsigned long samples;  // complete replies
+    unsigned long timeouts; // no (complete) reply
+    int backoff;            // the waits are multiplied by 2^backoff
+};
+
+// limits of the adaptive reply waits, floor == ceiling: fixed waits as before
+void rover_set_serial_timeouts(long floor_usec, long ceiling_usec, long gap_floor_usec);
+void rover_get_serial_rtt(int type, struct serial_rtt *rtt);
+// current reply waits (usec) for a command type: first byte, between bytes
+long rover_serial_first_wait(int type);
+long rover_serial_gap_wait(int type);
+// the port is kept open between commands, close it (it is reopened by the next command)
+void rover_serial_close();
+// write a message on the main connection without the hooks and without waiting for the reply,
+// for a caller holding the serial lock itself, returns the bytes written or -1
+int rover_serial_write_locked(const unsigned char *message, int messagelen);
+
 // serial port - transmit
 int send_command_raw(unsigned char *message, unsigned char messagelen, unsigned char *reply);
+// the same with a given reply wait (first byte and between bytes, 0: adaptive), lines > 0: wait for this many reply lines
+// (message with several commands), 0: stop at the first pause after a line
+int send_command_timeout(unsigned char *message, unsigned char messagelen, unsigned char *reply, long timeout_usec, int lines);
 // hexstring->endianness->num
 int read_register_from_memmap(unsigned char *memmap, unsigned char register_addr, unsigned char register_length);
 // read only 1 register, and update it in the memmap
@@ -150,10 +223,19 @@ int rover_write_register_uint16(unsigned char controller_addr, unsigned char reg
 int rover_write_register_int16(unsigned char controller_addr, unsigned char register_addr, int data, unsigned char *reply);
 int rover_write_register_uint32(unsigned char controller_addr, unsigned char register_addr, unsigned int data, unsigned char *reply);
 int rover_read_full_memmap(unsigned char *memmap, unsigned int controller_addr, struct roverstruct *rover);
+// both controllers (MecanumRover 2.1), every chunk is read from both of them with one write, so the second controller's
+// reply follows the first one without another round trip, and the two memmaps are of the same moment
+// both memmaps are updated only if both were read completely, returns the length read from the main one (384 if complete)
+// as rover_read_full_memmap(), *len_second: the same for the second one
+int rover_read_full_memmaps(unsigned char *memmap_main, unsigned char *memmap_second, struct roverstruct *rover, int *len_second);
 
 unsigned int rover_get_controller_addr(struct roverstruct *rover, unsigned int controller_id);
 
 unsigned char rover_identify(struct roverstruct *rover);
+// identify with a 4 byte read (system name, firmware revision) from both controllers in one write, retried with
+// reply waits starting at PROBE_TIMEOUT_MIN_USEC, for up to timeout_ms (e.g. a controller still booting)
+// registers 0x00-0x03 of the memmaps are filled, returns as rover_identify_from_main_memmap(), -1 if no answer
+int rover_probe(struct roverstruct *rover, unsigned int timeout_ms, struct rover_probe *probe);
 unsigned char rover_identify_from_main_memmap(struct roverstruct *rover);
 
 // get values from previously read memmap
@@ -194,6 +276,8 @@ int rover_set_X_speed(struct roverstruct *rover, int speed_x, unsigned char *rep
 int rover_set_Y_speed(struct roverstruct *rover, int speed_y, unsigned char *reply);
 int rover_set_rotation_speed(struct roverstruct *rover, int speed_rot, unsigned char *reply);
 int rover_set_XYrotation_speed_to_zero(struct roverstruct *rover, unsigned char *reply);
+// the stop command without sending it, returns the number of bytes to write (frame: 32 bytes at least)
+int rover_format_stop_frame(struct roverstruct *rover, char usekcommands, unsigned char *frame);
 
 // kkk commands - more robust comm
 // needs custom firmware!
@@ -14,11 +14,19 @@
 #include <fcntl.h>
 #include "mecanumrover_commlib.h"
 
-int main() {
+int main(int argc, char **argv) {
 
     int ret, fd;
     struct roverstruct rover;
 
+    // [device [baudrate]], as mecanumrover_monitor
+    if (argc > 1) {
+        rover_devfile = argv[1];
+    }
+    if (argc > 2) {
+        rover_baudrate = atoi(argv[2]);
+    }
+
     ret = rover_read_full_memmap(rover.memmap_main, CONTROLLER_ADDR_MAIN, &rover);
 
     fd = open("memmap_dump.dat", O_WRONLY | O_CREAT | O_TRUNC);
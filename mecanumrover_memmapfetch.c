@@ -0,0 +1,293 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "mecanumrover_memmapfetch.h"
+
+
+static double memmapfetch_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+int rover_memmapfetch_open(struct rover_memmapfetch *mf, const char *url) {
+
+    memset(mf, 0, sizeof(struct rover_memmapfetch));
+    mf->sock = -1;
+
+    if ((rover_transport_parse(&mf->http, url, 0) == -1) || (mf->http.type != TRANSPORT_HTTP)) {
+        rover_transport_message("Invalid memmap URL: %s\n", url);
+        return -1;
+    }
+
+    return rover_transport_resolve(&mf->http);
+}
+
+
+static void memmapfetch_disconnect(struct rover_memmapfetch *mf) {
+    if (mf->sock != -1) {
+        close(mf->sock);
+        mf->sock = -1;
+    }
+    mf->buffered = 0;
+}
+
+
+void rover_memmapfetch_close(struct rover_memmapfetch *mf) {
+    memmapfetch_disconnect(mf);
+}
+
+
+// receive more into the buffer until the deadline, returns the number of bytes, 0 if the server closed the connection, -1 on error/timeout
+static int memmapfetch_receive(struct rover_memmapfetch *mf, double deadline) {
+
+    struct pollfd pfd;
+    double wait;
+    int ret;
+
+    if (mf->buffered == MEMMAPFETCH_BUFFER_SIZE) {
+        return -1;
+    }
+
+    wait = deadline - memmapfetch_now();
+    if (wait <= 0) {
+        return -1;
+    }
+    pfd.fd = mf->sock;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, (int)(wait * 1000.0) + 1) != 1) {
+        return -1;
+    }
+
+    ret = recv(mf->sock, &mf->buffer[mf->buffered], MEMMAPFETCH_BUFFER_SIZE - mf->buffered, 0);
+    if (ret > 0) {
+        mf->buffered += ret;
+    }
+
+    return ret;
+}
+
+
+// the value of a header (name with the ':'), NULL if not present
+static const char *memmapfetch_header(const char *headers, const char *name) {
+
+    const char *line;
+    size_t namelen = strlen(name);
+
+    for (line = strstr(headers, "\r\n"); line != NULL; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, namelen) == 0) {
+            line += namelen;
+            while (*line == ' ') { line++; }
+            return line;
+        }
+    }
+
+    return NULL;
+}
+
+
+// one response from the buffer (received as needed), the body is copied to body (up to bodymax bytes)
+// returns the length of the body, -1 on error, -2 if the connection was closed before anything was received
+// *keepalive is 0 if the server closes the connection after this response
+static int memmapfetch_response(struct rover_memmapfetch *mf, double deadline, char *body, int bodymax, int *keepalive) {
+
+    char *headerend;
+    const char *value;
+    char *valueend;
+    long lvalue;
+    int ret, status, headerlen, contentlen;
+
+    // status line and headers
+    while (1) {
+        mf->buffer[mf->buffered] = 0;
+        headerend = strstr(mf->buffer, "\r\n\r\n");
+        if (headerend != NULL) {
+            break;
+        }
+        ret = memmapfetch_receive(mf, deadline);
+        if (ret <= 0) {
+            return ((ret == 0) && (mf->buffered == 0)) ? -2 : -1;
+        }
+    }
+    *headerend = 0;
+    headerlen = headerend - mf->buffer + 4;
+
+    if (sscanf(mf->buffer, "HTTP/1.%*d %d", &status) != 1) {
+        rover_transport_message("Invalid HTTP response: %.40s\n", mf->buffer);
+        return -1;
+    }
+    *keepalive = (strncmp(mf->buffer, "HTTP/1.1", 8) == 0);
+    value = memmapfetch_header(mf->buffer, "Connection:");
+    if (value != NULL) {
+        if (strncasecmp(value, "close", 5) == 0) {
+            *keepalive = 0;
+        } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+            *keepalive = 1;
+        }
+    }
+    if (memmapfetch_header(mf->buffer, "Transfer-Encoding:") != NULL) {
+        rover_transport_message("HTTP transfer encodings are not supported\n");
+        return -1;
+    }
+    value = memmapfetch_header(mf->buffer, "Content-Length:");
+    if (value != NULL) {
+        // it must fit in the buffer after the headers, a bogus length would desync the pipelined responses
+        errno = 0;
+        lvalue = strtol(value, &valueend, 10);
+        if ((valueend == value) || (errno != 0) || ((*valueend != '\r') && (*valueend != ' ') && (*valueend != 0)) ||
+            (lvalue < 0) || (lvalue > MEMMAPFETCH_BUFFER_SIZE - headerlen)) {
+            rover_transport_message("Invalid HTTP Content-Length: %.20s\n", value);
+            return -1;
+        }
+        contentlen = (int)lvalue;
+    } else {
+        // the end of the body is the end of the connection
+        contentlen = -1;
+        *keepalive = 0;
+    }
+
+    // the body
+    while ((contentlen == -1) || (mf->buffered < headerlen + contentlen)) {
+        ret = memmapfetch_receive(mf, deadline);
+        if (ret == 0) {
+            if (contentlen == -1) {
+                contentlen = mf->buffered - headerlen;
+                break;
+            }
+            return -1;
+        }
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    if (status != 200) {
+        rover_transport_message("HTTP error: %d\n", status);
+        ret = -1;
+    } else {
+        ret = (contentlen < bodymax) ? contentlen : bodymax;
+        memcpy(body, &mf->buffer[headerlen], ret);
+    }
+
+    // the next pipelined response is already in the buffer
+    mf->buffered -= headerlen + contentlen;
+    memmove(mf->buffer, &mf->buffer[headerlen + contentlen], mf->buffered);
+
+    return ret;
+}
+
+
+// 256 registers as uppercase hex, "\r\n"
+static int memmapfetch_valid(const char *body, int len) {
+
+    int i;
+
+    if ((len != MEMMAPFETCH_BODY_LEN) || (body[512] != '\r') || (body[513] != '\n')) {
+        return 0;
+    }
+    for (i = 0; i < 512; i++) {
+        if (!(((body[i] >= '0') && (body[i] <= '9')) || ((body[i] >= 'A') && (body[i] <= 'F')))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+int rover_memmapfetch_read(struct rover_memmapfetch *mf, unsigned char controller_main, unsigned char controller_second,
+                           unsigned char *memmap_main, unsigned char *memmap_second, unsigned int timeout_ms) {
+
+    char bodies[2][MEMMAPFETCH_BODY_LEN + 1];
+    char request[2 * (TRANSPORT_HOST_MAXLEN + 80)];
+    unsigned char controllers[2];
+    double deadline;
+    int count, done, attempts, reqlen, i, len, keepalive;
+
+    controllers[0] = controller_main;
+    controllers[1] = controller_second;
+    count = (controller_second != 0) ? 2 : 1;
+    deadline = memmapfetch_now() + timeout_ms / 1000.0;
+
+    // a kept-alive connection may have been closed by the server since the last fetch: one more attempt
+    done = 0;
+    len = 0;
+    keepalive = 1;
+    for (attempts = 0; (done < count) && (attempts < count + 1); attempts++) {
+
+        if (mf->sock == -1) {
+            mf->sock = rover_transport_connect(&mf->http, timeout_ms);
+            if (mf->sock == -1) {
+                break;
+            }
+            mf->buffered = 0;
+            mf->connects++;
+        }
+
+        // pipelined: the requests of the memmaps still missing in one write
+        reqlen = 0;
+        for (i = done; i < count; i++) {
+            reqlen += sprintf(&request[reqlen], "GET /read?i2caddr=%02X&addr=00&length=00 HTTP/1.1\r\nHost: %s\r\n\r\n",
+                              controllers[i], mf->http.path);
+        }
+        if (send(mf->sock, request, reqlen, MSG_NOSIGNAL) != reqlen) {
+            memmapfetch_disconnect(mf);
+            continue;
+        }
+
+        for (i = done; i < count; i++) {
+            len = memmapfetch_response(mf, deadline, bodies[i], MEMMAPFETCH_BODY_LEN + 1, &keepalive);
+            if (len < 0) {
+                break;
+            }
+            if (memmapfetch_valid(bodies[i], len) == 0) {
+                rover_transport_message("Invalid memmap of controller 0x%02X (%d bytes)\n", controllers[i], len);
+                len = -1;
+                break;
+            }
+            done++;
+            if (keepalive == 0) {
+                break;
+            }
+        }
+        if ((len < 0) || (keepalive == 0)) {
+            memmapfetch_disconnect(mf);
+        }
+        // only a connection closed before any answer is retried, not an error or a timeout
+        if (len == -1) {
+            break;
+        }
+    }
+
+    if (done < count) {
+        mf->errors++;
+        return -1;
+    }
+
+    memcpy(memmap_main, bodies[0], 512);
+    if (count == 2) {
+        memcpy(memmap_second, bodies[1], 512);
+    }
+    mf->fetches++;
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOMLIB_MEMMAPFETCH_H__
+
+#define __MECACOMLIB_MEMMAPFETCH_H__
+
+#include "mecanumrover_transport.h"
+
+/*
+ Memmap fetcher over the HTTP API of the rover's Wi-Fi module (what memmapupdate_via_wifi.sh does with wget)
+
+ One HTTP/1.1 connection is kept open, the requests of both controllers are sent in one write (pipelined),
+ and a memmap is only accepted if the body is exactly 512 hex digits + "\r\n". If the server closes the
+ connection (keep-alive not supported, idle timeout), it is reconnected and the unanswered requests are sent again.
+*/
+
+#define MEMMAPFETCH_BODY_LEN      514     // 256 registers as hex + "\r\n"
+#define MEMMAPFETCH_BUFFER_SIZE   4096
+
+struct rover_memmapfetch {
+    struct rover_transport http;    // host, port, resolved address
+    int sock;                       // -1: not connected
+    char buffer[MEMMAPFETCH_BUFFER_SIZE + 1];   // received, not parsed yet (+ terminating 0)
+    int buffered;
+    // statistics
+    unsigned long fetches;          // successful
+    unsigned long errors;
+    unsigned long connects;
+};
+
+// url: http://HOST[:PORT], returns -1 if invalid or cannot be resolved
+int  rover_memmapfetch_open(struct rover_memmapfetch *mf, const char *url);
+// read the memmap of controller_main (and of controller_second if not 0) into memmap_main (memmap_second),
+// the memmaps are only written if all of them were received intact, returns 0 or -1
+int  rover_memmapfetch_read(struct rover_memmapfetch *mf, unsigned char controller_main, unsigned char controller_second,
+                            unsigned char *memmap_main, unsigned char *memmap_second, unsigned int timeout_ms);
+void rover_memmapfetch_close(struct rover_memmapfetch *mf);
+
+#endif
@@ -14,12 +14,20 @@
 #include <fcntl.h>
 #include "mecanumrover_commlib.h"
 
-int main() {
+int main(int argc, char **argv) {
 
-    int ret, i=0;
+    int ret, ret_second, i=0;
     unsigned char answer[BUFFER_SIZE];
     struct roverstruct rover;
 
+    // [device [baudrate]], e.g. http://192.168.0.2 for a rover on the Wi-Fi network
+    if (argc > 1) {
+        rover_devfile = argv[1];
+    }
+    if (argc > 2) {
+        rover_baudrate = atoi(argv[2]);
+    }
+
     if (rover_identify(&rover) == 1) {
         printf("Unknown rover!\n");
         exit(1);
@@ -67,9 +75,11 @@ int main() {
             }
         }
 
-        ret = rover_read_full_memmap(rover.memmap_main, rover.regs->controller_addr_main, &rover);
+        // the 4 wheels from both controllers at once
         if (rover.config->has_second_controller == 1) {
-            ret = rover_read_full_memmap(rover.memmap_second, rover.regs->controller_addr_second, &rover);
+            ret = rover_read_full_memmaps(rover.memmap_main, rover.memmap_second, &rover, &ret_second);
+        } else {
+            ret = rover_read_full_memmap(rover.memmap_main, rover.regs->controller_addr_main, &rover);
         }
 
         switch (rover.config->motor_count) {
@@ -0,0 +1,151 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#include <time.h>
+#include "mecanumrover_stats.h"
+
+
+static struct rover_transport_stats transport_stats;
+static unsigned long stats_start_usec = 0;  // 0: not started yet
+
+
+static unsigned long stats_now_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+
+static void stats_add(unsigned long *counter, unsigned long value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+
+int rover_stats_ctrl(unsigned int controller_addr) {
+    switch (controller_addr) {
+        case 0x10: return ROVER_STATS_CTRL_MAIN;
+        case 0x1F: return ROVER_STATS_CTRL_SECOND;
+        default:   return ROVER_STATS_CTRL_OTHER;
+    }
+}
+
+
+int rover_hist_bucket(unsigned long usec) {
+
+    int msb, bucket;
+
+    if (usec < ROVER_HIST_SUBBUCKETS) {
+        return usec;
+    }
+    msb = 63 - __builtin_clzl(usec);
+    bucket = (msb - 1) * ROVER_HIST_SUBBUCKETS + ((usec >> (msb - 2)) & (ROVER_HIST_SUBBUCKETS - 1));
+
+    return (bucket < ROVER_HIST_BUCKETS) ? bucket : (ROVER_HIST_BUCKETS - 1);
+}
+
+
+unsigned long rover_hist_bucket_max(int bucket) {
+
+    int shift;
+
+    if (bucket < ROVER_HIST_SUBBUCKETS) {
+        return bucket;
+    }
+    shift = bucket / ROVER_HIST_SUBBUCKETS - 1;
+
+    return ((unsigned long)(ROVER_HIST_SUBBUCKETS + bucket % ROVER_HIST_SUBBUCKETS) << shift) + (1UL << shift) - 1;
+}
+
+
+unsigned long rover_hist_percentile(const unsigned long *hist, double fraction) {
+
+    unsigned long total = 0, count = 0;
+    int i;
+
+    for (i = 0; i < ROVER_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (i = 0; i < ROVER_HIST_BUCKETS; i++) {
+        count += hist[i];
+        if (count >= fraction * total) {
+            break;
+        }
+    }
+
+    return rover_hist_bucket_max((i < ROVER_HIST_BUCKETS) ? i : (ROVER_HIST_BUCKETS - 1));
+}
+
+
+void rover_hist_add(unsigned long *sum, const unsigned long *hist) {
+
+    int i;
+
+    for (i = 0; i < ROVER_HIST_BUCKETS; i++) {
+        sum[i] += hist[i];
+    }
+}
+
+
+void rover_stats_command(int type, int ctrl, unsigned long bytes_out, unsigned long bytes_in, unsigned long busy_usec,
+                         int replied, int timedout, unsigned long rtt_usec) {
+
+    struct rover_cmd_stats *stats = &transport_stats.cmd[type][ctrl];
+    unsigned long unset = 0;
+
+    __atomic_compare_exchange_n(&stats_start_usec, &unset, stats_now_usec() - busy_usec, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    stats_add(&stats->commands, 1);
+    stats_add(&stats->bytes_out, bytes_out);
+    stats_add(&stats->bytes_in, bytes_in);
+    stats_add(&stats->busy_usec, busy_usec);
+    if (replied) {
+        stats_add(&stats->replies, 1);
+        stats_add(&stats->rtt_hist[rover_hist_bucket(rtt_usec)], 1);
+    }
+    if (timedout) {
+        stats_add(&stats->timeouts, 1);
+    }
+}
+
+
+void rover_stats_retry(int type, int ctrl)    { stats_add(&transport_stats.cmd[type][ctrl].retries, 1); }
+void rover_stats_rs485_error(int ctrl)        { stats_add(&transport_stats.events[ctrl].rs485_errors, 1); }
+void rover_stats_readey(int ctrl)             { stats_add(&transport_stats.events[ctrl].readey, 1); }
+void rover_stats_invalid_chars(int ctrl)      { stats_add(&transport_stats.events[ctrl].invalid_chars, 1); }
+
+
+void rover_get_transport_stats(struct rover_transport_stats *snapshot) {
+
+    const unsigned long *from = (const unsigned long *)&transport_stats;
+    unsigned long *to = (unsigned long *)snapshot;
+    unsigned long start;
+    size_t i;
+
+    for (i = 0; i < sizeof(struct rover_transport_stats) / sizeof(unsigned long); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+    start = __atomic_load_n(&stats_start_usec, __ATOMIC_RELAXED);
+    snapshot->elapsed_usec = (start == 0) ? 0 : (stats_now_usec() - start);
+}
+
+
+// the commands in progress may be counted partly before, partly after
+void rover_reset_transport_stats() {
+
+    unsigned long *to = (unsigned long *)&transport_stats;
+    size_t i;
+
+    for (i = 0; i < sizeof(struct rover_transport_stats) / sizeof(unsigned long); i++) {
+        __atomic_store_n(&to[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stats_start_usec, stats_now_usec(), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,81 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOMLIB_STATS_H__
+
+#define __MECACOMLIB_STATS_H__
+
+/*
+ Transport statistics, kept by the commlib for every command sent (send_command_timeout())
+
+ Per command type (SERIAL_RTT_*) and controller: commands, complete replies, timeouts, retries, bytes out/in,
+ the time the port was held, and a histogram of the round trips (until the first byte of a complete reply).
+ Per controller: RS485 errors, "readey" messages (controller reset), replies with invalid characters.
+ The counters are updated with relaxed atomic adds, without a lock, so any thread can take a snapshot at any time
+ (the fields of a snapshot may be off by the commands completed while it was copied).
+*/
+
+// controller of a command
+#define ROVER_STATS_CTRL_MAIN       0   // 0x10
+#define ROVER_STATS_CTRL_SECOND     1   // 0x1F
+#define ROVER_STATS_CTRL_OTHER      2   // k commands, several controllers in one write
+#define ROVER_STATS_CTRLS           3
+
+#define ROVER_STATS_TYPES           5   // SERIAL_RTT_TYPES
+
+// HDR-like latency histogram: linear below 4 usec, then 4 buckets per power of two (< 25% error),
+// the last bucket takes everything from ~1.8 sec
+#define ROVER_HIST_SUBBUCKETS       4
+#define ROVER_HIST_BUCKETS          80
+
+struct rover_cmd_stats {
+    unsigned long commands;         // sent
+    unsigned long replies;          // complete replies
+    unsigned long timeouts;         // no (complete) reply
+    unsigned long retries;          // sent again after a failed attempt (memmap reads, identity probe)
+    unsigned long bytes_out;
+    unsigned long bytes_in;
+    unsigned long busy_usec;        // port held: from the write until the reply or the end of the wait
+    unsigned long rtt_hist[ROVER_HIST_BUCKETS];
+};
+
+struct rover_ctrl_events {
+    unsigned long rs485_errors;
+    unsigned long readey;
+    unsigned long invalid_chars;
+};
+
+// unsigned longs only: copied word by word
+struct rover_transport_stats {
+    struct rover_cmd_stats cmd[ROVER_STATS_TYPES][ROVER_STATS_CTRLS];
+    struct rover_ctrl_events events[ROVER_STATS_CTRLS];
+    unsigned long elapsed_usec;     // since the first command or the last reset
+};
+
+// the controller index of a controller address
+int  rover_stats_ctrl(unsigned int controller_addr);
+// update (commlib)
+void rover_stats_command(int type, int ctrl, unsigned long bytes_out, unsigned long bytes_in, unsigned long busy_usec,
+                         int replied, int timedout, unsigned long rtt_usec);
+void rover_stats_retry(int type, int ctrl);
+void rover_stats_rs485_error(int ctrl);
+void rover_stats_readey(int ctrl);
+void rover_stats_invalid_chars(int ctrl);
+
+void rover_get_transport_stats(struct rover_transport_stats *snapshot);
+void rover_reset_transport_stats();
+
+// histogram buckets: the bucket of a value, the largest value of a bucket
+int           rover_hist_bucket(unsigned long usec);
+unsigned long rover_hist_bucket_max(int bucket);
+// the value below which the given fraction (e.g. 0.99) of the samples are (the largest value of that bucket), 0 if empty
+unsigned long rover_hist_percentile(const unsigned long *hist, double fraction);
+// the sum of two histograms, e.g. to merge the controllers
+void          rover_hist_add(unsigned long *sum, const unsigned long *hist);
+
+#endif
@@ -0,0 +1,440 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "mecanumrover_transport.h"
+
+const char *rover_transport_names[] = { "tty", "pty", "tcp", "http" };
+
+static volatile int transport_verbose = 1;   // read by the memmap fetcher thread too
+
+static const struct { unsigned int baud; speed_t speed; } transport_speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+    { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 },
+    { 576000, B576000 }, { 921600, B921600 }, { 1000000, B1000000 }, { 1152000, B1152000 }, { 1500000, B1500000 },
+    { 2000000, B2000000 }, { 2500000, B2500000 }, { 3000000, B3000000 }, { 3500000, B3500000 }, { 4000000, B4000000 },
+    { 0, B0 }
+};
+
+
+void rover_transport_set_verbose(int verbose) {
+    transport_verbose = verbose;
+}
+
+
+void rover_transport_message(const char *format, ...) {
+    va_list args;
+
+    if (transport_verbose == 1) {
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
+
+static speed_t transport_speed(unsigned int baud) {
+    int i;
+
+    for (i = 0; transport_speeds[i].baud != 0; i++) {
+        if (transport_speeds[i].baud == baud) {
+            return transport_speeds[i].speed;
+        }
+    }
+    return B0;
+}
+
+
+// HOST:PORT (IPv6: [ADDR]:PORT), the port is optional if defport is not NULL
+static int transport_parse_hostport(struct rover_transport *t, const char *hostport, const char *defport) {
+
+    const char *colon, *end;
+    size_t hostlen;
+
+    if (hostport[0] == '[') {
+        end = strchr(hostport, ']');
+        if (end == NULL) {
+            return -1;
+        }
+        hostport++;
+        colon = (end[1] == ':') ? &end[1] : NULL;
+        if ((end[1] != ':') && (end[1] != '\0') && (end[1] != '/')) {
+            return -1;
+        }
+    } else {
+        colon = strchr(hostport, ':');
+        end = (colon != NULL) ? colon : hostport + strcspn(hostport, "/");
+    }
+
+    hostlen = end - hostport;
+    if ((hostlen == 0) || (hostlen >= TRANSPORT_HOST_MAXLEN)) {
+        return -1;
+    }
+    memcpy(t->path, hostport, hostlen);
+    t->path[hostlen] = 0;
+
+    if (colon != NULL) {
+        hostlen = strcspn(colon + 1, "/");
+        if ((hostlen == 0) || (hostlen >= sizeof(t->port))) {
+            return -1;
+        }
+        memcpy(t->port, colon + 1, hostlen);
+        t->port[hostlen] = 0;
+    } else if (defport != NULL) {
+        strcpy(t->port, defport);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int rover_transport_parse(struct rover_transport *t, const char *spec, unsigned int baudrate) {
+
+    const char *path;
+
+    memset(t, 0, sizeof(struct rover_transport));
+    t->fd = -1;
+    t->pipefd = -1;
+    t->spec = spec;
+    t->baudrate = baudrate;
+
+    if (strncmp(spec, "tcp:", 4) == 0) {
+        t->type = TRANSPORT_TCP;
+        return transport_parse_hostport(t, spec + 4, NULL);
+    }
+    if (strncmp(spec, "http://", 7) == 0) {
+        t->type = TRANSPORT_HTTP;
+        return transport_parse_hostport(t, spec + 7, TRANSPORT_HTTP_PORT);
+    }
+
+    if (strncmp(spec, "pty:", 4) == 0) {
+        t->type = TRANSPORT_PTY;
+        path = spec + 4;
+    } else if (strncmp(spec, "tty:", 4) == 0) {
+        t->type = TRANSPORT_TTY;
+        path = spec + 4;
+    } else {
+        t->type = (strncmp(spec, "/dev/pts/", 9) == 0) ? TRANSPORT_PTY : TRANSPORT_TTY;
+        path = spec;
+    }
+    if ((path[0] == '\0') || (strlen(path) >= TRANSPORT_HOST_MAXLEN)) {
+        return -1;
+    }
+    strcpy(t->path, path);
+
+    if ((t->type == TRANSPORT_TTY) && (transport_speed(baudrate) == B0)) {
+        rover_transport_message("Unsupported baud rate: %u\n", baudrate);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int transport_open_tty(struct rover_transport *t) {
+
+    struct termios tio;
+
+    t->fd = open(t->path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (t->fd == -1) {
+        rover_transport_message("open(serial): %s\n", strerror(errno));
+        return -1;
+    }
+
+    bzero(&tio, sizeof(tio));
+
+    tio.c_cflag = CS8 | CLOCAL | CREAD;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+
+    tio.c_cc[VTIME] = 0;     /* inter-character timer unused */
+    tio.c_cc[VMIN]  = 1;     /* blocking read until 1 character arrives */
+
+    // a pty has no line speed
+    if (t->type == TRANSPORT_TTY) {
+        cfsetispeed(&tio, transport_speed(t->baudrate));
+        cfsetospeed(&tio, transport_speed(t->baudrate));
+    }
+
+    if (tcsetattr(t->fd, TCSANOW, &tio) != 0) {
+        rover_transport_message("tcsetattr(): %s\n", strerror(errno));
+    }
+
+    return t->fd;
+}
+
+
+int rover_transport_resolve(struct rover_transport *t) {
+
+    struct addrinfo hints, *res;
+    int ret;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ret = getaddrinfo(t->path, t->port, &hints, &res);
+    if (ret != 0) {
+        rover_transport_message("getaddrinfo(%s:%s): %s\n", t->path, t->port, gai_strerror(ret));
+        return -1;
+    }
+    memcpy(&t->addr, res->ai_addr, res->ai_addrlen);
+    t->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    return 0;
+}
+
+
+int rover_transport_connect(struct rover_transport *t, unsigned int timeout_ms) {
+
+    struct timeval tv;
+    int sock, one = 1;
+
+    sock = socket(t->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        rover_transport_message("socket(): %s\n", strerror(errno));
+        return -1;
+    }
+
+    // connect() waits for SO_SNDTIMEO at most
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(sock, (struct sockaddr *)&t->addr, t->addrlen) == -1) {
+        rover_transport_message("connect(%s:%s): %s\n", t->path, t->port, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+
+int rover_transport_open(struct rover_transport *t, const char *spec, unsigned int baudrate) {
+
+    int pipefds[2];
+
+    if (rover_transport_parse(t, spec, baudrate) == -1) {
+        rover_transport_message("Invalid device: %s\n", spec);
+        return -1;
+    }
+
+    switch (t->type) {
+        case TRANSPORT_TTY:
+        case TRANSPORT_PTY:
+            return transport_open_tty(t);
+
+        case TRANSPORT_TCP:
+            if (rover_transport_resolve(t) == -1) {
+                return -1;
+            }
+            t->fd = rover_transport_connect(t, TRANSPORT_CONNECT_TIMEOUT_MS);
+            if (t->fd != -1) {
+                // the reply waits are done with select(), the timeouts are only for the connection setup
+                struct timeval tv = { 0, 0 };
+                setsockopt(t->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                setsockopt(t->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            }
+            return t->fd;
+
+        case TRANSPORT_HTTP:
+            if (rover_transport_resolve(t) == -1) {
+                return -1;
+            }
+            if (pipe2(pipefds, O_CLOEXEC) == -1) {
+                rover_transport_message("pipe2(): %s\n", strerror(errno));
+                return -1;
+            }
+            // a reply nobody reads must not block the next request
+            fcntl(pipefds[1], F_SETFL, O_NONBLOCK);
+            t->fd = pipefds[0];
+            t->pipefd = pipefds[1];
+            return t->fd;
+    }
+
+    return -1;
+}
+
+
+void rover_transport_close(struct rover_transport *t) {
+    if (t->fd != -1) {
+        close(t->fd);
+        t->fd = -1;
+    }
+    if (t->pipefd != -1) {
+        close(t->pipefd);
+        t->pipefd = -1;
+    }
+}
+
+
+// one GET request (HTTP/1.0, the server closes the connection), the body is returned in reply (0 terminated)
+// returns the length of the body, -1 on error
+static int transport_http_get(struct rover_transport *t, const char *query, char *reply, int replymax) {
+
+    char buffer[2048];
+    char *body;
+    int sock, len, ret, status;
+
+    sock = rover_transport_connect(t, TRANSPORT_HTTP_TIMEOUT_MS);
+    if (sock == -1) {
+        return -1;
+    }
+
+    len = snprintf(buffer, sizeof(buffer), "GET %s HTTP/1.0\r\nHost: %s\r\n\r\n", query, t->path);
+    if (send(sock, buffer, len, MSG_NOSIGNAL) != len) {
+        rover_transport_message("send(http): %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    len = 0;
+    while (len < (int)sizeof(buffer) - 1) {
+        ret = recv(sock, &buffer[len], sizeof(buffer) - 1 - len, 0);
+        if (ret == -1) {
+            rover_transport_message("recv(http): %s\n", strerror(errno));
+            close(sock);
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        len += ret;
+    }
+    close(sock);
+    buffer[len] = 0;
+
+    if ((sscanf(buffer, "HTTP/%*d.%*d %d", &status) != 1) || (status != 200)) {
+        rover_transport_message("HTTP error (%s): %.40s\n", query, buffer);
+        return -1;
+    }
+    body = strstr(buffer, "\r\n\r\n");
+    if (body == NULL) {
+        return -1;
+    }
+    body += 4;
+
+    len = strlen(body);
+    if (len >= replymax) {
+        len = replymax - 1;
+    }
+    memcpy(reply, body, len);
+    reply[len] = 0;
+
+    return len;
+}
+
+
+// the commands of the message are turned into requests, the replies are written into the pipe as lines
+static int transport_http_write(struct rover_transport *t, const unsigned char *buf, int len) {
+
+    char line[128], query[192], reply[1100];
+    unsigned int ctrl, addr, length;
+    int i, linelen, replylen;
+
+    for (i = 0; i < len; ) {
+        // one command per line, the 0 terminators between them are skipped
+        for (linelen = 0; (i < len) && (buf[i] != '\n'); i++) {
+            if ((buf[i] != 0) && (buf[i] != '\r') && (linelen < (int)sizeof(line) - 1)) {
+                line[linelen++] = buf[i];
+            }
+        }
+        i++;
+        line[linelen] = 0;
+        if (linelen == 0) {
+            continue;
+        }
+
+        if (sscanf(line, "r%2x %2x %2x", &ctrl, &addr, &length) == 3) {
+            snprintf(query, sizeof(query), "/read?i2caddr=%02X&addr=%02X&length=%02X", ctrl, addr, length);
+        } else if ((sscanf(line, "w%2x %2x", &ctrl, &addr) == 2) && (linelen > 7)) {
+            snprintf(query, sizeof(query), "/write?i2caddr=%02X&addr=%02X&data=%s", ctrl, addr, &line[7]);
+        } else {
+            rover_transport_message("Not supported over HTTP: %s\n", line);
+            continue;
+        }
+
+        // no reply, as if it was lost on the serial line
+        replylen = transport_http_get(t, query, reply, sizeof(reply) - 2);
+        if (replylen == -1) {
+            continue;
+        }
+        while ((replylen > 0) && ((reply[replylen - 1] == '\r') || (reply[replylen - 1] == '\n'))) {
+            replylen--;
+        }
+        reply[replylen++] = '\r';
+        reply[replylen++] = '\n';
+        if (write(t->pipefd, reply, replylen) != replylen) {
+            rover_transport_message("write(http reply): %s\n", strerror(errno));
+        }
+    }
+
+    return len;
+}
+
+
+int rover_transport_write(struct rover_transport *t, const unsigned char *buf, int len) {
+
+    if (t->type == TRANSPORT_HTTP) {
+        return transport_http_write(t, buf, len);
+    }
+    if (t->type == TRANSPORT_TCP) {
+        return send(t->fd, buf, len, MSG_NOSIGNAL);
+    }
+    return write(t->fd, buf, len);
+}
+
+
+int rover_transport_flush(struct rover_transport *t) {
+
+    unsigned char buffer[256];
+
+    if ((t->type == TRANSPORT_TTY) || (t->type == TRANSPORT_PTY)) {
+        return tcflush(t->fd, TCIFLUSH);
+    }
+
+    if (t->type == TRANSPORT_TCP) {
+        while (recv(t->fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+    } else {
+        fcntl(t->fd, F_SETFL, O_NONBLOCK);
+        while (read(t->fd, buffer, sizeof(buffer)) > 0) {}
+        fcntl(t->fd, F_SETFL, 0);
+    }
+
+    return 0;
+}
+
+
+int rover_transport_drain(struct rover_transport *t) {
+
+    if ((t->type == TRANSPORT_TTY) || (t->type == TRANSPORT_PTY)) {
+        return tcdrain(t->fd);
+    }
+    // TCP_NODELAY: already sent, HTTP: the request was completed by the write
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+    NLAB-MecanumCommlib for Linux, a simple library to control VStone MecanumRover 2.1 / VStone MegaRover 3
+    by David Vincze, vincze.david@webcode.hu
+    at Human-System Laboratory, Chuo University, Tokyo, Japan, 2021-2022
+    version 0.60
+    https://github.com/szaguldo-kamaz/
+*/
+
+#ifndef __MECACOMLIB_TRANSPORT_H__
+
+#define __MECACOMLIB_TRANSPORT_H__
+
+#include <sys/socket.h>
+
+/*
+ Transports to the robot controller, selected by the device string (rover_devfile):
+   /dev/ttyUSB0, tty:/dev/ttyAMA1   local serial port, at rover_baudrate
+   /dev/pts/N, pty:/dev/pts/N       pseudo terminal (simulator), no line settings besides raw mode
+   tcp:HOST:PORT                    raw TCP connection to a serial bridge (ser2net, ...)
+   http://HOST[:PORT]               the HTTP API of the rover's Wi-Fi module (read?i2caddr=..&addr=..&length=..,
+                                    write?i2caddr=..&addr=..&data=..), the k commands are not supported
+ All of them give an fd to select()/read() the replies from, in the format of the serial port (hex + "\r\n"),
+ so the commands, the pipelining of several commands in one write and the reply waits are the same for all.
+ The HTTP transport runs the requests within rover_transport_write(), the replies are put into a pipe.
+*/
+
+#define TRANSPORT_TTY     0
+#define TRANSPORT_PTY     1
+#define TRANSPORT_TCP     2
+#define TRANSPORT_HTTP    3
+
+#define TRANSPORT_HOST_MAXLEN         256
+#define TRANSPORT_CONNECT_TIMEOUT_MS  2000    // TCP/HTTP connection setup
+#define TRANSPORT_HTTP_TIMEOUT_MS     1000    // one HTTP request
+#define TRANSPORT_HTTP_PORT           "80"
+
+struct rover_transport {
+    unsigned char type;             // TRANSPORT_*
+    int fd;                         // replies are read from this (-1: closed)
+    int pipefd;                     // HTTP: write end of the reply pipe
+    const char *spec;               // the device string it was opened with
+    unsigned int baudrate;          // TTY only
+    char path[TRANSPORT_HOST_MAXLEN];   // TTY/PTY: device, TCP/HTTP: host
+    char port[8];                   // TCP/HTTP
+    struct sockaddr_storage addr;   // TCP/HTTP: resolved at open
+    socklen_t addrlen;
+};
+
+extern const char *rover_transport_names[];
+
+// 0: no error messages on stderr (e.g. under a curses screen, the fetcher thread runs in the background),
+// set by rover_set_verbose() of commlib too
+void rover_transport_set_verbose(int verbose);
+// an error message on stderr, if verbose
+void rover_transport_message(const char *format, ...);
+
+// parse the device string, returns -1 if invalid
+int  rover_transport_parse(struct rover_transport *t, const char *spec, unsigned int baudrate);
+// parse and open (TTY/PTY: open and set raw mode, TCP: connect, HTTP: resolve the host), returns the fd or -1
+int  rover_transport_open(struct rover_transport *t, const char *spec, unsigned int baudrate);
+void rover_transport_close(struct rover_transport *t);
+// returns the number of bytes accepted, -1 on error (the transport should be reopened)
+int  rover_transport_write(struct rover_transport *t, const unsigned char *buf, int len);
+// throw away what was received but not read yet
+int  rover_transport_flush(struct rover_transport *t);
+// wait until the written data is on the wire (TTY/PTY), returns -1 on error
+int  rover_transport_drain(struct rover_transport *t);
+
+// TCP/HTTP: resolve the host of a parsed transport, returns -1 on error
+int  rover_transport_resolve(struct rover_transport *t);
+// TCP/HTTP: a new connection to the resolved address, send/receive calls time out after timeout_ms
+// returns the socket or -1
+int  rover_transport_connect(struct rover_transport *t, unsigned int timeout_ms);
+
+#endif